@@ -39,6 +39,7 @@ namespace Constants {
         const int SPI_MISO_PIN = 19;
         const int SPI_MOSI_PIN = 23;
         const int BME688_CS_PIN = 4;
+        const int SD_CS_PIN = 13;          // Optional SD card (history archive, -DHISTORY_SD_ARCHIVE=1)
         const int BUTTON_PIN = 0;
         const int BATTERY_ADC_PIN = 36;
         const int SENSOR_POWER_PIN = 2;
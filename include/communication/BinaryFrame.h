@@ -0,0 +1,143 @@
+/*
+ * communication/BinaryFrame.h
+ * Binary framing for the Bluetooth link: typed TLV payloads, CRC16 per frame, COBS framing
+ *
+ * Frame on air: COBS([type][payload][crc16 hi][crc16 lo]) 0x00
+ * COBS removes every 0x00 from the encoded frame, so 0x00 only ever ends a frame and a
+ * receiver resynchronizes at the next delimiter after a lost or corrupted byte.
+ * Payload fields are [tag][length][value, little-endian], tag = kind << 5 | field.
+ */
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * Frame types, field kinds and field ids of protocol version 1
+ */
+struct BinaryFrame {
+    static const uint8_t VERSION = 1;
+
+    // Frame types
+    static const uint8_t TYPE_JSON = 0x01;           // Payload = one JSON message (any type, no newline)
+    static const uint8_t TYPE_SENSOR_DATA = 0x10;    // Typed fields below
+
+    // Field kinds (top 3 bits of the tag) - decoders can skip fields they do not know
+    static const uint8_t KIND_UINT = 0;              // 1, 2, 4 or 8 bytes
+    static const uint8_t KIND_INT = 1;               // 1, 2, 4 or 8 bytes, two's complement
+    static const uint8_t KIND_FLOAT = 2;             // 4 bytes IEEE 754
+    static const uint8_t KIND_BYTES = 3;             // UTF-8 text or raw bytes
+    static const uint8_t MAX_FIELD = 0x1F;
+
+    // TYPE_SENSOR_DATA fields
+    static const uint8_t FIELD_TIMESTAMP = 0x01;     // uint, device millis()
+    static const uint8_t FIELD_SENSOR_TYPE = 0x02;   // uint, SensorType
+    static const uint8_t FIELD_VALID = 0x03;         // uint, bit n = field FIELD_CO2 + n is valid
+    static const uint8_t FIELD_CO2 = 0x10;           // float, ppm
+    static const uint8_t FIELD_TEMPERATURE = 0x11;   // float, °C
+    static const uint8_t FIELD_HUMIDITY = 0x12;      // float, %RH
+    static const uint8_t FIELD_PRESSURE = 0x13;      // float, hPa
+    static const uint8_t FIELD_VOC = 0x14;           // float, ppb
+    static const uint8_t FIELD_PM2_5 = 0x15;         // float, µg/m³
+    static const uint8_t FIELD_PM10 = 0x16;          // float, µg/m³
+
+    static uint8_t tag(uint8_t kind, uint8_t field) { return (kind << 5) | (field & MAX_FIELD); }
+};
+
+/**
+ * Streaming frame encoder
+ * Bytes written between begin() and end() (print(), serializeJson(), add*()) are
+ * checksummed and COBS-encoded on the fly through a 254-byte block buffer, so a frame
+ * of any length is sent without being assembled in memory first.
+ */
+class FrameEncoder : public Print {
+public:
+    explicit FrameEncoder(Print& out) : target(out), block_length(0), crc(0xFFFF),
+                                        payload_bytes(0), wire_bytes(0), open(false) {}
+
+    void begin(uint8_t type);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+    // Typed fields (smallest width that holds the value for integers)
+    void addUint(uint8_t field, uint64_t value);
+    void addInt(uint8_t field, int64_t value);
+    void addFloat(uint8_t field, float value);
+    void addBytes(uint8_t field, const uint8_t* value, uint8_t length);
+
+    /**
+     * Append the CRC and the delimiter
+     * @return Bytes the whole frame took on the link
+     */
+    size_t end();
+
+    bool isOpen() const { return open; }
+    size_t getPayloadBytes() const { return payload_bytes; }   // Written since begin(), type byte excluded
+
+private:
+    Print& target;
+    uint8_t block[254];          // Non-zero bytes of the COBS block being collected
+    uint8_t block_length;
+    uint16_t crc;
+    size_t payload_bytes;
+    size_t wire_bytes;
+    bool open;
+
+    void encode(uint8_t c);
+    void emitBlock();
+    void addField(uint8_t kind, uint8_t field, uint64_t value, uint8_t length);
+};
+
+/**
+ * One decoded payload field
+ */
+struct FrameField {
+    uint8_t kind = 0;
+    uint8_t field = 0;
+    uint8_t length = 0;
+    const uint8_t* value = nullptr;
+
+    uint64_t asUint() const;
+    int64_t asInt() const;
+    float asFloat() const;
+};
+
+/**
+ * Incremental frame decoder - feed received bytes one at a time
+ * Frames longer than MAX_FRAME, with a COBS error or a CRC mismatch are dropped and counted.
+ */
+class FrameDecoder {
+public:
+    static const size_t MAX_FRAME = 512;     // Encoded bytes, delimiter excluded
+
+    FrameDecoder() : length(0), frame_length(0), overflow(false), crc_errors(0), dropped(0) {}
+
+    /**
+     * @return true when byte completed a valid frame (available until the next feed())
+     */
+    bool feed(uint8_t byte);
+
+    uint8_t type() const { return buffer[0]; }
+    const uint8_t* payload() const { return buffer + 1; }
+    size_t payloadLength() const { return frame_length - 3; }   // Without type and CRC
+
+    /**
+     * Next field of the current frame
+     * @param offset Start at 0, advanced past the field
+     * @return false at the end of the payload or on a truncated field
+     */
+    bool nextField(size_t& offset, FrameField& out) const;
+
+    uint32_t getCrcErrors() const { return crc_errors; }
+    uint32_t getDropped() const { return dropped; }   // Overflows and COBS errors
+
+private:
+    uint8_t buffer[MAX_FRAME];
+    size_t length;               // Encoded bytes collected so far
+    size_t frame_length;         // Decoded length of the last valid frame
+    bool overflow;
+    uint32_t crc_errors;
+    uint32_t dropped;
+
+    bool decode();
+};
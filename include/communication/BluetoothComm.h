@@ -3,6 +3,11 @@
 #include "../types/SensorData.h"
 #include "../types/TimeSync.h"
 #include "../storage/HistoricalDataStorage.h"
+#include "ResponseCache.h"
+#include "HistoryTransfer.h"
+#include "BinaryFrame.h"
+#include "RealtimeWriter.h"
+#include "DeltaColumnWriter.h"
 #include <BluetoothSerial.h>
 #include <ArduinoJson.h>
 #include <WiFi.h>
@@ -44,9 +49,23 @@ private:
     
     // Time synchronization and historical data
     TimeSync timeSync;
-    std::unique_ptr<HistoricalDataStorage> historicalStorage;
+    HistoricalDataStorage* historicalStorage;                  // Active storage (owned or external)
+    std::unique_ptr<HistoricalDataStorage> ownedStorage;      // Set when created by enableHistoricalData(max_records)
     bool historicalDataEnabled;
     
+    // Serialized bodies of recent history responses (repeated chart requests)
+    ResponseCache responseCache;
+    
+    // Chunked history_request in progress (sent from update(), paced by history_ack)
+    HistoryTransfer historyTransfer;
+    
+    // Binary framing (COBS + CRC16), negotiated in connection_ack; JSON lines otherwise
+    FrameEncoder frameEncoder;
+    bool binaryFraming;
+    
+    // sensor_data JSON lines, formatted without allocating
+    RealtimeWriter realtimeWriter;
+    
 public:
     BluetoothComm();
     virtual ~BluetoothComm() = default;
@@ -64,6 +83,7 @@ public:
     // Data transmission (must implement) - ✅ FIX: Use SensorDataBase
     bool sendData(const String& data) override;
     bool sendSensorData(const SensorDataBase& data) override;  // ✅ FIXED
+    bool sendSnapshot(const CO2SensorData* co2_data, const VOCSensorData* voc_data) override;
     String receiveData() override;
     bool hasDataAvailable() override;
     
@@ -114,15 +134,35 @@ public:
     bool synchronizeTime(uint64_t current_timestamp, const String& timezone_offset = "+0000");
     
     // Historical data management
-    bool enableHistoricalData(size_t max_records = 58000);
+    bool enableHistoricalData(size_t max_records = 58000,
+                              size_t archive_bytes = HISTORY_ARCHIVE_BYTES);
+    bool enableHistoricalData(HistoricalDataStorage& storage,   // e.g. a static StaticHistoricalDataStorage<N>
+                              size_t archive_bytes = HISTORY_ARCHIVE_BYTES);   // 0 = no compressed archive
     bool disableHistoricalData();
+    bool enableHistoryPersistence(IFileSystem& fs, const String& directory = "/history");
+    bool enableHistoryArchive(IFileSystem& fs, const String& directory = "/archive");
+    bool enableHistoryCheckpoint(IFileSystem& fs, uint32_t interval_ms = RingCheckpoint::DEFAULT_INTERVAL_MS,
+                                 const String& directory = "/checkpoint");
+    bool enableHistoryDeadband();   // Default tolerances, expanded at the sampling rate
     bool storeCurrentReading(const CO2SensorData* co2_data = nullptr,
                            const VOCSensorData* voc_data = nullptr);
     
     // Historical data queries
+    // chunk_size 0 = one message, otherwise numbered chunks of that many points
+    // delta_encoding: raw points as delta-encoded columns (DeltaColumnStream, one pass over the
+    // range per column; DeltaColumnWriter per chunk) instead of objects
     bool sendHistoricalData(const String& request_id, const TimeRange& range, 
-                           size_t chunk_size = 50);
+                           size_t chunk_size = 0, uint32_t resume_sequence = 0,
+                           size_t shape_metric = SensorRecord::METRIC_CO2,
+                           uint8_t window = HistoryTransfer::DEFAULT_WINDOW,
+                           bool delta_encoding = false);
+    bool sendHistorySince(const String& request_id, uint32_t sequence, uint32_t boot_id,
+                          size_t max_records = 1000);
     bool sendStorageInfo(const String& request_id = "");
+    bool sendStatistics(const String& request_id, size_t metric = SIZE_MAX, int window = -1);
+    bool sendProfile(const String& request_id, size_t metric = SensorRecord::METRIC_CO2);
+    bool sendAlertEpisodes(const String& request_id, uint64_t start_uptime = 0,
+                           uint64_t end_uptime = UINT64_MAX, uint8_t min_peak_level = 0);
     
     // Command handling (call from main loop)
     void handleIncomingCommands();
@@ -139,9 +179,17 @@ private:
     
     // JSON helpers
     bool sendJsonMessage(const String& type, JsonDocument& payload);  // ✅ FIX: JsonDocument
+    
+    // Message output: the returned Print is the link (JSON line) or the frame encoder;
+    // endMessage() writes the newline or the frame trailer and returns its bytes
+    Print& beginMessage(uint8_t frame_type = BinaryFrame::TYPE_JSON);
+    size_t endMessage();
+    bool sendSensorFrame(const SensorDataBase& data);
+    bool sendSnapshotFrame(const CO2SensorData* co2_data, const VOCSensorData* voc_data);
     void parseAndHandleCommand(const String& command);
     
     // Command handlers
+    void handleConnectionAck(JsonDocument& cmd);
     void handleSetSamplingRate(JsonDocument& cmd);  // ✅ FIX: JsonDocument
     void handleCalibrateSensor(JsonDocument& cmd);
     void handleGetDeviceInfo(JsonDocument& cmd);
@@ -153,13 +201,27 @@ private:
     void handleTimeSyncRequest(JsonDocument& cmd);
     void handleTimeSyncSet(JsonDocument& cmd);
     void handleHistoryRequest(JsonDocument& cmd);
+    void handleHistorySince(JsonDocument& cmd);
+    void handleHistoryAck(JsonDocument& cmd);
+    void handleHistoryResume(JsonDocument& cmd);
     void handleRealtimeControl(JsonDocument& cmd);
     void handleStorageInfoRequest(JsonDocument& cmd);
+    void handleStatsRequest(JsonDocument& cmd);
+    void handleEpisodesRequest(JsonDocument& cmd);
+    void handleProfileRequest(JsonDocument& cmd);
     
     // Helper functions for historical data
-    bool sendHistoricalDataChunk(const String& request_id, 
-                                const std::vector<SensorRecord>& records,
-                                size_t chunk_index, size_t total_chunks,
-                                size_t total_points);
+    bool sendHistoryChunk();   // Next chunk of historyTransfer
     bool validateTimeRange(const TimeRange& range, String& error_message);
+    uint64_t pointTimestamp(const SensorRecord& record);   // Unix ms once synced, uptime ms before
+    void fillCompactPoint(JsonObject dataPoint, const SensorRecord& record);
+    void fillRollupPoint(JsonObject dataPoint, const RollupBucket& bucket);
+    void fillStatistics(JsonObject stats, RunningStatistics::Window window);
+    void fillQuantiles(JsonObject stats, QuantileStatistics::Window window, size_t metric);
+    bool sendRollupData(const String& request_id, size_t tier_index,
+                        uint64_t start_uptime, uint64_t end_uptime,
+                        const ResponseCache::Key& key, ResponseCache::Stamp stamp);
+    String historyHead(const String& request_id);
+    bool sendCachedHistory(const String& request_id, const ResponseCache::Key& key,
+                           const ResponseCache::Stamp& stamp);
 };
@@ -0,0 +1,109 @@
+/*
+ * communication/DeltaColumnWriter.h
+ * Columnar, delta-encoded history payload ("encoding": "delta")
+ * Instead of one object per point with an absolute timestamp and every value, each
+ * column is sent once: timestamps as a base, an interval and the deviations from it,
+ * each metric as integers at a declared number of decimals - the first value, then the
+ * change from the previous one. Regular 10 s data becomes mostly 1-3 digit numbers.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "../storage/SensorRecord.h"
+
+/**
+ * Collects points, then writes the "d" object of a delta-encoded response
+ * {"t":{"n":points,"b":first,"i":first gap,"d":[later gap - interval, ...]},
+ *  "c":{"x":decimals,"d":[first, delta, ...],"m":"validity bitmap"}, "T":{...}, ...}
+ * A metric without any valid value is left out; "m" is only present when some points
+ * have no value (hex bytes, bit k of byte k / 8 = point k, least significant bit first).
+ */
+class DeltaColumnWriter {
+public:
+    static const uint8_t DECIMALS[SensorRecord::METRIC_COUNT];   // c = 0, T/h/p/v = 2, as in the point format
+
+    DeltaColumnWriter() { clear(); }
+
+    void clear();
+
+    /**
+     * Append one point
+     * @param timestamp Timestamp as sent in the point format (ms)
+     */
+    void add(uint64_t timestamp, const SensorRecord& record);
+
+    size_t size() const { return count; }
+
+    /**
+     * Write the "d" object
+     * @return Bytes written
+     */
+    size_t write(Print& out) const;
+
+private:
+    struct Column {
+        std::vector<char> deltas;    // Comma-separated: first value, then differences
+        std::vector<uint8_t> valid;  // Bitmap, one bit per point
+        int32_t previous;
+        size_t values;
+    };
+
+    size_t count;
+    uint64_t first_timestamp;
+    uint64_t previous_timestamp;
+    int64_t interval;                // First gap - the expected spacing of the rest
+    std::vector<char> gaps;          // Comma-separated deviations from interval (points 2..n-1)
+    Column columns[SensorRecord::METRIC_COUNT];
+
+    static void appendInt(std::vector<char>& text, int64_t value);
+};
+
+/**
+ * Writes the same "d" object as DeltaColumnWriter without holding the points
+ * The caller replays the points once per pass until nextPass() returns false: the first
+ * pass only counts, then the timestamps, each metric and each "m" bitmap get one pass.
+ * Output is written as the points arrive, so memory stays O(1) whatever the range.
+ */
+class DeltaColumnStream {
+public:
+    explicit DeltaColumnStream(Print& out);
+
+    /**
+     * Feed the next point of the current pass (same points, same order every pass)
+     * @param timestamp Timestamp as sent in the point format (ms)
+     */
+    void add(uint64_t timestamp, const SensorRecord& record);
+
+    /**
+     * End the current pass
+     * @return true if the points must be replayed once more, false once "d" is complete
+     */
+    bool nextPass();
+
+    size_t size() const { return count; }
+    size_t bytesWritten() const { return bytes; }
+
+private:
+    enum Pass { PASS_COUNT, PASS_TIMESTAMPS, PASS_VALUES, PASS_BITMAP, PASS_DONE };
+
+    Print& out;
+    Pass pass;
+    size_t metric;                   // Column of PASS_VALUES / PASS_BITMAP
+    size_t bytes;
+
+    // Known after PASS_COUNT
+    size_t count;
+    uint64_t first_timestamp;
+    int64_t interval;
+    size_t values[SensorRecord::METRIC_COUNT];
+
+    // Current pass
+    size_t index;                    // Points fed so far
+    uint64_t previous_timestamp;
+    int32_t previous;
+    size_t written;
+    uint8_t bitmap;
+
+    bool beginColumn(size_t first_metric);
+};
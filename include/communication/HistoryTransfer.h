@@ -0,0 +1,133 @@
+/*
+ * communication/HistoryTransfer.h
+ * Chunked, flow-controlled history transfer
+ * A history_request with "chunk_size" is answered as numbered history_chunk messages,
+ * one per main loop pass, at most "window" chunks ahead of the app's last history_ack.
+ * After a dropped link the app sends history_resume with the first chunk it is missing.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "../storage/HistoricalDataStorage.h"
+
+/**
+ * State of the one transfer in progress: what is sent, where the sender is,
+ * and how many chunks the app still accepts
+ * Only the storage cursor and the downsampler bucket are kept between chunks, so
+ * memory does not grow with the range; a chunk is serialized as it is sent.
+ */
+class HistoryTransfer {
+public:
+    static const uint16_t MAX_CHUNK_POINTS = 200;
+    static const uint8_t DEFAULT_WINDOW = 4;
+    static const uint8_t MAX_WINDOW = 8;
+    static const uint32_t IDLE_TIMEOUT_MS = 300000;   // Kept this long without acks (resume after a drop)
+
+    HistoryTransfer() : storage(nullptr), active(false) {}
+
+    /**
+     * Start a transfer, replacing any previous one
+     * @param resolution RAW_RESOLUTION (records through the min/max downsampler) or a rollup tier
+     * @param resume_sequence Raw transfers only: first sequence ("q" of an earlier response)
+     * @param delta_encoding Raw transfers only: chunks carry delta-encoded columns
+     */
+    void start(const HistoricalDataStorage& source, const String& request_id, int resolution,
+               uint64_t start_uptime, uint64_t end_uptime, uint32_t resume_sequence,
+               uint16_t max_points, size_t shape_metric, uint16_t chunk_points, uint8_t window,
+               bool delta_encoding, uint32_t now);
+    void cancel();
+
+    bool isActive() const { return active; }
+    const String& getRequestId() const { return request_id; }
+    int getResolution() const { return resolution; }
+    uint32_t getTotal() const { return total; }             // Records (raw) or buckets in range
+    uint16_t getChunkPoints() const { return chunk_points; }
+    uint16_t getNextChunk() const { return next_chunk; }
+    uint16_t getAcknowledged() const { return acknowledged; }
+    bool isDeltaEncoded() const { return delta_encoding; }
+
+    /**
+     * A chunk may be sent now (window not exhausted, last chunk not sent yet)
+     */
+    bool canSend() const { return active && !sent_last && next_chunk < acknowledged + window; }
+
+    /**
+     * Chunks up to and including chunk arrived; optionally resize the window
+     * @return true when that completes the transfer (it is then inactive)
+     */
+    bool acknowledge(uint16_t chunk, uint8_t new_window, uint32_t now);
+
+    /**
+     * Send again from chunk (the first one the app is missing)
+     * @return false if the storage no longer holds the data the transfer started with
+     */
+    bool resume(uint16_t chunk, uint32_t now);
+
+    /**
+     * Point source for the chunk being sent - call beginChunk() first, then nextRecord()
+     * or the bucket range, then endChunk()
+     * @return false if the data changed underneath the transfer (records overwritten, storage formatted)
+     */
+    bool beginChunk();
+    bool nextRecord(SensorRecord& record);                  // Raw: false at the end of this chunk
+    void bucketRange(size_t& begin, size_t& end) const;     // Rollup: logical tier indices of this chunk
+    bool endChunk(uint32_t now);                            // @return true if that was the last chunk
+    uint32_t getResumeSequence() const { return cursor.position(); }   // "q" of the last raw chunk
+
+    bool isIdle(uint32_t now) const { return active && now - last_activity >= IDLE_TIMEOUT_MS; }
+
+private:
+    const HistoricalDataStorage* storage;
+    bool active;
+    String request_id;
+
+    // Request
+    int resolution;
+    uint64_t start_uptime, end_uptime;
+    uint16_t max_points;
+    size_t shape_metric;
+    uint16_t chunk_points;
+    bool delta_encoding;
+    uint32_t generation;         // Storage generation at start
+    uint32_t total;
+    uint32_t rollup_start_s;     // Rollup: start of the first bucket (its index moves as the tier drops old ones)
+    size_t rollup_begin;         // Rollup: index of that bucket, found again by beginChunk()
+    uint16_t last_chunk;         // Valid once sent_last
+
+    // Flow control
+    uint16_t next_chunk;         // Next chunk to send
+    uint16_t acknowledged;       // Chunks below this arrived
+    uint8_t window;              // Chunks allowed in flight
+    bool sent_last;
+    uint32_t last_activity;
+
+    // Raw point source: cursor -> downsampler -> pending output
+    struct SourceState {
+        MinMaxDownsampler sampler;
+        SensorRecord pending[MinMaxDownsampler::MAX_OUTPUT];
+        uint8_t pending_count = 0;
+        uint8_t pending_index = 0;
+        bool input_done = false;
+        bool has_read = false;
+        uint64_t read_uptime = 0;    // Last record read from the cursor
+
+        SourceState() : sampler(0, 0) {}
+    };
+
+    // Source state at the start of a sent chunk - resume() continues from it
+    struct Checkpoint {
+        uint16_t chunk = UINT16_MAX;
+        uint32_t sequence = 0;       // HistoryCursor::markSequence()
+        SourceState state;
+    };
+
+    HistoryCursor cursor;
+    SourceState source;
+    uint16_t produced_chunk;             // Chunk the source continues with
+    uint16_t chunk_sent_points;          // Points returned for the chunk being sent
+    std::vector<Checkpoint> checkpoints; // Ring by chunk index, MAX_WINDOW + 1 entries (raw only)
+
+    bool fillPending();
+    bool storageUnchanged() const;
+};
@@ -0,0 +1,62 @@
+/*
+ * communication/RealtimeWriter.h
+ * Allocation-free formatter for realtime sensor_data JSON lines
+ * The message layout never changes, so every key, unit, accuracy and the device id are
+ * constant fragments; only timestamps, values and status words are formatted per message.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "../types/SensorData.h"
+
+/**
+ * Formats one sensor_data message, newline included, into a fixed buffer that is reused
+ * for every message (written to the link with a single write())
+ * Values carry 2 decimals with trailing zeros trimmed; NaN, infinity and magnitudes of
+ * 2e7 and more become null.
+ */
+class RealtimeWriter {
+public:
+    static const size_t CAPACITY = 512;              // Largest message (snapshot) is about 450 bytes
+    static const size_t MAX_DEVICE_ID = 32;
+
+    RealtimeWriter() : used(0), overflow(false), readings(0), prefix_length(0) { setDeviceId(String()); }
+
+    /**
+     * Precompute the message head - call when the device id is known
+     */
+    void setDeviceId(const String& device_id);
+
+    /**
+     * Format a reading
+     * @return Message length in bytes, 0 if it did not fit (not sent)
+     */
+    size_t format(const SensorDataBase& data, uint32_t timestamp);
+
+    /**
+     * Format one sample of both sensors - every metric once, one timestamp
+     * Either pointer may be null or hold an invalid reading (its metrics are left out).
+     * @return Message length in bytes, 0 if it did not fit
+     */
+    size_t formatSnapshot(const CO2SensorData* co2_data, const VOCSensorData* voc_data, uint32_t timestamp);
+
+    const uint8_t* data() const { return (const uint8_t*)buffer; }
+    size_t length() const { return used; }
+
+private:
+    char buffer[CAPACITY];
+    size_t used;
+    bool overflow;
+    size_t readings;             // Readings written to the current message
+
+    // ,"device_id":"<id>","readings":{ - follows the timestamp
+    char device_fragment[MAX_DEVICE_ID + 32];
+    size_t prefix_length;
+
+    void begin(uint32_t timestamp);
+    size_t end();
+    void append(const char* text, size_t length);
+    void appendUint(uint32_t value);
+    void appendFixed(float value);
+    void appendReading(size_t reading, float value, bool valid);
+};
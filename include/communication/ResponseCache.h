@@ -0,0 +1,151 @@
+/*
+ * communication/ResponseCache.h
+ * Bounded cache of serialized history responses
+ * Repeated identical history requests (chart screen rotated, tab switched) are answered
+ * by writing the stored bytes instead of querying, downsampling and serializing again
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "../storage/HistoricalDataStorage.h"
+
+/**
+ * Print that forwards everything to a target and keeps a copy of the first
+ * limit bytes (the copy is dropped once the response outgrows the limit)
+ */
+class ResponseCapture : public Print {
+public:
+    ResponseCapture(Print& out, size_t limit) : target(out), max_bytes(limit), overflow(limit == 0) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+    bool isComplete() const { return !overflow; }   // Every byte written is in captured()
+    std::vector<uint8_t>& captured() { return bytes; }
+
+private:
+    Print& target;
+    size_t max_bytes;
+    bool overflow;
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * LRU cache of response bodies
+ * An entry is looked up by the request (Key) and is only served while the storage still
+ * produces the same response - the caller derives a Stamp from the storage state the
+ * response depends on and a stale entry is dropped on lookup.
+ */
+class ResponseCache {
+public:
+    static const size_t DEFAULT_MAX_ENTRIES = 4;
+    static const size_t DEFAULT_BUDGET_BYTES = 16384;   // All cached bodies together
+
+    /**
+     * Request parameters (timestamps as sent by the app)
+     */
+    struct Key {
+        uint64_t start_time = 0;
+        uint64_t end_time = 0;
+        uint32_t resume_sequence = 0;
+        uint16_t max_points = 0;
+        uint8_t shape_metric = 0;
+        bool delta_encoding = false;
+
+        bool operator==(const Key& other) const {
+            return start_time == other.start_time && end_time == other.end_time &&
+                   resume_sequence == other.resume_sequence && max_points == other.max_points &&
+                   shape_metric == other.shape_metric && delta_encoding == other.delta_encoding;
+        }
+    };
+
+    /**
+     * Storage state a response was built from - equal stamps produce equal responses
+     */
+    struct Stamp {
+        uint32_t generation = 0;         // HistoricalDataStorage::getGeneration()
+        uint64_t time_offset = 0;        // Offset the timestamps were converted with
+        int32_t resolution = 0;          // RAW_RESOLUTION or rollup tier index
+        uint32_t first_sequence = 0;     // Cursor position / first bucket of the range
+        uint32_t total = 0;              // Records or buckets in range
+        uint32_t folded_readings = 0;    // Held records moved forward in place
+        uint32_t next_sequence = 0;      // Open-ended ranges only (new records land in them)
+
+        bool operator==(const Stamp& other) const {
+            return generation == other.generation && time_offset == other.time_offset &&
+                   resolution == other.resolution && first_sequence == other.first_sequence &&
+                   total == other.total && folded_readings == other.folded_readings &&
+                   next_sequence == other.next_sequence;
+        }
+
+        /**
+         * State every response depends on: storage generation, folded readings and the
+         * time offset its timestamps are converted with
+         */
+        static Stamp of(const HistoricalDataStorage& storage, uint64_t time_offset);
+
+        // Raw records read through cursor, positioned at the first record sent
+        // (resolved = false for a range outside the stored history)
+        void setRaw(const HistoricalDataStorage& storage, const HistoryCursor& cursor,
+                    bool resolved, uint64_t end_uptime);
+
+        // Buckets [begin, end) of a rollup tier
+        void setRollup(const HistoricalDataStorage& storage, size_t tier_index, size_t begin, size_t end);
+    };
+
+    /**
+     * Lookup counters
+     */
+    struct Stats {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t stale = 0;              // Entries dropped because the storage changed
+        uint32_t bytes_served = 0;
+    };
+
+    ResponseCache(size_t max_entries = DEFAULT_MAX_ENTRIES, size_t budget_bytes = DEFAULT_BUDGET_BYTES)
+        : entry_limit(max_entries), budget(budget_bytes), used_bytes(0), clock(0) {}
+
+    /**
+     * Cached body for a request, nullptr on a miss (a stale entry is dropped)
+     */
+    const std::vector<uint8_t>* find(const Key& key, const Stamp& stamp);
+
+    /**
+     * Keep a body, evicting least recently used entries to stay within the budget
+     * @return false if the body alone exceeds the budget (not cached)
+     */
+    bool store(const Key& key, const Stamp& stamp, std::vector<uint8_t>& body);
+
+    void clear();
+
+    bool isEnabled() const { return entry_limit > 0 && budget > 0; }
+    size_t getBudgetBytes() const { return budget; }
+    size_t getUsedBytes() const { return used_bytes; }
+    size_t size() const { return entries.size(); }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Entry {
+        Key key;
+        Stamp stamp;
+        std::vector<uint8_t> body;
+        uint32_t last_used;
+    };
+
+    std::vector<Entry> entries;
+    size_t entry_limit;
+    size_t budget;
+    size_t used_bytes;
+    uint32_t clock;                      // Use counter for LRU order
+
+    Stats stats;
+
+    void erase(size_t index);
+};
+
+// Budget of the history response cache (-DHISTORY_RESPONSE_CACHE_BYTES=N, 0 = off)
+#ifndef HISTORY_RESPONSE_CACHE_BYTES
+#define HISTORY_RESPONSE_CACHE_BYTES ResponseCache::DEFAULT_BUDGET_BYTES
+#endif
@@ -30,6 +30,15 @@ public:
     // OPTIONAL FEATURES
     // ================================
     
+    // One message per measurement cycle with both sensors' latest readings (null = none);
+    // links without a combined format send one message per sensor
+    virtual bool sendSnapshot(const CO2SensorData* co2_data, const VOCSensorData* voc_data) {
+        bool sent = false;
+        if (co2_data) sent |= sendSensorData(*co2_data);
+        if (voc_data) sent |= sendSensorData(*voc_data);
+        return sent;
+    }
+    
     // Connection management
     virtual bool startAdvertising() { return false; }
     virtual bool stopAdvertising() { return false; }
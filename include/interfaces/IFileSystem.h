@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+/**
+ * Minimal file access used by persistent history backends
+ * Implemented over Arduino fs::FS (LittleFS, SD) and plain POSIX directories (host tests)
+ */
+class IFileSystem {
+public:
+    virtual ~IFileSystem() = default;
+
+    // ================================
+    // ESSENTIAL OPERATIONS
+    // ================================
+
+    virtual bool exists(const String& path) = 0;
+    virtual bool makeDirectory(const String& path) = 0;
+    virtual bool remove(const String& path) = 0;
+    virtual size_t fileSize(const String& path) = 0;
+
+    // Append to a file (created if missing)
+    virtual bool append(const String& path, const uint8_t* data, size_t length) = 0;
+
+    // Read up to length bytes from offset, returns bytes read
+    virtual size_t read(const String& path, size_t offset, uint8_t* buffer, size_t length) = 0;
+
+    // File names (not paths) inside a directory
+    virtual bool listFiles(const String& directory, std::vector<String>& names) = 0;
+
+    // ================================
+    // OPTIONAL FEATURES
+    // ================================
+
+    // Overwrite bytes inside an existing file (false when unsupported)
+    virtual bool writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) { return false; }
+
+    virtual size_t totalBytes() { return 0; }
+    virtual size_t usedBytes() { return 0; }
+    virtual String getName() { return "fs"; }
+};
@@ -0,0 +1,80 @@
+/*
+ * storage/AlertEpisodes.h
+ * Run-length index of alert episodes over stored history
+ * An episode is a run of consecutive records at or above an alert level
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+
+/**
+ * One alert episode - first to last record of the run
+ */
+struct AlertEpisode {
+    uint64_t start_uptime = 0;   // Storage uptime (ms) of the first record
+    uint64_t end_uptime = 0;     // Storage uptime (ms) of the last record so far
+    uint32_t first_sequence = 0;
+    uint32_t record_count = 0;
+    float peak_co2 = 0;          // Highest valid CO2 (ppm) during the episode
+    float peak_voc = 0;          // Highest valid VOC (ppb) during the episode
+    uint8_t peak_level = 0;      // Highest AlertLevel reached
+
+    uint64_t getDuration() const { return end_uptime - start_uptime; }
+};
+
+/**
+ * Ring of the most recent episodes, oldest first, updated on every appended record
+ * Episodes do not overlap, so both start and end uptimes are sorted and a time
+ * range maps to a contiguous run of episodes by binary search.
+ */
+class AlertEpisodeIndex {
+public:
+    static const uint8_t DEFAULT_MIN_LEVEL = (uint8_t)AlertLevel::WARNING;
+    static const size_t DEFAULT_MAX_EPISODES = 128;
+    static const uint32_t DEFAULT_MAX_GAP_MS = 600000;   // Missing readings longer than this end an episode
+
+    AlertEpisodeIndex() : min_level(DEFAULT_MIN_LEVEL), max_gap_ms(DEFAULT_MAX_GAP_MS),
+                          head(0), used(0), open(false), last_uptime(0) {}
+
+    bool begin(uint8_t level = DEFAULT_MIN_LEVEL, size_t max_episodes = DEFAULT_MAX_EPISODES,
+               uint32_t max_gap = DEFAULT_MAX_GAP_MS);
+    void clear();
+    bool isEnabled() const { return !episodes.empty(); }
+
+    /**
+     * Extend the open episode or start a new one (O(1))
+     */
+    void add(const SensorRecord& record, uint32_t sequence);
+
+    /**
+     * Forget episodes that ended before the given uptime
+     */
+    void dropBefore(uint64_t uptime);
+
+    /**
+     * Episodes overlapping [start_uptime, end_uptime] as logical indices [begin, end)
+     */
+    void findRange(uint64_t start_uptime, uint64_t end_uptime, size_t& begin, size_t& end) const;
+
+    // Logical index 0 = oldest episode, size() - 1 = newest (possibly still open)
+    const AlertEpisode& at(size_t logical_index) const {
+        return episodes[(head + logical_index) % episodes.size()];
+    }
+    size_t size() const { return used; }
+    bool isOpen() const { return open; }   // Newest episode still running
+    uint8_t getMinLevel() const { return min_level; }
+    size_t getMemoryBytes() const { return episodes.size() * sizeof(AlertEpisode); }
+
+private:
+    std::vector<AlertEpisode> episodes;
+    uint8_t min_level;
+    uint32_t max_gap_ms;
+    size_t head;                 // Slot of the oldest episode
+    size_t used;
+    bool open;
+    uint64_t last_uptime;        // Uptime of the last record added
+
+    AlertEpisode& newest() { return episodes[(head + used - 1) % episodes.size()]; }
+};
@@ -0,0 +1,190 @@
+/*
+ * storage/CompressedBlock.h
+ * Gorilla-style compressed record blocks for long-term history
+ * Timestamps use delta-of-delta encoding, sensor values XOR encoding
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+
+/**
+ * Encoder/decoder state for one block
+ * The archive keeps one for the open block, readers keep their own
+ */
+struct GorillaState {
+    static const size_t METRIC_COUNT = SensorRecord::METRIC_COUNT;
+    static const uint8_t NO_WINDOW = 0xFF;       // No previous leading/trailing window yet
+
+    uint16_t bit_position = 0;                   // Next bit to read/write
+    uint16_t record_index = 0;                   // Records encoded/decoded so far
+    uint32_t prev_uptime = 0;                    // Native record time (see SensorRecord::getRawTime)
+    int32_t prev_delta = 0;
+    uint32_t prev_values[METRIC_COUNT] = {};     // Native value bits of previous record
+    uint8_t prev_leading[METRIC_COUNT] = {};
+    uint8_t prev_trailing[METRIC_COUNT] = {};
+    uint8_t prev_flags = 0;
+    uint8_t prev_alert = 0;
+
+    void reset() { *this = GorillaState(); }
+};
+
+/**
+ * Fixed-size compressed block of consecutive records
+ * First record is stored verbatim, the rest as deltas against the previous one
+ */
+class CompressedBlock {
+public:
+    /**
+     * Header written in front of the payload when a block is persisted
+     */
+    struct __attribute__((packed)) StoredHeader {
+        uint32_t first_sequence;
+        uint32_t first_uptime;   // Native record time
+        uint32_t last_uptime;
+        uint16_t record_count;
+        uint16_t bit_length;
+    };
+
+    static const size_t BLOCK_BYTES = 512;
+    static const size_t MAX_STORED_BYTES = sizeof(StoredHeader) + BLOCK_BYTES;
+    // Worst case: 36 bits timestamp + 17 bits flags + 44 bits per metric
+    static const size_t MAX_RECORD_BITS = 36 + 17 + GorillaState::METRIC_COUNT * 44;
+
+    CompressedBlock() { reset(0); }
+
+    /**
+     * Clear the block for reuse
+     * @param first_seq Sequence number of the first record that will be appended
+     */
+    void reset(uint32_t first_seq);
+
+    /**
+     * Append a record to the open block
+     * @param record Record to encode (uptime must not go backwards)
+     * @param writer Encoder state belonging to this block
+     * @return false if the block has no room left (caller seals it)
+     */
+    bool append(const SensorRecord& record, GorillaState& writer);
+
+    /**
+     * Decode the next record
+     * @param reader Decoder state (reset() to start from the first record)
+     * @param record Receives the decoded record
+     * @return false when all records have been read
+     */
+    bool decodeNext(GorillaState& reader, SensorRecord& record) const;
+
+    void seal() { sealed = true; }
+    bool isSealed() const { return sealed; }
+    bool isEmpty() const { return record_count == 0; }
+
+    uint32_t getFirstSequence() const { return first_sequence; }
+    uint32_t getEndSequence() const { return first_sequence + record_count; }
+    uint16_t getRecordCount() const { return record_count; }
+    uint64_t getFirstUptime() const { return SensorRecord::rawTimeToUptime(first_uptime); }
+    uint64_t getLastUptime() const { return SensorRecord::rawTimeToUptime(last_uptime); }
+    uint32_t getFirstRawTime() const { return first_uptime; }
+    uint32_t getLastRawTime() const { return last_uptime; }
+    size_t getUsedBytes() const { return (bit_length + 7) / 8; }
+
+    /**
+     * Write header + used payload bytes (the block is persisted as sealed)
+     * @param out Buffer of at least MAX_STORED_BYTES
+     * @return Bytes written
+     */
+    size_t serialize(uint8_t* out) const;
+
+    /**
+     * Load a block written by serialize()
+     * @return false if the data is truncated or inconsistent
+     */
+    bool deserialize(const uint8_t* in, size_t length);
+
+private:
+    uint8_t data[BLOCK_BYTES];
+    uint32_t first_sequence;
+    uint32_t first_uptime;       // Native record time
+    uint32_t last_uptime;
+    uint16_t record_count;
+    uint16_t bit_length;
+    bool sealed;
+
+    void writeBits(GorillaState& writer, uint32_t value, uint8_t bits);
+    uint32_t readBits(GorillaState& reader, uint8_t bits) const;
+    void writeValue(GorillaState& writer, size_t metric, uint32_t value);
+    uint32_t readValue(GorillaState& reader, size_t metric) const;
+};
+
+/**
+ * Ring of compressed blocks with a fixed RAM budget
+ * Holds the long tail of history once the raw ring has overwritten it.
+ * Records are addressed by the same sequence numbers as HistoricalDataStorage.
+ */
+class CompressedArchive {
+public:
+    /**
+     * Position of a reader inside the archive
+     * Keeps decoding forward within a block instead of restarting for every record
+     */
+    struct Reader {
+        size_t block_slot = SIZE_MAX;
+        uint32_t block_first_sequence = 0;
+        GorillaState state;
+    };
+
+    CompressedArchive() : head(0), used_blocks(0), sealed_records(0) {}
+
+    bool begin(size_t budget_bytes);
+    void clear();
+    bool isEnabled() const { return !blocks.empty(); }
+
+    /**
+     * Append a record (seals the open block when it fills up)
+     * @param record Record to archive
+     * @param sequence Record sequence number
+     */
+    void append(const SensorRecord& record, uint32_t sequence);
+
+    /**
+     * Read a record by sequence number
+     * @return false if the sequence is not in the archive
+     */
+    bool read(uint32_t sequence, Reader& reader, SensorRecord& record) const;
+
+    /**
+     * Drop sealed blocks that end before the given uptime
+     */
+    void dropBefore(uint64_t uptime);
+
+    // First sequence with uptime >= value / > value (getEndSequence() if none)
+    uint32_t lowerBoundSequence(uint64_t uptime) const;
+    uint32_t upperBoundSequence(uint64_t uptime) const;
+
+    size_t getRecordCount() const;
+    uint32_t getFirstSequence() const;
+    uint32_t getEndSequence() const;
+    bool getOldestUptime(uint64_t& uptime) const;
+    size_t getBlockCount() const { return used_blocks; }
+    size_t getCapacityBytes() const { return blocks.size() * CompressedBlock::BLOCK_BYTES; }
+    size_t getCompressedBytes() const;
+    float getCompressionRatio() const;
+
+private:
+    std::vector<CompressedBlock> blocks;
+    size_t head;                 // Slot of the oldest block
+    size_t used_blocks;          // Blocks in use, including the open one
+    size_t sealed_records;       // Records held in sealed blocks
+    GorillaState writer;         // Encoder state of the open block
+
+    const CompressedBlock& blockAt(size_t logical_index) const {
+        return blocks[(head + logical_index) % blocks.size()];
+    }
+    CompressedBlock& openBlock() {
+        return blocks[(head + used_blocks - 1) % blocks.size()];
+    }
+    void startBlock(uint32_t first_sequence);
+    size_t findBlock(uint32_t sequence) const;
+    uint32_t boundSequence(uint64_t uptime, bool inclusive) const;
+};
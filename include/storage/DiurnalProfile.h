@@ -0,0 +1,68 @@
+/*
+ * storage/DiurnalProfile.h
+ * Typical day of the week: running mean and maximum of every metric for each
+ * hour of the day and day of the week (24 x 7 cells, local time) - O(1) per reading
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+
+/**
+ * Hour-of-week grid fed by HistoricalDataStorage::storeReading()
+ * Cell index = day * 24 + hour, day 0 = Monday. A cell's mean weighs at most
+ * MAX_WEIGHT readings, after which it follows new readings like a moving average
+ * (at one reading every 5 s that is about the last 11 weeks).
+ */
+class DiurnalProfile {
+public:
+    static const size_t HOURS = 24;
+    static const size_t DAYS = 7;
+    static const size_t CELL_COUNT = HOURS * DAYS;
+    static const uint16_t MAX_WEIGHT = 8192;
+
+    DiurnalProfile() : timezone_minutes(0), readings(0) {}
+
+    bool begin();
+    void clear();
+    bool isEnabled() const { return !cells.empty(); }
+
+    /**
+     * Add a reading taken at a Unix time (ms) - local time comes from the timezone offset
+     */
+    void add(const SensorRecord& record, uint64_t timestamp);
+
+    /**
+     * Timezone used for new readings, minutes east of UTC
+     */
+    void setTimezone(int16_t minutes) { timezone_minutes = minutes; }
+    int16_t getTimezone() const { return timezone_minutes; }
+
+    /**
+     * Parse a TimeSync timezone string ("+0300", "-0530", "+03:00") into minutes east of UTC
+     */
+    static int16_t parseTimezone(const String& offset);
+
+    /**
+     * Cell of a Unix time (ms) in the current timezone
+     */
+    size_t cellOf(uint64_t timestamp) const;
+
+    uint16_t getCount(size_t cell, size_t metric) const { return cells[cell].count[metric]; }
+    float getMean(size_t cell, size_t metric) const { return cells[cell].mean[metric]; }
+    float getMax(size_t cell, size_t metric) const { return cells[cell].max[metric]; }
+    uint32_t getReadings() const { return readings; }
+    size_t getMemoryBytes() const { return cells.size() * sizeof(Cell); }
+
+private:
+    struct Cell {
+        float mean[SensorRecord::METRIC_COUNT];
+        float max[SensorRecord::METRIC_COUNT];
+        uint16_t count[SensorRecord::METRIC_COUNT];   // Saturates at MAX_WEIGHT
+    };
+
+    std::vector<Cell> cells;     // Allocated by begin()
+    int16_t timezone_minutes;
+    uint32_t readings;           // Readings added since the last clear()
+};
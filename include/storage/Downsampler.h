@@ -0,0 +1,69 @@
+/*
+ * storage/Downsampler.h
+ * Streaming min/max-per-bucket downsampling of history records
+ * Keeps spikes and dips visible where uniform every-k-th sampling drops them
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "SensorRecord.h"
+
+/**
+ * Single-pass downsampler driven by one metric
+ * Records are split into max_points / 2 equal-count buckets; each bucket
+ * emits the records holding its minimum and maximum of the chosen metric,
+ * in time order. State is O(1) - records are fed straight from a HistoryCursor.
+ */
+class MinMaxDownsampler {
+public:
+    static const size_t MAX_OUTPUT = 2;          // Records emitted per add()/finish() call
+
+    /**
+     * @param total_records Records that will be fed (HistoryCursor::remaining())
+     * @param max_points Output budget (ranges that fit are passed through unchanged)
+     * @param metric SensorRecord::METRIC_* index that selects the kept records
+     */
+    MinMaxDownsampler(size_t total_records, size_t max_points, size_t metric = SensorRecord::METRIC_CO2);
+
+    /**
+     * Feed the next record in chronological order
+     * @param out Receives records ready to emit (oldest first)
+     * @return Number of records written to out (0-2)
+     */
+    size_t add(const SensorRecord& record, SensorRecord out[MAX_OUTPUT]);
+
+    /**
+     * Flush the last bucket once the input is exhausted
+     */
+    size_t finish(SensorRecord out[MAX_OUTPUT]);
+
+    bool isPassThrough() const { return bucket_count == 0; }
+    size_t getBucketCount() const { return bucket_count; }
+
+    /**
+     * Parse a metric name ("co2", "temperature", "humidity", "pressure", "voc")
+     * @return METRIC_* index, METRIC_CO2 for unknown names
+     */
+    static size_t metricFromName(const String& name);
+
+private:
+    size_t total;
+    size_t bucket_count;         // 0 = pass-through
+    bool peak_only;              // max_points == 1: one bucket, emits only its maximum
+    size_t metric;
+    uint8_t metric_flag;
+
+    size_t fed;                  // Records fed so far
+    size_t bucket_index;
+    size_t bucket_end;           // First record index of the next bucket
+
+    // Current bucket
+    bool has_first, has_value;
+    SensorRecord first;          // Fallback when no record has a valid metric
+    SensorRecord low, high;
+    size_t low_index, high_index;
+    float low_value, high_value;
+
+    void startBucket();
+    size_t emitBucket(SensorRecord out[MAX_OUTPUT]);
+};
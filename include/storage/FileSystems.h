@@ -0,0 +1,62 @@
+/*
+ * storage/FileSystems.h
+ * IFileSystem implementations: Arduino fs::FS (LittleFS / SD) and POSIX directories
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include "../interfaces/IFileSystem.h"
+
+/**
+ * Adapter for Arduino filesystems (LittleFS, SD, SPIFFS)
+ * The filesystem must already be mounted (e.g. LittleFS.begin(true))
+ */
+class ArduinoFileSystem : public IFileSystem {
+private:
+    fs::FS& fs;
+    String name;
+
+public:
+    ArduinoFileSystem(fs::FS& filesystem, const String& fs_name = "littlefs")
+        : fs(filesystem), name(fs_name) {}
+
+    bool exists(const String& path) override;
+    bool makeDirectory(const String& path) override;
+    bool remove(const String& path) override;
+    size_t fileSize(const String& path) override;
+    bool append(const String& path, const uint8_t* data, size_t length) override;
+    size_t read(const String& path, size_t offset, uint8_t* buffer, size_t length) override;
+    bool listFiles(const String& directory, std::vector<String>& names) override;
+    bool writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) override;
+    String getName() override { return name; }
+};
+
+/**
+ * Plain directory on a POSIX filesystem
+ * Stand-in for flash on the host (tests, write-amplification benchmarks);
+ * also usable on ESP-IDF VFS mount points such as "/littlefs"
+ */
+class PosixFileSystem : public IFileSystem {
+private:
+    String root;                 // Prefix for every path
+    size_t bytes_appended;       // Total bytes written (benchmark counter)
+
+public:
+    PosixFileSystem(const String& root_directory) : root(root_directory), bytes_appended(0) {}
+
+    bool exists(const String& path) override;
+    bool makeDirectory(const String& path) override;
+    bool remove(const String& path) override;
+    size_t fileSize(const String& path) override;
+    bool append(const String& path, const uint8_t* data, size_t length) override;
+    size_t read(const String& path, size_t offset, uint8_t* buffer, size_t length) override;
+    bool listFiles(const String& directory, std::vector<String>& names) override;
+    bool writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) override;
+    String getName() override { return "posix"; }
+
+    size_t getBytesAppended() const { return bytes_appended; }
+
+private:
+    String fullPath(const String& path) const { return root + path; }
+};
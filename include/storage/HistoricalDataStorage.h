@@ -8,151 +8,50 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include <array>
+#include <climits>
 #include "../types/SensorData.h"
 #include "../types/TimeSync.h"
 #include "../interfaces/IDataStorage.h"
+#include "SensorRecord.h"
+#include "CompressedBlock.h"
+#include "RollupTiers.h"
+#include "Downsampler.h"
+#include "SegmentLog.h"
+#include "PartitionedArchive.h"
+#include "RecordColumns.h"
+#include "RunningStats.h"
+#include "QuantileSketch.h"
+#include "AlertEpisodes.h"
+#include "DiurnalProfile.h"
+#include "RingCheckpoint.h"
+#include <memory>
 
 /**
- * Compact sensor record for efficient storage
- * Fixed size structure for optimal flash storage
+ * Contiguous run of records inside the ring buffer
  */
-// no need to use PM sensor data
-struct __attribute__((packed)) SensorRecord {
-    unsigned long uptime;        // ESP32 uptime in ms (4 bytes)
-    float co2;                   // CO2 in ppm (4 bytes)
-    float temperature;           // Temperature in °C (4 bytes)
-    float humidity;              // Humidity in % (4 bytes)
-    float pressure;              // Pressure in hPa (4 bytes)
-    float voc;                   // VOC index/estimate (4 bytes)
-    uint8_t validity_flags;      // Bit flags for data validity (1 byte)
-    uint8_t alert_level;         // Overall alert level (1 byte)
-    uint8_t reserved[2];         // Reserved for future use (2 bytes)
-    // Total: 38 bytes per record
-    
-    // Validity flag bits
-    static const uint8_t FLAG_CO2_VALID = 0x01;
-    static const uint8_t FLAG_TEMP_VALID = 0x02;
-    static const uint8_t FLAG_HUMIDITY_VALID = 0x04;
-    static const uint8_t FLAG_PRESSURE_VALID = 0x08;
-    static const uint8_t FLAG_VOC_VALID = 0x10;
-    static const uint8_t FLAG_OVERALL_VALID = 0x80;
-    
-    /**
-     * Default constructor - initialize with safe values
-     */
-    SensorRecord() : uptime(0), co2(0), temperature(0), humidity(0), 
-                    pressure(0), voc(0), 
-                    validity_flags(0), alert_level(0) {
-        reserved[0] = reserved[1] = 0;
-    }
-    
-    /**
-     * Constructor from sensor data objects
-     */
-    SensorRecord(unsigned long record_uptime, 
-                const CO2SensorData* co2_data = nullptr,
-                const VOCSensorData* voc_data = nullptr) 
-        : uptime(record_uptime), validity_flags(0), alert_level(0) {
-        
-        reserved[0] = reserved[1] = 0;
-        
-        // Initialize all values to zero
-        co2 = temperature = humidity = pressure = voc = 0.0;
-        
-        // Fill from CO2 sensor data
-        if (co2_data && co2_data->isValid()) {
-            co2 = co2_data->co2;
-            temperature = co2_data->temperature;
-            humidity = co2_data->humidity;
-            validity_flags |= FLAG_CO2_VALID | FLAG_TEMP_VALID | FLAG_HUMIDITY_VALID;
-            alert_level = max(alert_level, (uint8_t)co2_data->getAlertLevel());
-        }
-        
-        // Fill from VOC sensor data (override temp/humidity if available)
-        if (voc_data && voc_data->isValid()) {
-            if (!co2_data || !co2_data->isValid()) { // Use VOC temp/humidity if CO2 not available
-                temperature = voc_data->temperature;
-                humidity = voc_data->humidity;
-                validity_flags |= FLAG_TEMP_VALID | FLAG_HUMIDITY_VALID;
-            }
-            pressure = voc_data->pressure / 100.0; // Convert Pa to hPa
-            voc = voc_data->vocEstimate;
-            validity_flags |= FLAG_PRESSURE_VALID | FLAG_VOC_VALID;
-            alert_level = max(alert_level, (uint8_t)voc_data->getAlertLevel());
-        }
-        
-        // Set overall validity if any sensor data is valid
-        if (validity_flags != 0) {
-            validity_flags |= FLAG_OVERALL_VALID;
-        }
-    }
-    
-    /**
-     * Convert to JSON for transmission
-     */
-    String toJson(const TimeSync& timeSync) const {
-        JsonDocument doc;
-        
-        // Calculate timestamp from uptime
-        unsigned long timestamp = timeSync.uptimeToTimestamp(uptime);
-        doc["timestamp"] = timestamp;
-        doc["uptime"] = uptime;
-        
-        // Create readings object
-        JsonObject readings = doc["readings"].to<JsonObject>();
-        
-        if (validity_flags & FLAG_CO2_VALID) {
-            JsonObject co2Reading = readings["co2"].to<JsonObject>();
-            co2Reading["value"] = round(co2 * 10) / 10.0; // 1 decimal place
-            co2Reading["unit"] = "ppm";
-            co2Reading["status"] = "valid";
-        }
-        
-        if (validity_flags & FLAG_TEMP_VALID) {
-            JsonObject tempReading = readings["temperature"].to<JsonObject>();
-            tempReading["value"] = round(temperature * 10) / 10.0;
-            tempReading["unit"] = "°C";
-            tempReading["status"] = "valid";
-        }
-        
-        if (validity_flags & FLAG_HUMIDITY_VALID) {
-            JsonObject humReading = readings["humidity"].to<JsonObject>();
-            humReading["value"] = round(humidity * 10) / 10.0;
-            humReading["unit"] = "%";
-            humReading["status"] = "valid";
-        }
-        
-        if (validity_flags & FLAG_PRESSURE_VALID) {
-            JsonObject pressReading = readings["pressure"].to<JsonObject>();
-            pressReading["value"] = round(pressure * 10) / 10.0;
-            pressReading["unit"] = "hPa";
-            pressReading["status"] = "valid";
-        }
-        
-        if (validity_flags & FLAG_VOC_VALID) {
-            JsonObject vocReading = readings["voc"].to<JsonObject>();
-            vocReading["value"] = round(voc * 10) / 10.0;
-            vocReading["unit"] = "ppb";
-            vocReading["status"] = "valid";
-        }
-            
-        String result;
-        serializeJson(doc, result);
-        return result;
-    }
-    
-    /**
-     * Check if record is valid (has any sensor data)
-     */
-    bool isValid() const {
-        return (validity_flags & FLAG_OVERALL_VALID) != 0;
-    }
-    
+struct RecordSpan {
+    const SensorRecord* data = nullptr;
+    size_t count = 0;
+};
+
+/**
+ * Zero-copy view over a range of stored records
+ * A range in the circular buffer is at most two spans: before and after the wrap point.
+ * The view is invalidated by the next storeReading()/clearOldData() call.
+ */
+struct RecordView {
+    RecordSpan spans[2];
+
+    size_t size() const { return spans[0].count + spans[1].count; }
+    bool empty() const { return size() == 0; }
+
     /**
-     * Get overall alert level
+     * Access record by position in the view (0 = oldest)
      */
-    AlertLevel getAlertLevel() const {
-        return static_cast<AlertLevel>(alert_level);
+    const SensorRecord& operator[](size_t index) const {
+        return index < spans[0].count ? spans[0].data[index]
+                                      : spans[1].data[index - spans[0].count];
     }
 };
 
@@ -165,8 +64,8 @@ struct StorageInfo {
     float used_capacity_mb;         // Used capacity in MB
     float free_capacity_mb;         // Free capacity in MB
     uint32_t total_records;         // Total number of records
-    unsigned long oldest_record_time;  // Oldest record timestamp
-    unsigned long newest_record_time;  // Newest record timestamp
+    uint64_t oldest_record_time;    // Oldest record timestamp
+    uint64_t newest_record_time;    // Newest record timestamp
     float estimated_days_remaining; // Estimated days of storage remaining
     
     /**
@@ -189,17 +88,101 @@ struct StorageInfo {
     }
 };
 
+class HistoricalDataStorage;
+
+/**
+ * Forward-only cursor over stored records in chronological order
+ * Reads records straight from the ring buffer, or decodes them from the
+ * compressed archive (RAM, then SD card) for history the ring has already overwritten.
+ * Positions are record sequence numbers, so a transfer can be resumed later
+ * from position(); records overwritten in the meantime are skipped.
+ */
+class HistoryCursor {
+private:
+    const HistoricalDataStorage* storage;
+    uint32_t next_sequence;      // Sequence number of the next record to read
+    uint64_t start_uptime;       // Points before this uptime are dropped (expanded runs)
+    uint64_t end_uptime;         // Stop after this uptime (inclusive)
+    bool finished;
+    CompressedArchive::Reader archive_reader;
+    std::unique_ptr<PartitionedArchive::Reader> sd_reader;   // Allocated on the first SD read
+    
+    // Deadband runs: points between a run start and its held record are re-created
+    SensorRecord previous;       // Last record read (start of a possible run)
+    uint32_t previous_sequence;
+    bool has_previous;
+    uint32_t expand_left;        // Re-created points still to return before the held record
+    uint64_t expand_uptime;      // Uptime of the next re-created point
+    SensorRecord held;           // Held record returned after the re-created points
+    
+    bool readStored(SensorRecord& record);
+    void resetRun() { has_previous = false; expand_left = 0; }
+    
+public:
+    HistoryCursor() : storage(nullptr), next_sequence(0), start_uptime(0), end_uptime(0), finished(true),
+                      previous_sequence(0), has_previous(false), expand_left(0), expand_uptime(0) {}
+    HistoryCursor(const HistoricalDataStorage* source, uint32_t start_sequence, uint64_t end,
+                  uint64_t start = 0)
+        : storage(source), next_sequence(start_sequence), start_uptime(start), end_uptime(end),
+          finished(source == nullptr),
+          previous_sequence(0), has_previous(false), expand_left(0), expand_uptime(0) {}
+    
+    /**
+     * Read the next record in range
+     * Deadband runs are expanded back into one point per sampling interval.
+     * @param record Receives a copy of the record
+     * @return false when the range is exhausted
+     */
+    bool next(SensorRecord& record);
+    
+    /**
+     * Skip records without reading them
+     * @param count Number of records to skip
+     */
+    void skip(size_t count);
+    
+    /**
+     * Move forward to a sequence number (never moves backwards)
+     * @param sequence Resume position from a previous position() call
+     */
+    void seek(uint32_t sequence);
+    
+    /**
+     * Sequence number to resume from (next record that would be returned)
+     * Inside an expanded run this is the held record, which is returned again on resume
+     */
+    uint32_t position() const { return expand_left > 0 ? next_sequence - 1 : next_sequence; }
+
+    /**
+     * Sequence a new cursor continues this one from exactly: the last record read, which
+     * starts a deadband run that may still expand (drop points up to the last one returned)
+     */
+    uint32_t markSequence() const { return has_previous ? previous_sequence : next_sequence; }
+
+    /**
+     * Number of records left in range (O(log n))
+     * With deadband storage: estimated points after run expansion
+     */
+    size_t remaining() const;
+    
+    bool isFinished() const { return finished; }
+};
+
 /**
  * Historical data storage manager
  * Handles circular buffer storage of sensor records
  */
 class HistoricalDataStorage : public IDataStorage {
+    friend class HistoryCursor;
+    
 private:
     // Storage configuration
     static const size_t RECORD_SIZE = sizeof(SensorRecord);
-    static const size_t MAX_RECORDS_FLASH = 600;     // ~24KB for default NVS partition (38-byte records)
     static const size_t CHUNK_SIZE = 50;             // Records per transmission chunk
     static const uint32_t STORAGE_MAGIC = 0x436F546D; // "CoTm" magic number
+    static const uint32_t EPOCH_MAGIC = 0x436F4570;   // "CoEp" boot epoch table
+    static const size_t RETENTION_STEP_RECORDS = 4;    // Ring records expired per reading at most
+    static const uint16_t RETENTION_SWEEP_INTERVAL = 60; // Readings between archive retention sweeps
     
     // Storage state
     size_t max_records;
@@ -209,16 +192,88 @@ private:
     bool storage_full;
     String storage_type;
     
-    // Record buffer for flash storage
-    std::vector<SensorRecord> record_buffer;
+    // Ring slots: owned_buffer (heap, sized once) or a StaticHistoricalDataStorage array
+    std::vector<SensorRecord> owned_buffer;
+    SensorRecord* record_buffer;
+    
+    // Optional structure-of-arrays copy of the ring (same slots) for single-metric scans
+    RecordColumns columns;
+    
+    // Record sequence numbers (monotonic, first stored record is 0)
+    uint32_t next_sequence;
+    
+    // Compressed long-term history (optional, covers what the ring overwrote)
+    CompressedArchive archive;
+    
+    // Aggregated 1 min / 1 h / 1 day history (optional, far longer retention)
+    RollupTiers rollups;
+    
+    // Per-metric statistics of the last hour / day / boot (optional, O(1) per reading)
+    RunningStatistics statistics;
+    
+    // CO2/VOC quantile sketches of the last day / week (optional, fixed size)
+    QuantileStatistics quantiles;
+    
+    // Run-length index of alert episodes (optional, answers "when and how long")
+    AlertEpisodeIndex episodes;
+    
+    // Mean/max per hour of the day and day of the week in local time (optional, O(1) per reading)
+    DiurnalProfile profile;
+    
+    // Persistent log on flash (optional, restored on boot)
+    std::unique_ptr<SegmentLog> segment_log;
+    
+    // Incremental snapshot of the ring on flash (optional, restored on boot)
+    std::unique_ptr<RingCheckpoint> checkpoint;
+    
+    // Time-partitioned archive on SD card (optional, months of raw history)
+    std::unique_ptr<PartitionedArchive> sd_archive;
+    
+    // Storage clock = millis64() + clock_offset; restored history keeps its place
+    // before the current boot instead of colliding with the new uptimes
+    uint64_t clock_offset;
+    
+    // Unix offset of every boot on the storage clock, persisted next to the first
+    // backend that restores history (two alternating files, newest valid one wins)
+    BootEpochTable epochs;
+    IFileSystem* epoch_fs;
+    String epoch_directory;
+    uint32_t epoch_generation;
+    
+    // Automatic age-based retention (0 = off), applied incrementally in storeReading()
+    uint64_t retention_ms;
+    uint16_t retention_countdown;      // Readings until the next archive sweep
+    
+    // Change-only storage (optional): readings within tolerance of the run start only
+    // move the run's held record forward instead of taking a new slot
+    bool deadband_enabled;
+    float deadband_tolerance[SensorRecord::METRIC_COUNT];
+    uint32_t deadband_interval_ms;     // Sampling interval used to expand runs again
+    bool run_open;                     // run_start may be extended by the next reading
+    SensorRecord run_start;
+    bool held_pending;                 // Newest slot is a held record not yet archived/logged
+    uint32_t folded_readings;          // Readings absorbed by held records (bounds expansion estimates)
+    
+    // Bumped when query results change other than by appended or expired records
+    // (format, deadband settings, boot epochs restored) - callers may cache responses
+    uint32_t generation;
     
     // Storage validation
     bool initialized;
     
 public:
+    static const size_t RAW_BUFFER_BYTES = 16800;        // RAM budget of the raw ring
+    static const size_t MAX_RECORDS_FLASH = RAW_BUFFER_BYTES / RECORD_SIZE;  // 600 float / 1050 quantized records
+    static const size_t DEFAULT_ARCHIVE_BYTES = 32768;   // 64 compressed blocks
+    static const int RAW_RESOLUTION = -1;                // selectResolution(): raw records, no rollup
+    
     HistoricalDataStorage(const String& type = "flash", size_t max_recs = MAX_RECORDS_FLASH);
     virtual ~HistoricalDataStorage() = default;
     
+    // Not copyable - record_buffer may point into the object itself
+    HistoricalDataStorage(const HistoricalDataStorage&) = delete;
+    HistoricalDataStorage& operator=(const HistoricalDataStorage&) = delete;
+    
     // ================================
     // INITIALIZATION & SETUP
     // ================================
@@ -227,12 +282,89 @@ public:
     bool format();
     void reset();
     
+    // Compressed archive for long-term history (RAM budget in bytes)
+    bool enableArchive(size_t budget_bytes = DEFAULT_ARCHIVE_BYTES);
+    const CompressedArchive& getArchive() const { return archive; }
+    
+    // Rollup tiers for long-range queries (retention in buckets per tier)
+    bool enableRollups(size_t minute_buckets = RollupTiers::DEFAULT_MINUTE_BUCKETS,
+                       size_t hour_buckets = RollupTiers::DEFAULT_HOUR_BUCKETS,
+                       size_t day_buckets = RollupTiers::DEFAULT_DAY_BUCKETS);
+    const RollupTiers& getRollups() const { return rollups; }
+    
+    // Persistent segment log (restores stored history, then logs every reading)
+    bool enablePersistence(IFileSystem& fs, const String& directory = "/history",
+                           size_t batch_records = SegmentLog::DEFAULT_BATCH_RECORDS,
+                           size_t max_segments = SegmentLog::DEFAULT_MAX_SEGMENTS);
+    const SegmentLog* getSegmentLog() const { return segment_log.get(); }
+    
+    // Ring checkpoint (restores the last snapshot, then rewrites changed pages every interval)
+    bool enableCheckpoint(IFileSystem& fs, const String& directory = "/checkpoint",
+                          uint32_t interval_ms = RingCheckpoint::DEFAULT_INTERVAL_MS);
+    size_t pollCheckpoint();                  // From the main loop, one flash write per call
+    bool checkpointNow();                     // Before a restart
+    const RingCheckpoint* getCheckpoint() const { return checkpoint.get(); }
+    
+    // SD card archive (daily partitions of compressed blocks with a sparse index)
+    bool enableSdArchive(IFileSystem& fs, const String& directory = "/archive",
+                         uint32_t partition_seconds = PartitionedArchive::DEFAULT_PARTITION_SECONDS,
+                         size_t max_partitions = PartitionedArchive::DEFAULT_MAX_PARTITIONS);
+    const PartitionedArchive* getSdArchive() const { return sd_archive.get(); }
+    
+    // Per-metric column layout of the raw ring (25 extra bytes per record)
+    bool enableColumns();
+    const RecordColumns& getColumns() const { return columns; }
+    
+    // Running statistics over readings stored since boot (last hour, last day, whole boot)
+    bool enableStatistics();
+    const RunningStatistics& getStatistics() const { return statistics; }
+    
+    // Quantile sketches (p50/p95/p99) of CO2 and VOC over the last day and week
+    bool enableQuantiles();
+    const QuantileStatistics& getQuantiles() const { return quantiles; }
+    
+    // Alert episodes: runs of records at or above min_level (AlertLevel), newest max_episodes kept
+    bool enableEpisodes(uint8_t min_level = AlertEpisodeIndex::DEFAULT_MIN_LEVEL,
+                        size_t max_episodes = AlertEpisodeIndex::DEFAULT_MAX_EPISODES);
+    const AlertEpisodeIndex& getEpisodes() const { return episodes; }
+    
+    // Typical week: 24 x 7 hour cells of every metric, filled once time is synchronized
+    // (local time from the timezone of the last noteTimeSync())
+    bool enableProfile();
+    const DiurnalProfile& getProfile() const { return profile; }
+    
+    // Change-only storage: per-metric tolerance in metric units (ppm, °C, %, hPa, ppb)
+    // A run of readings within tolerance of its first one is kept as two records
+    // (first and last); queries expand it back at sample_interval_ms
+    bool enableDeadband(const float tolerances[SensorRecord::METRIC_COUNT], uint32_t sample_interval_ms);
+    void disableDeadband();
+    void setDeadbandInterval(uint32_t sample_interval_ms);
+    bool isDeadbandEnabled() const { return deadband_enabled; }
+    uint32_t getFoldedReadings() const { return folded_readings; }
+    
+    bool flush();   // Write batched records now (e.g. before restart)
+    
+    // ================================
+    // STORAGE CLOCK
+    // ================================
+    
+    // Record uptimes are storage clock values (millis64() + offset of restored history)
+    uint64_t getCurrentUptime() const { return millis64() + clock_offset; }
+    uint64_t getClockOffset() const { return clock_offset; }
+    
+    // Timestamps go through the boot epoch table, so records of earlier boots keep the
+    // offset their boot was synchronized with; timeSync supplies the current boot's offset
+    uint64_t toTimestamp(const TimeSync& timeSync, uint64_t storage_uptime) const;
+    uint64_t toStorageUptime(const TimeSync& timeSync, uint64_t timestamp) const;
+    void noteTimeSync(const TimeSync& timeSync);   // After every sync - persists a changed offset
+    const BootEpochTable& getEpochs() const { return epochs; }
+    
     // ================================
     // CORE STORAGE OPERATIONS
     // ================================
     
     bool storeReading(const SensorRecord& record);
-    bool storeReading(unsigned long uptime, 
+    bool storeReading(uint64_t uptime, 
                      const CO2SensorData* co2_data = nullptr,
                      const VOCSensorData* voc_data = nullptr);
     
@@ -241,14 +373,46 @@ public:
     // ================================
     
     std::vector<SensorRecord> queryByTimeRange(const TimeRange& range, const TimeSync& timeSync);
-    std::vector<SensorRecord> queryByUptimeRange(unsigned long start_uptime, unsigned long end_uptime);
+    std::vector<SensorRecord> queryByUptimeRange(uint64_t start_uptime, uint64_t end_uptime);
     std::vector<SensorRecord> queryLatest(size_t count = 100);
+
+    // Zero-copy range lookups (binary search over the uptime-ordered ring, raw records only)
+    RecordView viewByTimeRange(const TimeRange& range, const TimeSync& timeSync) const;
+    RecordView viewByUptimeRange(uint64_t start_uptime, uint64_t end_uptime) const;
+    
+    // Single-metric access to the raw ring
+    // viewMetric() needs enableColumns(); summarizeMetric() falls back to a record scan without it
+    MetricView viewMetric(size_t metric, uint64_t start_uptime, uint64_t end_uptime) const;
+    MetricSummary summarizeMetric(size_t metric, uint64_t start_uptime, uint64_t end_uptime) const;
+
+    // Streaming access (constant memory, resumable by sequence number)
+    HistoryCursor openCursor(uint64_t start_uptime, uint64_t end_uptime) const;
+    HistoryCursor openCursor(const TimeRange& range, const TimeSync& timeSync) const;
+    HistoryCursor resumeCursor(uint32_t sequence, uint64_t end_uptime = UINT64_MAX) const;
+    
+    // Incremental sync: cursor over everything stored from a client's next sequence on
+    // (position() of its last transfer during boot_id). Sequences reissued after a
+    // reboot that lost unsaved records are read again; reset is set when the client's
+    // position is unknown here (other device, table lost) and all history is returned.
+    HistoryCursor openSince(uint32_t sequence, uint32_t boot_id, bool& reset) const;
+    uint32_t getBootId() const { return epochs.current().boot_id; }
+    
+    // Multi-resolution access
+    // Returns the finest source (RAW_RESOLUTION or a rollup tier index) that covers the
+    // range within max_points, falling back to the coarsest tier for very long ranges
+    int selectResolution(uint64_t start_uptime, uint64_t end_uptime, size_t max_points) const;
+    std::vector<RollupBucket> queryRollups(size_t tier_index, uint64_t start_uptime, uint64_t end_uptime) const;
+    
+    // Convert a timestamp range to uptimes (clamped to boot and current uptime)
+    bool resolveUptimeRange(const TimeRange& range, const TimeSync& timeSync,
+                            uint64_t& start_uptime, uint64_t& end_uptime) const;
     
     // Query with pagination support
     struct QueryResult {
         std::vector<SensorRecord> records;
         size_t total_available;
         bool has_more;
+        uint32_t next_sequence;     // Resume position after the last returned record
     };
     
     QueryResult queryByTimeRangePaged(const TimeRange& range, const TimeSync& timeSync, 
@@ -261,18 +425,26 @@ public:
     StorageInfo getStorageInfo(const TimeSync& timeSync) const;
     size_t getRecordCount() const { return current_records; }
     size_t getMaxRecords() const { return max_records; }
+    uint32_t getFirstSequence() const { return next_sequence - current_records; }
+    uint32_t getOldestSequence() const;
+    uint32_t getNextSequence() const { return next_sequence; }
+    uint32_t getGeneration() const { return generation; }
     bool isFull() const { return storage_full; }
     bool isEmpty() const { return current_records == 0; }
     
     // Get time range of stored data
-    bool getDataTimeRange(unsigned long& oldest_uptime, unsigned long& newest_uptime) const;
+    bool getDataTimeRange(uint64_t& oldest_uptime, uint64_t& newest_uptime) const;
     
     // ================================
     // MAINTENANCE OPERATIONS
     // ================================
     
-    bool clearOldData(unsigned long before_uptime);
+    bool clearOldData(uint64_t before_uptime);        // O(log n): advances the ring head in place
     bool clearOldData(const TimeSync& timeSync, uint32_t max_age_hours = 168); // 7 days default
+    
+    // Drop records older than max_age_hours as new ones arrive (0 = keep until overwritten)
+    void setRetention(uint32_t max_age_hours);
+    uint32_t getRetention() const { return retention_ms / 3600000UL; }
     size_t getEstimatedDaysRemaining(uint32_t records_per_day = 8640) const; // Assuming 10s interval
     
     // ================================
@@ -294,26 +466,120 @@ public:
     String getStorageType() override { return storage_type; }
     bool isReady() override { return initialized; }
     
+protected:
+    // Ring over caller-provided slots (no heap allocation for the raw records)
+    HistoricalDataStorage(const String& type, SensorRecord* slots, size_t slot_count);
+    
 private:
     // ================================
     // INTERNAL HELPERS
     // ================================
     
     bool validateRecord(const SensorRecord& record) const;
+    void appendRecord(const SensorRecord& record, bool held = false);
+    bool foldReading(const SensorRecord& record);
+    bool withinDeadband(const SensorRecord& record) const;
+    void closeRun();
+    void resetRing();
     void updateIndices();
     size_t getNextWriteIndex() const;
     bool shouldOverwrite() const;
-    
+    void dropOldest(size_t count);
+    void applyRetention(uint64_t newest_uptime);
+    CheckpointRing checkpointRing() const;
+
+    // Ring buffer addressing (logical index 0 = oldest record)
+    size_t oldestIndex() const { return read_index; }
+    const SensorRecord& recordAt(size_t logical_index) const {
+        return record_buffer[(oldestIndex() + logical_index) % max_records];
+    }
+    size_t lowerBoundUptime(uint64_t uptime) const;
+    size_t upperBoundUptime(uint64_t uptime) const;
+    RecordView viewLogicalRange(size_t begin, size_t end) const;
+    uint32_t lowerBoundSequence(uint64_t uptime) const;
+    uint32_t upperBoundSequence(uint64_t uptime) const;
+    uint32_t getMemorySequence() const;    // Oldest sequence held in RAM (archive or ring)
+    bool useSdArchive(uint64_t uptime) const;
+
     // Storage persistence (for ESP32 flash)
     bool loadFromFlash();
     bool saveToFlash();
     String getStorageKey(size_t index) const;
     
-    // Data sampling for large queries
-    std::vector<SensorRecord> sampleRecords(const std::vector<SensorRecord>& records, 
-                                           size_t max_points) const;
+    // Boot epoch table
+    void attachEpochs(IFileSystem& fs, const String& directory);
+    bool loadEpochs();
+    bool saveEpochs();
+    String epochPath(uint32_t generation) const;
+    uint64_t currentEpochOffset(const TimeSync& timeSync) const;
 };
 
+/**
+ * Storage with a statically sized raw ring - nothing is allocated on the heap for it
+ * Declare it static or global to place the ring in .bss, or with EXT_RAM_ATTR to place it
+ * in PSRAM (needs CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY):
+ *   static StaticHistoricalDataStorage<HISTORY_RING_RECORDS> storage("ram_only");
+ */
+template <size_t N>
+class StaticHistoricalDataStorage : public HistoricalDataStorage {
+    static_assert(N > 0, "Ring needs at least one record");
+    
+private:
+    std::array<SensorRecord, N> slots;
+    
+public:
+    StaticHistoricalDataStorage(const String& type = "flash")
+        : HistoricalDataStorage(type, slots.data(), N) {}
+    
+    static constexpr size_t RING_BYTES = N * sizeof(SensorRecord);
+};
+
+// Raw ring capacity of the statically allocated storage (-DHISTORY_RING_RECORDS=N)
+#ifndef HISTORY_RING_RECORDS
+#define HISTORY_RING_RECORDS HistoricalDataStorage::MAX_RECORDS_FLASH
+#endif
+
+// Store only changes beyond the default tolerances (-DHISTORY_DEADBAND=1)
+#ifndef HISTORY_DEADBAND
+#define HISTORY_DEADBAND 0
+#endif
+
+// Snapshot the ring to LittleFS every N seconds instead of logging every reading
+// (-DHISTORY_CHECKPOINT_SECONDS=60, 0 = segment log)
+#ifndef HISTORY_CHECKPOINT_SECONDS
+#define HISTORY_CHECKPOINT_SECONDS 0
+#endif
+
+// Archive raw history to an SD card on the shared SPI bus (-DHISTORY_SD_ARCHIVE=1); off by
+// default, so boards without a card never probe it. Chip select: -DHISTORY_SD_CS_PIN=N
+#ifndef HISTORY_SD_ARCHIVE
+#define HISTORY_SD_ARCHIVE 0
+#endif
+#ifndef HISTORY_SD_CS_PIN
+#define HISTORY_SD_CS_PIN Constants::GPIO::SD_CS_PIN
+#endif
+
+// Optional indexes BluetoothComm::enableHistoricalData() sets up, with their approximate
+// heap cost. Set one to 0 (e.g. -DHISTORY_ROLLUPS=0) to leave it out on tight builds.
+#ifndef HISTORY_ARCHIVE_BYTES
+#define HISTORY_ARCHIVE_BYTES HistoricalDataStorage::DEFAULT_ARCHIVE_BYTES   // Compressed archive budget
+#endif
+#ifndef HISTORY_ROLLUPS
+#define HISTORY_ROLLUPS 1        // ~33 KB: long-range requests answered from min/max/mean buckets
+#endif
+#ifndef HISTORY_STATISTICS
+#define HISTORY_STATISTICS 1     // ~6 KB: hour / day / since-boot statistics in storage info
+#endif
+#ifndef HISTORY_QUANTILES
+#define HISTORY_QUANTILES 1      // No heap (~4 KB inside the storage object): stats_request percentiles
+#endif
+#ifndef HISTORY_EPISODES
+#define HISTORY_EPISODES 1       // ~5 KB: warning-and-above episodes for episodes_request
+#endif
+#ifndef HISTORY_PROFILE
+#define HISTORY_PROFILE 1        // ~8.5 KB: hour-of-week means and maxima for profile_request
+#endif
+
 // ================================
 // STORAGE FACTORY
 // ================================
@@ -329,7 +595,10 @@ public:
         AUTO_DETECT
     };
     
+    // With a card (SD_CARD_STORAGE / AUTO_DETECT) the storage comes back initialized and
+    // archiving to it; otherwise it is the RAM ring, not yet initialized
     static std::unique_ptr<HistoricalDataStorage> createStorage(StorageType type = AUTO_DETECT);
     static bool isSDCardAvailable();
+    static IFileSystem* getSDCardFileSystem();   // nullptr without a card
     static size_t getAvailableFlashSpace();
 };
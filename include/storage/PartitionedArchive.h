@@ -0,0 +1,144 @@
+/*
+ * storage/PartitionedArchive.h
+ * Time-partitioned archive of compressed record blocks for SD card storage
+ * A sparse per-partition index maps block time ranges to file offsets
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "../interfaces/IFileSystem.h"
+#include "CompressedBlock.h"
+
+/**
+ * One index entry per compressed block in a partition
+ */
+struct __attribute__((packed)) ArchiveIndexEntry {
+    uint32_t first_sequence;
+    uint32_t first_uptime;       // Native record time of the first record (SensorRecord::getRawTime)
+    uint32_t last_uptime;        // Native record time of the last record
+    uint32_t offset;             // Byte offset of the block in the partition data file
+    uint16_t record_count;
+    uint16_t length;             // Stored block bytes, CRC16 not included
+};
+
+/**
+ * Archive laid out as one pair of files per time partition (default: one day):
+ *   /archive/p_00000003.blk  [StoredHeader][payload][CRC16] per block
+ *   /archive/p_00000003.idx  ArchiveIndexEntry per block
+ * Partition number = record uptime / partition length, so a time range maps directly
+ * to the partitions it touches; the index then points at the first block in range and
+ * only the blocks inside the range are read.
+ */
+class PartitionedArchive {
+public:
+    static const uint32_t DEFAULT_PARTITION_SECONDS = 86400;   // Daily files
+    static const size_t DEFAULT_MAX_PARTITIONS = 366;          // ~1 year of daily files
+
+    /**
+     * Position of a reader inside the archive
+     * Keeps the current block in memory so sequential reads touch the card once per block
+     */
+    struct Reader {
+        size_t partition = SIZE_MAX;     // Index into the partition list
+        uint32_t partition_id = 0;       // Detects a partition list that shifted since
+        size_t entry = 0;                // Index entry of the loaded block
+        uint32_t block_first_sequence = 0;
+        uint32_t block_end_sequence = 0;
+        uint32_t next_available = 0;     // After a failed read: next stored sequence
+        CompressedBlock block;
+        GorillaState state;
+    };
+
+    struct Stats {
+        uint32_t blocks_written = 0;
+        uint32_t bytes_written = 0;      // Data + index bytes
+        uint32_t blocks_read = 0;
+        uint32_t partitions_dropped = 0;
+        uint32_t crc_errors = 0;
+    };
+
+    PartitionedArchive(IFileSystem& filesystem, const String& dir = "/archive",
+                       uint32_t partition_length_s = DEFAULT_PARTITION_SECONDS,
+                       size_t partition_limit = DEFAULT_MAX_PARTITIONS);
+
+    /**
+     * Create the directory and load the partition list
+     */
+    bool begin();
+
+    /**
+     * Add a record (written to the card each time a block fills up)
+     * @param sequence Record sequence number (a gap starts a new block)
+     */
+    void append(const SensorRecord& record, uint32_t sequence);
+
+    /**
+     * Write the open block now (e.g. before restart); later records start a new block
+     */
+    bool flush();
+
+    /**
+     * Delete every partition
+     */
+    bool clear();
+
+    /**
+     * Delete partitions that end before the given uptime
+     */
+    void dropBefore(uint64_t uptime);
+
+    /**
+     * Read a record by sequence number
+     * @return false if the sequence is not on the card (reader.next_available tells where to continue)
+     */
+    bool read(uint32_t sequence, Reader& reader, SensorRecord& record) const;
+
+    // First sequence with uptime >= value / > value (getEndSequence() if none)
+    uint32_t lowerBoundSequence(uint64_t uptime) const;
+    uint32_t upperBoundSequence(uint64_t uptime) const;
+
+    bool isEmpty() const { return partitions.empty(); }
+    uint32_t getFirstSequence() const { return partitions.empty() ? end_sequence : partitions.front().first_sequence; }
+    uint32_t getEndSequence() const { return end_sequence; }   // Written blocks only
+    bool getOldestUptime(uint64_t& uptime) const;
+    uint64_t getNewestUptime() const { return newest_uptime; }
+    size_t getPartitionCount() const { return partitions.size(); }
+    uint32_t getPartitionSeconds() const { return partition_seconds; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Partition {
+        uint32_t id;
+        uint32_t first_sequence;
+        uint64_t first_uptime;   // Storage uptime (ms)
+        size_t entries;          // Index entries (= blocks)
+    };
+
+    IFileSystem& fs;
+    String directory;
+    uint32_t partition_seconds;
+    size_t max_partitions;
+
+    std::vector<Partition> partitions;   // Oldest first (ordered by id and by sequence)
+    uint32_t end_sequence;               // Sequence after the last written block
+    uint64_t newest_uptime;
+
+    // Block being filled
+    CompressedBlock open_block;
+    GorillaState writer;
+    uint32_t open_partition;
+
+    mutable Stats stats;
+
+    uint32_t partitionOf(uint64_t uptime) const { return uptime / 1000 / partition_seconds; }
+    String dataPath(uint32_t id) const;
+    String indexPath(uint32_t id) const;
+    bool writeBlock();
+    void removePartition(size_t index);
+    bool readEntry(size_t partition, size_t entry, ArchiveIndexEntry& out) const;
+    bool migrateIndex(uint32_t id, size_t entries);
+    bool loadBlock(size_t partition, size_t entry, Reader& reader) const;
+    size_t findPartition(uint32_t sequence) const;
+    uint32_t boundSequence(uint64_t uptime, bool inclusive) const;
+};
@@ -0,0 +1,131 @@
+/*
+ * storage/QuantileSketch.h
+ * Fixed-size quantile sketches (p50/p95/p99) of CO2 and VOC over the last day and week
+ * Memory does not depend on the sampling rate or on how long history is kept
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "SensorRecord.h"
+
+/**
+ * Value range of a sketch - bins are spaced geometrically from low to high,
+ * so every bin has the same relative error (within ~3% for CO2, ~5% for VOC)
+ */
+struct SketchRange {
+    float low;
+    float high;
+};
+
+/**
+ * Log-bucketed histogram of one metric
+ * Sketches over the same range merge by adding bins, so short slices can be
+ * rolled up into longer ones and a window answered by merging its slices.
+ * A bin that would overflow halves every bin (shift counts the halvings).
+ */
+class QuantileSketch {
+public:
+    static const size_t BIN_COUNT = 64;
+
+    QuantileSketch() { clear(); }
+
+    void clear();
+    void add(float value, const SketchRange& range);
+    void merge(const QuantileSketch& other);
+
+    /**
+     * Value at quantile q (0..1), clamped to the exact min/max seen
+     * @return 0 for an empty sketch
+     */
+    float quantile(float q, const SketchRange& range) const;
+
+    uint32_t getCount() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    float getMin() const { return min_value; }
+    float getMax() const { return max_value; }
+
+private:
+    uint16_t bins[BIN_COUNT];
+    uint8_t shift;               // Each bin count stands for 2^shift samples
+    uint32_t phase;              // xorshift state that thins adds after a halving
+    uint32_t count;              // Exact number of samples
+    float min_value;
+    float max_value;
+
+    static size_t binOf(float value, const SketchRange& range);
+    static float binValue(size_t bin, const SketchRange& range);
+    void compact();
+};
+
+/**
+ * Last day and last week sketches of one metric
+ * Readings go into 4 hour slices; a closed slice is merged into the daily slice it
+ * belongs to. Windows are answered by merging slices (6 x 4 h, 7 days + open slice).
+ */
+class MetricQuantiles {
+public:
+    static const uint32_t SLICE_SECONDS = 4 * 3600;
+    static const uint32_t DAY_SECONDS = 86400;
+    static const size_t DAY_SLICES = DAY_SECONDS / SLICE_SECONDS;   // 6
+    static const size_t WEEK_DAYS = 7;
+
+    MetricQuantiles() { clear(); }
+
+    void clear();
+    void add(uint32_t uptime_s, float value, const SketchRange& range);
+
+    QuantileSketch lastDay() const;
+    QuantileSketch lastWeek() const;
+
+private:
+    QuantileSketch slices[DAY_SLICES];    // Ring of 4 hour slices, open one included
+    uint32_t slice_starts[DAY_SLICES];
+    size_t slice_head;                    // Slot of the open slice
+    size_t slices_used;
+
+    QuantileSketch days[WEEK_DAYS];       // Ring of daily roll-ups of closed slices
+    uint32_t day_starts[WEEK_DAYS];
+    size_t day_head;                      // Slot of the newest day
+    size_t days_used;
+
+    void closeSlice(size_t slot);
+};
+
+/**
+ * Quantile sketches of the compliance metrics, fed by HistoricalDataStorage::storeReading()
+ */
+class QuantileStatistics {
+public:
+    enum Window {
+        LAST_DAY = 0,
+        LAST_WEEK = 1
+    };
+
+    static const size_t SKETCH_COUNT = 2;
+    static const size_t METRICS[SKETCH_COUNT];        // METRIC_CO2, METRIC_VOC
+    static const SketchRange RANGES[SKETCH_COUNT];
+
+    QuantileStatistics() : enabled(false) {}
+
+    bool begin();
+    void clear();
+    bool isEnabled() const { return enabled; }
+
+    void add(const SensorRecord& record);
+
+    /**
+     * Sketch slot of a metric, SIZE_MAX when the metric is not sketched
+     */
+    static size_t sketchOf(size_t metric);
+
+    /**
+     * Merged sketch of a window (empty for metrics that are not sketched)
+     */
+    QuantileSketch get(Window window, size_t metric) const;
+    const SketchRange& rangeOf(size_t sketch) const { return RANGES[sketch]; }
+    size_t getMemoryBytes() const { return sizeof(*this); }
+
+private:
+    bool enabled;
+    MetricQuantiles sketches[SKETCH_COUNT];
+};
@@ -0,0 +1,87 @@
+/*
+ * storage/RecordColumns.h
+ * Structure-of-arrays mirror of the raw ring for single-metric scans
+ * One contiguous array per field, indexed by the same slots as the ring
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+
+/**
+ * Min/max/mean of one metric over a range (count = records with a valid value)
+ */
+struct MetricSummary {
+    uint32_t count = 0;
+    float min = 0;
+    float max = 0;
+    float mean = 0;
+    float stddev = 0;            // Running statistics only (0 from range scans)
+};
+
+/**
+ * Contiguous run of one metric's column values
+ */
+struct MetricSpan {
+    const uint32_t* uptimes = nullptr;   // Storage uptime (ms)
+    const float* values = nullptr;
+    const uint8_t* flags = nullptr;      // Record validity flags
+    size_t count = 0;
+};
+
+/**
+ * Zero-copy view over one metric in a range of stored records
+ * Like RecordView: at most two spans, invalidated by the next storeReading()/clearOldData()
+ */
+struct MetricView {
+    MetricSpan spans[2];
+    uint8_t valid_mask = 0;              // SensorRecord::metricFlag() of the metric
+
+    size_t size() const { return spans[0].count + spans[1].count; }
+    bool empty() const { return size() == 0; }
+};
+
+/**
+ * Per-field columns (uptime, 5 metrics, flags) - 25 bytes per slot
+ */
+class RecordColumns {
+public:
+    /**
+     * Running min/max/sum while scanning one or more spans
+     */
+    struct Accumulator {
+        uint32_t count = 0;
+        float min = 0;
+        float max = 0;
+        float sum = 0;
+
+        MetricSummary result() const;
+    };
+
+    bool begin(size_t capacity);
+    void release();
+    bool isEnabled() const { return !uptime_column.empty(); }
+
+    /**
+     * Write a record into a ring slot
+     */
+    void set(size_t slot, const SensorRecord& record);
+
+    const uint32_t* uptimes() const { return uptime_column.data(); }
+    const float* values(size_t metric) const { return value_columns[metric].data(); }
+    const uint8_t* flags() const { return flag_column.data(); }
+    size_t getMemoryBytes() const;
+
+    /**
+     * Fold count values into the accumulator, skipping those without the valid flag
+     * Branch-free loop over contiguous arrays so the compiler can vectorize it
+     */
+    static void accumulate(const float* values, const uint8_t* flags, size_t count,
+                           uint8_t valid_mask, Accumulator& accumulator);
+
+private:
+    std::vector<uint32_t> uptime_column;
+    std::vector<float> value_columns[SensorRecord::METRIC_COUNT];
+    std::vector<uint8_t> flag_column;
+};
@@ -0,0 +1,160 @@
+/*
+ * storage/RingCheckpoint.h
+ * Crash-safe snapshot of the raw history ring in a flash file
+ * Only ring pages written since the last checkpoint are rewritten, one per loop pass
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <functional>
+#include "../interfaces/IFileSystem.h"
+#include "SensorRecord.h"
+
+/**
+ * Header in front of every page of ring slots
+ * The ring state at write time tells which sequence number each slot of the page held
+ */
+struct __attribute__((packed)) CheckpointPageHeader {
+    uint32_t magic;              // RingCheckpoint::PAGE_MAGIC
+    uint32_t next_sequence;      // Ring state when the page was written
+    uint32_t first_sequence;
+    uint32_t write_index;
+    uint16_t page;
+    uint16_t crc;                // CRC16 of the header fields above and the page's slots
+};
+
+/**
+ * Checkpoint file metadata, kept in two alternating slots so a torn write
+ * leaves the previous one intact
+ */
+struct __attribute__((packed)) CheckpointMeta {
+    uint32_t magic;              // RingCheckpoint::META_MAGIC
+    uint32_t generation;         // Newest valid slot wins
+    uint32_t floor_sequence;     // Records below this were dropped (retention, clear, format)
+    uint32_t slot_count;         // Ring geometry the pages were written for
+    uint16_t page_records;
+    uint8_t record_format;       // HISTORY_RECORD_FORMAT
+    uint8_t record_size;         // sizeof(SensorRecord)
+    uint16_t crc;                // CRC16 of the fields above
+};
+
+/**
+ * Ring slots and indices handed to RingCheckpoint::step()
+ */
+struct CheckpointRing {
+    const SensorRecord* slots;
+    uint32_t next_sequence;
+    uint32_t first_sequence;     // Oldest record still in the ring
+    size_t write_index;
+};
+
+/**
+ * File layout: [meta A][meta B][page 0 copy A][page 0 copy B][page 1 copy A]... where
+ * page p holds ring slots [p * page_records, (p + 1) * page_records). The file is
+ * preallocated once; a page write overwrites the older of its two copies, so a torn
+ * write (CRC mismatch) falls back to the previous copy of that page.
+ *
+ * Recovery takes the newest sequence found in any valid page and walks back slot by
+ * slot while every slot holds the expected sequence, so pages written at different
+ * times still combine into one contiguous run of records.
+ */
+class RingCheckpoint {
+public:
+    static const uint32_t PAGE_MAGIC = 0x436F4370;         // "CoCp"
+    static const uint32_t META_MAGIC = 0x436F434D;         // "CoCM"
+    static const size_t DEFAULT_PAGE_RECORDS = 16;         // 256 bytes of v2 records per write
+    static const uint32_t DEFAULT_INTERVAL_MS = 60000;
+
+    /**
+     * Write counters
+     */
+    struct Stats {
+        uint32_t rounds = 0;             // Checkpoints started
+        uint32_t pages_written = 0;
+        uint32_t meta_written = 0;
+        uint32_t flash_bytes = 0;
+        uint32_t max_step_us = 0;        // Longest step() so far (one flash write)
+        uint32_t restored_records = 0;
+        uint32_t crc_errors = 0;         // Torn or corrupt page copies found during restore
+    };
+
+    typedef std::function<void(const SensorRecord& record, uint32_t sequence, size_t slot)> RestoreCallback;
+
+    RingCheckpoint(IFileSystem& filesystem, const String& dir, size_t slot_count,
+                   size_t page_size = DEFAULT_PAGE_RECORDS,
+                   uint32_t interval = DEFAULT_INTERVAL_MS);
+
+    /**
+     * Create the directory and the checkpoint file (kept if it matches the ring geometry)
+     */
+    bool begin();
+
+    /**
+     * Return the recovered records oldest first with the slot each one occupied
+     * @return Number of records restored
+     */
+    size_t restore(const RestoreCallback& callback);
+
+    /**
+     * Slot rewritten (O(1)) / ring emptied - the next step() writes the new floor
+     * (records expired one by one are excluded at the next regular round)
+     */
+    void markDirty(size_t slot) { dirty[slot / page_records] = 1; }
+    void markDropped() { meta_dirty = true; }
+
+    /**
+     * Continue the checkpoint: starts a round every interval (or after records were
+     * dropped) and makes one flash write - the metadata or the next dirty page - so a
+     * call costs a single page write (see Stats::max_step_us for what that takes)
+     * @return Pages written
+     */
+    size_t step(const CheckpointRing& ring);
+
+    /**
+     * Write every dirty page and the metadata now (before a restart)
+     */
+    bool checkpointAll(const CheckpointRing& ring);
+
+    /**
+     * Forget all pages - records before floor_sequence are never restored
+     */
+    bool clear(uint32_t floor_sequence);
+
+    size_t getDirtyPages() const;
+    size_t getFileBytes() const { return 2 * sizeof(CheckpointMeta) + 2 * page_count * pageBytes(); }
+    uint32_t getIntervalMs() const { return interval_ms; }
+    void setIntervalMs(uint32_t interval) { interval_ms = interval; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    IFileSystem& fs;
+    String directory;
+    size_t slots;
+    size_t page_records;
+    size_t page_count;
+    uint32_t interval_ms;
+
+    std::vector<uint8_t> dirty;          // One flag per page
+    std::vector<uint8_t> newer_copy;     // Copy (0/1) of each page holding its latest write
+    std::vector<uint8_t> scratch;        // One page (header + slots), assembled before writing
+    size_t scan_page;                    // Round-robin position of the page scan
+    bool round_active;
+    bool meta_dirty;
+    uint32_t round_started;              // millis() of the last round start
+    uint32_t generation;
+    uint32_t written_floor;              // floor_sequence of the newest meta slot on flash
+
+    Stats stats;
+
+    String filePath() const { return directory + "/ring.ckp"; }
+    size_t pageBytes() const { return sizeof(CheckpointPageHeader) + page_records * sizeof(SensorRecord); }
+    size_t pageOffset(size_t page, size_t copy) const {
+        return 2 * sizeof(CheckpointMeta) + (2 * page + copy) * pageBytes();
+    }
+    bool readPage(size_t page, size_t copy, CheckpointPageHeader& header);
+    bool writePage(size_t page, const CheckpointRing& ring);
+    bool writeMeta(uint32_t floor_sequence);
+    bool readMeta(CheckpointMeta& meta);
+    bool createFile();
+};
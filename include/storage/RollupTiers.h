@@ -0,0 +1,101 @@
+/*
+ * storage/RollupTiers.h
+ * Multi-resolution rollups (1 min / 1 h / 1 day) of stored sensor records
+ * Maintained incrementally on every stored reading, each tier with its own retention
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+
+/**
+ * Aggregate of all records that fell into one time bucket
+ */
+struct RollupBucket {
+    uint32_t start_s = 0;                               // Bucket start (uptime seconds)
+    uint32_t count = 0;                                 // Records aggregated
+    uint8_t validity_flags = 0;                         // OR of record validity flags
+    uint8_t alert_level = 0;                            // Highest alert level seen
+    float min[SensorRecord::METRIC_COUNT] = {};
+    float max[SensorRecord::METRIC_COUNT] = {};
+    float mean[SensorRecord::METRIC_COUNT] = {};
+
+    uint64_t getStartUptime() const { return start_s * 1000ULL; }
+
+    /**
+     * Bucket means as a record stamped at the bucket start
+     */
+    SensorRecord toRecord() const;
+};
+
+/**
+ * One rollup resolution: ring of buckets, newest one still open
+ */
+class RollupTier {
+public:
+    RollupTier() : bucket_seconds(60), head(0), used(0), open_counts() {}
+
+    bool begin(uint32_t bucket_length_s, size_t retention_buckets);
+    void clear();
+    bool isEnabled() const { return !buckets.empty(); }
+
+    /**
+     * Fold a record into its bucket (opens a new bucket when the record crosses a boundary)
+     */
+    void add(const SensorRecord& record);
+
+    /**
+     * Buckets overlapping [start_uptime, end_uptime] as logical indices [begin, end)
+     */
+    void findRange(uint64_t start_uptime, uint64_t end_uptime, size_t& begin, size_t& end) const;
+
+    // Logical index 0 = oldest bucket, size() - 1 = open bucket
+    const RollupBucket& at(size_t logical_index) const {
+        return buckets[(head + logical_index) % buckets.size()];
+    }
+    size_t size() const { return used; }
+    size_t getCapacity() const { return buckets.size(); }
+    uint32_t getBucketSeconds() const { return bucket_seconds; }
+    bool getOldestUptime(uint64_t& uptime) const;
+
+private:
+    std::vector<RollupBucket> buckets;
+    uint32_t bucket_seconds;
+    size_t head;                                        // Slot of the oldest bucket
+    size_t used;                                        // Buckets in use, including the open one
+    uint32_t open_counts[SensorRecord::METRIC_COUNT];   // Per-metric samples in the open bucket
+
+    RollupBucket& openBucket() {
+        return buckets[(head + used - 1) % buckets.size()];
+    }
+    void startBucket(uint32_t start_s);
+};
+
+/**
+ * Fixed set of rollup tiers, finest first
+ */
+class RollupTiers {
+public:
+    static const size_t TIER_COUNT = 3;
+    static const uint32_t TIER_SECONDS[TIER_COUNT];             // 60, 3600, 86400
+
+    // Default retention: 4 hours of minutes, 7 days of hours, 60 days
+    static const size_t DEFAULT_MINUTE_BUCKETS = 240;
+    static const size_t DEFAULT_HOUR_BUCKETS = 168;
+    static const size_t DEFAULT_DAY_BUCKETS = 60;
+
+    bool begin(size_t minute_buckets = DEFAULT_MINUTE_BUCKETS,
+               size_t hour_buckets = DEFAULT_HOUR_BUCKETS,
+               size_t day_buckets = DEFAULT_DAY_BUCKETS);
+    void clear();
+    bool isEnabled() const { return tiers[0].isEnabled(); }
+
+    void add(const SensorRecord& record);
+
+    const RollupTier& tier(size_t index) const { return tiers[index]; }
+    size_t getMemoryBytes() const;
+
+private:
+    RollupTier tiers[TIER_COUNT];
+};
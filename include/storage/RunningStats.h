@@ -0,0 +1,108 @@
+/*
+ * storage/RunningStats.h
+ * Incrementally maintained per-metric statistics over rolling windows
+ * (last hour, last 24 hours, since boot) - O(1) per stored reading
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "SensorRecord.h"
+#include "RecordColumns.h"
+
+/**
+ * Count, mean, Welford M2 and min/max of one metric
+ * Two sets of moments can be merged, and a merged-in part subtracted again
+ * (min/max cannot be subtracted - the owner rescans them)
+ */
+struct MetricMoments {
+    uint32_t count = 0;
+    double mean = 0;
+    double m2 = 0;               // Sum of squared deviations from the mean
+    float min = 0;
+    float max = 0;
+
+    void add(float value);
+    void merge(const MetricMoments& other);
+    void subtract(const MetricMoments& part);
+
+    double sum() const { return mean * count; }
+    float variance() const { return count > 1 ? m2 / (count - 1) : 0.0f; }   // Sample variance
+    float stddev() const;
+    MetricSummary summary() const;
+};
+
+/**
+ * Rolling window made of fixed-length slices (a small rollup of its own)
+ * Readings are added to the open slice and to the window totals; a slice that
+ * falls out of the window is subtracted from the totals. slice_count 0 = never expires.
+ * Metrics without their validity flag, and NaN values, are skipped.
+ */
+class StatsWindow {
+public:
+    StatsWindow() : slice_seconds(0), head(0), used(0) {}
+
+    bool begin(uint32_t slice_length_s, size_t slice_count);
+    void clear();
+
+    void add(uint32_t uptime_s, const float values[SensorRecord::METRIC_COUNT], uint8_t validity_flags);
+
+    const MetricMoments& metric(size_t index) const { return totals[index]; }
+    uint32_t getSpanSeconds() const { return slice_seconds * slices.size(); }   // 0 = unbounded
+    size_t getMemoryBytes() const { return slices.size() * sizeof(Slice); }
+
+    /**
+     * Change per hour between the oldest and newest slice means (0 without two slices)
+     */
+    float getTrend(size_t metric) const;
+
+private:
+    struct Slice {
+        uint32_t start_s = 0;
+        MetricMoments metrics[SensorRecord::METRIC_COUNT];
+    };
+
+    uint32_t slice_seconds;
+    std::vector<Slice> slices;   // Ring, empty for an unbounded window
+    size_t head;                 // Slot of the oldest slice
+    size_t used;
+    MetricMoments totals[SensorRecord::METRIC_COUNT];
+
+    const Slice& at(size_t logical_index) const { return slices[(head + logical_index) % slices.size()]; }
+    void expireBefore(uint32_t start_s);
+    void rescanExtremes(size_t metric);
+};
+
+/**
+ * Fixed set of statistics windows fed by HistoricalDataStorage::storeReading()
+ */
+class RunningStatistics {
+public:
+    enum Window {
+        LAST_HOUR = 0,
+        LAST_DAY = 1,
+        SINCE_BOOT = 2,
+        WINDOW_COUNT = 3
+    };
+
+    // Last hour in 5 minute slices, last day in hourly slices
+    static const uint32_t HOUR_SLICE_SECONDS = 300;
+    static const uint32_t DAY_SLICE_SECONDS = 3600;
+
+    RunningStatistics() : enabled(false) {}
+
+    bool begin();
+    void clear();
+    bool isEnabled() const { return enabled; }
+
+    void add(const SensorRecord& record);
+
+    const MetricMoments& get(Window window, size_t metric) const { return windows[window].metric(metric); }
+    MetricSummary summary(Window window, size_t metric) const { return get(window, metric).summary(); }
+    float getTrend(size_t metric) const { return windows[LAST_HOUR].getTrend(metric); }
+    size_t getMemoryBytes() const;
+
+private:
+    bool enabled;
+    StatsWindow windows[WINDOW_COUNT];
+};
@@ -0,0 +1,135 @@
+/*
+ * storage/SegmentLog.h
+ * Append-only, segment-rotating record log for persistent history on flash
+ * Each record carries a CRC16; writes are batched to touch flash once per N records
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <functional>
+#include "../interfaces/IFileSystem.h"
+#include "SensorRecord.h"
+
+/**
+ * Header at the start of every segment file
+ */
+struct __attribute__((packed)) SegmentHeader {
+    uint32_t magic;              // SegmentLog::SEGMENT_MAGIC
+    uint8_t version;             // SegmentLog::SEGMENT_VERSION
+    uint8_t record_format;       // HISTORY_RECORD_FORMAT the records were written with
+    uint16_t record_size;        // sizeof(SensorRecord)
+    uint32_t first_sequence;     // Sequence number of the first entry
+    uint32_t reserved;
+};
+
+/**
+ * Log of fixed-size segment files: /history/seg_00000001.log, seg_00000002.log, ...
+ * Entries are [SensorRecord][CRC16]. Full segments are never rewritten; the oldest
+ * segment is deleted when the segment budget is exceeded, so wear rotates across
+ * the whole budget instead of hammering one file.
+ */
+class SegmentLog {
+public:
+    static const uint32_t SEGMENT_MAGIC = 0x436F5367;      // "CoSg"
+    static const uint8_t SEGMENT_VERSION = 1;
+    static const size_t ENTRY_BYTES = sizeof(SensorRecord) + sizeof(uint16_t);
+    static const size_t DEFAULT_SEGMENT_BYTES = 16384;      // 4 LittleFS blocks
+    static const size_t DEFAULT_MAX_SEGMENTS = 32;          // 512KB of flash
+    static const size_t DEFAULT_BATCH_RECORDS = 30;         // ~5 minutes at 10s sampling
+    static const size_t MAX_PENDING_BATCHES = 4;            // Unwritten batches kept for retry
+
+    /**
+     * Write counters for wear / write-amplification tracking
+     */
+    struct Stats {
+        uint32_t records_appended = 0;
+        uint32_t payload_bytes = 0;      // Raw record bytes handed to the log
+        uint32_t flash_bytes = 0;        // Bytes written including headers and CRCs
+        uint32_t flushes = 0;            // Flash write operations
+        uint32_t segments_created = 0;
+        uint32_t segments_dropped = 0;
+        uint32_t crc_errors = 0;         // Corrupt entries found during replay
+        uint32_t write_errors = 0;       // Failed flash writes (the tail is retried)
+        uint32_t records_lost = 0;       // Dropped from a full retry queue or across a gap
+
+        float getWriteAmplification() const {
+            return payload_bytes > 0 ? (float)flash_bytes / payload_bytes : 0;
+        }
+    };
+
+    typedef std::function<void(const SensorRecord& record, uint32_t sequence)> ReplayCallback;
+
+    SegmentLog(IFileSystem& filesystem, const String& dir = "/history",
+               size_t segment_size = DEFAULT_SEGMENT_BYTES,
+               size_t segment_limit = DEFAULT_MAX_SEGMENTS,
+               size_t batch_size = DEFAULT_BATCH_RECORDS);
+
+    /**
+     * Create the directory and index existing segments
+     */
+    bool begin();
+
+    /**
+     * Read every valid entry, oldest first (stops a segment at the first bad CRC)
+     * @return Number of records replayed
+     */
+    size_t replay(const ReplayCallback& callback);
+
+    /**
+     * Queue a record; flushes automatically once a batch is full
+     * If flash is failing the batch stays queued and is retried on every append,
+     * up to MAX_PENDING_BATCHES batches - beyond that the oldest records are dropped
+     * @param sequence Record sequence number (a gap starts a new segment)
+     * @return false if a flush was attempted and failed
+     */
+    bool append(const SensorRecord& record, uint32_t sequence);
+
+    /**
+     * Write queued records to flash; whatever could not be written stays queued
+     */
+    bool flush();
+
+    /**
+     * Delete all segments
+     */
+    bool clear();
+
+    /**
+     * Delete closed segments whose newest record is older than uptime
+     */
+    void dropBefore(uint64_t uptime);
+
+    size_t getPendingRecords() const { return pending_records; }
+    size_t getSegmentCount() const { return segment_ids.size(); }
+    size_t getCapacityBytes() const { return segment_bytes * max_segments; }
+    size_t getBatchRecords() const { return batch_records; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    IFileSystem& fs;
+    String directory;
+    size_t segment_bytes;
+    size_t max_segments;
+    size_t batch_records;
+
+    std::vector<uint32_t> segment_ids;   // Oldest first
+    uint32_t next_segment_id;
+
+    // Segment currently being appended to
+    bool open_writable;
+    size_t open_segment_bytes;
+    uint32_t open_end_sequence;          // Sequence the next entry must have
+
+    // Batch waiting for the next flush
+    std::vector<uint8_t> pending;
+    size_t pending_records;
+    uint32_t pending_first_sequence;
+
+    Stats stats;
+
+    String segmentPath(uint32_t id) const;
+    bool startSegment(uint32_t first_sequence);
+    bool readHeader(uint32_t id, SegmentHeader& header);
+    size_t entriesPerSegment() const { return (segment_bytes - sizeof(SegmentHeader)) / ENTRY_BYTES; }
+};
@@ -0,0 +1,311 @@
+/*
+ * storage/SensorRecord.h
+ * Fixed-size sensor record stored in the history ring and archive blocks
+ *
+ * Two layouts, selected at compile time with HISTORY_RECORD_FORMAT:
+ *   1 - legacy float record (uptime seconds + five floats), 28 bytes
+ *   2 - quantized fixed-point record, 16 bytes (default)
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "../types/SensorData.h"
+
+#ifndef HISTORY_RECORD_FORMAT
+#define HISTORY_RECORD_FORMAT 2
+#endif
+
+#if HISTORY_RECORD_FORMAT != 1 && HISTORY_RECORD_FORMAT != 2
+#error "HISTORY_RECORD_FORMAT must be 1 (float) or 2 (quantized)"
+#endif
+
+/**
+ * Compact sensor record for efficient storage
+ * Fixed size structure for optimal flash storage
+ * Always access values through the getters/setters so both layouts work
+ */
+// no need to use PM sensor data
+struct __attribute__((packed)) SensorRecord {
+#if HISTORY_RECORD_FORMAT == 1
+    uint32_t uptime_s;           // Storage clock in seconds (4 bytes, no wrap for ~136 years)
+    float co2;                   // CO2 in ppm (4 bytes)
+    float temperature;           // Temperature in °C (4 bytes)
+    float humidity;              // Humidity in % (4 bytes)
+    float pressure;              // Pressure in hPa (4 bytes)
+    float voc;                   // VOC index/estimate (4 bytes)
+#else
+    uint32_t uptime_s;           // Storage clock in seconds (4 bytes, no wrap for ~136 years)
+    uint16_t co2_ppm;            // CO2 in ppm (2 bytes)
+    int16_t temperature_centi;   // Temperature in 0.01 °C (2 bytes)
+    uint16_t humidity_centi;     // Humidity in 0.01 % (2 bytes)
+    int16_t pressure_offset_pa;  // Pressure in Pa relative to PRESSURE_BASE_PA (2 bytes, see PRESSURE_NONE)
+    uint16_t voc_deci;           // VOC estimate in 0.1 ppb (2 bytes, see VOC_NONE)
+#endif
+    uint8_t validity_flags;      // Bit flags for data validity (1 byte)
+    uint8_t alert_level;         // Overall alert level (1 byte)
+#if HISTORY_RECORD_FORMAT == 1
+    uint8_t reserved[2];         // Reserved for future use (2 bytes)
+    // Total: 28 bytes per record
+#else
+    // Total: 16 bytes per record
+#endif
+
+    // Validity flag bits
+    static const uint8_t FLAG_CO2_VALID = 0x01;
+    static const uint8_t FLAG_TEMP_VALID = 0x02;
+    static const uint8_t FLAG_HUMIDITY_VALID = 0x04;
+    static const uint8_t FLAG_PRESSURE_VALID = 0x08;
+    static const uint8_t FLAG_VOC_VALID = 0x10;
+    static const uint8_t FLAG_HELD = 0x40;           // Deadband run end: values held since the previous record
+    static const uint8_t FLAG_OVERALL_VALID = 0x80;
+
+    // Metric indices for getRawValue()/setRawValue()
+    static const size_t METRIC_CO2 = 0;
+    static const size_t METRIC_TEMPERATURE = 1;
+    static const size_t METRIC_HUMIDITY = 2;
+    static const size_t METRIC_PRESSURE = 3;
+    static const size_t METRIC_VOC = 4;
+    static const size_t METRIC_COUNT = 5;
+
+#if HISTORY_RECORD_FORMAT == 2
+    static const int32_t PRESSURE_BASE_PA = 101325;  // Standard atmosphere
+    // Offsets cover 685.58 - 1340.92 hPa (sea level up to ~3200 m); pressure outside that
+    // range is stored as PRESSURE_NONE, reads back as NaN and is not flagged valid
+    static const int16_t PRESSURE_NONE = INT16_MIN;
+    // VOC estimates cover 0 - 6553.4 ppb; higher ones (gas resistance below ~380 Ohm)
+    // are stored as VOC_NONE, read back as NaN and are not flagged valid
+    static const uint16_t VOC_NONE = UINT16_MAX;
+#endif
+
+    /**
+     * Default constructor - initialize with safe values
+     */
+    SensorRecord() : validity_flags(0), alert_level(0) {
+#if HISTORY_RECORD_FORMAT == 1
+        uptime_s = 0;
+        co2 = temperature = humidity = pressure = voc = 0.0;
+        reserved[0] = reserved[1] = 0;
+#else
+        uptime_s = 0;
+        co2_ppm = 0;
+        temperature_centi = 0;
+        humidity_centi = 0;
+        pressure_offset_pa = 0;
+        voc_deci = 0;
+#endif
+    }
+
+    /**
+     * Constructor from sensor data objects
+     */
+    SensorRecord(uint64_t record_uptime,
+                const CO2SensorData* co2_data = nullptr,
+                const VOCSensorData* voc_data = nullptr)
+        : SensorRecord() {
+
+        setUptime(record_uptime);
+
+        // Fill from CO2 sensor data
+        if (co2_data && co2_data->isValid()) {
+            setCo2(co2_data->co2);
+            setTemperature(co2_data->temperature);
+            setHumidity(co2_data->humidity);
+            validity_flags |= FLAG_CO2_VALID | FLAG_TEMP_VALID | FLAG_HUMIDITY_VALID;
+            alert_level = max(alert_level, (uint8_t)co2_data->getAlertLevel());
+        }
+
+        // Fill from VOC sensor data (override temp/humidity if available)
+        if (voc_data && voc_data->isValid()) {
+            if (!co2_data || !co2_data->isValid()) { // Use VOC temp/humidity if CO2 not available
+                setTemperature(voc_data->temperature);
+                setHumidity(voc_data->humidity);
+                validity_flags |= FLAG_TEMP_VALID | FLAG_HUMIDITY_VALID;
+            }
+            setPressure(voc_data->pressure / 100.0); // Convert Pa to hPa
+            setVoc(voc_data->vocEstimate);
+            if (!isnan(getPressure())) {
+                validity_flags |= FLAG_PRESSURE_VALID;   // Not when outside the stored range
+            }
+            if (!isnan(getVoc())) {
+                validity_flags |= FLAG_VOC_VALID;
+            }
+            alert_level = max(alert_level, (uint8_t)voc_data->getAlertLevel());
+        }
+
+        // Set overall validity if any sensor data is valid
+        if (validity_flags != 0) {
+            validity_flags |= FLAG_OVERALL_VALID;
+        }
+    }
+
+    // ================================
+    // VALUE ACCESSORS
+    // ================================
+
+#if HISTORY_RECORD_FORMAT == 1
+    uint64_t getUptime() const { return uptime_s * 1000ULL; }
+    float getCo2() const { return co2; }
+    float getTemperature() const { return temperature; }
+    float getHumidity() const { return humidity; }
+    float getPressure() const { return pressure; }
+    float getVoc() const { return voc; }
+
+    void setUptime(uint64_t value) { uptime_s = value / 1000ULL; }
+    void setCo2(float value) { co2 = value; }
+    void setTemperature(float value) { temperature = value; }
+    void setHumidity(float value) { humidity = value; }
+    void setPressure(float value) { pressure = value; }
+    void setVoc(float value) { voc = value; }
+#else
+    uint64_t getUptime() const { return uptime_s * 1000ULL; }
+    float getCo2() const { return co2_ppm; }
+    float getTemperature() const { return temperature_centi / 100.0f; }
+    float getHumidity() const { return humidity_centi / 100.0f; }
+    float getPressure() const {
+        return pressure_offset_pa == PRESSURE_NONE ? NAN : (PRESSURE_BASE_PA + pressure_offset_pa) / 100.0f;
+    }
+    float getVoc() const { return voc_deci == VOC_NONE ? NAN : voc_deci / 10.0f; }
+
+    void setUptime(uint64_t value) { uptime_s = value / 1000ULL; }
+    void setCo2(float value) { co2_ppm = quantizeUnsigned(value, 1.0f); }
+    void setTemperature(float value) { temperature_centi = quantizeSigned(value, 100.0f); }
+    void setHumidity(float value) { humidity_centi = quantizeUnsigned(value, 100.0f); }
+    void setPressure(float value) {
+        float offset = roundf(value * 100.0f - PRESSURE_BASE_PA);
+        pressure_offset_pa = (offset > PRESSURE_NONE && offset <= INT16_MAX) ? (int16_t)offset : PRESSURE_NONE;
+    }
+    void setVoc(float value) {
+        float scaled = roundf(value * 10.0f);
+        voc_deci = (scaled < VOC_NONE) ? quantizeUnsigned(value, 10.0f) : VOC_NONE;
+    }
+#endif
+
+    /**
+     * Native time field (storage clock seconds in both layouts)
+     * Used by the block codec so deltas stay small
+     */
+    uint32_t getRawTime() const { return uptime_s; }
+
+    void setRawTime(uint32_t value) { uptime_s = value; }
+
+    static uint64_t rawTimeToUptime(uint32_t raw_time) { return raw_time * 1000ULL; }
+
+    /**
+     * Native bits of one metric (float bits for format 1, sign-extended integer for format 2)
+     */
+    uint32_t getRawValue(size_t metric) const {
+#if HISTORY_RECORD_FORMAT == 1
+        float value;
+        switch (metric) {
+            case METRIC_CO2: value = co2; break;
+            case METRIC_TEMPERATURE: value = temperature; break;
+            case METRIC_HUMIDITY: value = humidity; break;
+            case METRIC_PRESSURE: value = pressure; break;
+            default: value = voc; break;
+        }
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+#else
+        switch (metric) {
+            case METRIC_CO2: return co2_ppm;
+            case METRIC_TEMPERATURE: return (uint32_t)(int32_t)temperature_centi;
+            case METRIC_HUMIDITY: return humidity_centi;
+            case METRIC_PRESSURE: return (uint32_t)(int32_t)pressure_offset_pa;
+            default: return voc_deci;
+        }
+#endif
+    }
+
+    void setRawValue(size_t metric, uint32_t bits) {
+#if HISTORY_RECORD_FORMAT == 1
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        switch (metric) {
+            case METRIC_CO2: co2 = value; break;
+            case METRIC_TEMPERATURE: temperature = value; break;
+            case METRIC_HUMIDITY: humidity = value; break;
+            case METRIC_PRESSURE: pressure = value; break;
+            default: voc = value; break;
+        }
+#else
+        switch (metric) {
+            case METRIC_CO2: co2_ppm = bits; break;
+            case METRIC_TEMPERATURE: temperature_centi = (int16_t)bits; break;
+            case METRIC_HUMIDITY: humidity_centi = bits; break;
+            case METRIC_PRESSURE: pressure_offset_pa = (int16_t)bits; break;
+            default: voc_deci = bits; break;
+        }
+#endif
+    }
+
+    /**
+     * Value of one metric by index (METRIC_CO2 ... METRIC_VOC)
+     */
+    float getValue(size_t metric) const {
+        switch (metric) {
+            case METRIC_TEMPERATURE: return getTemperature();
+            case METRIC_HUMIDITY: return getHumidity();
+            case METRIC_PRESSURE: return getPressure();
+            case METRIC_VOC: return getVoc();
+            default: return getCo2();
+        }
+    }
+
+    /**
+     * Validity flag belonging to a metric index
+     */
+    static uint8_t metricFlag(size_t metric) {
+        static const uint8_t flags[METRIC_COUNT] = {
+            FLAG_CO2_VALID, FLAG_TEMP_VALID, FLAG_HUMIDITY_VALID, FLAG_PRESSURE_VALID, FLAG_VOC_VALID
+        };
+        return metric < METRIC_COUNT ? flags[metric] : 0;
+    }
+
+    /**
+     * Short key of a metric index in history messages ("c", "T", "h", "p", "v")
+     */
+    static const char* metricKey(size_t metric) {
+        static const char* const keys[METRIC_COUNT] = { "c", "T", "h", "p", "v" };
+        return metric < METRIC_COUNT ? keys[metric] : "";
+    }
+
+    /**
+     * Check if record is valid (has any sensor data)
+     */
+    bool isValid() const {
+        return (validity_flags & FLAG_OVERALL_VALID) != 0;
+    }
+
+    /**
+     * Get overall alert level
+     */
+    AlertLevel getAlertLevel() const {
+        return static_cast<AlertLevel>(alert_level);
+    }
+
+private:
+#if HISTORY_RECORD_FORMAT == 2
+    // Round to fixed point and clamp to the field range (NaN becomes 0)
+    static uint16_t quantizeUnsigned(float value, float scale) {
+        float scaled = roundf(value * scale);
+        if (!(scaled > 0)) return 0;
+        if (scaled > 65535) return 65535;
+        return (uint16_t)scaled;
+    }
+
+    static int16_t quantizeSigned(float value, float scale) {
+        float scaled = roundf(value * scale);
+        if (isnan(scaled)) return 0;
+        if (scaled < -32768) return -32768;
+        if (scaled > 32767) return 32767;
+        return (int16_t)scaled;
+    }
+#endif
+};
+
+#if HISTORY_RECORD_FORMAT == 1
+static_assert(sizeof(SensorRecord) == 28, "Float SensorRecord must stay 28 bytes");
+#else
+static_assert(sizeof(SensorRecord) == 16, "Quantized SensorRecord must stay 16 bytes");
+#endif
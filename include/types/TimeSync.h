@@ -6,15 +6,30 @@
 #pragma once
 #include <Arduino.h>
 
+/**
+ * millis() extended to 64 bits - counts the 49.7 day wraps of the 32-bit counter
+ * Must be called at least once per wrap period (every stored reading does)
+ */
+inline uint64_t millis64() {
+    static uint32_t last_millis = 0;
+    static uint32_t wraps = 0;
+    uint32_t now = millis();
+    if (now < last_millis) {
+        wraps++;
+    }
+    last_millis = now;
+    return ((uint64_t)wraps << 32) | now;
+}
+
 /**
  * Time synchronization management for ESP32 devices without RTC
  * Maps Unix timestamps to ESP32 uptime for historical data retrieval
  */
 struct TimeSync {
     bool has_time = false;              // Whether time has been synchronized
-    unsigned long sync_uptime = 0;      // ESP32 uptime when sync occurred (ms)
+    uint64_t sync_uptime = 0;           // ESP32 uptime when sync occurred (ms, millis64)
     uint64_t time_offset = 0;           // Unix timestamp - uptime offset
-    unsigned long last_sync_uptime = 0; // Last successful sync uptime
+    uint64_t last_sync_uptime = 0;      // Last successful sync uptime
     String timezone_offset = "+0000";   // Timezone offset string (e.g., "+0300")
     
     /**
@@ -23,7 +38,7 @@ struct TimeSync {
      */
     uint64_t getCurrentTimestamp() const {
         if (!has_time) return 0;
-        return millis() + time_offset;
+        return millis64() + time_offset;
     }
     
     /**
@@ -31,9 +46,9 @@ struct TimeSync {
      * @param timestamp Unix timestamp in milliseconds
      * @return ESP32 uptime in milliseconds, or 0 if not synced
      */
-    unsigned long timestampToUptime(uint64_t timestamp) const {
+    uint64_t timestampToUptime(uint64_t timestamp) const {
         if (!has_time || timestamp < time_offset) return 0;
-        return (unsigned long)(timestamp - time_offset);
+        return timestamp - time_offset;
     }
     
     /**
@@ -41,7 +56,7 @@ struct TimeSync {
      * @param uptime ESP32 uptime in milliseconds
      * @return Unix timestamp in milliseconds, or 0 if not synced
      */
-    uint64_t uptimeToTimestamp(unsigned long uptime) const {
+    uint64_t uptimeToTimestamp(uint64_t uptime) const {
         if (!has_time) return 0;
         return uptime + time_offset;
     }
@@ -53,7 +68,7 @@ struct TimeSync {
      * @return true if sync successful
      */
     bool synchronizeTime(uint64_t current_timestamp, const String& timezone_str = "+0000") {
-        unsigned long current_uptime = millis();
+        uint64_t current_uptime = millis64();
         
         // Basic validation
         if (current_timestamp < 1600000000000ULL) { // Before 2020
@@ -67,8 +82,9 @@ struct TimeSync {
         timezone_offset = timezone_str;
         has_time = true;
         
-        Serial.printf("⏰ Time synchronized: Offset=%llu, Uptime=%lu, Timestamp=%llu\n", 
-                     time_offset, current_uptime, current_timestamp);
+        Serial.printf("⏰ Time synchronized: Offset=%llu, Uptime=%llu, Timestamp=%llu\n", 
+                     (unsigned long long)time_offset, (unsigned long long)current_uptime,
+                     (unsigned long long)current_timestamp);
         
         return true;
     }
@@ -81,8 +97,8 @@ struct TimeSync {
     bool isSyncStale(uint8_t max_age_hours = 24) const {
         if (!has_time) return true;
         
-        unsigned long age_ms = millis() - last_sync_uptime;
-        unsigned long max_age_ms = max_age_hours * 3600000UL; // hours to ms
+        uint64_t age_ms = millis64() - last_sync_uptime;
+        uint64_t max_age_ms = max_age_hours * 3600000ULL; // hours to ms
         
         return age_ms > max_age_ms;
     }
@@ -93,7 +109,7 @@ struct TimeSync {
      */
     uint32_t getSyncAgeMinutes() const {
         if (!has_time) return 0;
-        return (millis() - last_sync_uptime) / 60000;
+        return (millis64() - last_sync_uptime) / 60000;
     }
     
     /**
@@ -135,6 +151,141 @@ struct TimeSync {
     }
 };
 
+/**
+ * One boot of the device on the storage clock (history restored from flash/SD keeps
+ * the storage clock monotonic across reboots, see HistoricalDataStorage)
+ */
+struct __attribute__((packed)) BootEpoch {
+    uint64_t start_uptime;              // Storage uptime when the boot started (ms)
+    uint64_t time_offset;               // Unix ms - storage uptime during the boot, 0 = never synced
+    uint32_t boot_id;                   // Random per boot, names the sequence space for incremental sync
+    uint32_t start_sequence;            // First record sequence of the boot
+};
+
+/**
+ * Per-boot time offsets, oldest boot first
+ * A record belongs to the last epoch starting at or before its storage uptime, so
+ * records need no epoch tag. Boots that were never synchronized borrow the offset of
+ * the nearest later synced boot (as if there had been no downtime), which keeps
+ * timestamps in storage order; an earlier synced boot is the fallback.
+ */
+struct BootEpochTable {
+    static const size_t MAX_EPOCHS = 32;
+
+    BootEpoch epochs[MAX_EPOCHS];
+    uint8_t count = 0;
+
+    /**
+     * Start a new epoch (the oldest one is dropped when the table is full)
+     */
+    void begin(uint64_t start_uptime, uint32_t start_sequence, uint32_t boot_id) {
+        if (count == MAX_EPOCHS) {
+            memmove(epochs, epochs + 1, (MAX_EPOCHS - 1) * sizeof(BootEpoch));
+            count--;
+        }
+        epochs[count].start_uptime = start_uptime;
+        epochs[count].time_offset = 0;
+        epochs[count].boot_id = boot_id;
+        epochs[count].start_sequence = start_sequence;
+        count++;
+    }
+
+    /**
+     * Move the start of the current epoch (restored history advanced the storage clock
+     * and the sequence numbers)
+     */
+    void setCurrentStart(uint64_t start_uptime, uint32_t start_sequence) {
+        if (count == 0) return;
+        epochs[count - 1].start_uptime = start_uptime;
+        epochs[count - 1].start_sequence = start_sequence;
+    }
+
+    const BootEpoch& current() const { return epochs[count - 1]; }
+
+    /**
+     * Index of the epoch with a boot id, count if not in the table
+     */
+    size_t findBoot(uint32_t boot_id) const {
+        for (size_t i = count; i-- > 0;) {
+            if (epochs[i].boot_id == boot_id) return i;
+        }
+        return count;
+    }
+
+    /**
+     * Record the current boot's offset
+     * @return true if it changed by more than a second (worth persisting)
+     */
+    bool setCurrentOffset(uint64_t time_offset) {
+        if (count == 0 || time_offset == 0) return false;
+        BootEpoch& current = epochs[count - 1];
+        uint64_t drift = time_offset > current.time_offset ? time_offset - current.time_offset
+                                                            : current.time_offset - time_offset;
+        current.time_offset = time_offset;
+        return drift > 1000;
+    }
+
+    /**
+     * Epoch holding a storage uptime (the first one for uptimes before all epochs)
+     */
+    size_t find(uint64_t uptime) const {
+        size_t index = count;
+        while (index > 1 && epochs[index - 1].start_uptime > uptime) {
+            index--;
+        }
+        return index > 0 ? index - 1 : 0;
+    }
+
+    /**
+     * Offset used for an epoch
+     * @param current_offset Live offset of the current boot (overrides the table), 0 = none
+     * @return Offset in ms, or 0 if no boot was ever synchronized
+     */
+    uint64_t offsetOf(size_t index, uint64_t current_offset) const {
+        for (size_t i = index; i < count; i++) {
+            uint64_t offset = (i == (size_t)count - 1 && current_offset) ? current_offset : epochs[i].time_offset;
+            if (offset) return offset;
+        }
+        for (size_t i = index; i-- > 0;) {
+            if (epochs[i].time_offset) return epochs[i].time_offset;
+        }
+        return 0;
+    }
+
+    /**
+     * Storage uptime to Unix timestamp (ms), 0 if unknown
+     */
+    uint64_t toTimestamp(uint64_t uptime, uint64_t current_offset) const {
+        if (count == 0) {
+            return current_offset ? uptime + current_offset : 0;
+        }
+        uint64_t offset = offsetOf(find(uptime), current_offset);
+        return offset ? uptime + offset : 0;
+    }
+
+    /**
+     * Unix timestamp (ms) to storage uptime, 0 if before all known history or unknown
+     * A timestamp in the downtime after an epoch maps to the end of that epoch.
+     */
+    uint64_t toUptime(uint64_t timestamp, uint64_t current_offset) const {
+        if (count == 0) {
+            return current_offset && timestamp >= current_offset ? timestamp - current_offset : 0;
+        }
+        for (size_t i = count; i-- > 0;) {
+            uint64_t offset = offsetOf(i, current_offset);
+            if (offset == 0) return 0;
+            if (timestamp < offset + epochs[i].start_uptime) continue;
+
+            uint64_t uptime = timestamp - offset;
+            if (i + 1 < count && uptime >= epochs[i + 1].start_uptime) {
+                uptime = epochs[i + 1].start_uptime - 1;
+            }
+            return uptime;
+        }
+        return 0;
+    }
+};
+
 /**
  * Time range specification for historical data queries
  */
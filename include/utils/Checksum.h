@@ -0,0 +1,21 @@
+/*
+ * utils/Checksum.h
+ * Small checksums for persisted records and protocol frames
+ */
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+ * @param crc Running value, pass the previous result to checksum data in pieces
+ */
+inline uint16_t crc16Ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
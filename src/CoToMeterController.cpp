@@ -2,8 +2,10 @@
 #include "sensors/SCD41Sensor.h"
 #include "sensors/BME688Sensor.h"
 #include "display/SSD1351Display.h" 
+#include "storage/FileSystems.h"
 #include <Wire.h>
 #include <SPI.h>
+#include <LittleFS.h>
 
 CoToMeterController::CoToMeterController() 
     : lastMeasurement(0)
@@ -95,10 +97,44 @@ bool CoToMeterController::initialize() {
         // ✅ ENABLE HISTORICAL DATA IMMEDIATELY (before time sync)
         BluetoothComm* btComm = static_cast<BluetoothComm*>(communication.get());
         if (btComm) {
-            Serial.println("📊 Enabling RAM-only historical data storage...");
-            if (btComm->enableHistoricalData(600)) {  // 600 records (~1.7 hours)
-                Serial.println("✅ RAM-only historical data enabled - fast operation");
-                Serial.println("⚠️  Data will be lost on power cycle/reboot");
+            Serial.println("📊 Enabling historical data storage...");
+            // Raw ring lives in .bss (sized at compile time) so the heap stays flat from boot
+            static StaticHistoricalDataStorage<HISTORY_RING_RECORDS> historyStorage("ram_only");
+            if (btComm->enableHistoricalData(historyStorage)) {  // Raw ring (~1.7h float / ~2.9h quantized) + compressed archive
+                Serial.println("✅ Historical data enabled - fast operation");
+                
+#if HISTORY_DEADBAND
+                // Steady readings collapse into runs - many more hours fit in the ring
+                if (btComm->enableHistoryDeadband()) {
+                    Serial.println("✅ History stores changes only (deadband)");
+                }
+#endif
+                
+                // Persist to LittleFS so history survives reboots (restored before the first reading)
+                static ArduinoFileSystem historyFs(LittleFS, "littlefs");
+#if HISTORY_CHECKPOINT_SECONDS
+                // Changed ring pages only, every few seconds - survives crashes and watchdog resets
+                if (LittleFS.begin(true) &&
+                    btComm->enableHistoryCheckpoint(historyFs, HISTORY_CHECKPOINT_SECONDS * 1000UL)) {
+                    Serial.println("✅ History checkpointed to LittleFS");
+                } else {
+                    Serial.println("⚠️  LittleFS unavailable - data will be lost on power cycle/reboot");
+                }
+#else
+                if (LittleFS.begin(true) && btComm->enableHistoryPersistence(historyFs)) {
+                    Serial.println("✅ History persisted to LittleFS");
+                } else {
+                    Serial.println("⚠️  LittleFS unavailable - data will be lost on power cycle/reboot");
+                }
+#endif
+                
+#if HISTORY_SD_ARCHIVE
+                // Long-term raw history on SD card (daily partitions), if a card is inserted
+                IFileSystem* sdFs = StorageFactory::getSDCardFileSystem();
+                if (sdFs && btComm->enableHistoryArchive(*sdFs)) {
+                    Serial.println("✅ History archived to SD card");
+                }
+#endif
             } else {
                 Serial.println("⚠️  Historical data storage failed to initialize");
             }
@@ -158,12 +194,11 @@ void CoToMeterController::loop() {
             }
             // Send data via communication and store historical data
             if (communication && communication->isConnected()) {
-                if (co2Data && co2Data->isValid()) {
-                    communication->sendSensorData(*(SensorDataBase*)(co2Data));
-                }
-                if (vocData && vocData->isValid()) {
-                    communication->sendSensorData(*(SensorDataBase*)(vocData));
-                }
+                // Both sensors in one message - shared timestamp, temperature and humidity once
+                communication->sendSnapshot(
+                    (co2Data && co2Data->isValid()) ? co2Data : nullptr,
+                    (vocData && vocData->isValid()) ? vocData : nullptr
+                );
                 
                 // Store current reading for historical data
                 BluetoothComm* btComm = static_cast<BluetoothComm*>(communication.get());
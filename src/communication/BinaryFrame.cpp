@@ -0,0 +1,211 @@
+/*
+ * communication/BinaryFrame.cpp
+ * Implementation of the COBS/CRC16 frame encoder and decoder
+ */
+
+#include "communication/BinaryFrame.h"
+#include "utils/Checksum.h"
+
+// ================================
+// ENCODER
+// ================================
+
+void FrameEncoder::begin(uint8_t type) {
+    block_length = 0;
+    crc = 0xFFFF;
+    payload_bytes = 0;
+    wire_bytes = 0;
+    open = true;
+    write(type);
+    payload_bytes = 0;
+}
+
+size_t FrameEncoder::write(uint8_t c) {
+    crc = crc16Ccitt(&c, 1, crc);
+    encode(c);
+    payload_bytes++;
+    return 1;
+}
+
+size_t FrameEncoder::write(const uint8_t* buffer, size_t size) {
+    crc = crc16Ccitt(buffer, size, crc);
+    for (size_t i = 0; i < size; i++) {
+        encode(buffer[i]);
+    }
+    payload_bytes += size;
+    return size;
+}
+
+void FrameEncoder::addUint(uint8_t field, uint64_t value) {
+    uint8_t length = value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : value <= 0xFFFFFFFFULL ? 4 : 8;
+    addField(BinaryFrame::KIND_UINT, field, value, length);
+}
+
+void FrameEncoder::addInt(uint8_t field, int64_t value) {
+    uint8_t length = (value >= INT8_MIN && value <= INT8_MAX) ? 1 :
+                     (value >= INT16_MIN && value <= INT16_MAX) ? 2 :
+                     (value >= INT32_MIN && value <= INT32_MAX) ? 4 : 8;
+    addField(BinaryFrame::KIND_INT, field, (uint64_t)value, length);
+}
+
+void FrameEncoder::addFloat(uint8_t field, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    addField(BinaryFrame::KIND_FLOAT, field, bits, sizeof(bits));
+}
+
+void FrameEncoder::addBytes(uint8_t field, const uint8_t* value, uint8_t length) {
+    write(BinaryFrame::tag(BinaryFrame::KIND_BYTES, field));
+    write(length);
+    write(value, length);
+}
+
+void FrameEncoder::addField(uint8_t kind, uint8_t field, uint64_t value, uint8_t length) {
+    uint8_t bytes[2 + 8];
+    bytes[0] = BinaryFrame::tag(kind, field);
+    bytes[1] = length;
+    for (uint8_t i = 0; i < length; i++) {
+        bytes[2 + i] = value >> (8 * i);
+    }
+    write(bytes, 2 + length);
+}
+
+size_t FrameEncoder::end() {
+    if (!open) {
+        return 0;
+    }
+
+    // CRC of everything before it, big-endian, inside the COBS encoding
+    uint16_t frame_crc = crc;
+    encode(frame_crc >> 8);
+    encode(frame_crc & 0xFF);
+    emitBlock();
+    wire_bytes += target.write((uint8_t)0);
+
+    open = false;
+    return wire_bytes;
+}
+
+void FrameEncoder::encode(uint8_t c) {
+    if (c == 0) {
+        emitBlock();   // The block's code stands for the zero
+        return;
+    }
+
+    block[block_length++] = c;
+    if (block_length == sizeof(block)) {
+        emitBlock();   // Code 0xFF: full block, no zero implied
+    }
+}
+
+void FrameEncoder::emitBlock() {
+    wire_bytes += target.write((uint8_t)(block_length + 1));
+    wire_bytes += target.write(block, block_length);
+    block_length = 0;
+}
+
+// ================================
+// DECODER
+// ================================
+
+bool FrameDecoder::feed(uint8_t byte) {
+    if (byte != 0) {
+        if (length == MAX_FRAME) {
+            overflow = true;   // Dropped at the delimiter
+        } else {
+            buffer[length++] = byte;
+        }
+        return false;
+    }
+
+    // Delimiter - decode what was collected
+    bool valid = false;
+    if (overflow) {
+        dropped++;
+    } else if (length > 0) {
+        valid = decode();
+    }
+    length = 0;
+    overflow = false;
+    return valid;
+}
+
+bool FrameDecoder::decode() {
+    // In place: the decoded frame is never longer than the encoded one
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length) {
+        uint8_t code = buffer[in++];
+        if (code == 0 || in + code - 1 > length) {
+            dropped++;
+            return false;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            buffer[out++] = buffer[in++];
+        }
+        if (code < 0xFF && in < length) {
+            buffer[out++] = 0;
+        }
+    }
+
+    // Type byte and CRC at least
+    if (out < 3) {
+        dropped++;
+        return false;
+    }
+    uint16_t received = (uint16_t)buffer[out - 2] << 8 | buffer[out - 1];
+    if (crc16Ccitt(buffer, out - 2) != received) {
+        crc_errors++;
+        return false;
+    }
+
+    frame_length = out;
+    return true;
+}
+
+bool FrameDecoder::nextField(size_t& offset, FrameField& out) const {
+    size_t available = payloadLength();
+    if (offset + 2 > available) {
+        return false;
+    }
+
+    const uint8_t* data = payload() + offset;
+    out.kind = data[0] >> 5;
+    out.field = data[0] & BinaryFrame::MAX_FIELD;
+    out.length = data[1];
+    out.value = data + 2;
+    if (offset + 2 + out.length > available) {
+        return false;
+    }
+
+    offset += 2 + out.length;
+    return true;
+}
+
+// ================================
+// FIELDS
+// ================================
+
+uint64_t FrameField::asUint() const {
+    uint64_t result = 0;
+    for (uint8_t i = 0; i < length && i < 8; i++) {
+        result |= (uint64_t)value[i] << (8 * i);
+    }
+    return result;
+}
+
+int64_t FrameField::asInt() const {
+    uint64_t result = asUint();
+    if (length > 0 && length < 8 && (value[length - 1] & 0x80)) {
+        result |= ~0ULL << (8 * length);   // Sign-extend
+    }
+    return (int64_t)result;
+}
+
+float FrameField::asFloat() const {
+    float result = 0;
+    if (length == sizeof(result)) {
+        memcpy(&result, value, sizeof(result));
+    }
+    return result;
+}
@@ -15,7 +15,11 @@ BluetoothComm::BluetoothComm()
     , samplingRate(5)
     , batteryPowered(true)
     , storageCapacityMB(3.5)
+    , historicalStorage(nullptr)
     , historicalDataEnabled(false)
+    , responseCache(ResponseCache::DEFAULT_MAX_ENTRIES, HISTORY_RESPONSE_CACHE_BYTES)
+    , frameEncoder(SerialBT)
+    , binaryFraming(false)
 {
     // Set defaults
     firmwareVersion = "2.0.0";
@@ -40,6 +44,7 @@ bool BluetoothComm::initialize() {
     deviceName = "CoToMeter 😺";
     deviceId = "ESP32_" + macAddress.substring(9);
     deviceId.replace(":", "");
+    realtimeWriter.setDeviceId(deviceId);
     
     if (!SerialBT.begin(deviceName)) {
         lastError = "Bluetooth initialization failed";
@@ -73,6 +78,7 @@ void BluetoothComm::disconnect() {
         SerialBT.disconnect();
         connected = false;
         streaming = false;
+        binaryFraming = false;
         Serial.println("📱 Bluetooth disconnected");
     }
 }
@@ -90,8 +96,10 @@ bool BluetoothComm::sendData(const String& data) {
         return false;
     }
     
-    SerialBT.println(data);
-    bytesTransmitted += data.length() + 1;
+    Print& out = beginMessage();
+    size_t bytes = out.print(data);
+    bytes += endMessage();
+    bytesTransmitted += bytes;
     
     Serial.printf("📤 BT Sent: %s\n", data.c_str());
     return true;
@@ -103,84 +111,120 @@ bool BluetoothComm::sendSensorData(const SensorDataBase& data) {
         return false;
     }
     
-    // ✅ FIX: Use JsonDocument instead of DynamicJsonDocument
-    JsonDocument doc;
-    doc["type"] = "sensor_data";
-    doc["timestamp"] = millis();
-    doc["device_id"] = deviceId;
+    // Typed fields instead of a JSON document once the app opted in to binary frames
+    if (binaryFraming) {
+        return sendSensorFrame(data);
+    }
     
-    // Create readings object based on sensor type
-    JsonObject readings = doc["readings"].to<JsonObject>();
+    // Constant fragments plus formatted values in a reused buffer - no heap, one write
+    size_t length = realtimeWriter.format(data, millis());
+    if (length == 0) {
+        return false;
+    }
+    bytesTransmitted += SerialBT.write(realtimeWriter.data(), length);
+    return true;
+}
+
+bool BluetoothComm::sendSnapshot(const CO2SensorData* co2_data, const VOCSensorData* voc_data) {
+    bool has_co2 = co2_data && co2_data->isValid();
+    bool has_voc = voc_data && voc_data->isValid();
+    if (!isConnected() || !streaming || (!has_co2 && !has_voc)) {
+        return false;
+    }
     
-    // ✅ FIX: Handle different sensor types without dynamic_cast
-    SensorType sensorType = data.getType();
+    // One sample per cycle: each metric once, one timestamp and envelope for both sensors
+    if (binaryFraming) {
+        return sendSnapshotFrame(co2_data, voc_data);
+    }
+    
+    size_t length = realtimeWriter.formatSnapshot(co2_data, voc_data, millis());
+    if (length == 0) {
+        return false;
+    }
+    bytesTransmitted += SerialBT.write(realtimeWriter.data(), length);
+    return true;
+}
+
+bool BluetoothComm::sendSnapshotFrame(const CO2SensorData* co2_data, const VOCSensorData* voc_data) {
+    // No sensor type field - the valid bitmask tells which metrics the sample has
+    frameEncoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    frameEncoder.addUint(BinaryFrame::FIELD_TIMESTAMP, millis());
+    
+    uint32_t valid = 0;
+    bool has_co2 = co2_data && co2_data->isValid();
+    bool has_voc = voc_data && voc_data->isValid();
+    if (has_co2) {
+        frameEncoder.addFloat(BinaryFrame::FIELD_CO2, co2_data->co2);
+        frameEncoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, co2_data->temperature);
+        frameEncoder.addFloat(BinaryFrame::FIELD_HUMIDITY, co2_data->humidity);
+        valid |= 1UL << (BinaryFrame::FIELD_CO2 - BinaryFrame::FIELD_CO2);
+    } else if (has_voc) {
+        frameEncoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, voc_data->temperature);
+        frameEncoder.addFloat(BinaryFrame::FIELD_HUMIDITY, voc_data->humidity);
+    }
+    if (has_co2 || has_voc) {
+        valid |= 1UL << (BinaryFrame::FIELD_TEMPERATURE - BinaryFrame::FIELD_CO2);
+        valid |= 1UL << (BinaryFrame::FIELD_HUMIDITY - BinaryFrame::FIELD_CO2);
+    }
+    if (has_voc) {
+        frameEncoder.addFloat(BinaryFrame::FIELD_VOC, voc_data->vocEstimate);
+        frameEncoder.addFloat(BinaryFrame::FIELD_PRESSURE, voc_data->pressure / 100.0f);
+        if (voc_data->gasValid) {
+            valid |= 1UL << (BinaryFrame::FIELD_VOC - BinaryFrame::FIELD_CO2);
+        }
+        valid |= 1UL << (BinaryFrame::FIELD_PRESSURE - BinaryFrame::FIELD_CO2);
+    }
+    
+    frameEncoder.addUint(BinaryFrame::FIELD_VALID, valid);
+    bytesTransmitted += frameEncoder.end();
+    return true;
+}
+
+bool BluetoothComm::sendSensorFrame(const SensorDataBase& data) {
+    // Units, accuracies and names are implied by the field ids
+    frameEncoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    frameEncoder.addUint(BinaryFrame::FIELD_TIMESTAMP, millis());
+    frameEncoder.addUint(BinaryFrame::FIELD_SENSOR_TYPE, (uint8_t)data.getType());
     
+    uint32_t valid = 0;
+    SensorType sensorType = data.getType();
     if (sensorType == SensorType::CO2_TEMP_HUMIDITY) {
-        // ✅ FIX: Use static_cast instead of dynamic_cast (we know the type)
         const CO2SensorData* co2Data = static_cast<const CO2SensorData*>(&data);
-        
-        JsonObject co2Reading = readings["co2"].to<JsonObject>();
-        co2Reading["value"] = co2Data->co2;
-        co2Reading["unit"] = "ppm";
-        co2Reading["accuracy"] = 0.95;
-        co2Reading["status"] = co2Data->isDataValid() ? "valid" : "invalid";
-        
-        JsonObject tempReading = readings["temperature"].to<JsonObject>();
-        tempReading["value"] = co2Data->temperature;
-        tempReading["unit"] = "celsius";
-        tempReading["accuracy"] = 0.98;
-        tempReading["status"] = "valid";
-        
-        JsonObject humReading = readings["humidity"].to<JsonObject>();
-        humReading["value"] = co2Data->humidity;
-        humReading["unit"] = "percent";
-        humReading["accuracy"] = 0.92;
-        humReading["status"] = "valid";
+        frameEncoder.addFloat(BinaryFrame::FIELD_CO2, co2Data->co2);
+        frameEncoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, co2Data->temperature);
+        frameEncoder.addFloat(BinaryFrame::FIELD_HUMIDITY, co2Data->humidity);
+        if (co2Data->isDataValid()) {
+            valid |= 1UL << (BinaryFrame::FIELD_CO2 - BinaryFrame::FIELD_CO2);
+        }
+        valid |= 1UL << (BinaryFrame::FIELD_TEMPERATURE - BinaryFrame::FIELD_CO2);
+        valid |= 1UL << (BinaryFrame::FIELD_HUMIDITY - BinaryFrame::FIELD_CO2);
         
     } else if (sensorType == SensorType::VOC_GAS) {
         const VOCSensorData* vocData = static_cast<const VOCSensorData*>(&data);
-        
-        JsonObject vocReading = readings["voc"].to<JsonObject>();
-        vocReading["value"] = vocData->vocEstimate;
-        vocReading["unit"] = "ppb";
-        vocReading["accuracy"] = 0.85;
-        vocReading["status"] = vocData->gasValid ? "valid" : "invalid";
-        
-        JsonObject tempReading = readings["temperature"].to<JsonObject>();
-        tempReading["value"] = vocData->temperature;
-        tempReading["unit"] = "celsius";
-        tempReading["accuracy"] = 0.98;
-        tempReading["status"] = "valid";
-        
-        JsonObject humReading = readings["humidity"].to<JsonObject>();
-        humReading["value"] = vocData->humidity;
-        humReading["unit"] = "percent";
-        humReading["accuracy"] = 0.92;
-        humReading["status"] = "valid";
-        
-        JsonObject pressReading = readings["pressure"].to<JsonObject>();
-        pressReading["value"] = vocData->pressure / 100.0;
-        pressReading["unit"] = "hPa";
-        pressReading["accuracy"] = 0.99;
-        pressReading["status"] = "valid";
+        frameEncoder.addFloat(BinaryFrame::FIELD_VOC, vocData->vocEstimate);
+        frameEncoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, vocData->temperature);
+        frameEncoder.addFloat(BinaryFrame::FIELD_HUMIDITY, vocData->humidity);
+        frameEncoder.addFloat(BinaryFrame::FIELD_PRESSURE, vocData->pressure / 100.0f);
+        if (vocData->gasValid) {
+            valid |= 1UL << (BinaryFrame::FIELD_VOC - BinaryFrame::FIELD_CO2);
+        }
+        valid |= 1UL << (BinaryFrame::FIELD_TEMPERATURE - BinaryFrame::FIELD_CO2);
+        valid |= 1UL << (BinaryFrame::FIELD_HUMIDITY - BinaryFrame::FIELD_CO2);
+        valid |= 1UL << (BinaryFrame::FIELD_PRESSURE - BinaryFrame::FIELD_CO2);
         
     } else if (sensorType == SensorType::PARTICULATE_MATTER) {
         const PMSensorData* pmData = static_cast<const PMSensorData*>(&data);
-        
-        JsonObject pm25Reading = readings["pm2_5"].to<JsonObject>();
-        pm25Reading["value"] = pmData->pm2_5_atmospheric;
-        pm25Reading["unit"] = "μg/m³";
-        pm25Reading["accuracy"] = 0.90;
-        pm25Reading["status"] = pmData->isDataValid() ? "valid" : "invalid";
-        
-        JsonObject pm10Reading = readings["pm10"].to<JsonObject>();
-        pm10Reading["value"] = pmData->pm10_atmospheric;
-        pm10Reading["unit"] = "μg/m³";
-        pm10Reading["accuracy"] = 0.90;
-        pm10Reading["status"] = pmData->isDataValid() ? "valid" : "invalid";
+        frameEncoder.addFloat(BinaryFrame::FIELD_PM2_5, pmData->pm2_5_atmospheric);
+        frameEncoder.addFloat(BinaryFrame::FIELD_PM10, pmData->pm10_atmospheric);
+        if (pmData->isDataValid()) {
+            valid |= 1UL << (BinaryFrame::FIELD_PM2_5 - BinaryFrame::FIELD_CO2);
+            valid |= 1UL << (BinaryFrame::FIELD_PM10 - BinaryFrame::FIELD_CO2);
+        }
     }
     
-    return sendJsonMessage("sensor_data", doc);
+    frameEncoder.addUint(BinaryFrame::FIELD_VALID, valid);
+    bytesTransmitted += frameEncoder.end();
+    return true;
 }
 
 String BluetoothComm::receiveData() {
@@ -287,17 +331,33 @@ void BluetoothComm::setDeviceInfo(const String& firmware, const String& hardware
 
 void BluetoothComm::setSamplingRate(int rate) {
     samplingRate = rate;
+    if (historicalStorage) {
+        historicalStorage->setDeadbandInterval(rate * 1000UL);   // Deadband runs expand at the new rate
+    }
     Serial.printf("📊 Bluetooth: Sampling rate set to %d seconds\n", rate);
 }
 
 void BluetoothComm::update() {
+    // History snapshot keeps going while no app is connected (bounded to ~1 ms)
+    if (historicalStorage) {
+        historicalStorage->pollCheckpoint();
+    }
+    
     isConnected();
     
     if (!connected) return;
     
     handleIncomingCommands();
     
+    // At most one history chunk per pass - the measurement loop keeps its pace
     uint32_t now = millis();
+    if (historyTransfer.isIdle(now)) {
+        Serial.println("📦 History transfer dropped (no ack or resume)");
+        historyTransfer.cancel();
+    } else if (historyTransfer.canSend()) {
+        sendHistoryChunk();
+    }
+    
     if (now - lastStatusSent >= statusUpdateInterval) {
         sendDeviceStatus();
         lastStatusSent = now;
@@ -405,6 +465,7 @@ void BluetoothComm::onConnectionChange() {
         
     } else {
         streaming = false;
+        binaryFraming = false;   // The next app negotiates again
         Serial.println("📱 Mobile app disconnected");
         
         if (statusCallback) {
@@ -414,11 +475,39 @@ void BluetoothComm::onConnectionChange() {
 }
 
 bool BluetoothComm::sendJsonMessage(const String& type, JsonDocument& doc) {
+    if (binaryFraming) {
+        // Serialized straight into the frame - no intermediate String
+        if (!isConnected()) {
+            return false;
+        }
+        size_t bytes = serializeJson(doc, beginMessage());
+        bytes += endMessage();
+        bytesTransmitted += bytes;
+        return true;
+    }
+    
     String jsonString;
     serializeJson(doc, jsonString);
     return sendData(jsonString);
 }
 
+Print& BluetoothComm::beginMessage(uint8_t frame_type) {
+    if (!binaryFraming) {
+        return SerialBT;
+    }
+    frameEncoder.begin(frame_type);
+    return frameEncoder;
+}
+
+size_t BluetoothComm::endMessage() {
+    if (!binaryFraming) {
+        return SerialBT.println();
+    }
+    // Frame bytes on air minus the payload the caller already counted
+    size_t payload = frameEncoder.getPayloadBytes();
+    return frameEncoder.end() - payload;
+}
+
 // ================================
 // TIME SYNCHRONIZATION FUNCTIONS
 // ================================
@@ -469,7 +558,12 @@ bool BluetoothComm::synchronizeTime(uint64_t current_timestamp, const String& ti
     bool success = timeSync.synchronizeTime(current_timestamp, timezone_offset);
     
     if (success) {
-        Serial.printf("⏰ Time synchronized! Current time: %llu\n", timeSync.getCurrentTimestamp());
+        Serial.printf("⏰ Time synchronized! Current time: %llu\n", (unsigned long long)timeSync.getCurrentTimestamp());
+        
+        // Remember this boot's offset so its records keep their times after a reboot
+        if (historicalStorage) {
+            historicalStorage->noteTimeSync(timeSync);
+        }
         
         // Enable historical data storage now that we have time sync
         if (!historicalDataEnabled && historicalStorage) {
@@ -488,71 +582,589 @@ bool BluetoothComm::synchronizeTime(uint64_t current_timestamp, const String& ti
 // ================================
 
 bool BluetoothComm::sendHistoricalData(const String& request_id, const TimeRange& range, 
-                                     size_t chunk_size) {
+                                     size_t chunk_size, uint32_t resume_sequence, size_t shape_metric,
+                                     uint8_t window, bool delta_encoding) {
     if (!isConnected()) return false;
     
     if (!historicalStorage) {
         return sendErrorMessage("STORAGE_ERROR", "Historical data not enabled", "error", "", request_id);
     }
     
-    // Create TimeRange struct for query
-    TimeRange query_range;
-    query_range.start_time = range.start_time;
-    query_range.end_time = range.end_time;
-    query_range.max_points = range.max_points;
+    ResponseCache::Key key;
+    key.start_time = range.start_time;
+    key.end_time = range.end_time;
+    key.resume_sequence = resume_sequence;
+    key.max_points = range.max_points;
+    key.shape_metric = shape_metric;
+    key.delta_encoding = delta_encoding;
+    
+    // Storage state the response depends on - a cached body is only reused while it matches
+    ResponseCache::Stamp stamp = ResponseCache::Stamp::of(*historicalStorage,
+                                                          timeSync.has_time ? timeSync.time_offset : 0);
+    
+    // Long ranges are answered from the rollup tier that fits max_points (fresh requests only)
+    uint64_t start_uptime, end_uptime;
+    bool resolved = historicalStorage->resolveUptimeRange(range, timeSync, start_uptime, end_uptime);
+    int resolution = HistoricalDataStorage::RAW_RESOLUTION;
+    if (resume_sequence == 0 && resolved) {
+        resolution = historicalStorage->selectResolution(start_uptime, end_uptime, range.max_points);
+    }
     
-    // Query historical data
-    std::vector<SensorRecord> records = historicalStorage->queryByTimeRange(query_range, timeSync);
+    // Chunked: the transfer is set up here and sent from update() as the app grants credits
+    if (chunk_size > 0) {
+        if (!resolved) {
+            start_uptime = 1;   // Empty range - one empty, final chunk
+            end_uptime = 0;
+        }
+        historyTransfer.start(*historicalStorage, request_id, resolution, start_uptime, end_uptime,
+                              resume_sequence, range.max_points, shape_metric,
+                              min(chunk_size, (size_t)HistoryTransfer::MAX_CHUNK_POINTS), window,
+                              delta_encoding, millis());
+        Serial.printf("📦 Chunked history transfer: %lu %s, %u per chunk, window %u%s\n",
+                     (unsigned long)historyTransfer.getTotal(),
+                     resolution == HistoricalDataStorage::RAW_RESOLUTION ? "records" : "buckets",
+                     historyTransfer.getChunkPoints(), window,
+                     historyTransfer.isDeltaEncoded() ? ", delta-encoded" : "");
+        return true;
+    }
+    
+    // Rollup buckets (min/max/count per point) keep the point format
+    if (resolution != HistoricalDataStorage::RAW_RESOLUTION) {
+        return sendRollupData(request_id, resolution, start_uptime, end_uptime, key, stamp);
+    }
+    
+    // Cursor reads straight from the storage ring - no intermediate record vectors
+    HistoryCursor cursor = resolved ? historicalStorage->openCursor(start_uptime, end_uptime) : HistoryCursor();
+    cursor.seek(resume_sequence);
+    size_t total_records = cursor.remaining();
+    
+    stamp.setRaw(*historicalStorage, cursor, resolved, end_uptime);
+    if (sendCachedHistory(request_id, key, stamp)) {
+        return true;
+    }
+    
+    // Everything after the request id is captured for the response cache
+    Print& link = beginMessage();
+    size_t bytes = link.print(historyHead(request_id));
+    ResponseCapture out(link, responseCache.getBudgetBytes());
     
     JsonDocument doc;
-    doc["t"] = "historical_data";  // t = type
-    doc["r"] = request_id;         // r = request_id  
-    doc["n"] = records.size();     // n = total_records
+    doc["total"] = total_records;  // total = records in the range before max_points thinning
     doc["s"] = timeSync.has_time;  // s = time_synced
+    if (delta_encoding) {
+        doc["f"] = "delta";        // f = "d" holds delta-encoded columns
+    }
     
     // 🚀 ULTRA COMPACT FORMAT: Single letter field names + 2 decimal precision
     // Each record: {t: timestamp, c: co2, T: temp, h: humidity, p: pressure, v: voc}
-    JsonArray dataArray = doc["d"].to<JsonArray>();  // d = data
-    
-    for (const SensorRecord& record : records) {
-        JsonObject dataPoint = dataArray.add<JsonObject>();
-        
-        // t = timestamp
-        if (timeSync.has_time) {
-            dataPoint["t"] = timeSync.uptimeToTimestamp(record.uptime);
-        } else {
-            dataPoint["t"] = record.uptime;
+    // Envelope is written first, then the "d" array is streamed record by record
+    // (delta encoding writes one column per pass over the range)
+    String envelope;
+    serializeJson(doc, envelope);
+    envelope.setCharAt(0, ',');              // Continue the head's object
+    envelope.remove(envelope.length() - 1);  // Reopen the object to append "d"
+    envelope += delta_encoding ? ",\"d\":" : ",\"d\":[";   // d = data
+    
+    bytes += out.print(envelope);
+    
+    // max_points is met by keeping each bucket's min/max of the shape metric
+    MinMaxDownsampler sampler(total_records, range.max_points, shape_metric);
+    
+    DeltaColumnStream columns(out);
+    JsonDocument point;
+    SensorRecord record;
+    SensorRecord samples[MinMaxDownsampler::MAX_OUTPUT];
+    size_t sent = 0;
+    for (;;) {
+        bool input_done = false;
+        while (!input_done) {
+            size_t ready;
+            if (cursor.next(record)) {
+                ready = sampler.add(record, samples);
+            } else {
+                ready = sampler.finish(samples);
+                input_done = true;
+            }
+            
+            for (size_t i = 0; i < ready; i++) {
+                sent++;
+                if (delta_encoding) {
+                    columns.add(pointTimestamp(samples[i]), samples[i]);
+                    continue;
+                }
+                if (sent > 1) {
+                    bytes += out.print(',');
+                }
+                point.clear();
+                fillCompactPoint(point.to<JsonObject>(), samples[i]);
+                bytes += serializeJson(point, out);
+            }
         }
         
-        // c = CO2 (integer is fine)
-        if (record.validity_flags & SensorRecord::FLAG_CO2_VALID) {
-            dataPoint["c"] = (int)round(record.co2);
+        // Delta columns hold no points: the cursor and sampler are reopened for each column
+        if (!delta_encoding || !columns.nextPass()) {
+            break;
+        }
+        cursor = resolved ? historicalStorage->openCursor(start_uptime, end_uptime) : HistoryCursor();
+        cursor.seek(resume_sequence);
+        sampler = MinMaxDownsampler(total_records, range.max_points, shape_metric);
+        sent = 0;
+    }
+    
+    // n = points in "d" (known once thinned), q = sequence to resume from on the next request
+    bytes += delta_encoding ? columns.bytesWritten() : out.print(']');
+    bytes += out.printf(",\"n\":%zu,\"q\":%lu}", sent, (unsigned long)cursor.position());
+    bytes += endMessage();
+    bytesTransmitted += bytes;
+    
+    if (out.isComplete()) {
+        responseCache.store(key, stamp, out.captured());
+    }
+    
+    if (delta_encoding) {
+        Serial.printf("🚀 Streamed %zu historical records as delta-encoded columns (%zu bytes)\n", sent, bytes);
+        Serial.println("📝 Format: {t:type, r:request_id, total:records_in_range, s:time_synced, f:delta, d:{t:{n,b,i,d}, c:{x,d,m}, ...}, n:count, q:next_seq}");
+        return true;
+    }
+    Serial.printf("🚀 Streamed %zu historical records in ULTRA COMPACT format (%zu bytes)\n", sent, bytes);
+    Serial.println("📝 Format: {t:type, r:request_id, total:records_in_range, s:time_synced, d:[{t:timestamp, c:co2, T:temp, h:humidity, p:pressure, v:voc}], n:count, q:next_seq}");
+    return true;
+}
+
+bool BluetoothComm::sendHistoryChunk() {
+    uint16_t chunk = historyTransfer.getNextChunk();
+    String request_id = historyTransfer.getRequestId();
+    
+    if (!historyTransfer.beginChunk()) {
+        // Records the transfer started with were formatted away or rolled out of the tier
+        historyTransfer.cancel();
+        return sendErrorMessage("TRANSFER_EXPIRED", "History changed during transfer, request again",
+                                "error", "", request_id);
+    }
+    
+    bool rollup = historyTransfer.getResolution() != HistoricalDataStorage::RAW_RESOLUTION;
+    
+    JsonDocument doc;
+    doc["t"] = "history_chunk";                      // t = type
+    doc["r"] = request_id;                           // r = request_id
+    doc["i"] = chunk;                                // i = chunk index (acknowledge with history_ack)
+    doc["n"] = historyTransfer.getTotal();           // n = total records / buckets of the transfer
+    doc["s"] = timeSync.has_time;                    // s = time_synced
+    if (rollup) {
+        const RollupTier& tier = historicalStorage->getRollups().tier(historyTransfer.getResolution());
+        doc["g"] = tier.getBucketSeconds();          // g = bucket length in seconds (rollup transfer)
+    }
+    bool delta = historyTransfer.isDeltaEncoded();
+    if (delta) {
+        doc["f"] = "delta";                          // f = "d" holds delta-encoded columns
+    }
+    
+    String envelope;
+    serializeJson(doc, envelope);
+    envelope.remove(envelope.length() - 1);
+    envelope += delta ? ",\"d\":" : ",\"d\":[";
+    
+    Print& link = beginMessage();
+    size_t bytes = link.print(envelope);
+    
+    // One chunk of points, serialized as read - nothing else of the transfer is held
+    JsonDocument point;
+    size_t sent = 0;
+    if (rollup) {
+        const RollupTier& tier = historicalStorage->getRollups().tier(historyTransfer.getResolution());
+        size_t begin, end;
+        historyTransfer.bucketRange(begin, end);
+        for (size_t i = begin; i < end; i++) {
+            if (sent > 0) {
+                bytes += link.print(',');
+            }
+            point.clear();
+            fillRollupPoint(point.to<JsonObject>(), tier.at(i));
+            bytes += serializeJson(point, link);
+            sent++;
+        }
+    } else if (delta) {
+        // Each chunk is self-contained: its own base timestamp and first values
+        DeltaColumnWriter columns;
+        SensorRecord record;
+        while (historyTransfer.nextRecord(record)) {
+            columns.add(pointTimestamp(record), record);
+            sent++;
+        }
+        bytes += columns.write(link);
+    } else {
+        SensorRecord record;
+        while (historyTransfer.nextRecord(record)) {
+            if (sent > 0) {
+                bytes += link.print(',');
+            }
+            point.clear();
+            fillCompactPoint(point.to<JsonObject>(), record);
+            bytes += serializeJson(point, link);
+            sent++;
+        }
+    }
+    
+    // e = last chunk, q = sequence to resume from on a later request (raw, last chunk)
+    bool last = historyTransfer.endChunk(millis());
+    if (!delta) {
+        bytes += link.print(']');
+    }
+    bytes += link.printf(",\"e\":%s", last ? "true" : "false");
+    if (last && !rollup) {
+        bytes += link.printf(",\"q\":%lu", (unsigned long)historyTransfer.getResumeSequence());
+    }
+    bytes += link.print('}');
+    bytes += endMessage();
+    bytesTransmitted += bytes;
+    
+    Serial.printf("📦 History chunk %u: %zu points, %zu bytes%s\n", chunk, sent, bytes, last ? " (last)" : "");
+    return true;
+}
+
+String BluetoothComm::historyHead(const String& request_id) {
+    JsonDocument doc;
+    doc["t"] = "historical_data";  // t = type
+    doc["r"] = request_id;         // r = request_id
+    
+    String head;
+    serializeJson(doc, head);
+    head.remove(head.length() - 1);  // The body continues the object
+    return head;
+}
+
+bool BluetoothComm::sendCachedHistory(const String& request_id, const ResponseCache::Key& key,
+                                      const ResponseCache::Stamp& stamp) {
+    const std::vector<uint8_t>* body = responseCache.find(key, stamp);
+    if (!body) {
+        return false;
+    }
+    
+    // Same response as last time - only the request id differs
+    Print& link = beginMessage();
+    size_t bytes = link.print(historyHead(request_id));
+    bytes += link.write(body->data(), body->size());
+    bytes += endMessage();
+    bytesTransmitted += bytes;
+    
+    Serial.printf("⚡ History response served from cache (%zu bytes)\n", bytes);
+    return true;
+}
+
+bool BluetoothComm::sendHistorySince(const String& request_id, uint32_t sequence, uint32_t boot_id,
+                                     size_t max_records) {
+    if (!isConnected()) return false;
+    
+    if (!historicalStorage) {
+        return sendErrorMessage("STORAGE_ERROR", "Historical data not enabled", "error", "", request_id);
+    }
+    
+    bool reset;
+    HistoryCursor cursor = historicalStorage->openSince(sequence, boot_id, reset);
+    
+    JsonDocument doc;
+    doc["t"] = "history_since";                     // t = type
+    doc["r"] = request_id;                          // r = request_id
+    doc["b"] = historicalStorage->getBootId();      // b = boot id to send back with "q"
+    doc["s"] = timeSync.has_time;                   // s = time_synced
+    if (reset) {
+        doc["x"] = true;                            // x = position unknown, all history follows
+    }
+    
+    // Raw records in storage order - no downsampling, the app keeps everything it is sent
+    String envelope;
+    serializeJson(doc, envelope);
+    envelope.remove(envelope.length() - 1);
+    envelope += ",\"d\":[";
+    
+    Print& link = beginMessage();
+    size_t bytes = link.print(envelope);
+    
+    JsonDocument point;
+    SensorRecord record;
+    size_t sent = 0;
+    while (sent < max_records && cursor.next(record)) {
+        if (sent > 0) {
+            bytes += link.print(',');
+        }
+        point.clear();
+        fillCompactPoint(point.to<JsonObject>(), record);
+        bytes += serializeJson(point, link);
+        sent++;
+    }
+    
+    // n = records in "d" (counted as sent), q = sequence to send as "seq" next time,
+    // m = more records are waiting
+    bool more = cursor.remaining() > 0;
+    bytes += link.printf("],\"n\":%zu,\"q\":%lu,\"m\":%s}", sent, (unsigned long)cursor.position(),
+                         more ? "true" : "false");
+    bytes += endMessage();
+    bytesTransmitted += bytes;
+    
+    Serial.printf("🔄 Sent %zu new records since %lu in %zu bytes%s\n", sent, (unsigned long)sequence,
+                 bytes, reset ? " (full resync)" : "");
+    return true;
+}
+
+uint64_t BluetoothComm::pointTimestamp(const SensorRecord& record) {
+    if (timeSync.has_time) {
+        return historicalStorage->toTimestamp(timeSync, record.getUptime());
+    }
+    return record.getUptime();
+}
+
+void BluetoothComm::fillCompactPoint(JsonObject dataPoint, const SensorRecord& record) {
+    // t = timestamp
+    dataPoint["t"] = pointTimestamp(record);
+    
+    // c = CO2 (integer is fine)
+    if (record.validity_flags & SensorRecord::FLAG_CO2_VALID) {
+        dataPoint["c"] = (int)round(record.getCo2());
+    }
+    
+    // T = Temperature (2 decimal places)
+    if (record.validity_flags & SensorRecord::FLAG_TEMP_VALID) {
+        dataPoint["T"] = round(record.getTemperature() * 100) / 100.0;
+    }
+    
+    // h = Humidity (2 decimal places)
+    if (record.validity_flags & SensorRecord::FLAG_HUMIDITY_VALID) {
+        dataPoint["h"] = round(record.getHumidity() * 100) / 100.0;
+    }
+    
+    // p = Pressure (2 decimal places)
+    if (record.validity_flags & SensorRecord::FLAG_PRESSURE_VALID) {
+        dataPoint["p"] = round(record.getPressure() * 100) / 100.0;
+    }
+    
+    // v = VOC (2 decimal places)
+    if (record.validity_flags & SensorRecord::FLAG_VOC_VALID) {
+        dataPoint["v"] = round(record.getVoc() * 100) / 100.0;
+    }
+}
+
+bool BluetoothComm::sendRollupData(const String& request_id, size_t tier_index,
+                                   uint64_t start_uptime, uint64_t end_uptime,
+                                   const ResponseCache::Key& key, ResponseCache::Stamp stamp) {
+    const RollupTier& tier = historicalStorage->getRollups().tier(tier_index);
+    size_t begin, end;
+    tier.findRange(start_uptime, end_uptime, begin, end);
+    
+    stamp.setRollup(*historicalStorage, tier_index, begin, end);
+    if (sendCachedHistory(request_id, key, stamp)) {
+        return true;
+    }
+    
+    Print& link = beginMessage();
+    size_t bytes = link.print(historyHead(request_id));
+    ResponseCapture out(link, responseCache.getBudgetBytes());
+    
+    JsonDocument doc;
+    doc["n"] = end - begin;                // n = total_records
+    doc["s"] = timeSync.has_time;          // s = time_synced
+    doc["g"] = tier.getBucketSeconds();    // g = bucket length in seconds (rollup response)
+    
+    String envelope;
+    serializeJson(doc, envelope);
+    envelope.setCharAt(0, ',');
+    envelope.remove(envelope.length() - 1);
+    envelope += ",\"d\":[";
+    
+    bytes += out.print(envelope);
+    
+    JsonDocument point;
+    for (size_t i = begin; i < end; i++) {
+        if (i > begin) {
+            bytes += out.print(',');
+        }
+        point.clear();
+        fillRollupPoint(point.to<JsonObject>(), tier.at(i));
+        bytes += serializeJson(point, out);
+    }
+    
+    bytes += out.print("]}");
+    bytes += endMessage();
+    bytesTransmitted += bytes;
+    
+    if (out.isComplete()) {
+        responseCache.store(key, stamp, out.captured());
+    }
+    
+    Serial.printf("📈 Streamed %zu rollup buckets (%lus) in %zu bytes\n",
+                 end - begin, (unsigned long)tier.getBucketSeconds(), bytes);
+    return true;
+}
+
+void BluetoothComm::fillRollupPoint(JsonObject dataPoint, const RollupBucket& bucket) {
+    // Means use the regular point keys, plus k = sample count, mn/mx = per-metric min/max
+    fillCompactPoint(dataPoint, bucket.toRecord());
+    dataPoint["k"] = bucket.count;
+    
+    JsonObject lows = dataPoint["mn"].to<JsonObject>();
+    JsonObject highs = dataPoint["mx"].to<JsonObject>();
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (bucket.validity_flags & SensorRecord::metricFlag(i)) {
+            lows[SensorRecord::metricKey(i)] = round(bucket.min[i] * 100) / 100.0;
+            highs[SensorRecord::metricKey(i)] = round(bucket.max[i] * 100) / 100.0;
+        }
+    }
+}
+
+void BluetoothComm::fillStatistics(JsonObject stats, RunningStatistics::Window window) {
+    // Per metric: [count, mean, min, max, stddev], metrics without samples are left out
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        MetricSummary summary = historicalStorage->getStatistics().summary(window, i);
+        if (summary.count == 0) {
+            continue;
         }
         
-        // T = Temperature (2 decimal places)
-        if (record.validity_flags & SensorRecord::FLAG_TEMP_VALID) {
-            dataPoint["T"] = round(record.temperature * 100) / 100.0;
+        JsonArray values = stats[SensorRecord::metricKey(i)].to<JsonArray>();
+        values.add(summary.count);
+        values.add(round(summary.mean * 100) / 100.0);
+        values.add(round(summary.min * 100) / 100.0);
+        values.add(round(summary.max * 100) / 100.0);
+        values.add(round(summary.stddev * 100) / 100.0);
+    }
+}
+
+void BluetoothComm::fillQuantiles(JsonObject stats, QuantileStatistics::Window window, size_t metric) {
+    static const float levels[] = { 0.5f, 0.95f, 0.99f };
+    
+    const QuantileStatistics& quantiles = historicalStorage->getQuantiles();
+    for (size_t s = 0; s < QuantileStatistics::SKETCH_COUNT; s++) {
+        size_t sketch_metric = QuantileStatistics::METRICS[s];
+        if (metric != SIZE_MAX && metric != sketch_metric) {
+            continue;
         }
         
-        // h = Humidity (2 decimal places)
-        if (record.validity_flags & SensorRecord::FLAG_HUMIDITY_VALID) {
-            dataPoint["h"] = round(record.humidity * 100) / 100.0;
+        QuantileSketch sketch = quantiles.get(window, sketch_metric);
+        if (sketch.isEmpty()) {
+            continue;
         }
         
-        // p = Pressure (2 decimal places)
-        if (record.validity_flags & SensorRecord::FLAG_PRESSURE_VALID) {
-            dataPoint["p"] = round(record.pressure * 100) / 100.0;
+        JsonObject entry = stats[SensorRecord::metricKey(sketch_metric)].to<JsonObject>();
+        entry["n"] = sketch.getCount();                               // n = samples
+        entry["mn"] = round(sketch.getMin() * 100) / 100.0;           // mn = minimum
+        entry["mx"] = round(sketch.getMax() * 100) / 100.0;           // mx = maximum
+        JsonArray values = entry["q"].to<JsonArray>();                // q = p50, p95, p99
+        for (float level : levels) {
+            values.add(round(sketch.quantile(level, quantiles.rangeOf(s)) * 100) / 100.0);
+        }
+    }
+}
+
+bool BluetoothComm::sendStatistics(const String& request_id, size_t metric, int window) {
+    if (!isConnected()) return false;
+    
+    if (!historicalStorage || !historicalStorage->getQuantiles().isEnabled()) {
+        return sendErrorMessage("STORAGE_ERROR", "Statistics not enabled", "error", "", request_id);
+    }
+    
+    if (metric != SIZE_MAX && QuantileStatistics::sketchOf(metric) == SIZE_MAX) {
+        return sendErrorMessage("INVALID_METRIC", "Quantiles are kept for co2 and voc", "error", "", request_id);
+    }
+    
+    JsonDocument doc;
+    doc["t"] = "stats";  // t = type
+    if (request_id.length() > 0) {
+        doc["r"] = request_id;  // r = request_id
+    }
+    
+    // Sketches are merged on demand - cost is fixed, independent of stored history
+    if (window < 0 || window == QuantileStatistics::LAST_DAY) {
+        fillQuantiles(doc["d"].to<JsonObject>(), QuantileStatistics::LAST_DAY, metric);    // d = last day
+    }
+    if (window < 0 || window == QuantileStatistics::LAST_WEEK) {
+        fillQuantiles(doc["w"].to<JsonObject>(), QuantileStatistics::LAST_WEEK, metric);   // w = last week
+    }
+    
+    Serial.println("📊 Sending quantile statistics");
+    return sendJsonMessage("stats", doc);
+}
+
+bool BluetoothComm::sendProfile(const String& request_id, size_t metric) {
+    if (!isConnected()) return false;
+    
+    if (!historicalStorage || !historicalStorage->getProfile().isEnabled()) {
+        return sendErrorMessage("STORAGE_ERROR", "Diurnal profile not enabled", "error", "", request_id);
+    }
+    
+    const DiurnalProfile& profile = historicalStorage->getProfile();
+    
+    JsonDocument doc;
+    doc["t"] = "profile";  // t = type
+    if (request_id.length() > 0) {
+        doc["r"] = request_id;  // r = request_id
+    }
+    doc["k"] = SensorRecord::metricKey(metric);   // k = metric key
+    doc["z"] = profile.getTimezone();        // z = timezone, minutes east of UTC
+    doc["n"] = profile.getReadings();        // n = readings in the profile
+    
+    // a/x = mean/max of the 168 hour cells, Monday 00:00 first; null = no readings yet
+    // CO2 as integers, other metrics to 0.1 - the whole grid stays below ~2 KB
+    JsonArray means = doc["a"].to<JsonArray>();
+    JsonArray maxima = doc["x"].to<JsonArray>();
+    float scale = metric == SensorRecord::METRIC_CO2 ? 1.0f : 10.0f;
+    for (size_t cell = 0; cell < DiurnalProfile::CELL_COUNT; cell++) {
+        if (profile.getCount(cell, metric) == 0) {
+            means.add<JsonVariant>();
+            maxima.add<JsonVariant>();
+            continue;
+        }
+        means.add(round(profile.getMean(cell, metric) * scale) / scale);
+        maxima.add(round(profile.getMax(cell, metric) * scale) / scale);
+    }
+    
+    Serial.printf("🗓️ Sending diurnal profile of %s\n", SensorRecord::metricKey(metric));
+    return sendJsonMessage("profile", doc);
+}
+
+bool BluetoothComm::sendAlertEpisodes(const String& request_id, uint64_t start_uptime,
+                                      uint64_t end_uptime, uint8_t min_peak_level) {
+    if (!isConnected()) return false;
+    
+    if (!historicalStorage || !historicalStorage->getEpisodes().isEnabled()) {
+        return sendErrorMessage("STORAGE_ERROR", "Alert episodes not enabled", "error", "", request_id);
+    }
+    
+    const AlertEpisodeIndex& index = historicalStorage->getEpisodes();
+    size_t begin, end;
+    index.findRange(start_uptime, end_uptime, begin, end);
+    
+    JsonDocument doc;
+    doc["t"] = "episodes";               // t = type
+    doc["r"] = request_id;               // r = request_id
+    doc["lv"] = index.getMinLevel();     // lv = alert level that starts an episode
+    doc["s"] = timeSync.has_time;        // s = time_synced
+    
+    // O(episodes in range) - the records themselves are never read
+    JsonArray data = doc["d"].to<JsonArray>();  // d = data
+    for (size_t i = begin; i < end; i++) {
+        const AlertEpisode& episode = index.at(i);
+        if (episode.peak_level < min_peak_level) {
+            continue;
         }
         
-        // v = VOC (2 decimal places)
-        if (record.validity_flags & SensorRecord::FLAG_VOC_VALID) {
-            dataPoint["v"] = round(record.voc * 100) / 100.0;
+        JsonObject item = data.add<JsonObject>();
+        if (timeSync.has_time) {
+            item["b"] = historicalStorage->toTimestamp(timeSync, episode.start_uptime);  // b = begin
+            item["e"] = historicalStorage->toTimestamp(timeSync, episode.end_uptime);    // e = end
+        } else {
+            item["b"] = episode.start_uptime;
+            item["e"] = episode.end_uptime;
+        }
+        item["l"] = episode.peak_level;                      // l = peak alert level
+        item["c"] = (int)round(episode.peak_co2);            // c = peak CO2
+        item["v"] = round(episode.peak_voc * 100) / 100.0;   // v = peak VOC
+        item["k"] = episode.record_count;                    // k = records
+        if (i + 1 == index.size() && index.isOpen()) {
+            item["o"] = true;                                // o = still open
         }
     }
+    doc["n"] = data.size();  // n = episodes returned
     
-    Serial.printf("🚀 Sending %zu historical records in ULTRA COMPACT format\n", records.size());
-    Serial.println("📝 Format: {t:type, r:request_id, n:count, s:time_synced, d:[{t:timestamp, c:co2, T:temp, h:humidity, p:pressure, v:voc}]}");
-    return sendJsonMessage("historical_data", doc);
+    Serial.printf("🚨 Sending %zu alert episodes\n", data.size());
+    return sendJsonMessage("episodes", doc);
 }
 
 bool BluetoothComm::sendStorageInfo(const String& request_id) {
@@ -571,14 +1183,28 @@ bool BluetoothComm::sendStorageInfo(const String& request_id) {
         doc["f"] = historicalStorage->isFull();          // f = is_full
         doc["z"] = historicalStorage->isEmpty();         // z = is_empty (using z to avoid conflict)
         doc["y"] = historicalStorage->getStorageType();  // y = storage_type
+        doc["a"] = historicalStorage->getArchive().getRecordCount();  // a = archived (compressed) records
         doc["s"] = timeSync.has_time;                    // s = time_synced
+        doc["ep"] = historicalStorage->getEpochs().count; // ep = boot epochs with known offsets
+        doc["rh"] = responseCache.getStats().hits;        // rh = history responses served from cache
+        if (const RingCheckpoint* checkpoint = historicalStorage->getCheckpoint()) {
+            doc["ck"] = checkpoint->getStats().max_step_us;   // ck = longest checkpoint step (µs)
+        }
+        
+        // Running statistics: constant time, no history scan
+        if (historicalStorage->getStatistics().isEnabled()) {
+            JsonObject stats = doc["st"].to<JsonObject>();   // st = statistics
+            fillStatistics(stats["h"].to<JsonObject>(), RunningStatistics::LAST_HOUR);
+            fillStatistics(stats["d"].to<JsonObject>(), RunningStatistics::LAST_DAY);
+            fillStatistics(stats["b"].to<JsonObject>(), RunningStatistics::SINCE_BOOT);
+        }
         
         // Get time range if data exists
-        unsigned long oldest_uptime, newest_uptime;
+        uint64_t oldest_uptime, newest_uptime;
         if (historicalStorage->getDataTimeRange(oldest_uptime, newest_uptime)) {
             if (timeSync.has_time) {
-                doc["o"] = timeSync.uptimeToTimestamp(oldest_uptime);  // o = earliest_timestamp
-                doc["l"] = timeSync.uptimeToTimestamp(newest_uptime);  // l = latest_timestamp
+                doc["o"] = historicalStorage->toTimestamp(timeSync, oldest_uptime);  // o = earliest_timestamp
+                doc["l"] = historicalStorage->toTimestamp(timeSync, newest_uptime);  // l = latest_timestamp
             } else {
                 doc["o"] = oldest_uptime;   // o = earliest_uptime
                 doc["l"] = newest_uptime;   // l = latest_uptime
@@ -598,26 +1224,125 @@ bool BluetoothComm::sendStorageInfo(const String& request_id) {
 // HISTORICAL DATA MANAGEMENT
 // ================================
 
-bool BluetoothComm::enableHistoricalData(size_t max_records) {
+bool BluetoothComm::enableHistoricalData(size_t max_records, size_t archive_bytes) {
+    if (historicalStorage) {
+        historicalDataEnabled = true;
+        return true;
+    }
+    
+    ownedStorage = std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("ram_only", max_records));
+    if (!enableHistoricalData(*ownedStorage, archive_bytes)) {
+        ownedStorage.reset();
+        return false;
+    }
+    return true;
+}
+
+bool BluetoothComm::enableHistoricalData(HistoricalDataStorage& storage, size_t archive_bytes) {
+    if (historicalStorage && historicalStorage != &storage) {
+        Serial.println("⚠️  Historical data already enabled with another storage");
+        return false;
+    }
+    
     if (!historicalStorage) {
-        historicalStorage = std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("ram_only", max_records));
-        if (!historicalStorage->initialize()) {
+        if (!storage.initialize()) {
             Serial.println("❌ Failed to initialize historical data storage");
-            historicalStorage.reset();
             return false;
         }
+        historicalStorage = &storage;
+        responseCache.clear();
+        
+        // Compressed archive keeps older history once the raw ring wraps
+        if (archive_bytes > 0 && !historicalStorage->enableArchive(archive_bytes)) {
+            Serial.println("⚠️  History archive unavailable - raw ring only");
+        }
+        
+#if HISTORY_ROLLUPS
+        // Rollups answer long-range requests (days/weeks) with min/max/mean buckets
+        if (!historicalStorage->enableRollups()) {
+            Serial.println("⚠️  History rollups unavailable - long ranges limited to raw history");
+        }
+#endif
+        
+#if HISTORY_STATISTICS
+        // Hour / day / boot statistics reported with storage info
+        if (!historicalStorage->enableStatistics()) {
+            Serial.println("⚠️  History statistics unavailable");
+        }
+#endif
+        
+#if HISTORY_QUANTILES
+        // CO2/VOC percentiles for stats_request
+        if (!historicalStorage->enableQuantiles()) {
+            Serial.println("⚠️  History quantile sketches unavailable");
+        }
+#endif
+        
+#if HISTORY_EPISODES
+        // Warning-and-above episodes for episodes_request
+        if (!historicalStorage->enableEpisodes()) {
+            Serial.println("⚠️  Alert episode index unavailable");
+        }
+#endif
+        
+#if HISTORY_PROFILE
+        // Hour-of-week means/maxima for profile_request
+        if (!historicalStorage->enableProfile()) {
+            Serial.println("⚠️  Diurnal profile unavailable");
+        }
+#endif
     }
     
     historicalDataEnabled = true;
-    Serial.printf("✅ Historical data enabled with %zu max records\n", max_records);
+    Serial.printf("✅ Historical data enabled with %zu max records (free heap %lu bytes)\n",
+                 historicalStorage->getMaxRecords(), (unsigned long)ESP.getFreeHeap());
     return true;
 }
 
-bool BluetoothComm::disableHistoricalData() {
-    if (historicalStorage) {
-        historicalStorage.reset();
+bool BluetoothComm::enableHistoryPersistence(IFileSystem& fs, const String& directory) {
+    if (!historicalStorage) {
+        Serial.println("❌ Enable historical data before persistence");
+        return false;
     }
+    
+    return historicalStorage->enablePersistence(fs, directory);
+}
+
+bool BluetoothComm::enableHistoryCheckpoint(IFileSystem& fs, uint32_t interval_ms, const String& directory) {
+    if (!historicalStorage) {
+        Serial.println("❌ Enable historical data before the checkpoint");
+        return false;
+    }
+    
+    return historicalStorage->enableCheckpoint(fs, directory, interval_ms);
+}
+
+bool BluetoothComm::enableHistoryDeadband() {
+    if (!historicalStorage) {
+        Serial.println("❌ Enable historical data before deadband storage");
+        return false;
+    }
+    
+    // Around sensor noise: CO2 ppm, °C, %RH, hPa, VOC ppb
+    static const float tolerances[SensorRecord::METRIC_COUNT] = { 10.0f, 0.1f, 0.5f, 0.5f, 1.0f };
+    return historicalStorage->enableDeadband(tolerances, samplingRate * 1000UL);
+}
+
+bool BluetoothComm::enableHistoryArchive(IFileSystem& fs, const String& directory) {
+    if (!historicalStorage) {
+        Serial.println("❌ Enable historical data before the SD archive");
+        return false;
+    }
+    
+    return historicalStorage->enableSdArchive(fs, directory);
+}
+
+bool BluetoothComm::disableHistoricalData() {
+    historyTransfer.cancel();   // Its cursor points into the storage
+    historicalStorage = nullptr;
+    ownedStorage.reset();
     historicalDataEnabled = false;
+    responseCache.clear();
     Serial.println("📊 Historical data disabled");
     return true;
 }
@@ -628,7 +1353,7 @@ bool BluetoothComm::storeCurrentReading(const CO2SensorData* co2_data,
         return false;
     }
     
-    return historicalStorage->storeReading(millis(), co2_data, voc_data);
+    return historicalStorage->storeReading(millis64(), co2_data, voc_data);
 }
 
 void BluetoothComm::parseAndHandleCommand(const String& command) {
@@ -644,7 +1369,7 @@ void BluetoothComm::parseAndHandleCommand(const String& command) {
     Serial.printf("🔍 Parsing command type: '%s'\n", type.c_str());
     
     if (type == "connection_ack") {
-        Serial.println("✅ Connection acknowledged");
+        handleConnectionAck(doc);
     } else if (type == "set_sampling_rate") {
         handleSetSamplingRate(doc);
     } else if (type == "calibrate_sensor") {
@@ -663,10 +1388,22 @@ void BluetoothComm::parseAndHandleCommand(const String& command) {
         handleTimeSyncSet(doc);
     } else if (type == "history_request") {
         handleHistoryRequest(doc);
+    } else if (type == "history_since") {
+        handleHistorySince(doc);
+    } else if (type == "history_ack") {
+        handleHistoryAck(doc);
+    } else if (type == "history_resume") {
+        handleHistoryResume(doc);
     } else if (type == "realtime_control") {
         handleRealtimeControl(doc);
     } else if (type == "storage_info_request") {
         handleStorageInfoRequest(doc);
+    } else if (type == "stats_request") {
+        handleStatsRequest(doc);
+    } else if (type == "episodes_request") {
+        handleEpisodesRequest(doc);
+    } else if (type == "profile_request") {
+        handleProfileRequest(doc);
     } else {
         sendErrorMessage("UNKNOWN_COMMAND", "Command not recognized: " + type, "warning");
     }
@@ -688,6 +1425,26 @@ void BluetoothComm::handleCalibrateSensor(JsonDocument& cmd) {
     Serial.printf("🔧 Calibration requested for: %s\n", sensor.c_str());
 }
 
+void BluetoothComm::handleConnectionAck(JsonDocument& cmd) {
+    Serial.println("✅ Connection acknowledged");
+    
+    // Optional "framing": "binary" (COBS frames from now on) or "json" (back to lines)
+    String framing = cmd["framing"].as<String>();
+    if (framing != "binary" && framing != "json") {
+        return;
+    }
+    
+    // Confirmed in the current mode - the switch applies to everything sent after it
+    JsonDocument reply;
+    reply["type"] = "framing";
+    reply["mode"] = framing;
+    reply["version"] = BinaryFrame::VERSION;
+    sendJsonMessage("framing", reply);
+    
+    binaryFraming = framing == "binary";
+    Serial.printf("📦 Framing: %s\n", binaryFraming ? "binary (COBS + CRC16)" : "JSON lines");
+}
+
 void BluetoothComm::handleGetDeviceInfo(JsonDocument& cmd) {
     sendDeviceInfo();
 }
@@ -704,6 +1461,9 @@ void BluetoothComm::handleStopStreaming(JsonDocument& cmd) {
 
 void BluetoothComm::handleRestartDevice(JsonDocument& cmd) {
     Serial.println("🔄 Restart requested via Bluetooth");
+    if (historicalStorage) {
+        historicalStorage->flush();  // Don't lose the pending batch / unsaved checkpoint pages
+    }
     delay(1000);
     ESP.restart();
 }
@@ -741,7 +1501,7 @@ void BluetoothComm::handleTimeSyncSet(JsonDocument& cmd) {
         timezone_offset = "+0000";
     }
     
-    Serial.printf("⏰ Setting time: %llu, timezone: %s\n", current_time, timezone_offset.c_str());
+    Serial.printf("⏰ Setting time: %llu, timezone: %s\n", (unsigned long long)current_time, timezone_offset.c_str());
     
     bool success = synchronizeTime(current_time, timezone_offset);
     sendTimeSyncAck(request_id, success);
@@ -759,10 +1519,75 @@ void BluetoothComm::handleHistoryRequest(JsonDocument& cmd) {
         range.max_points = 1000; // Default
     }
     
-    Serial.printf("📊 History request: %llu-%llu, max_points=%u\n", 
-                 range.start_time, range.end_time, range.max_points);
+    // Optional resume position from a previous response's "q" field
+    uint32_t resume_sequence = cmd["from_seq"].as<uint32_t>();
+    
+    // Optional metric whose peaks/dips survive downsampling (default co2)
+    size_t shape_metric = MinMaxDownsampler::metricFromName(cmd["shape"].as<String>());
+    
+    // Optional chunked transfer: points per chunk and chunks in flight before a history_ack
+    size_t chunk_size = cmd["chunk_size"].as<uint16_t>();
+    uint8_t window = cmd["window"].as<uint8_t>();
+    if (window == 0) {
+        window = HistoryTransfer::DEFAULT_WINDOW;
+    }
+    
+    // Optional "encoding": "delta" - raw points as delta-encoded columns
+    bool delta_encoding = cmd["encoding"].as<String>() == "delta";
+    
+    Serial.printf("📊 History request: %llu-%llu, max_points=%u, from_seq=%lu%s\n", 
+                 (unsigned long long)range.start_time, (unsigned long long)range.end_time, range.max_points,
+                 (unsigned long)resume_sequence,
+                 delta_encoding ? ", delta" : "");
+    
+    sendHistoricalData(request_id, range, chunk_size, resume_sequence, shape_metric, window, delta_encoding);
+}
+
+void BluetoothComm::handleHistoryAck(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    if (!historyTransfer.isActive() || historyTransfer.getRequestId() != request_id) {
+        return;   // Late ack of a finished or replaced transfer
+    }
+    
+    // chunk = highest chunk received in order; optional window resizes the credits
+    uint16_t chunk = cmd["chunk"].as<uint16_t>();
+    uint8_t window = cmd["window"].as<uint8_t>();
+    if (historyTransfer.acknowledge(chunk, window, millis())) {
+        Serial.printf("📦 History transfer %s complete\n", request_id.c_str());
+    }
+}
+
+void BluetoothComm::handleHistoryResume(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    uint16_t chunk = cmd["chunk"].as<uint16_t>();
     
-    sendHistoricalData(request_id, range);
+    if (!historyTransfer.isActive() || historyTransfer.getRequestId() != request_id) {
+        sendErrorMessage("NO_TRANSFER", "No history transfer with this request_id", "error", "", request_id);
+        return;
+    }
+    if (!historyTransfer.resume(chunk, millis())) {
+        historyTransfer.cancel();
+        sendErrorMessage("TRANSFER_EXPIRED", "Chunk can no longer be sent, request again", "error", "", request_id);
+        return;
+    }
+    
+    Serial.printf("📦 History transfer %s resumed at chunk %u\n", request_id.c_str(), chunk);
+}
+
+void BluetoothComm::handleHistorySince(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    
+    // seq/b = "q"/"b" of the last response, both absent on the first sync
+    uint32_t sequence = cmd["seq"].as<uint32_t>();
+    uint32_t boot_id = cmd["b"].as<uint32_t>();
+    size_t max_records = cmd["max_points"].as<uint16_t>();
+    if (max_records == 0) {
+        max_records = 1000; // Default
+    }
+    
+    Serial.printf("📊 History since %lu (boot %08lx), max %zu records\n",
+                 (unsigned long)sequence, (unsigned long)boot_id, max_records);
+    sendHistorySince(request_id, sequence, boot_id, max_records);
 }
 
 void BluetoothComm::handleRealtimeControl(JsonDocument& cmd) {
@@ -791,6 +1616,67 @@ void BluetoothComm::handleStorageInfoRequest(JsonDocument& cmd) {
     sendStorageInfo(request_id);
 }
 
+void BluetoothComm::handleEpisodesRequest(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    
+    // Optional time range (needs time sync) - all indexed episodes without it
+    uint64_t start_uptime = 0;
+    uint64_t end_uptime = UINT64_MAX;
+    TimeRange range;
+    range.start_time = cmd["start_time"].as<uint64_t>();
+    range.end_time = cmd["end_time"].as<uint64_t>();
+    if (range.start_time > 0 || range.end_time > 0) {
+        if (range.end_time == 0) {
+            range.end_time = timeSync.getCurrentTimestamp();
+        }
+        if (!historicalStorage ||
+            !historicalStorage->resolveUptimeRange(range, timeSync, start_uptime, end_uptime)) {
+            sendErrorMessage("INVALID_RANGE", "Time range needs time sync", "error", "", request_id);
+            return;
+        }
+    }
+    
+    // Optional minimum peak level (AlertLevel number, e.g. 3 = critical only)
+    uint8_t min_peak_level = cmd["level"].as<uint8_t>();
+    
+    Serial.printf("🚨 Alert episodes requested: %llu-%llu, level >= %u\n",
+                 (unsigned long long)start_uptime, (unsigned long long)end_uptime, min_peak_level);
+    sendAlertEpisodes(request_id, start_uptime, end_uptime, min_peak_level);
+}
+
+void BluetoothComm::handleProfileRequest(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    
+    // Optional "metric" (co2, temperature, humidity, pressure, voc), co2 by default
+    size_t metric = MinMaxDownsampler::metricFromName(cmd["metric"].as<String>());
+    
+    Serial.printf("🗓️ Profile requested: metric=%u\n", (unsigned)metric);
+    sendProfile(request_id, metric);
+}
+
+void BluetoothComm::handleStatsRequest(JsonDocument& cmd) {
+    String request_id = cmd["request_id"].as<String>();
+    
+    // Optional filters: "metric" ("co2"/"voc") and "window" ("day"/"week"), both by default
+    size_t metric = SIZE_MAX;
+    if (cmd["metric"].is<const char*>()) {
+        metric = MinMaxDownsampler::metricFromName(cmd["metric"].as<String>());
+    }
+    
+    int window = -1;
+    String window_name = cmd["window"].as<String>();
+    if (window_name == "day") {
+        window = QuantileStatistics::LAST_DAY;
+    } else if (window_name == "week") {
+        window = QuantileStatistics::LAST_WEEK;
+    }
+    
+    Serial.printf("📊 Stats requested: metric=%s window=%s\n",
+                 metric == SIZE_MAX ? "all" : cmd["metric"].as<String>().c_str(),
+                 window < 0 ? "all" : window_name.c_str());
+    sendStatistics(request_id, metric, window);
+}
+
 bool BluetoothComm::sendErrorMessage(const String& errorCode, const String& message, 
                                     const String& severity, const String& sensor,
                                     const String& request_id, JsonDocument* details) {
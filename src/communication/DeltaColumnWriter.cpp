@@ -0,0 +1,298 @@
+/*
+ * communication/DeltaColumnWriter.cpp
+ * Implementation of the delta-encoded history columns
+ */
+
+#include "communication/DeltaColumnWriter.h"
+
+const uint8_t DeltaColumnWriter::DECIMALS[SensorRecord::METRIC_COUNT] = { 0, 2, 2, 2, 2 };
+
+static const float SCALES[SensorRecord::METRIC_COUNT] = { 1.0f, 100.0f, 100.0f, 100.0f, 100.0f };
+
+// Decimal text of value, written backwards from the end of text
+static size_t formatInt(char (&text)[21], int64_t value) {
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    size_t start = sizeof(text);
+    do {
+        text[--start] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        text[--start] = '-';
+    }
+    return start;
+}
+
+static size_t printInt(Print& out, int64_t value) {
+    char text[21];
+    size_t start = formatInt(text, value);
+    return out.write((const uint8_t*)text + start, sizeof(text) - start);
+}
+
+static size_t printHex(Print& out, uint8_t byte) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    char hex[2] = { HEX_DIGITS[byte >> 4], HEX_DIGITS[byte & 0x0F] };
+    return out.write((const uint8_t*)hex, sizeof(hex));
+}
+
+// Same rounding as the point format; NaN or out-of-range values count as missing
+static bool scaledValue(const SensorRecord& record, size_t metric, int32_t& value) {
+    float scaled = record.getValue(metric) * SCALES[metric];
+    if (!(record.validity_flags & SensorRecord::metricFlag(metric)) || !(fabsf(scaled) < 2.0e9f)) {
+        return false;
+    }
+    value = (int32_t)lroundf(scaled);
+    return true;
+}
+
+// Opening of the "t" column up to its "d" array: n = points, b = first, i = interval
+// (first gap), d = each gap after the first minus the interval
+static size_t printTimestampHead(Print& out, size_t count, uint64_t first_timestamp, int64_t interval) {
+    size_t bytes = out.print("{\"t\":{\"n\":");
+    bytes += printInt(out, (int64_t)count);
+    bytes += out.print(",\"b\":");
+    bytes += printInt(out, (int64_t)first_timestamp);
+    bytes += out.print(",\"i\":");
+    bytes += printInt(out, interval);
+    bytes += out.print(",\"d\":[");
+    return bytes;
+}
+
+// x = decimals, d = first value then differences
+static size_t printValueHead(Print& out, size_t metric) {
+    return out.printf(",\"%s\":{\"x\":%u,\"d\":[", SensorRecord::metricKey(metric),
+                      DeltaColumnWriter::DECIMALS[metric]);
+}
+
+// ================================
+// COLLECTING
+// ================================
+
+void DeltaColumnWriter::clear() {
+    count = 0;
+    first_timestamp = 0;
+    previous_timestamp = 0;
+    interval = 0;
+    gaps.clear();
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        columns[i].deltas.clear();
+        columns[i].valid.clear();
+        columns[i].previous = 0;
+        columns[i].values = 0;
+    }
+}
+
+void DeltaColumnWriter::add(uint64_t timestamp, const SensorRecord& record) {
+    if (count == 0) {
+        first_timestamp = timestamp;
+    } else {
+        // The first gap is the interval itself; only later gaps are sent as deviations
+        int64_t gap = (int64_t)(timestamp - previous_timestamp);
+        if (count == 1) {
+            interval = gap;
+        } else {
+            appendInt(gaps, gap - interval);
+        }
+    }
+    previous_timestamp = timestamp;
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        Column& column = columns[i];
+        if (count % 8 == 0) {
+            column.valid.push_back(0);
+        }
+
+        int32_t value;
+        if (!scaledValue(record, i, value)) {
+            continue;
+        }
+        appendInt(column.deltas, column.values == 0 ? value : (int64_t)value - column.previous);
+        column.previous = value;
+        column.values++;
+        column.valid.back() |= 1 << (count % 8);
+    }
+    count++;
+}
+
+void DeltaColumnWriter::appendInt(std::vector<char>& text, int64_t value) {
+    if (!text.empty()) {
+        text.push_back(',');
+    }
+    char digits[21];
+    size_t start = formatInt(digits, value);
+    text.insert(text.end(), digits + start, digits + sizeof(digits));
+}
+
+// ================================
+// OUTPUT
+// ================================
+
+size_t DeltaColumnWriter::write(Print& out) const {
+    size_t bytes = printTimestampHead(out, count, first_timestamp, interval);
+    bytes += out.write((const uint8_t*)gaps.data(), gaps.size());
+    bytes += out.print("]}");
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        const Column& column = columns[i];
+        if (column.values == 0) {
+            continue;
+        }
+
+        // m = which points have a value
+        bytes += printValueHead(out, i);
+        bytes += out.write((const uint8_t*)column.deltas.data(), column.deltas.size());
+        bytes += out.print(']');
+        if (column.values < count) {
+            bytes += out.print(",\"m\":\"");
+            for (uint8_t byte : column.valid) {
+                bytes += printHex(out, byte);
+            }
+            bytes += out.print('"');
+        }
+        bytes += out.print('}');
+    }
+
+    bytes += out.print('}');
+    return bytes;
+}
+
+// ================================
+// STREAMING
+// ================================
+
+DeltaColumnStream::DeltaColumnStream(Print& out)
+    : out(out)
+    , pass(PASS_COUNT)
+    , metric(0)
+    , bytes(0)
+    , count(0)
+    , first_timestamp(0)
+    , interval(0)
+    , index(0)
+    , previous_timestamp(0)
+    , previous(0)
+    , written(0)
+    , bitmap(0) {
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        values[i] = 0;
+    }
+}
+
+void DeltaColumnStream::add(uint64_t timestamp, const SensorRecord& record) {
+    int32_t value;
+    switch (pass) {
+        case PASS_COUNT:
+            if (index == 0) {
+                first_timestamp = timestamp;
+            } else if (index == 1) {
+                interval = (int64_t)(timestamp - previous_timestamp);
+            }
+            for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+                if (scaledValue(record, i, value)) {
+                    values[i]++;
+                }
+            }
+            count++;
+            break;
+
+        case PASS_TIMESTAMPS:
+            if (index >= 2) {
+                if (index > 2) {
+                    bytes += out.print(',');
+                }
+                bytes += printInt(out, (int64_t)(timestamp - previous_timestamp) - interval);
+            }
+            break;
+
+        case PASS_VALUES:
+            if (scaledValue(record, metric, value)) {
+                if (written > 0) {
+                    bytes += out.print(',');
+                }
+                bytes += printInt(out, written == 0 ? value : (int64_t)value - previous);
+                previous = value;
+                written++;
+            }
+            break;
+
+        case PASS_BITMAP:
+            if (scaledValue(record, metric, value)) {
+                bitmap |= 1 << (index % 8);
+            }
+            if (index % 8 == 7) {
+                bytes += printHex(out, bitmap);
+                bitmap = 0;
+            }
+            break;
+
+        case PASS_DONE:
+            return;
+    }
+    previous_timestamp = timestamp;
+    index++;
+}
+
+bool DeltaColumnStream::nextPass() {
+    // Close the column of the pass just finished and pick the next one
+    bool more;
+    switch (pass) {
+        case PASS_COUNT:
+            bytes += printTimestampHead(out, count, first_timestamp, interval);
+            pass = PASS_TIMESTAMPS;
+            more = count > 2;            // The first two points are already in "b" and "i"
+            if (!more) {
+                bytes += out.print("]}");
+                more = beginColumn(0);
+            }
+            break;
+
+        case PASS_TIMESTAMPS:
+            bytes += out.print("]}");
+            more = beginColumn(0);
+            break;
+
+        case PASS_VALUES:
+            bytes += out.print(']');
+            if (values[metric] < count) {
+                bytes += out.print(",\"m\":\"");
+                pass = PASS_BITMAP;
+                more = true;
+                break;
+            }
+            bytes += out.print('}');
+            more = beginColumn(metric + 1);
+            break;
+
+        case PASS_BITMAP:
+            if (index % 8 != 0) {
+                bytes += printHex(out, bitmap);
+            }
+            bytes += out.print("\"}");
+            more = beginColumn(metric + 1);
+            break;
+
+        default:
+            return false;
+    }
+
+    index = 0;
+    previous_timestamp = 0;
+    previous = 0;
+    written = 0;
+    bitmap = 0;
+    return more;
+}
+
+bool DeltaColumnStream::beginColumn(size_t first_metric) {
+    // A metric without any valid value is left out
+    for (metric = first_metric; metric < SensorRecord::METRIC_COUNT; metric++) {
+        if (values[metric] > 0) {
+            bytes += printValueHead(out, metric);
+            pass = PASS_VALUES;
+            return true;
+        }
+    }
+    bytes += out.print('}');
+    pass = PASS_DONE;
+    return false;
+}
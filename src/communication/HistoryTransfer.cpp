@@ -0,0 +1,189 @@
+/*
+ * communication/HistoryTransfer.cpp
+ * Implementation of the chunked history transfer state
+ */
+
+#include "communication/HistoryTransfer.h"
+
+void HistoryTransfer::start(const HistoricalDataStorage& source_storage, const String& id, int chunk_resolution,
+                            uint64_t start, uint64_t end, uint32_t resume_sequence,
+                            uint16_t points, size_t metric, uint16_t chunk_size, uint8_t credits,
+                            bool delta, uint32_t now) {
+    storage = &source_storage;
+    active = true;
+    request_id = id;
+
+    resolution = chunk_resolution;
+    start_uptime = start;
+    end_uptime = end;
+    max_points = points;
+    shape_metric = metric;
+    chunk_points = constrain(chunk_size, (uint16_t)1, MAX_CHUNK_POINTS);
+    delta_encoding = delta && resolution == HistoricalDataStorage::RAW_RESOLUTION;
+    generation = storage->getGeneration();
+
+    next_chunk = 0;
+    acknowledged = 0;
+    window = constrain(credits, (uint8_t)1, MAX_WINDOW);
+    sent_last = false;
+    last_chunk = 0;
+    last_activity = now;
+    produced_chunk = 0;
+    chunk_sent_points = 0;
+
+    if (resolution == HistoricalDataStorage::RAW_RESOLUTION) {
+        cursor = storage->openCursor(start_uptime, end_uptime);
+        cursor.seek(resume_sequence);
+        total = cursor.remaining();
+        source = SourceState();
+        source.sampler = MinMaxDownsampler(total, max_points, shape_metric);
+        checkpoints.assign(MAX_WINDOW + 1, Checkpoint());
+    } else {
+        const RollupTier& tier = storage->getRollups().tier(resolution);
+        size_t end_index;
+        tier.findRange(start_uptime, end_uptime, rollup_begin, end_index);
+        total = end_index - rollup_begin;
+        rollup_start_s = total > 0 ? tier.at(rollup_begin).start_s : 0;
+        cursor = HistoryCursor();
+        std::vector<Checkpoint>().swap(checkpoints);
+    }
+}
+
+void HistoryTransfer::cancel() {
+    active = false;
+    storage = nullptr;
+    cursor = HistoryCursor();
+    std::vector<Checkpoint>().swap(checkpoints);
+}
+
+bool HistoryTransfer::acknowledge(uint16_t chunk, uint8_t new_window, uint32_t now) {
+    if (!active) {
+        return false;
+    }
+
+    // Acks for chunks not sent yet are clamped, stale ones do not move the window back
+    uint16_t received = min((uint16_t)(chunk + 1), next_chunk);
+    acknowledged = max(acknowledged, received);
+    if (new_window > 0) {
+        window = min(new_window, (uint8_t)MAX_WINDOW);
+    }
+    last_activity = now;
+
+    if (sent_last && acknowledged > last_chunk) {
+        cancel();
+        return true;
+    }
+    return false;
+}
+
+bool HistoryTransfer::resume(uint16_t chunk, uint32_t now) {
+    if (!active || chunk > next_chunk || !storageUnchanged()) {
+        return false;
+    }
+
+    if (resolution == HistoricalDataStorage::RAW_RESOLUTION && chunk != produced_chunk) {
+        // Only the last MAX_WINDOW + 1 chunks can be sent again
+        const Checkpoint& checkpoint = checkpoints[chunk % checkpoints.size()];
+        if (checkpoint.chunk != chunk) {
+            return false;
+        }
+        source = checkpoint.state;
+        uint64_t from = source.has_read ? source.read_uptime + 1 : start_uptime;
+        cursor = HistoryCursor(storage, checkpoint.sequence, end_uptime, from);
+        produced_chunk = chunk;
+    }
+
+    next_chunk = chunk;
+    acknowledged = chunk;   // Everything before the missing chunk arrived
+    sent_last = false;
+    last_activity = now;
+    return true;
+}
+
+bool HistoryTransfer::beginChunk() {
+    if (!storageUnchanged()) {
+        return false;
+    }
+    chunk_sent_points = 0;
+
+    if (resolution == HistoricalDataStorage::RAW_RESOLUTION) {
+        Checkpoint& checkpoint = checkpoints[next_chunk % checkpoints.size()];
+        checkpoint.chunk = next_chunk;
+        checkpoint.sequence = cursor.markSequence();
+        checkpoint.state = source;
+    } else {
+        // Find the first bucket again - the tier may have dropped older ones since
+        const RollupTier& tier = storage->getRollups().tier(resolution);
+        size_t end_index;
+        tier.findRange(start_uptime, end_uptime, rollup_begin, end_index);
+    }
+    return true;
+}
+
+bool HistoryTransfer::nextRecord(SensorRecord& record) {
+    if (chunk_sent_points == chunk_points || !fillPending()) {
+        return false;
+    }
+    record = source.pending[source.pending_index++];
+    chunk_sent_points++;
+    return true;
+}
+
+void HistoryTransfer::bucketRange(size_t& begin, size_t& end) const {
+    const RollupTier& tier = storage->getRollups().tier(resolution);
+    size_t first = (size_t)next_chunk * chunk_points;
+    begin = min(rollup_begin + first, tier.size());
+    end = min(rollup_begin + min((size_t)total, first + chunk_points), tier.size());
+}
+
+bool HistoryTransfer::endChunk(uint32_t now) {
+    bool last;
+    if (resolution == HistoricalDataStorage::RAW_RESOLUTION) {
+        last = !fillPending();
+        produced_chunk = next_chunk + 1;
+    } else {
+        last = (size_t)(next_chunk + 1) * chunk_points >= total;
+    }
+
+    if (last) {
+        sent_last = true;
+        last_chunk = next_chunk;
+    }
+    next_chunk++;
+    last_activity = now;
+    return last;
+}
+
+bool HistoryTransfer::fillPending() {
+    while (source.pending_index == source.pending_count) {
+        if (source.input_done) {
+            return false;
+        }
+
+        SensorRecord record;
+        if (cursor.next(record)) {
+            source.has_read = true;
+            source.read_uptime = record.getUptime();
+            source.pending_count = source.sampler.add(record, source.pending);
+        } else {
+            source.pending_count = source.sampler.finish(source.pending);
+            source.input_done = true;
+        }
+        source.pending_index = 0;
+    }
+    return true;
+}
+
+bool HistoryTransfer::storageUnchanged() const {
+    if (!storage || storage->getGeneration() != generation) {
+        return false;   // Formatted, deadband switched, history reloaded
+    }
+    if (resolution != HistoricalDataStorage::RAW_RESOLUTION && total > 0) {
+        // The range's first bucket must still be there
+        const RollupTier& tier = storage->getRollups().tier(resolution);
+        size_t begin, end;
+        tier.findRange(start_uptime, end_uptime, begin, end);
+        return begin < tier.size() && tier.at(begin).start_s == rollup_start_s;
+    }
+    return true;
+}
@@ -0,0 +1,192 @@
+/*
+ * communication/RealtimeWriter.cpp
+ * Implementation of the realtime sensor_data formatter
+ */
+
+#include "communication/RealtimeWriter.h"
+
+// ================================
+// CONSTANT FRAGMENTS
+// ================================
+
+// Literal and its length, without the terminator
+#define FRAGMENT(text) text, sizeof(text) - 1
+
+struct Fragment {
+    const char* text;
+    size_t length;
+};
+
+// Reading = head + value + tail + status word
+struct ReadingFormat {
+    Fragment head;
+    Fragment tail;
+};
+
+enum ReadingIndex { READING_CO2, READING_TEMPERATURE, READING_HUMIDITY, READING_PRESSURE,
+                    READING_VOC, READING_PM2_5, READING_PM10 };
+
+static const ReadingFormat READINGS[] = {
+    { { FRAGMENT("\"co2\":{\"value\":") },         { FRAGMENT(",\"unit\":\"ppm\",\"accuracy\":0.95,\"status\":\"") } },
+    { { FRAGMENT("\"temperature\":{\"value\":") }, { FRAGMENT(",\"unit\":\"celsius\",\"accuracy\":0.98,\"status\":\"") } },
+    { { FRAGMENT("\"humidity\":{\"value\":") },    { FRAGMENT(",\"unit\":\"percent\",\"accuracy\":0.92,\"status\":\"") } },
+    { { FRAGMENT("\"pressure\":{\"value\":") },    { FRAGMENT(",\"unit\":\"hPa\",\"accuracy\":0.99,\"status\":\"") } },
+    { { FRAGMENT("\"voc\":{\"value\":") },         { FRAGMENT(",\"unit\":\"ppb\",\"accuracy\":0.85,\"status\":\"") } },
+    { { FRAGMENT("\"pm2_5\":{\"value\":") },       { FRAGMENT(",\"unit\":\"μg/m³\",\"accuracy\":0.9,\"status\":\"") } },
+    { { FRAGMENT("\"pm10\":{\"value\":") },        { FRAGMENT(",\"unit\":\"μg/m³\",\"accuracy\":0.9,\"status\":\"") } },
+};
+
+static const Fragment HEAD = { FRAGMENT("{\"type\":\"sensor_data\",\"timestamp\":") };
+static const Fragment DEVICE_ID = { FRAGMENT(",\"device_id\":\"") };
+static const Fragment READINGS_OPEN = { FRAGMENT("\",\"readings\":{") };
+static const Fragment VALID = { FRAGMENT("valid\"}") };
+static const Fragment INVALID = { FRAGMENT("invalid\"}") };
+static const Fragment END = { FRAGMENT("}}\n") };
+
+#undef FRAGMENT
+
+// ================================
+// MESSAGE
+// ================================
+
+void RealtimeWriter::setDeviceId(const String& device_id) {
+    size_t id_length = min((size_t)device_id.length(), (size_t)MAX_DEVICE_ID);
+
+    char* out = device_fragment;
+    memcpy(out, DEVICE_ID.text, DEVICE_ID.length);
+    out += DEVICE_ID.length;
+    memcpy(out, device_id.c_str(), id_length);
+    out += id_length;
+    memcpy(out, READINGS_OPEN.text, READINGS_OPEN.length);
+    out += READINGS_OPEN.length;
+    prefix_length = out - device_fragment;
+}
+
+size_t RealtimeWriter::format(const SensorDataBase& data, uint32_t timestamp) {
+    begin(timestamp);
+
+    SensorType sensorType = data.getType();
+    if (sensorType == SensorType::CO2_TEMP_HUMIDITY) {
+        const CO2SensorData& co2Data = static_cast<const CO2SensorData&>(data);
+        appendReading(READING_CO2, co2Data.co2, co2Data.isDataValid());
+        appendReading(READING_TEMPERATURE, co2Data.temperature, true);
+        appendReading(READING_HUMIDITY, co2Data.humidity, true);
+
+    } else if (sensorType == SensorType::VOC_GAS) {
+        const VOCSensorData& vocData = static_cast<const VOCSensorData&>(data);
+        appendReading(READING_VOC, vocData.vocEstimate, vocData.gasValid);
+        appendReading(READING_TEMPERATURE, vocData.temperature, true);
+        appendReading(READING_HUMIDITY, vocData.humidity, true);
+        appendReading(READING_PRESSURE, vocData.pressure / 100.0f, true);
+
+    } else if (sensorType == SensorType::PARTICULATE_MATTER) {
+        const PMSensorData& pmData = static_cast<const PMSensorData&>(data);
+        appendReading(READING_PM2_5, pmData.pm2_5_atmospheric, pmData.isDataValid());
+        appendReading(READING_PM10, pmData.pm10_atmospheric, pmData.isDataValid());
+    }
+
+    return end();
+}
+
+size_t RealtimeWriter::formatSnapshot(const CO2SensorData* co2_data, const VOCSensorData* voc_data,
+                                      uint32_t timestamp) {
+    begin(timestamp);
+
+    // Same merge as SensorRecord: the SCD41 measures temperature and humidity next to
+    // the CO2 cell, the BME688 values are used when it has no valid reading
+    bool has_co2 = co2_data && co2_data->isValid();
+    bool has_voc = voc_data && voc_data->isValid();
+    if (has_co2) {
+        appendReading(READING_CO2, co2_data->co2, true);
+        appendReading(READING_TEMPERATURE, co2_data->temperature, true);
+        appendReading(READING_HUMIDITY, co2_data->humidity, true);
+    } else if (has_voc) {
+        appendReading(READING_TEMPERATURE, voc_data->temperature, true);
+        appendReading(READING_HUMIDITY, voc_data->humidity, true);
+    }
+    if (has_voc) {
+        appendReading(READING_VOC, voc_data->vocEstimate, voc_data->gasValid);
+        appendReading(READING_PRESSURE, voc_data->pressure / 100.0f, true);
+    }
+
+    return end();
+}
+
+void RealtimeWriter::begin(uint32_t timestamp) {
+    used = 0;
+    overflow = false;
+    readings = 0;
+
+    append(HEAD.text, HEAD.length);
+    appendUint(timestamp);
+    append(device_fragment, prefix_length);
+}
+
+size_t RealtimeWriter::end() {
+    append(END.text, END.length);
+    return overflow ? 0 : used;
+}
+
+void RealtimeWriter::appendReading(size_t reading, float value, bool valid) {
+    const ReadingFormat& format = READINGS[reading];
+    if (readings++ > 0) {
+        append(",", 1);
+    }
+    append(format.head.text, format.head.length);
+    appendFixed(value);
+    append(format.tail.text, format.tail.length);
+    const Fragment& status = valid ? VALID : INVALID;
+    append(status.text, status.length);
+}
+
+// ================================
+// FORMATTING
+// ================================
+
+void RealtimeWriter::append(const char* text, size_t length) {
+    if (used + length > CAPACITY) {
+        overflow = true;
+        return;
+    }
+    memcpy(buffer + used, text, length);
+    used += length;
+}
+
+void RealtimeWriter::appendUint(uint32_t value) {
+    char text[10];
+    size_t start = sizeof(text);
+    do {
+        text[--start] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    append(text + start, sizeof(text) - start);
+}
+
+void RealtimeWriter::appendFixed(float value) {
+    // Integer arithmetic only - printf("%f") may allocate in newlib
+    if (!(fabsf(value) < 2.0e7f)) {   // NaN, infinity, beyond any sensor's range
+        append("null", 4);
+        return;
+    }
+
+    // Whole part and fraction separately: both are exact in float, while value * 100
+    // loses the hundredths above ~170000
+    float magnitude = fabsf(value);
+    float whole = floorf(magnitude);
+    uint32_t units = (uint32_t)whole;
+    uint32_t fraction = (uint32_t)lroundf((magnitude - whole) * 100.0f);
+    if (fraction == 100) {
+        units++;
+        fraction = 0;
+    }
+    if (value < 0 && (units > 0 || fraction > 0)) {   // No "-0"
+        append("-", 1);
+    }
+    appendUint(units);
+
+    if (fraction == 0) {
+        return;
+    }
+    char text[3] = { '.', (char)('0' + fraction / 10), (char)('0' + fraction % 10) };
+    append(text, fraction % 10 == 0 ? 2 : 3);
+}
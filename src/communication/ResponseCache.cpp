@@ -0,0 +1,117 @@
+/*
+ * communication/ResponseCache.cpp
+ * Implementation of the history response cache
+ */
+
+#include "communication/ResponseCache.h"
+
+size_t ResponseCapture::write(const uint8_t* buffer, size_t size) {
+    if (!overflow) {
+        if (bytes.size() + size > max_bytes) {
+            // Too large to cache - stop copying and release what was kept
+            overflow = true;
+            std::vector<uint8_t>().swap(bytes);
+        } else {
+            bytes.insert(bytes.end(), buffer, buffer + size);
+        }
+    }
+    return target.write(buffer, size);
+}
+
+ResponseCache::Stamp ResponseCache::Stamp::of(const HistoricalDataStorage& storage, uint64_t time_offset) {
+    Stamp stamp;
+    stamp.generation = storage.getGeneration();
+    stamp.time_offset = time_offset;
+    stamp.folded_readings = storage.getFoldedReadings();
+    return stamp;
+}
+
+void ResponseCache::Stamp::setRaw(const HistoricalDataStorage& storage, const HistoryCursor& cursor,
+                                  bool resolved, uint64_t end_uptime) {
+    resolution = HistoricalDataStorage::RAW_RESOLUTION;
+    first_sequence = cursor.position();
+    total = cursor.remaining();
+
+    // Records stored later only land in ranges that reach the newest record
+    uint64_t oldest_uptime, newest_uptime;
+    if (!resolved || !storage.getDataTimeRange(oldest_uptime, newest_uptime) || end_uptime >= newest_uptime) {
+        next_sequence = storage.getNextSequence();
+    }
+}
+
+void ResponseCache::Stamp::setRollup(const HistoricalDataStorage& storage, size_t tier_index,
+                                     size_t begin, size_t end) {
+    // Stored readings only change the newest (open) bucket; a full tier dropping its
+    // oldest bucket moves begin
+    resolution = tier_index;
+    first_sequence = begin;
+    total = end - begin;
+    if (end == storage.getRollups().tier(tier_index).size()) {
+        next_sequence = storage.getNextSequence();
+    }
+}
+
+const std::vector<uint8_t>* ResponseCache::find(const Key& key, const Stamp& stamp) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!(entries[i].key == key)) {
+            continue;
+        }
+
+        if (!(entries[i].stamp == stamp)) {
+            erase(i);
+            stats.stale++;
+            break;
+        }
+
+        entries[i].last_used = ++clock;
+        stats.hits++;
+        stats.bytes_served += entries[i].body.size();
+        return &entries[i].body;
+    }
+
+    stats.misses++;
+    return nullptr;
+}
+
+bool ResponseCache::store(const Key& key, const Stamp& stamp, std::vector<uint8_t>& body) {
+    if (!isEnabled() || body.empty() || body.size() > budget) {
+        return false;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].key == key) {
+            erase(i);
+            break;
+        }
+    }
+
+    // Least recently used entries make room
+    while (!entries.empty() && (entries.size() >= entry_limit || used_bytes + body.size() > budget)) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < entries.size(); i++) {
+            if (entries[i].last_used < entries[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        erase(oldest);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.stamp = stamp;
+    entry.body.swap(body);
+    entry.last_used = ++clock;
+    used_bytes += entry.body.size();
+    entries.push_back(std::move(entry));
+    return true;
+}
+
+void ResponseCache::clear() {
+    entries.clear();
+    used_bytes = 0;
+}
+
+void ResponseCache::erase(size_t index) {
+    used_bytes -= entries[index].body.size();
+    entries.erase(entries.begin() + index);
+}
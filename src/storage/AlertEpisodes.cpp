@@ -0,0 +1,105 @@
+/*
+ * storage/AlertEpisodes.cpp
+ * Implementation of the alert episode index
+ */
+
+#include "storage/AlertEpisodes.h"
+
+bool AlertEpisodeIndex::begin(uint8_t level, size_t max_episodes, uint32_t max_gap) {
+    if (level == 0 || max_episodes == 0) {
+        return false;
+    }
+
+    min_level = level;
+    max_gap_ms = max_gap;
+    episodes.assign(max_episodes, AlertEpisode());
+    clear();
+    return true;
+}
+
+void AlertEpisodeIndex::clear() {
+    head = 0;
+    used = 0;
+    open = false;
+    last_uptime = 0;
+}
+
+void AlertEpisodeIndex::add(const SensorRecord& record, uint32_t sequence) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    uint64_t uptime = record.getUptime();
+    bool continues = open && uptime - last_uptime <= max_gap_ms;
+    last_uptime = uptime;
+
+    if (record.alert_level < min_level) {
+        open = false;
+        return;
+    }
+
+    if (!continues) {
+        if (used == episodes.size()) {
+            // Full - the oldest episode makes room
+            head = (head + 1) % episodes.size();
+            used--;
+        }
+
+        used++;
+        AlertEpisode& started = newest();
+        started = AlertEpisode();
+        started.start_uptime = uptime;
+        started.first_sequence = sequence;
+        open = true;
+    }
+
+    AlertEpisode& episode = newest();
+    episode.end_uptime = uptime;
+    episode.record_count++;
+    episode.peak_level = max(episode.peak_level, record.alert_level);
+    if (record.validity_flags & SensorRecord::FLAG_CO2_VALID) {
+        episode.peak_co2 = max(episode.peak_co2, record.getCo2());
+    }
+    if (record.validity_flags & SensorRecord::FLAG_VOC_VALID) {
+        episode.peak_voc = max(episode.peak_voc, record.getVoc());
+    }
+}
+
+void AlertEpisodeIndex::dropBefore(uint64_t uptime) {
+    while (used > 0 && at(0).end_uptime < uptime) {
+        head = (head + 1) % episodes.size();
+        used--;
+    }
+
+    if (used == 0) {
+        open = false;
+    }
+}
+
+void AlertEpisodeIndex::findRange(uint64_t start_uptime, uint64_t end_uptime,
+                                  size_t& begin, size_t& end) const {
+    // First episode that ends at or after start_uptime
+    size_t low = 0;
+    size_t high = used;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (at(mid).end_uptime < start_uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    begin = low;
+
+    // First episode that starts after end_uptime
+    high = used;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (at(mid).start_uptime <= end_uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    end = low;
+}
@@ -0,0 +1,482 @@
+/*
+ * storage/CompressedBlock.cpp
+ * Implementation of Gorilla-style compressed record blocks
+ */
+
+#include "storage/CompressedBlock.h"
+
+// ================================
+// VALUE HELPERS
+// ================================
+
+static void recordValues(const SensorRecord& record, uint32_t values[GorillaState::METRIC_COUNT]) {
+    // Native bits: float bits for the legacy layout, fixed-point integers for the quantized one
+    for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+        values[i] = record.getRawValue(i);
+    }
+}
+
+static void applyValues(SensorRecord& record, const uint32_t values[GorillaState::METRIC_COUNT]) {
+    for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+        record.setRawValue(i, values[i]);
+    }
+}
+
+static uint8_t leadingZeros(uint32_t value) {
+    return value == 0 ? 32 : __builtin_clz(value);
+}
+
+static uint8_t trailingZeros(uint32_t value) {
+    return value == 0 ? 32 : __builtin_ctz(value);
+}
+
+// ================================
+// COMPRESSED BLOCK
+// ================================
+
+void CompressedBlock::reset(uint32_t first_seq) {
+    first_sequence = first_seq;
+    first_uptime = 0;
+    last_uptime = 0;
+    record_count = 0;
+    bit_length = 0;
+    sealed = false;
+}
+
+bool CompressedBlock::append(const SensorRecord& record, GorillaState& writer) {
+    if (sealed || writer.bit_position + MAX_RECORD_BITS > BLOCK_BYTES * 8) {
+        return false;
+    }
+
+    uint32_t uptime = record.getRawTime();
+    uint32_t values[GorillaState::METRIC_COUNT];
+    recordValues(record, values);
+
+    if (record_count == 0) {
+        // First record: uptime lives in the header, values stored verbatim
+        writer.reset();
+        first_uptime = uptime;
+        for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+            writeBits(writer, values[i], 32);
+            writer.prev_values[i] = values[i];
+            writer.prev_leading[i] = GorillaState::NO_WINDOW;
+        }
+        writeBits(writer, record.validity_flags, 8);
+        writeBits(writer, record.alert_level, 8);
+    } else {
+        // Timestamp: delta-of-delta against the previous interval
+        int32_t delta = (int32_t)(uptime - writer.prev_uptime);
+        int32_t dod = delta - writer.prev_delta;
+        if (dod == 0) {
+            writeBits(writer, 0x0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            writeBits(writer, 0x2, 2);
+            writeBits(writer, dod + 63, 7);
+        } else if (dod >= -255 && dod <= 256) {
+            writeBits(writer, 0x6, 3);
+            writeBits(writer, dod + 255, 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            writeBits(writer, 0xE, 4);
+            writeBits(writer, dod + 2047, 12);
+        } else {
+            writeBits(writer, 0xF, 4);
+            writeBits(writer, (uint32_t)dod, 32);
+        }
+        writer.prev_delta = delta;
+
+        // Flags: single bit when unchanged
+        if (record.validity_flags == writer.prev_flags && record.alert_level == writer.prev_alert) {
+            writeBits(writer, 0x0, 1);
+        } else {
+            writeBits(writer, 0x1, 1);
+            writeBits(writer, record.validity_flags, 8);
+            writeBits(writer, record.alert_level, 8);
+        }
+
+        for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+            writeValue(writer, i, values[i]);
+        }
+    }
+
+    writer.prev_uptime = uptime;
+    writer.prev_flags = record.validity_flags;
+    writer.prev_alert = record.alert_level;
+    writer.record_index++;
+
+    last_uptime = uptime;
+    record_count++;
+    bit_length = writer.bit_position;
+    return true;
+}
+
+bool CompressedBlock::decodeNext(GorillaState& reader, SensorRecord& record) const {
+    if (reader.record_index >= record_count) {
+        return false;
+    }
+
+    uint32_t values[GorillaState::METRIC_COUNT];
+
+    if (reader.record_index == 0) {
+        reader.reset();
+        reader.prev_uptime = first_uptime;
+        for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+            values[i] = readBits(reader, 32);
+            reader.prev_values[i] = values[i];
+            reader.prev_leading[i] = GorillaState::NO_WINDOW;
+        }
+        reader.prev_flags = readBits(reader, 8);
+        reader.prev_alert = readBits(reader, 8);
+    } else {
+        int32_t dod;
+        if (readBits(reader, 1) == 0) {
+            dod = 0;
+        } else if (readBits(reader, 1) == 0) {
+            dod = (int32_t)readBits(reader, 7) - 63;
+        } else if (readBits(reader, 1) == 0) {
+            dod = (int32_t)readBits(reader, 9) - 255;
+        } else if (readBits(reader, 1) == 0) {
+            dod = (int32_t)readBits(reader, 12) - 2047;
+        } else {
+            dod = (int32_t)readBits(reader, 32);
+        }
+        reader.prev_delta += dod;
+        reader.prev_uptime += reader.prev_delta;
+
+        if (readBits(reader, 1) == 1) {
+            reader.prev_flags = readBits(reader, 8);
+            reader.prev_alert = readBits(reader, 8);
+        }
+
+        for (size_t i = 0; i < GorillaState::METRIC_COUNT; i++) {
+            values[i] = readValue(reader, i);
+        }
+    }
+
+    record = SensorRecord();
+    record.setRawTime(reader.prev_uptime);
+    applyValues(record, values);
+    record.validity_flags = reader.prev_flags;
+    record.alert_level = reader.prev_alert;
+
+    reader.record_index++;
+    return true;
+}
+
+size_t CompressedBlock::serialize(uint8_t* out) const {
+    StoredHeader header;
+    header.first_sequence = first_sequence;
+    header.first_uptime = first_uptime;
+    header.last_uptime = last_uptime;
+    header.record_count = record_count;
+    header.bit_length = bit_length;
+
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), data, getUsedBytes());
+    return sizeof(header) + getUsedBytes();
+}
+
+bool CompressedBlock::deserialize(const uint8_t* in, size_t length) {
+    if (length < sizeof(StoredHeader)) {
+        return false;
+    }
+
+    StoredHeader header;
+    memcpy(&header, in, sizeof(header));
+    size_t payload = (header.bit_length + 7) / 8;
+    if (header.bit_length > BLOCK_BYTES * 8 || length < sizeof(header) + payload) {
+        return false;
+    }
+
+    first_sequence = header.first_sequence;
+    first_uptime = header.first_uptime;
+    last_uptime = header.last_uptime;
+    record_count = header.record_count;
+    bit_length = header.bit_length;
+    sealed = true;
+    memcpy(data, in + sizeof(header), payload);
+    return true;
+}
+
+void CompressedBlock::writeBits(GorillaState& writer, uint32_t value, uint8_t bits) {
+    // MSB-first bit packing
+    for (int8_t i = bits - 1; i >= 0; i--) {
+        size_t byte_index = writer.bit_position >> 3;
+        uint8_t mask = 0x80 >> (writer.bit_position & 7);
+        if ((value >> i) & 1) {
+            data[byte_index] |= mask;
+        } else {
+            data[byte_index] &= ~mask;
+        }
+        writer.bit_position++;
+    }
+}
+
+uint32_t CompressedBlock::readBits(GorillaState& reader, uint8_t bits) const {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bits; i++) {
+        uint8_t byte = data[reader.bit_position >> 3];
+        value = (value << 1) | ((byte >> (7 - (reader.bit_position & 7))) & 1);
+        reader.bit_position++;
+    }
+    return value;
+}
+
+void CompressedBlock::writeValue(GorillaState& writer, size_t metric, uint32_t value) {
+    uint32_t xored = value ^ writer.prev_values[metric];
+    writer.prev_values[metric] = value;
+
+    if (xored == 0) {
+        writeBits(writer, 0x0, 1);
+        return;
+    }
+
+    uint8_t leading = min(leadingZeros(xored), (uint8_t)31);
+    uint8_t trailing = trailingZeros(xored);
+    uint8_t prev_leading = writer.prev_leading[metric];
+    uint8_t prev_trailing = writer.prev_trailing[metric];
+
+    if (prev_leading != GorillaState::NO_WINDOW &&
+        leading >= prev_leading && trailing >= prev_trailing) {
+        // Meaningful bits fit inside the previous window
+        writeBits(writer, 0x2, 2);
+        writeBits(writer, xored >> prev_trailing, 32 - prev_leading - prev_trailing);
+    } else {
+        // New window: 5 bits leading zeros, 5 bits (length - 1), then the bits
+        uint8_t length = 32 - leading - trailing;
+        writeBits(writer, 0x3, 2);
+        writeBits(writer, leading, 5);
+        writeBits(writer, length - 1, 5);
+        writeBits(writer, xored >> trailing, length);
+        writer.prev_leading[metric] = leading;
+        writer.prev_trailing[metric] = trailing;
+    }
+}
+
+uint32_t CompressedBlock::readValue(GorillaState& reader, size_t metric) const {
+    if (readBits(reader, 1) == 0) {
+        return reader.prev_values[metric];
+    }
+
+    uint32_t xored;
+    if (readBits(reader, 1) == 0) {
+        uint8_t leading = reader.prev_leading[metric];
+        uint8_t trailing = reader.prev_trailing[metric];
+        xored = readBits(reader, 32 - leading - trailing) << trailing;
+    } else {
+        uint8_t leading = readBits(reader, 5);
+        uint8_t length = readBits(reader, 5) + 1;
+        uint8_t trailing = 32 - leading - length;
+        uint32_t meaningful = readBits(reader, length);
+        xored = trailing >= 32 ? 0 : meaningful << trailing;
+        reader.prev_leading[metric] = leading;
+        reader.prev_trailing[metric] = trailing;
+    }
+
+    reader.prev_values[metric] ^= xored;
+    return reader.prev_values[metric];
+}
+
+// ================================
+// COMPRESSED ARCHIVE
+// ================================
+
+bool CompressedArchive::begin(size_t budget_bytes) {
+    size_t block_count = budget_bytes / CompressedBlock::BLOCK_BYTES;
+    if (block_count < 2) {
+        Serial.println("❌ Archive budget too small for compressed blocks");
+        return false;
+    }
+
+    blocks.assign(block_count, CompressedBlock());
+    clear();
+
+    Serial.printf("🗜️  Compressed archive ready: %zu blocks x %zu bytes\n",
+                 block_count, CompressedBlock::BLOCK_BYTES);
+    return true;
+}
+
+void CompressedArchive::clear() {
+    head = 0;
+    used_blocks = 0;
+    sealed_records = 0;
+    writer.reset();
+}
+
+void CompressedArchive::append(const SensorRecord& record, uint32_t sequence) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    // Sequences inside a block must be contiguous - start a new block on gaps
+    if (used_blocks == 0 || openBlock().getEndSequence() != sequence) {
+        startBlock(sequence);
+    }
+
+    if (!openBlock().append(record, writer)) {
+        startBlock(sequence);
+        openBlock().append(record, writer);
+    }
+}
+
+void CompressedArchive::startBlock(uint32_t first_sequence) {
+    if (used_blocks > 0) {
+        CompressedBlock& current = openBlock();
+        if (current.isEmpty()) {
+            // Nothing written yet, reuse the slot
+            current.reset(first_sequence);
+            writer.reset();
+            return;
+        }
+        current.seal();
+        sealed_records += current.getRecordCount();
+    }
+
+    if (used_blocks == blocks.size()) {
+        // Evict the oldest block
+        sealed_records -= blocks[head].getRecordCount();
+        head = (head + 1) % blocks.size();
+        used_blocks--;
+    }
+
+    used_blocks++;
+    openBlock().reset(first_sequence);
+    writer.reset();
+}
+
+bool CompressedArchive::read(uint32_t sequence, Reader& reader, SensorRecord& record) const {
+    size_t logical = findBlock(sequence);
+    if (logical == SIZE_MAX) {
+        return false;
+    }
+
+    size_t slot = (head + logical) % blocks.size();
+    const CompressedBlock& block = blocks[slot];
+    uint16_t target = sequence - block.getFirstSequence();
+
+    // Restart decoding unless the reader is already positioned before the target in this block
+    if (reader.block_slot != slot ||
+        reader.block_first_sequence != block.getFirstSequence() ||
+        reader.state.record_index > target) {
+        reader.block_slot = slot;
+        reader.block_first_sequence = block.getFirstSequence();
+        reader.state.reset();
+    }
+
+    while (reader.state.record_index <= target) {
+        if (!block.decodeNext(reader.state, record)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CompressedArchive::dropBefore(uint64_t uptime) {
+    // Whole blocks only - the open block is never dropped
+    while (used_blocks > 1 && blocks[head].getLastUptime() < uptime) {
+        sealed_records -= blocks[head].getRecordCount();
+        head = (head + 1) % blocks.size();
+        used_blocks--;
+    }
+}
+
+size_t CompressedArchive::findBlock(uint32_t sequence) const {
+    // Blocks are ordered by sequence - binary search for the one containing it
+    size_t low = 0;
+    size_t high = used_blocks;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (blockAt(mid).getEndSequence() <= sequence) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < used_blocks && blockAt(low).getFirstSequence() <= sequence) {
+        return low;
+    }
+    return SIZE_MAX;
+}
+
+uint32_t CompressedArchive::lowerBoundSequence(uint64_t uptime) const {
+    return boundSequence(uptime, true);
+}
+
+uint32_t CompressedArchive::upperBoundSequence(uint64_t uptime) const {
+    return boundSequence(uptime, false);
+}
+
+uint32_t CompressedArchive::boundSequence(uint64_t uptime, bool inclusive) const {
+    // Find the first block whose last record passes the bound
+    size_t low = 0;
+    size_t high = used_blocks;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const CompressedBlock& block = blockAt(mid);
+        bool before = block.isEmpty() ||
+                      (inclusive ? block.getLastUptime() < uptime : block.getLastUptime() <= uptime);
+        if (before) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low >= used_blocks) {
+        return getEndSequence();
+    }
+
+    // Decode within the block to find the exact record
+    const CompressedBlock& block = blockAt(low);
+    GorillaState state;
+    SensorRecord record;
+    uint32_t sequence = block.getFirstSequence();
+    while (block.decodeNext(state, record)) {
+        uint64_t record_uptime = record.getUptime();
+        if (inclusive ? record_uptime >= uptime : record_uptime > uptime) {
+            return sequence;
+        }
+        sequence++;
+    }
+    return sequence;
+}
+
+size_t CompressedArchive::getRecordCount() const {
+    if (used_blocks == 0) {
+        return 0;
+    }
+    return sealed_records + blockAt(used_blocks - 1).getRecordCount();
+}
+
+uint32_t CompressedArchive::getFirstSequence() const {
+    return used_blocks > 0 ? blockAt(0).getFirstSequence() : 0;
+}
+
+uint32_t CompressedArchive::getEndSequence() const {
+    return used_blocks > 0 ? blockAt(used_blocks - 1).getEndSequence() : 0;
+}
+
+bool CompressedArchive::getOldestUptime(uint64_t& uptime) const {
+    if (getRecordCount() == 0) {
+        return false;
+    }
+    uptime = blockAt(0).getFirstUptime();
+    return true;
+}
+
+size_t CompressedArchive::getCompressedBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < used_blocks; i++) {
+        bytes += blockAt(i).getUsedBytes();
+    }
+    return bytes;
+}
+
+float CompressedArchive::getCompressionRatio() const {
+    size_t compressed = getCompressedBytes();
+    if (compressed == 0) {
+        return 0;
+    }
+    return (float)(getRecordCount() * sizeof(SensorRecord)) / compressed;
+}
@@ -0,0 +1,77 @@
+/*
+ * storage/DiurnalProfile.cpp
+ * Implementation of the hour-of-week profile
+ */
+
+#include "storage/DiurnalProfile.h"
+
+bool DiurnalProfile::begin() {
+    cells.assign(CELL_COUNT, Cell());
+    clear();
+    return true;
+}
+
+void DiurnalProfile::clear() {
+    memset(cells.data(), 0, cells.size() * sizeof(Cell));
+    readings = 0;
+}
+
+void DiurnalProfile::add(const SensorRecord& record, uint64_t timestamp) {
+    if (!isEnabled() || timestamp == 0) {
+        return;
+    }
+
+    Cell& cell = cells[cellOf(timestamp)];
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (!(record.validity_flags & SensorRecord::metricFlag(i))) {
+            continue;
+        }
+
+        float value = record.getValue(i);
+        if (cell.count[i] == 0) {
+            cell.mean[i] = cell.max[i] = value;
+            cell.count[i] = 1;
+            continue;
+        }
+
+        if (cell.count[i] < MAX_WEIGHT) {
+            cell.count[i]++;
+        }
+        cell.mean[i] += (value - cell.mean[i]) / cell.count[i];
+        cell.max[i] = max(cell.max[i], value);
+    }
+    readings++;
+}
+
+size_t DiurnalProfile::cellOf(uint64_t timestamp) const {
+    int64_t local_s = (int64_t)(timestamp / 1000) + (int64_t)timezone_minutes * 60;
+    if (local_s < 0) {
+        local_s = 0;
+    }
+
+    uint64_t days = (uint64_t)local_s / 86400;
+    size_t hour = ((uint64_t)local_s % 86400) / 3600;
+    size_t day = (days + 3) % DAYS;   // 1970-01-01 was a Thursday
+    return day * HOURS + hour;
+}
+
+int16_t DiurnalProfile::parseTimezone(const String& offset) {
+    // Sign followed by HHMM, optionally with a colon
+    int sign = 1;
+    int digits[4];
+    size_t found = 0;
+    for (size_t i = 0; i < offset.length() && found < 4; i++) {
+        char c = offset.charAt(i);
+        if (c == '-' && found == 0) {
+            sign = -1;
+        } else if (c >= '0' && c <= '9') {
+            digits[found++] = c - '0';
+        }
+    }
+    if (found != 4) {
+        return 0;
+    }
+
+    int minutes = (digits[0] * 10 + digits[1]) * 60 + digits[2] * 10 + digits[3];
+    return sign * min(minutes, 14 * 60);
+}
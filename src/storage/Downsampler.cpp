@@ -0,0 +1,120 @@
+/*
+ * storage/Downsampler.cpp
+ * Implementation of streaming min/max-per-bucket downsampling
+ */
+
+#include "storage/Downsampler.h"
+
+MinMaxDownsampler::MinMaxDownsampler(size_t total_records, size_t max_points, size_t metric_index)
+    : total(total_records)
+    , bucket_count(0)
+    , peak_only(false)
+    , metric(metric_index < SensorRecord::METRIC_COUNT ? metric_index : SensorRecord::METRIC_CO2)
+    , metric_flag(SensorRecord::metricFlag(metric))
+    , fed(0)
+    , bucket_index(0)
+    , bucket_end(0) {
+
+    // Two records per bucket; ranges that already fit are passed through
+    if (total > max_points) {
+        bucket_count = max(max_points / MAX_OUTPUT, (size_t)1);
+        peak_only = max_points < MAX_OUTPUT;
+    }
+
+    startBucket();
+}
+
+size_t MinMaxDownsampler::add(const SensorRecord& record, SensorRecord out[MAX_OUTPUT]) {
+    if (isPassThrough()) {
+        out[0] = record;
+        fed++;
+        return 1;
+    }
+
+    size_t emitted = 0;
+    if (fed >= bucket_end && bucket_index + 1 < bucket_count) {
+        emitted = emitBucket(out);
+        bucket_index++;
+        startBucket();
+    }
+
+    if (!has_first) {
+        first = record;
+        has_first = true;
+    }
+
+    if (record.validity_flags & metric_flag) {
+        float value = record.getValue(metric);
+        if (!has_value || value < low_value) {
+            low = record;
+            low_value = value;
+            low_index = fed;
+        }
+        if (!has_value || value > high_value) {
+            high = record;
+            high_value = value;
+            high_index = fed;
+        }
+        has_value = true;
+    }
+
+    fed++;
+    return emitted;
+}
+
+size_t MinMaxDownsampler::finish(SensorRecord out[MAX_OUTPUT]) {
+    if (isPassThrough()) {
+        return 0;
+    }
+
+    size_t emitted = emitBucket(out);
+    has_first = false;
+    has_value = false;
+    return emitted;
+}
+
+size_t MinMaxDownsampler::metricFromName(const String& name) {
+    if (name == "temperature") return SensorRecord::METRIC_TEMPERATURE;
+    if (name == "humidity") return SensorRecord::METRIC_HUMIDITY;
+    if (name == "pressure") return SensorRecord::METRIC_PRESSURE;
+    if (name == "voc") return SensorRecord::METRIC_VOC;
+    return SensorRecord::METRIC_CO2;
+}
+
+void MinMaxDownsampler::startBucket() {
+    has_first = false;
+    has_value = false;
+    low_index = high_index = 0;
+    low_value = high_value = 0;
+
+    // Equal-count buckets over the known input size
+    if (bucket_count > 0) {
+        bucket_end = (uint64_t)(bucket_index + 1) * total / bucket_count;
+    }
+}
+
+size_t MinMaxDownsampler::emitBucket(SensorRecord out[MAX_OUTPUT]) {
+    if (!has_first) {
+        return 0;
+    }
+
+    if (!has_value) {
+        out[0] = first;
+        return 1;
+    }
+
+    if (low_index == high_index || peak_only) {
+        out[0] = high;
+        return 1;
+    }
+
+    // Keep chronological order inside the bucket
+    if (low_index < high_index) {
+        out[0] = low;
+        out[1] = high;
+    } else {
+        out[0] = high;
+        out[1] = low;
+    }
+    return 2;
+}
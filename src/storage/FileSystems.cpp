@@ -0,0 +1,163 @@
+/*
+ * storage/FileSystems.cpp
+ * Implementation of the Arduino and POSIX IFileSystem adapters
+ */
+
+#include "storage/FileSystems.h"
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// ================================
+// ARDUINO FS (LittleFS / SD)
+// ================================
+
+bool ArduinoFileSystem::exists(const String& path) {
+    return fs.exists(path);
+}
+
+bool ArduinoFileSystem::makeDirectory(const String& path) {
+    return fs.exists(path) || fs.mkdir(path);
+}
+
+bool ArduinoFileSystem::remove(const String& path) {
+    return fs.remove(path);
+}
+
+size_t ArduinoFileSystem::fileSize(const String& path) {
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t size = file.size();
+    file.close();
+    return size;
+}
+
+bool ArduinoFileSystem::append(const String& path, const uint8_t* data, size_t length) {
+    File file = fs.open(path, FILE_APPEND);
+    if (!file) {
+        return false;
+    }
+    size_t written = file.write(data, length);
+    file.close();
+    return written == length;
+}
+
+size_t ArduinoFileSystem::read(const String& path, size_t offset, uint8_t* buffer, size_t length) {
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t bytes = file.seek(offset) ? file.read(buffer, length) : 0;
+    file.close();
+    return bytes;
+}
+
+bool ArduinoFileSystem::writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) {
+    // "r+" keeps the contents - FILE_WRITE would truncate
+    File file = fs.open(path, "r+");
+    if (!file) {
+        return false;
+    }
+    size_t written = file.seek(offset) ? file.write(data, length) : 0;
+    file.close();
+    return written == length;
+}
+
+bool ArduinoFileSystem::listFiles(const String& directory, std::vector<String>& names) {
+    File dir = fs.open(directory);
+    if (!dir || !dir.isDirectory()) {
+        return false;
+    }
+
+    File entry = dir.openNextFile();
+    while (entry) {
+        if (!entry.isDirectory()) {
+            // Older cores return the full path, newer ones just the name
+            String entry_name = entry.name();
+            int slash = entry_name.lastIndexOf('/');
+            names.push_back(slash >= 0 ? entry_name.substring(slash + 1) : entry_name);
+        }
+        entry = dir.openNextFile();
+    }
+    return true;
+}
+
+// ================================
+// POSIX DIRECTORY
+// ================================
+
+bool PosixFileSystem::exists(const String& path) {
+    struct stat info;
+    return stat(fullPath(path).c_str(), &info) == 0;
+}
+
+bool PosixFileSystem::makeDirectory(const String& path) {
+    return exists(path) || mkdir(fullPath(path).c_str(), 0755) == 0;
+}
+
+bool PosixFileSystem::remove(const String& path) {
+    return ::remove(fullPath(path).c_str()) == 0;
+}
+
+size_t PosixFileSystem::fileSize(const String& path) {
+    struct stat info;
+    if (stat(fullPath(path).c_str(), &info) != 0) {
+        return 0;
+    }
+    return info.st_size;
+}
+
+bool PosixFileSystem::append(const String& path, const uint8_t* data, size_t length) {
+    FILE* file = fopen(fullPath(path).c_str(), "ab");
+    if (!file) {
+        return false;
+    }
+    size_t written = fwrite(data, 1, length, file);
+    fclose(file);
+    bytes_appended += written;
+    return written == length;
+}
+
+size_t PosixFileSystem::read(const String& path, size_t offset, uint8_t* buffer, size_t length) {
+    FILE* file = fopen(fullPath(path).c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t bytes = fseek(file, offset, SEEK_SET) == 0 ? fread(buffer, 1, length, file) : 0;
+    fclose(file);
+    return bytes;
+}
+
+bool PosixFileSystem::writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) {
+    FILE* file = fopen(fullPath(path).c_str(), "r+b");
+    if (!file) {
+        return false;
+    }
+    size_t written = fseek(file, offset, SEEK_SET) == 0 ? fwrite(data, 1, length, file) : 0;
+    fclose(file);
+    bytes_appended += written;
+    return written == length;
+}
+
+bool PosixFileSystem::listFiles(const String& directory, std::vector<String>& names) {
+    DIR* dir = opendir(fullPath(directory).c_str());
+    if (!dir) {
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        String name(entry->d_name);
+        struct stat info;
+        if (stat(fullPath(directory + "/" + name).c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    return true;
+}
@@ -4,7 +4,13 @@
  */
 
 #include "storage/HistoricalDataStorage.h"
+#include "storage/FileSystems.h"
+#include "utils/Checksum.h"
+#include "Constants.h"
 // #include <Preferences.h>  // Disabled - using RAM-only storage
+#if HISTORY_SD_ARCHIVE
+#include <SD.h>
+#endif
 #include <algorithm>
 
 // Note: Flash persistence disabled - using RAM-only storage for faster operation
@@ -17,6 +23,20 @@ HistoricalDataStorage::HistoricalDataStorage(const String& type, size_t max_recs
     , read_index(0)
     , storage_full(false)
     , storage_type(type)
+    , record_buffer(nullptr)
+    , next_sequence(0)
+    , clock_offset(0)
+    , epoch_fs(nullptr)
+    , epoch_generation(0)
+    , retention_ms(0)
+    , retention_countdown(0)
+    , deadband_enabled(false)
+    , deadband_tolerance()
+    , deadband_interval_ms(0)
+    , run_open(false)
+    , held_pending(false)
+    , folded_readings(0)
+    , generation(0)
     , initialized(false) {
     
     // Limit max records based on available memory
@@ -24,9 +44,37 @@ HistoricalDataStorage::HistoricalDataStorage(const String& type, size_t max_recs
         max_records = MAX_RECORDS_FLASH;
         Serial.printf("⚠️  Storage: Limited max records to %zu due to memory constraints\n", max_records);
     }
+    if (max_records == 0) {
+        max_records = 1;
+    }
     
-    // Reserve space for record buffer
-    record_buffer.reserve(max_records);
+    // One allocation up front - the ring never grows or reallocates afterwards
+    owned_buffer.resize(max_records);
+    record_buffer = owned_buffer.data();
+}
+
+HistoricalDataStorage::HistoricalDataStorage(const String& type, SensorRecord* slots, size_t slot_count)
+    : max_records(slot_count)
+    , current_records(0)
+    , write_index(0)
+    , read_index(0)
+    , storage_full(false)
+    , storage_type(type)
+    , record_buffer(slots)
+    , next_sequence(0)
+    , clock_offset(0)
+    , epoch_fs(nullptr)
+    , epoch_generation(0)
+    , retention_ms(0)
+    , retention_countdown(0)
+    , deadband_enabled(false)
+    , deadband_tolerance()
+    , deadband_interval_ms(0)
+    , run_open(false)
+    , held_pending(false)
+    , folded_readings(0)
+    , generation(0)
+    , initialized(false) {
 }
 
 // ================================
@@ -41,14 +89,15 @@ bool HistoricalDataStorage::initialize() {
     // This provides faster operation but data is lost on power cycle
     
     // Clear buffer and reset indices
-    record_buffer.clear();
-    current_records = 0;
-    write_index = 0;
-    read_index = 0;
-    storage_full = false;
+    resetRing();
     
-    // Note: Flash loading disabled - starting with empty RAM buffer
-    // All data stored in RAM only for faster operation
+    // Note: Flash loading happens in enablePersistence() - without it the
+    // buffer starts empty and all data is kept in RAM only
+    
+    // This boot's epoch - moved forward once restored history advances the clock
+    if (epochs.count == 0) {
+        epochs.begin(clock_offset, next_sequence, esp_random() | 1);
+    }
     
     initialized = true;
     
@@ -62,13 +111,25 @@ bool HistoricalDataStorage::format() {
     Serial.println("🗑️  Formatting storage...");
     
     // Clear all data
-    record_buffer.clear();
-    current_records = 0;
-    write_index = 0;
-    read_index = 0;
-    storage_full = false;
-    
-    // Note: No flash storage to clear - RAM only mode
+    resetRing();
+    folded_readings = 0;
+    generation++;
+    archive.clear();
+    rollups.clear();
+    statistics.clear();
+    quantiles.clear();
+    episodes.clear();
+    profile.clear();
+    
+    if (segment_log) {
+        segment_log->clear();
+    }
+    if (checkpoint) {
+        checkpoint->clear(next_sequence);
+    }
+    if (sd_archive) {
+        sd_archive->clear();
+    }
     
     Serial.println("✅ Storage formatted successfully");
     return true;
@@ -78,6 +139,253 @@ void HistoricalDataStorage::reset() {
     format();
 }
 
+bool HistoricalDataStorage::enableArchive(size_t budget_bytes) {
+    if (!archive.begin(budget_bytes)) {
+        return false;
+    }
+    
+    Serial.printf("✅ History archive enabled: %zu KB compressed budget\n", budget_bytes / 1024);
+    return true;
+}
+
+bool HistoricalDataStorage::enablePersistence(IFileSystem& fs, const String& directory,
+                                              size_t batch_records, size_t max_segments) {
+    if (!initialized) {
+        Serial.println("❌ Storage not initialized");
+        return false;
+    }
+    
+    // Restored records take the first sequence numbers - must happen before any reading is stored
+    if (next_sequence != 0) {
+        Serial.println("❌ Persistence must be enabled before the first reading is stored");
+        return false;
+    }
+    
+    segment_log.reset(new SegmentLog(fs, directory, SegmentLog::DEFAULT_SEGMENT_BYTES,
+                                     max_segments, batch_records));
+    if (!segment_log->begin()) {
+        segment_log.reset();
+        return false;
+    }
+    
+    storage_type = "flash";
+    loadFromFlash();
+    attachEpochs(fs, directory);
+    
+    Serial.printf("✅ History persistence enabled: %zu KB log, flush every %zu records\n",
+                 segment_log->getCapacityBytes() / 1024, batch_records);
+    return true;
+}
+
+bool HistoricalDataStorage::enableCheckpoint(IFileSystem& fs, const String& directory, uint32_t interval_ms) {
+    if (!initialized) {
+        Serial.println("❌ Storage not initialized");
+        return false;
+    }
+    
+    // Restored records keep their sequence numbers and ring slots
+    if (next_sequence != 0) {
+        Serial.println("❌ Checkpoint must be enabled before the first reading is stored");
+        return false;
+    }
+    
+    std::unique_ptr<RingCheckpoint> created(new RingCheckpoint(fs, directory, max_records,
+                                                               RingCheckpoint::DEFAULT_PAGE_RECORDS,
+                                                               interval_ms));
+    if (!created->begin()) {
+        return false;
+    }
+    
+    uint64_t newest_uptime = 0;
+    size_t restored = created->restore([this, &newest_uptime](const SensorRecord& record,
+                                                              uint32_t sequence, size_t slot) {
+        if (current_records == 0) {
+            read_index = write_index = slot;
+            next_sequence = sequence;
+        }
+        appendRecord(record);
+        newest_uptime = max(newest_uptime, record.getUptime());
+    });
+    
+    if (restored > 0 && newest_uptime + 1000 > clock_offset) {
+        // Continue the clock after the newest restored record (downtime is unknown)
+        clock_offset = newest_uptime + 1000;
+    }
+    attachEpochs(fs, directory);
+    
+    // Assigned after the restore - restored slots are already on flash
+    checkpoint = std::move(created);
+    
+    Serial.printf("✅ History checkpoint enabled: %zu KB, every %lus, %zu records restored\n",
+                 checkpoint->getFileBytes() / 1024, (unsigned long)(interval_ms / 1000), restored);
+    return true;
+}
+
+size_t HistoricalDataStorage::pollCheckpoint() {
+    if (!checkpoint) {
+        return 0;
+    }
+    return checkpoint->step(checkpointRing());
+}
+
+bool HistoricalDataStorage::checkpointNow() {
+    if (!checkpoint) {
+        return true;
+    }
+    return checkpoint->checkpointAll(checkpointRing());
+}
+
+CheckpointRing HistoricalDataStorage::checkpointRing() const {
+    CheckpointRing ring;
+    ring.slots = record_buffer;
+    ring.next_sequence = next_sequence;
+    ring.first_sequence = getFirstSequence();
+    ring.write_index = write_index;
+    return ring;
+}
+
+bool HistoricalDataStorage::enableSdArchive(IFileSystem& fs, const String& directory,
+                                            uint32_t partition_seconds, size_t max_partitions) {
+    if (!initialized) {
+        Serial.println("❌ Storage not initialized");
+        return false;
+    }
+    
+    sd_archive.reset(new PartitionedArchive(fs, directory, partition_seconds, max_partitions));
+    if (!sd_archive->begin()) {
+        sd_archive.reset();
+        return false;
+    }
+    
+    if (sd_archive->getEndSequence() > next_sequence) {
+        // Card is ahead of what was restored (flash formatted or disabled) - number new
+        // records after it; the RAM archive would collide with the card's sequences
+        archive.clear();
+        next_sequence = sd_archive->getEndSequence();
+    }
+    if (!sd_archive->isEmpty() && sd_archive->getNewestUptime() + 1000 > clock_offset) {
+        clock_offset = sd_archive->getNewestUptime() + 1000;
+    }
+    attachEpochs(fs, directory);
+    
+    storage_type = "sd_card";
+    
+    Serial.printf("✅ SD archive enabled: %zu partitions of %lus\n",
+                 sd_archive->getPartitionCount(), (unsigned long)sd_archive->getPartitionSeconds());
+    return true;
+}
+
+bool HistoricalDataStorage::enableColumns() {
+    if (!columns.begin(max_records)) {
+        return false;
+    }
+    
+    // Mirror what the ring already holds
+    for (size_t i = 0; i < current_records; i++) {
+        columns.set((oldestIndex() + i) % max_records, recordAt(i));
+    }
+    
+    Serial.printf("✅ History columns enabled: %zu KB\n", columns.getMemoryBytes() / 1024);
+    return true;
+}
+
+bool HistoricalDataStorage::enableStatistics() {
+    if (!statistics.begin()) {
+        return false;
+    }
+    
+    Serial.printf("✅ History statistics enabled: %zu bytes\n", statistics.getMemoryBytes());
+    return true;
+}
+
+bool HistoricalDataStorage::enableQuantiles() {
+    if (!quantiles.begin()) {
+        return false;
+    }
+    
+    Serial.printf("✅ History quantile sketches enabled: %zu bytes\n", quantiles.getMemoryBytes());
+    return true;
+}
+
+bool HistoricalDataStorage::enableProfile() {
+    if (!profile.begin()) {
+        return false;
+    }
+    
+    Serial.printf("✅ Diurnal profile enabled: %zu bytes\n", profile.getMemoryBytes());
+    return true;
+}
+
+bool HistoricalDataStorage::enableEpisodes(uint8_t min_level, size_t max_episodes) {
+    if (!episodes.begin(min_level, max_episodes)) {
+        return false;
+    }
+    
+    // Index what the ring already holds (a pending held record is added when its run ends)
+    uint32_t first_sequence = getFirstSequence();
+    size_t final_records = current_records - (held_pending ? 1 : 0);
+    for (size_t i = 0; i < final_records; i++) {
+        episodes.add(recordAt(i), first_sequence + i);
+    }
+    
+    Serial.printf("✅ Alert episode index enabled: level >= %u, %zu episodes\n",
+                 min_level, max_episodes);
+    return true;
+}
+
+bool HistoricalDataStorage::enableDeadband(const float tolerances[SensorRecord::METRIC_COUNT],
+                                           uint32_t sample_interval_ms) {
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (tolerances[i] < 0) {
+            return false;
+        }
+        deadband_tolerance[i] = tolerances[i];
+    }
+    
+    deadband_interval_ms = sample_interval_ms;
+    deadband_enabled = true;
+    closeRun();   // New tolerances - the next reading starts a run
+    generation++;
+    
+    Serial.printf("✅ Deadband storage enabled: co2 ±%.0f, temp ±%.2f, hum ±%.1f, press ±%.1f, voc ±%.1f\n",
+                 tolerances[0], tolerances[1], tolerances[2], tolerances[3], tolerances[4]);
+    return true;
+}
+
+void HistoricalDataStorage::disableDeadband() {
+    closeRun();
+    deadband_enabled = false;
+    generation++;
+}
+
+void HistoricalDataStorage::setDeadbandInterval(uint32_t sample_interval_ms) {
+    // Runs are expanded at one interval - start a new run when it changes
+    if (sample_interval_ms != deadband_interval_ms) {
+        closeRun();
+        deadband_interval_ms = sample_interval_ms;
+        generation++;   // Existing runs expand differently
+    }
+}
+
+bool HistoricalDataStorage::flush() {
+    closeRun();   // The held record goes to the log/card before a restart
+    bool success = saveToFlash();
+    success &= checkpointNow();
+    if (sd_archive) {
+        success &= sd_archive->flush();
+    }
+    return success;
+}
+
+bool HistoricalDataStorage::enableRollups(size_t minute_buckets, size_t hour_buckets, size_t day_buckets) {
+    if (!rollups.begin(minute_buckets, hour_buckets, day_buckets)) {
+        return false;
+    }
+    
+    Serial.printf("✅ History rollups enabled: %zu KB\n", rollups.getMemoryBytes() / 1024);
+    return true;
+}
+
 // ================================
 // CORE STORAGE OPERATIONS
 // ================================
@@ -93,35 +401,161 @@ bool HistoricalDataStorage::storeReading(const SensorRecord& record) {
         return false;
     }
     
+    // Stamp with the storage clock so restored history stays ordered
+    SensorRecord stored = record;
+    stored.setUptime(record.getUptime() + clock_offset);
+    
+    statistics.add(stored);
+    quantiles.add(stored);
+    
+    // Local time needs this boot's offset - readings before the first sync are left out
+    uint64_t time_offset = epochs.count > 0 ? epochs.current().time_offset : 0;
+    if (time_offset > 0) {
+        profile.add(stored, stored.getUptime() + time_offset);
+    }
+    
+    // Deadband: a reading close to the run start only moves the held record forward
+    if (deadband_enabled && foldReading(stored)) {
+        if (retention_ms > 0) {
+            applyRetention(stored.getUptime());
+        }
+        return true;
+    }
+    closeRun();
+    
+    uint32_t sequence = next_sequence;
+    appendRecord(stored);
+    run_start = stored;
+    run_open = deadband_enabled;
+    
+    if (retention_ms > 0) {
+        applyRetention(stored.getUptime());
+    }
+    
+    // Batched - flash is only written once per batch
+    if (segment_log) {
+        segment_log->append(stored, sequence);
+    }
+    
+    // Written to the card once per compressed block
+    if (sd_archive) {
+        sd_archive->append(stored, sequence);
+    }
+    
+    return true;
+}
+
+bool HistoricalDataStorage::foldReading(const SensorRecord& record) {
+    if (!run_open || current_records == 0 || !withinDeadband(record)) {
+        return false;
+    }
+    
+    SensorRecord held = record;
+    held.validity_flags |= SensorRecord::FLAG_HELD;
+    
+    if (!held_pending) {
+        // Second reading of the run takes a slot; archives and episodes get it once the run ends
+        appendRecord(held, true);
+        held_pending = true;
+        return true;
+    }
+    
+    // Later readings replace the held record in place
+    size_t slot = (write_index + max_records - 1) % max_records;
+    record_buffer[slot] = held;
+    columns.set(slot, held);
+    if (checkpoint) {
+        checkpoint->markDirty(slot);
+    }
+    rollups.add(held);
+    folded_readings++;
+    return true;
+}
+
+bool HistoricalDataStorage::withinDeadband(const SensorRecord& record) const {
+    if (record.validity_flags != run_start.validity_flags || record.alert_level != run_start.alert_level) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if ((record.validity_flags & SensorRecord::metricFlag(i)) &&
+            fabsf(record.getValue(i) - run_start.getValue(i)) > deadband_tolerance[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HistoricalDataStorage::closeRun() {
+    run_open = false;
+    if (!held_pending) {
+        return;
+    }
+    held_pending = false;
+    
+    // The held record is final now - hand it to the archives like any other record
+    if (current_records == 0) {
+        return;
+    }
+    const SensorRecord& held = recordAt(current_records - 1);
+    uint32_t sequence = next_sequence - 1;
+    archive.append(held, sequence);
+    episodes.add(held, sequence);
+    if (segment_log) {
+        segment_log->append(held, sequence);
+    }
+    if (sd_archive) {
+        sd_archive->append(held, sequence);
+    }
+}
+
+void HistoricalDataStorage::appendRecord(const SensorRecord& record, bool held) {
+    columns.set(write_index, record);
+    if (checkpoint) {
+        checkpoint->markDirty(write_index);
+    }
+    
     // Handle circular buffer logic
     if (current_records < max_records) {
-        // Still have space, just append
-        record_buffer.push_back(record);
+        // Still have space (slots are preallocated, nothing grows)
+        record_buffer[write_index] = record;
         current_records++;
-        write_index = current_records;
-    } else {
-        // Buffer full, implement circular buffer
-        if (!storage_full) {
-            storage_full = true;
+        
+        if (current_records == max_records) {
             Serial.println("⚠️  Storage buffer full, switching to circular buffer mode");
         }
-        
-        // Overwrite oldest record
-        write_index = write_index % max_records;
+    } else {
+        // Overwrite oldest record and skip past it
         record_buffer[write_index] = record;
-        write_index = (write_index + 1) % max_records;
-        
-        // Update read index to skip overwritten record
-        read_index = write_index;
+        read_index = (read_index + 1) % max_records;
     }
+    updateIndices();
     
-    // Note: Flash persistence disabled - data stored in RAM only
-    // Data will be lost on power cycle but provides faster operation
+    // Long-term copy (sealed into compressed blocks as they fill) - a held record
+    // still changes, closeRun() hands over its final value
+    if (!held) {
+        archive.append(record, next_sequence);
+        episodes.add(record, next_sequence);
+    }
+    next_sequence++;
     
-    return true;
+    // Fold into the 1 min / 1 h / 1 day buckets
+    rollups.add(record);
+}
+
+void HistoricalDataStorage::resetRing() {
+    // Emptied ring: the checkpoint must stop restoring the old slots soon
+    if (checkpoint) {
+        checkpoint->markDropped();
+    }
+    closeRun();   // A held record leaves the ring - archives keep its final value
+    current_records = 0;
+    write_index = 0;
+    read_index = 0;
+    storage_full = false;
 }
 
-bool HistoricalDataStorage::storeReading(unsigned long uptime, 
+bool HistoricalDataStorage::storeReading(uint64_t uptime, 
                                         const CO2SensorData* co2_data,
                                         const VOCSensorData* voc_data) {
     
@@ -134,139 +568,502 @@ bool HistoricalDataStorage::storeReading(unsigned long uptime,
 // ================================
 
 std::vector<SensorRecord> HistoricalDataStorage::queryByTimeRange(const TimeRange& range, const TimeSync& timeSync) {
-    if (!timeSync.has_time) {
-        Serial.println("❌ Cannot query by time range: Time not synchronized");
+    uint64_t start_uptime, end_uptime;
+    if (!resolveUptimeRange(range, timeSync, start_uptime, end_uptime)) {
         return {};
     }
     
-    // Convert timestamps to uptime range
-    unsigned long start_uptime = timeSync.timestampToUptime(range.start_time);
-    unsigned long end_uptime = timeSync.timestampToUptime(range.end_time);
+    int resolution = selectResolution(start_uptime, end_uptime, range.max_points);
+    if (resolution == RAW_RESOLUTION) {
+        // Raw records, thinned to max_points without losing spikes
+        HistoryCursor cursor = openCursor(start_uptime, end_uptime);
+        MinMaxDownsampler sampler(cursor.remaining(), range.max_points);
+        std::vector<SensorRecord> results;
+        results.reserve(min(cursor.remaining(), (size_t)range.max_points));
+        
+        SensorRecord record;
+        SensorRecord out[MinMaxDownsampler::MAX_OUTPUT];
+        while (cursor.next(record)) {
+            size_t ready = sampler.add(record, out);
+            results.insert(results.end(), out, out + ready);
+        }
+        size_t ready = sampler.finish(out);
+        results.insert(results.end(), out, out + ready);
+        
+        Serial.printf("📊 Query returned %zu records for time range\n", results.size());
+        return results;
+    }
     
-    Serial.printf("🔍 Time conversion: start_ts=%llu -> uptime=%lu, end_ts=%llu -> uptime=%lu\n",
-                 range.start_time, start_uptime, range.end_time, end_uptime);
-    Serial.printf("🔍 TimeSync: has_time=%s, offset=%llu, current_uptime=%lu\n",
-                 timeSync.has_time ? "true" : "false", timeSync.time_offset, millis());
+    // Long range - one record per rollup bucket (bucket means)
+    std::vector<RollupBucket> buckets = queryRollups(resolution, start_uptime, end_uptime);
+    std::vector<SensorRecord> results;
+    results.reserve(buckets.size());
+    for (const RollupBucket& bucket : buckets) {
+        results.push_back(bucket.toRecord());
+    }
     
-    // Handle case where requested time is before device boot
-    if (start_uptime == 0) {
-        // Start time is before device boot, adjust to earliest available data
-        start_uptime = 1; // Start from beginning of device uptime
-        Serial.printf("⚠️ Adjusting start time: requested timestamp before device boot\n");
+    return results;
+}
+
+std::vector<SensorRecord> HistoricalDataStorage::queryByUptimeRange(uint64_t start_uptime, uint64_t end_uptime) {
+    std::vector<SensorRecord> results;
+    
+    // Cursor covers both the archive and the raw ring, already in uptime order
+    HistoryCursor cursor = openCursor(start_uptime, end_uptime);
+    results.reserve(cursor.remaining());
+    
+    SensorRecord record;
+    while (cursor.next(record)) {
+        results.push_back(record);
+    }
+    
+    Serial.printf("📊 Query found %zu records in uptime range %llu-%llu\n", 
+                 results.size(), (unsigned long long)start_uptime, (unsigned long long)end_uptime);
+    
+    return results;
+}
+
+RecordView HistoricalDataStorage::viewByTimeRange(const TimeRange& range, const TimeSync& timeSync) const {
+    uint64_t start_uptime, end_uptime;
+    if (!resolveUptimeRange(range, timeSync, start_uptime, end_uptime)) {
+        return RecordView();
+    }
+    
+    return viewByUptimeRange(start_uptime, end_uptime);
+}
+
+RecordView HistoricalDataStorage::viewByUptimeRange(uint64_t start_uptime, uint64_t end_uptime) const {
+    if (!initialized || current_records == 0 || end_uptime < start_uptime) {
+        return RecordView();
+    }
+    
+    // Records are appended in uptime order, so the ring is sorted from the oldest slot
+    return viewLogicalRange(lowerBoundUptime(start_uptime), upperBoundUptime(end_uptime));
+}
+
+MetricView HistoricalDataStorage::viewMetric(size_t metric, uint64_t start_uptime,
+                                             uint64_t end_uptime) const {
+    MetricView view;
+    if (!columns.isEnabled() || metric >= SensorRecord::METRIC_COUNT) {
+        return view;
+    }
+    
+    // Same slots as the records, so the record view's split applies to the columns
+    RecordView records = viewByUptimeRange(start_uptime, end_uptime);
+    view.valid_mask = SensorRecord::metricFlag(metric);
+    for (size_t i = 0; i < 2; i++) {
+        if (records.spans[i].count == 0) {
+            continue;
+        }
+        size_t slot = records.spans[i].data - record_buffer;
+        view.spans[i].uptimes = columns.uptimes() + slot;
+        view.spans[i].values = columns.values(metric) + slot;
+        view.spans[i].flags = columns.flags() + slot;
+        view.spans[i].count = records.spans[i].count;
+    }
+    
+    return view;
+}
+
+MetricSummary HistoricalDataStorage::summarizeMetric(size_t metric, uint64_t start_uptime,
+                                                     uint64_t end_uptime) const {
+    RecordColumns::Accumulator accumulator;
+    if (metric >= SensorRecord::METRIC_COUNT) {
+        return accumulator.result();
+    }
+    
+    if (columns.isEnabled()) {
+        // Contiguous float arrays - tight loop per span
+        MetricView view = viewMetric(metric, start_uptime, end_uptime);
+        for (const MetricSpan& span : view.spans) {
+            RecordColumns::accumulate(span.values, span.flags, span.count, view.valid_mask, accumulator);
+        }
+        return accumulator.result();
+    }
+    
+    // Record layout: every field of every record passes through the cache
+    RecordView view = viewByUptimeRange(start_uptime, end_uptime);
+    uint8_t mask = SensorRecord::metricFlag(metric);
+    for (size_t i = 0; i < view.size(); i++) {
+        const SensorRecord& record = view[i];
+        if (!(record.validity_flags & mask)) {
+            continue;
+        }
+        float value = record.getValue(metric);
+        accumulator.min = accumulator.count == 0 ? value : min(accumulator.min, value);
+        accumulator.max = accumulator.count == 0 ? value : max(accumulator.max, value);
+        accumulator.sum += value;
+        accumulator.count++;
+    }
+    return accumulator.result();
+}
+
+std::vector<SensorRecord> HistoricalDataStorage::queryLatest(size_t count) {
+    std::vector<SensorRecord> results;
+    
+    if (!initialized || current_records == 0) {
+        return results;
+    }
+    
+    // Limit count to available records
+    size_t actual_count = min(count, current_records);
+    
+    // Get latest records (work backwards from the newest)
+    for (size_t i = 0; i < actual_count; i++) {
+        const SensorRecord& record = recordAt(current_records - 1 - i);
+        if (record.isValid()) {
+            results.push_back(record);
+        }
+    }
+    
+    // Reverse to get chronological order (oldest first)
+    std::reverse(results.begin(), results.end());
+    
+    Serial.printf("📊 Query returned %zu latest records\n", results.size());
+    return results;
+}
+
+HistoricalDataStorage::QueryResult HistoricalDataStorage::queryByTimeRangePaged(
+    const TimeRange& range, const TimeSync& timeSync, 
+    size_t page_size, size_t page_index) {
+    
+    QueryResult result;
+    result.has_more = false;
+    result.total_available = 0;
+    result.next_sequence = next_sequence;
+    
+    // Locate the range without copying it
+    uint64_t start_uptime, end_uptime;
+    if (!resolveUptimeRange(range, timeSync, start_uptime, end_uptime)) {
+        return result;
+    }
+    
+    HistoryCursor cursor = openCursor(start_uptime, end_uptime);
+    result.total_available = cursor.remaining();
+    if (result.total_available == 0) {
+        return result;
+    }
+    
+    // Min/max downsampling keeps spikes; pages index into the downsampled stream
+    MinMaxDownsampler sampler(result.total_available, range.max_points);
+    size_t start_idx = page_index * page_size;
+    size_t end_idx = start_idx + page_size;
+    size_t emitted = 0;
+    result.records.reserve(min(page_size, (size_t)range.max_points));
+    
+    SensorRecord record;
+    SensorRecord out[MinMaxDownsampler::MAX_OUTPUT];
+    bool input_done = false;
+    while (emitted <= end_idx) {
+        size_t ready;
+        uint32_t resume_sequence;
+        if (cursor.next(record)) {
+            ready = sampler.add(record, out);
+            // A closed bucket is emitted on the first record of the next one - resume at that record
+            resume_sequence = sampler.isPassThrough() ? cursor.position() : cursor.position() - 1;
+        } else if (!input_done) {
+            ready = sampler.finish(out);
+            resume_sequence = cursor.position();
+            input_done = true;
+        } else {
+            break;
+        }
+        
+        for (size_t i = 0; i < ready; i++, emitted++) {
+            if (emitted >= start_idx && emitted < end_idx) {
+                result.records.push_back(out[i]);
+                result.next_sequence = resume_sequence;
+            }
+        }
+    }
+    result.has_more = emitted > end_idx;
+    
+    return result;
+}
+
+HistoryCursor HistoricalDataStorage::openCursor(uint64_t start_uptime, uint64_t end_uptime) const {
+    if (!initialized || end_uptime < start_uptime) {
+        return HistoryCursor();
+    }
+    
+    // With deadband runs the range may start inside one - begin at the record before
+    // so its run start is known (the cursor drops points before start_uptime)
+    uint32_t sequence = lowerBoundSequence(start_uptime);
+    if (folded_readings > 0 && sequence > getOldestSequence()) {
+        sequence--;
+    }
+    return HistoryCursor(this, sequence, end_uptime, start_uptime);
+}
+
+HistoryCursor HistoricalDataStorage::openCursor(const TimeRange& range, const TimeSync& timeSync) const {
+    uint64_t start_uptime, end_uptime;
+    if (!resolveUptimeRange(range, timeSync, start_uptime, end_uptime)) {
+        return HistoryCursor();
+    }
+    
+    return openCursor(start_uptime, end_uptime);
+}
+
+HistoryCursor HistoricalDataStorage::resumeCursor(uint32_t sequence, uint64_t end_uptime) const {
+    if (!initialized) {
+        return HistoryCursor();
     }
     
-    if (end_uptime == 0) {
-        // End time is before device boot - no data available
-        Serial.println("❌ End time is before device boot - no data available");
-        return {};
+    return HistoryCursor(this, sequence, end_uptime);
+}
+
+HistoryCursor HistoricalDataStorage::openSince(uint32_t sequence, uint32_t boot_id, bool& reset) const {
+    reset = false;
+    if (!initialized) {
+        return HistoryCursor();
     }
     
-    // Cap end time to current uptime if it's in the future
-    unsigned long current_uptime = millis();
-    if (end_uptime > current_uptime) {
-        end_uptime = current_uptime;
-        Serial.printf("⚠️ Adjusting end time: requested timestamp in future (capped to current uptime: %lu)\n", current_uptime);
+    size_t index = epochs.findBoot(boot_id);
+    if (index == epochs.count || sequence > next_sequence) {
+        // Unknown boot or ahead of this device's sequence space - start over
+        reset = boot_id != 0;
+        sequence = 0;
+    } else if (index + 1 < epochs.count) {
+        // Sequences from the next boot's start on were lost at that reboot and reused
+        sequence = min(sequence, epochs.epochs[index + 1].start_sequence);
     }
     
-    return queryByUptimeRange(start_uptime, end_uptime);
+    // The cursor clamps to the oldest stored record and positions in O(log n)
+    return HistoryCursor(this, sequence, UINT64_MAX);
 }
 
-std::vector<SensorRecord> HistoricalDataStorage::queryByUptimeRange(unsigned long start_uptime, unsigned long end_uptime) {
-    std::vector<SensorRecord> results;
+int HistoricalDataStorage::selectResolution(uint64_t start_uptime, uint64_t end_uptime,
+                                           size_t max_points) const {
+    if (!rollups.isEnabled() || end_uptime < start_uptime) {
+        return RAW_RESOLUTION;
+    }
     
-    if (!initialized || current_records == 0) {
-        return results;
+    // Nothing can cover data older than the oldest thing any source still holds
+    uint64_t raw_oldest = UINT64_MAX, newest, tier_oldest;
+    bool has_raw = getDataTimeRange(raw_oldest, newest);
+    uint64_t earliest = raw_oldest;
+    for (size_t i = 0; i < RollupTiers::TIER_COUNT; i++) {
+        if (rollups.tier(i).getOldestUptime(tier_oldest)) {
+            earliest = min(earliest, tier_oldest);
+        }
     }
+    uint64_t needed_from = max(start_uptime, earliest);
     
-    // Search through all records
-    size_t search_start = storage_full ? read_index : 0;
-    size_t search_count = current_records;
+    if (has_raw && raw_oldest <= needed_from &&
+        openCursor(start_uptime, end_uptime).remaining() <= max_points) {
+        return RAW_RESOLUTION;
+    }
     
-    for (size_t i = 0; i < search_count; i++) {
-        size_t idx = (search_start + i) % max_records;
-        const SensorRecord& record = record_buffer[idx];
+    // Finest tier that reaches back far enough (give or take one bucket) and fits in max_points
+    bool tier_covers = false;
+    for (size_t i = 0; i < RollupTiers::TIER_COUNT; i++) {
+        const RollupTier& tier = rollups.tier(i);
+        if (!tier.getOldestUptime(tier_oldest) ||
+            tier_oldest > needed_from + tier.getBucketSeconds() * 1000UL) {
+            continue;
+        }
         
-        if (record.uptime >= start_uptime && record.uptime <= end_uptime && record.isValid()) {
-            results.push_back(record);
+        tier_covers = true;
+        size_t begin, end;
+        tier.findRange(start_uptime, end_uptime, begin, end);
+        if (end - begin <= max_points) {
+            Serial.printf("📈 Using %lus rollups: %zu points\n", (unsigned long)tier.getBucketSeconds(), end - begin);
+            return i;
         }
     }
     
-    // Sort by uptime (should already be sorted, but ensure it)
-    std::sort(results.begin(), results.end(), 
-              [](const SensorRecord& a, const SensorRecord& b) {
-                  return a.uptime < b.uptime;
-              });
-    
-    Serial.printf("📊 Query found %zu records in uptime range %lu-%lu\n", 
-                 results.size(), start_uptime, end_uptime);
+    // Beyond rollup retention only the SD archive still has the data - downsample raw records
+    if (!tier_covers && has_raw && raw_oldest <= needed_from) {
+        return RAW_RESOLUTION;
+    }
     
-    return results;
+    return RollupTiers::TIER_COUNT - 1;
 }
 
-std::vector<SensorRecord> HistoricalDataStorage::queryLatest(size_t count) {
-    std::vector<SensorRecord> results;
-    
-    if (!initialized || current_records == 0) {
+std::vector<RollupBucket> HistoricalDataStorage::queryRollups(size_t tier_index, uint64_t start_uptime,
+                                                              uint64_t end_uptime) const {
+    std::vector<RollupBucket> results;
+    if (tier_index >= RollupTiers::TIER_COUNT || end_uptime < start_uptime) {
         return results;
     }
     
-    // Limit count to available records
-    size_t actual_count = min(count, current_records);
+    const RollupTier& tier = rollups.tier(tier_index);
+    size_t begin, end;
+    tier.findRange(start_uptime, end_uptime, begin, end);
     
-    // Get latest records (work backwards from write index)
-    for (size_t i = 0; i < actual_count; i++) {
-        size_t idx;
-        if (storage_full) {
-            // Circular buffer: work backwards from write_index
-            idx = (write_index - 1 - i + max_records) % max_records;
-        } else {
-            // Linear buffer: work backwards from end
-            idx = current_records - 1 - i;
+    results.reserve(end - begin);
+    for (size_t i = begin; i < end; i++) {
+        results.push_back(tier.at(i));
+    }
+    
+    return results;
+}
+
+// ================================
+// HISTORY CURSOR
+// ================================
+
+bool HistoryCursor::next(SensorRecord& record) {
+    while (!finished) {
+        // Inside a deadband run: re-created points at the run start values, then the held record
+        if (expand_left > 0) {
+            expand_left--;
+            if (expand_left == 0) {
+                record = held;
+                previous = held;
+                previous_sequence = next_sequence - 1;
+            } else {
+                record = previous;
+                record.setUptime(expand_uptime);
+                expand_uptime += storage->deadband_interval_ms;
+            }
+            
+            if (record.getUptime() > end_uptime) {
+                finished = true;
+                expand_left = 0;
+                return false;
+            }
+            if (record.getUptime() < start_uptime) {
+                continue;
+            }
+            return true;
+        }
+        
+        if (!readStored(record)) {
+            return false;
+        }
+        
+        if (record.validity_flags & SensorRecord::FLAG_HELD) {
+            record.validity_flags &= ~SensorRecord::FLAG_HELD;
+            
+            // Readings folded into the run are re-created one sampling interval apart
+            uint32_t interval = storage->deadband_interval_ms;
+            bool follows_start = has_previous && previous_sequence + 2 == next_sequence;
+            if (follows_start && interval > 0 && record.getUptime() > previous.getUptime() + interval) {
+                uint64_t span = record.getUptime() - previous.getUptime();
+                held = record;
+                expand_left = (span + interval / 2) / interval;   // Points after the run start, held one included
+                expand_uptime = previous.getUptime() + interval;
+                continue;
+            }
+            
+            // A held record is read past the end so its run can be expanded up to it
+            if (record.getUptime() > end_uptime) {
+                finished = true;
+                return false;
+            }
         }
         
-        if (idx < record_buffer.size() && record_buffer[idx].isValid()) {
-            results.push_back(record_buffer[idx]);
+        previous = record;
+        previous_sequence = next_sequence - 1;
+        has_previous = true;
+        if (record.getUptime() < start_uptime) {
+            continue;   // Run start before the range, read only to expand its run
         }
+        return true;
     }
-    
-    // Reverse to get chronological order (oldest first)
-    std::reverse(results.begin(), results.end());
-    
-    Serial.printf("📊 Query returned %zu latest records\n", results.size());
-    return results;
+    return false;
 }
 
-HistoricalDataStorage::QueryResult HistoricalDataStorage::queryByTimeRangePaged(
-    const TimeRange& range, const TimeSync& timeSync, 
-    size_t page_size, size_t page_index) {
+bool HistoryCursor::readStored(SensorRecord& record) {
+    // Skip anything that has been dropped since the cursor was positioned
+    uint32_t oldest_sequence = storage->getOldestSequence();
+    if (next_sequence < oldest_sequence) {
+        next_sequence = oldest_sequence;
+    }
     
-    QueryResult result;
-    result.has_more = false;
-    result.total_available = 0;
+    if (next_sequence >= storage->next_sequence) {
+        finished = true;
+        return false;
+    }
     
-    // Get all records in range first
-    std::vector<SensorRecord> all_records = queryByTimeRange(range, timeSync);
-    result.total_available = all_records.size();
+    uint32_t first_sequence = storage->getFirstSequence();
+    uint32_t memory_sequence = storage->getMemorySequence();
+    bool found;
+    if (next_sequence >= first_sequence) {
+        record = storage->recordAt(next_sequence - first_sequence);
+        found = true;
+    } else if (next_sequence >= memory_sequence) {
+        found = storage->archive.read(next_sequence, archive_reader, record);
+    } else {
+        // Older than anything in RAM - read it back from the SD archive
+        if (!sd_reader) {
+            sd_reader.reset(new PartitionedArchive::Reader());
+        }
+        found = storage->sd_archive && storage->sd_archive->read(next_sequence, *sd_reader, record);
+    }
     
-    if (all_records.empty()) {
-        return result;
+    if (!found) {
+        // Gap (lost block, archive enabled late) - continue at the next stored record
+        uint32_t resume = first_sequence;
+        if (next_sequence < memory_sequence) {
+            resume = memory_sequence;
+            if (sd_reader && sd_reader->next_available > next_sequence) {
+                resume = min(resume, sd_reader->next_available);
+            }
+        }
+        next_sequence = resume;
+        return readStored(record);
     }
     
-    // Apply sampling if we have too many records
-    if (all_records.size() > range.max_points) {
-        all_records = sampleRecords(all_records, range.max_points);
+    if (record.getUptime() > end_uptime && !(record.validity_flags & SensorRecord::FLAG_HELD)) {
+        finished = true;
+        return false;
     }
     
-    // Calculate pagination
-    size_t start_idx = page_index * page_size;
-    size_t end_idx = min(start_idx + page_size, all_records.size());
+    next_sequence++;
+    return true;
+}
+
+void HistoryCursor::skip(size_t count) {
+    if (finished) {
+        return;
+    }
+    resetRun();
+    
+    uint32_t oldest_sequence = storage->getOldestSequence();
+    if (next_sequence < oldest_sequence) {
+        next_sequence = oldest_sequence;
+    }
+    next_sequence = min(next_sequence + (uint32_t)count, storage->next_sequence);
+}
+
+void HistoryCursor::seek(uint32_t sequence) {
+    if (finished || sequence <= next_sequence) {
+        return;
+    }
     
-    if (start_idx < all_records.size()) {
-        result.records.assign(all_records.begin() + start_idx, all_records.begin() + end_idx);
-        result.has_more = end_idx < all_records.size();
+    next_sequence = min(sequence, storage->next_sequence);
+    resetRun();
+}
+
+size_t HistoryCursor::remaining() const {
+    if (finished) {
+        return 0;
     }
     
-    return result;
+    uint32_t begin = max(next_sequence, storage->getOldestSequence());
+    uint32_t end = storage->upperBoundSequence(end_uptime);
+    size_t stored = end > begin ? end - begin : 0;
+    
+    uint32_t interval = storage->deadband_interval_ms;
+    if (stored == 0 || interval == 0 || storage->folded_readings == 0) {
+        return stored + expand_left;
+    }
+    
+    // Deadband runs expand to about one point per interval over the span, but
+    // never to more than the readings folded into held records
+    uint64_t oldest_uptime, newest_uptime;
+    if (!storage->getDataTimeRange(oldest_uptime, newest_uptime)) {
+        return stored + expand_left;
+    }
+    uint32_t first_sequence = storage->getFirstSequence();
+    uint64_t from = begin >= first_sequence ? storage->recordAt(begin - first_sequence).getUptime()
+                                                 : oldest_uptime;
+    uint64_t to = min(end_uptime, newest_uptime);
+    size_t by_time = to > from ? (to - from) / interval + 1 : 1;
+    size_t expanded = min(by_time, stored + (size_t)storage->folded_readings);
+    return max(stored, expanded) + expand_left;
 }
 
 // ================================
@@ -275,7 +1072,10 @@ HistoricalDataStorage::QueryResult HistoricalDataStorage::queryByTimeRangePaged(
 
 StorageInfo HistoricalDataStorage::getStorageInfo(const TimeSync& timeSync) const {
     StorageInfo info;
-    info.storage_type = storage_type + "_ram_only";  // Indicate RAM-only storage
+    info.storage_type = storage_type;
+    if (!segment_log && !sd_archive) {
+        info.storage_type += "_ram_only";  // Indicate RAM-only storage
+    }
     info.total_capacity_mb = (max_records * RECORD_SIZE) / (1024.0 * 1024.0);
     info.used_capacity_mb = (current_records * RECORD_SIZE) / (1024.0 * 1024.0);
     info.free_capacity_mb = info.total_capacity_mb - info.used_capacity_mb;
@@ -285,12 +1085,12 @@ StorageInfo HistoricalDataStorage::getStorageInfo(const TimeSync& timeSync) cons
     
     // Get time range of stored data
     if (current_records > 0) {
-        unsigned long oldest_uptime, newest_uptime;
+        uint64_t oldest_uptime, newest_uptime;
         if (getDataTimeRange(oldest_uptime, newest_uptime)) {
             if (timeSync.has_time) {
                 // Convert to real timestamps if time is synced
-                info.oldest_record_time = timeSync.uptimeToTimestamp(oldest_uptime);
-                info.newest_record_time = timeSync.uptimeToTimestamp(newest_uptime);
+                info.oldest_record_time = toTimestamp(timeSync, oldest_uptime);
+                info.newest_record_time = toTimestamp(timeSync, newest_uptime);
             } else {
                 // Use uptime values directly (will be mapped later when time syncs)
                 info.oldest_record_time = oldest_uptime;
@@ -310,22 +1110,22 @@ StorageInfo HistoricalDataStorage::getStorageInfo(const TimeSync& timeSync) cons
     return info;
 }
 
-bool HistoricalDataStorage::getDataTimeRange(unsigned long& oldest_uptime, unsigned long& newest_uptime) const {
+bool HistoricalDataStorage::getDataTimeRange(uint64_t& oldest_uptime, uint64_t& newest_uptime) const {
     if (current_records == 0) {
         return false;
     }
     
-    if (storage_full) {
-        // In circular buffer mode, oldest is at read_index, newest is at write_index-1
-        size_t oldest_idx = read_index;
-        size_t newest_idx = (write_index - 1 + max_records) % max_records;
-        
-        oldest_uptime = record_buffer[oldest_idx].uptime;
-        newest_uptime = record_buffer[newest_idx].uptime;
-    } else {
-        // In linear mode, oldest is at index 0, newest is at current_records-1
-        oldest_uptime = record_buffer[0].uptime;
-        newest_uptime = record_buffer[current_records - 1].uptime;
+    // Oldest is at the head (read_index), newest just before write_index
+    oldest_uptime = recordAt(0).getUptime();
+    newest_uptime = recordAt(current_records - 1).getUptime();
+    
+    // Archive reaches further back than the ring once it has wrapped
+    uint64_t archived_uptime;
+    if (archive.getOldestUptime(archived_uptime) && archived_uptime < oldest_uptime) {
+        oldest_uptime = archived_uptime;
+    }
+    if (sd_archive && sd_archive->getOldestUptime(archived_uptime) && archived_uptime < oldest_uptime) {
+        oldest_uptime = archived_uptime;
     }
     
     return true;
@@ -335,43 +1135,26 @@ bool HistoricalDataStorage::getDataTimeRange(unsigned long& oldest_uptime, unsig
 // MAINTENANCE OPERATIONS
 // ================================
 
-bool HistoricalDataStorage::clearOldData(unsigned long before_uptime) {
+bool HistoricalDataStorage::clearOldData(uint64_t before_uptime) {
     if (!initialized || current_records == 0) {
         return true;
     }
     
-    size_t removed_count = 0;
-    std::vector<SensorRecord> filtered_records;
+    // Records are in uptime order - advance the head past the old ones in place
+    size_t removed_count = lowerBoundUptime(before_uptime);
+    dropOldest(removed_count);
     
-    // Collect records newer than before_uptime
-    size_t search_start = storage_full ? read_index : 0;
-    
-    for (size_t i = 0; i < current_records; i++) {
-        size_t idx = (search_start + i) % max_records;
-        const SensorRecord& record = record_buffer[idx];
-        
-        if (record.uptime >= before_uptime) {
-            filtered_records.push_back(record);
-        } else {
-            removed_count++;
-        }
+    archive.dropBefore(before_uptime);
+    episodes.dropBefore(before_uptime);
+    if (segment_log) {
+        segment_log->dropBefore(before_uptime);
     }
-    
-    // Replace buffer with filtered records
-    record_buffer = filtered_records;
-    current_records = filtered_records.size();
-    write_index = current_records;
-    read_index = 0;
-    storage_full = false;
-    
-    // Ensure we don't exceed max_records
-    if (current_records > max_records) {
-        record_buffer.resize(max_records);
-        current_records = max_records;
-        storage_full = true;
+    if (sd_archive) {
+        sd_archive->dropBefore(before_uptime);
     }
     
-    Serial.printf("🗑️  Removed %zu old records (before uptime %lu)\n", removed_count, before_uptime);
+    Serial.printf("🗑️  Removed %zu old records (before uptime %llu)\n", removed_count,
+                 (unsigned long long)before_uptime);
     
     if (storage_type == "flash") {
         saveToFlash();
@@ -380,14 +1163,24 @@ bool HistoricalDataStorage::clearOldData(unsigned long before_uptime) {
     return true;
 }
 
+void HistoricalDataStorage::setRetention(uint32_t max_age_hours) {
+    retention_ms = (uint64_t)max_age_hours * 3600000ULL;
+    retention_countdown = 0;
+    
+    if (max_age_hours > 0) {
+        Serial.printf("🗑️  Automatic retention: records older than %lu hours are dropped\n",
+                     (unsigned long)max_age_hours);
+    }
+}
+
 bool HistoricalDataStorage::clearOldData(const TimeSync& timeSync, uint32_t max_age_hours) {
     if (!timeSync.has_time) {
         Serial.println("⚠️  Cannot clear old data: Time not synchronized");
         return false;
     }
     
-    unsigned long cutoff_timestamp = timeSync.getCurrentTimestamp() - (max_age_hours * 3600000UL);
-    unsigned long cutoff_uptime = timeSync.timestampToUptime(cutoff_timestamp);
+    uint64_t cutoff_timestamp = timeSync.getCurrentTimestamp() - (max_age_hours * 3600000ULL);
+    uint64_t cutoff_uptime = toStorageUptime(timeSync, cutoff_timestamp);
     
     return clearOldData(cutoff_uptime);
 }
@@ -431,12 +1224,12 @@ String HistoricalDataStorage::exportData(uint32_t count) {
     
     for (const SensorRecord& record : records) {
         JsonObject record_obj = data_array.add<JsonObject>();
-        record_obj["uptime"] = record.uptime;
-        record_obj["co2"] = record.co2;
-        record_obj["temperature"] = record.temperature;
-        record_obj["humidity"] = record.humidity;
-        record_obj["pressure"] = record.pressure;
-        record_obj["voc"] = record.voc;
+        record_obj["uptime"] = record.getUptime();
+        record_obj["co2"] = record.getCo2();
+        record_obj["temperature"] = record.getTemperature();
+        record_obj["humidity"] = record.getHumidity();
+        record_obj["pressure"] = record.getPressure();
+        record_obj["voc"] = record.getVoc();
         record_obj["validity_flags"] = record.validity_flags;
         record_obj["alert_level"] = record.alert_level;
     }
@@ -452,26 +1245,63 @@ String HistoricalDataStorage::exportData(uint32_t count) {
 
 bool HistoricalDataStorage::validateRecord(const SensorRecord& record) const {
     // Basic validation
-    return record.uptime > 0 && 
+    return record.getUptime() > 0 && 
            record.validity_flags != 0 && 
            record.isValid();
 }
 
 void HistoricalDataStorage::updateIndices() {
-    if (storage_full) {
-        write_index = (write_index + 1) % max_records;
-        read_index = write_index; // Oldest record is always next to be overwritten
-    } else {
-        write_index = current_records;
-        read_index = 0;
-    }
+    // Records occupy [read_index, read_index + current_records) modulo max_records
+    write_index = (read_index + current_records) % max_records;
+    storage_full = current_records >= max_records;
 }
 
 size_t HistoricalDataStorage::getNextWriteIndex() const {
-    if (current_records < max_records) {
-        return current_records;
-    } else {
-        return write_index % max_records;
+    return write_index;
+}
+
+void HistoricalDataStorage::dropOldest(size_t count) {
+    count = min(count, current_records);
+    if (count == 0) {
+        return;
+    }
+    
+    if (count == current_records) {
+        resetRing();
+        return;
+    }
+    
+    read_index = (read_index + count) % max_records;
+    current_records -= count;
+    updateIndices();
+}
+
+void HistoricalDataStorage::applyRetention(uint64_t newest_uptime) {
+    if (newest_uptime <= retention_ms) {
+        return;
+    }
+    uint64_t cutoff = newest_uptime - retention_ms;
+    
+    // A few ring records per reading - more than one arrives, so a backlog still drains
+    size_t expired = 0;
+    while (expired < RETENTION_STEP_RECORDS && expired < current_records &&
+           recordAt(expired).getUptime() < cutoff) {
+        expired++;
+    }
+    dropOldest(expired);
+    
+    // Archives drop whole blocks/segments/partitions - check them now and then
+    if (++retention_countdown < RETENTION_SWEEP_INTERVAL) {
+        return;
+    }
+    retention_countdown = 0;
+    archive.dropBefore(cutoff);
+    episodes.dropBefore(cutoff);
+    if (segment_log) {
+        segment_log->dropBefore(cutoff);
+    }
+    if (sd_archive) {
+        sd_archive->dropBefore(cutoff);
     }
 }
 
@@ -480,66 +1310,391 @@ bool HistoricalDataStorage::shouldOverwrite() const {
 }
 
 
-String HistoricalDataStorage::getStorageKey(size_t index) const {
-    return "rec_" + String(index);
+uint64_t HistoricalDataStorage::toTimestamp(const TimeSync& timeSync, uint64_t storage_uptime) const {
+    return epochs.toTimestamp(storage_uptime, currentEpochOffset(timeSync));
+}
+
+uint64_t HistoricalDataStorage::toStorageUptime(const TimeSync& timeSync, uint64_t timestamp) const {
+    return epochs.toUptime(timestamp, currentEpochOffset(timeSync));
+}
+
+uint64_t HistoricalDataStorage::currentEpochOffset(const TimeSync& timeSync) const {
+    // TimeSync maps millis64(), the storage clock runs clock_offset ahead of it
+    if (!timeSync.has_time || timeSync.time_offset <= clock_offset) {
+        return 0;
+    }
+    return timeSync.time_offset - clock_offset;
+}
+
+void HistoricalDataStorage::noteTimeSync(const TimeSync& timeSync) {
+    profile.setTimezone(DiurnalProfile::parseTimezone(timeSync.timezone_offset));
+    if (epochs.setCurrentOffset(currentEpochOffset(timeSync))) {
+        saveEpochs();
+    }
+}
+
+// ================================
+// BOOT EPOCHS
+// ================================
+
+void HistoricalDataStorage::attachEpochs(IFileSystem& fs, const String& directory) {
+    if (!epoch_fs) {
+        epoch_fs = &fs;
+        epoch_directory = directory;
+        
+        BootEpoch current = epochs.current();
+        if (loadEpochs()) {
+            // Continue after the newest known boot even if its records were lost
+            const BootEpoch& previous = epochs.current();
+            if (clock_offset <= previous.start_uptime) {
+                clock_offset = previous.start_uptime + 1000;
+            }
+            if (current_records == 0 && next_sequence < previous.start_sequence) {
+                archive.clear();
+                next_sequence = previous.start_sequence;
+            }
+            epochs.begin(clock_offset, next_sequence, current.boot_id);
+            epochs.setCurrentOffset(current.time_offset);
+            generation++;   // Earlier boots now have their own offsets
+        }
+    }
+    
+    epochs.setCurrentStart(clock_offset, next_sequence);
+    saveEpochs();
+}
+
+String HistoricalDataStorage::epochPath(uint32_t generation) const {
+    return epoch_directory + (generation % 2 ? "/epochs_1.bin" : "/epochs_0.bin");
+}
+
+bool HistoricalDataStorage::loadEpochs() {
+    // [magic][generation][count][BootEpoch x count][CRC16]
+    static const size_t HEADER_BYTES = 2 * sizeof(uint32_t) + 1;
+    uint8_t buffer[HEADER_BYTES + sizeof(epochs.epochs) + sizeof(uint16_t)];
+    bool found = false;
+    
+    for (uint32_t file = 0; file < 2; file++) {
+        size_t length = epoch_fs->read(epochPath(file), 0, buffer, sizeof(buffer));
+        uint32_t magic, generation;
+        if (length < HEADER_BYTES + sizeof(uint16_t)) {
+            continue;
+        }
+        memcpy(&magic, buffer, sizeof(magic));
+        memcpy(&generation, buffer + sizeof(magic), sizeof(generation));
+        uint8_t count = buffer[2 * sizeof(uint32_t)];
+        size_t payload = HEADER_BYTES + count * sizeof(BootEpoch);
+        
+        uint16_t crc;
+        if (magic != EPOCH_MAGIC || count == 0 || count > BootEpochTable::MAX_EPOCHS ||
+            length != payload + sizeof(crc)) {
+            continue;
+        }
+        memcpy(&crc, buffer + payload, sizeof(crc));
+        if (crc != crc16Ccitt(buffer, payload) || (found && generation <= epoch_generation)) {
+            continue;
+        }
+        
+        epochs.count = count;
+        memcpy(epochs.epochs, buffer + HEADER_BYTES, count * sizeof(BootEpoch));
+        epoch_generation = generation;
+        found = true;
+    }
+    
+    if (found) {
+        Serial.printf("⏰ Restored %u boot epochs\n", epochs.count);
+    }
+    return found;
+}
+
+bool HistoricalDataStorage::saveEpochs() {
+    if (!epoch_fs) {
+        return true;   // RAM only - epochs of this boot are all there is
+    }
+    
+    static const size_t HEADER_BYTES = 2 * sizeof(uint32_t) + 1;
+    uint8_t buffer[HEADER_BYTES + sizeof(epochs.epochs) + sizeof(uint16_t)];
+    uint32_t magic = EPOCH_MAGIC;
+    uint32_t generation = epoch_generation + 1;
+    memcpy(buffer, &magic, sizeof(magic));
+    memcpy(buffer + sizeof(magic), &generation, sizeof(generation));
+    buffer[2 * sizeof(uint32_t)] = epochs.count;
+    memcpy(buffer + HEADER_BYTES, epochs.epochs, epochs.count * sizeof(BootEpoch));
+    size_t payload = HEADER_BYTES + epochs.count * sizeof(BootEpoch);
+    uint16_t crc = crc16Ccitt(buffer, payload);
+    memcpy(buffer + payload, &crc, sizeof(crc));
+    
+    // Overwrites the older file - the other one still holds the previous table
+    String path = epochPath(generation);
+    epoch_fs->remove(path);
+    if (!epoch_fs->append(path, buffer, payload + sizeof(crc))) {
+        Serial.println("❌ Cannot save boot epochs");
+        return false;
+    }
+    
+    epoch_generation = generation;
+    return true;
+}
+
+bool HistoricalDataStorage::loadFromFlash() {
+    if (!segment_log) {
+        return false;
+    }
+    
+    uint64_t newest_uptime = 0;
+    size_t restored = segment_log->replay([this, &newest_uptime](const SensorRecord& record, uint32_t sequence) {
+        if (sequence != next_sequence) {
+            // Gap in the log (lost batch) - ring sequence numbers must stay contiguous
+            resetRing();
+            next_sequence = sequence;
+        }
+        appendRecord(record);
+        newest_uptime = max(newest_uptime, record.getUptime());
+    });
+    
+    if (restored > 0) {
+        // Continue the clock after the newest restored record (downtime is unknown)
+        clock_offset = newest_uptime + 1000;
+    }
+    
+    Serial.printf("📂 Restored %zu records from flash (clock offset %llu ms)\n", restored,
+                 (unsigned long long)clock_offset);
+    return true;
+}
+
+bool HistoricalDataStorage::saveToFlash() {
+    if (!segment_log) {
+        return true;   // RAM-only storage has nothing to write
+    }
+    return segment_log->flush();
+}
+
+bool HistoricalDataStorage::resolveUptimeRange(const TimeRange& range, const TimeSync& timeSync,
+                                               uint64_t& start_uptime, uint64_t& end_uptime) const {
+    if (!timeSync.has_time) {
+        Serial.println("❌ Cannot query by time range: Time not synchronized");
+        return false;
+    }
+    
+    // Convert timestamps to uptime range
+    start_uptime = toStorageUptime(timeSync, range.start_time);
+    end_uptime = toStorageUptime(timeSync, range.end_time);
+    
+    Serial.printf("🔍 Time conversion: start_ts=%llu -> uptime=%llu, end_ts=%llu -> uptime=%llu\n",
+                 (unsigned long long)range.start_time, (unsigned long long)start_uptime,
+                 (unsigned long long)range.end_time, (unsigned long long)end_uptime);
+    Serial.printf("🔍 TimeSync: has_time=%s, offset=%llu, current_uptime=%llu\n",
+                 timeSync.has_time ? "true" : "false", (unsigned long long)timeSync.time_offset,
+                 (unsigned long long)millis64());
+    
+    // Handle case where requested time is before device boot
+    if (start_uptime == 0) {
+        // Start time is before device boot, adjust to earliest available data
+        start_uptime = 1; // Start from beginning of device uptime
+        Serial.printf("⚠️ Adjusting start time: requested timestamp before device boot\n");
+    }
+    
+    if (end_uptime == 0) {
+        // End time is before device boot - no data available
+        Serial.println("❌ End time is before device boot - no data available");
+        return false;
+    }
+    
+    // Cap end time to current uptime if it's in the future
+    uint64_t current_uptime = getCurrentUptime();
+    if (end_uptime > current_uptime) {
+        end_uptime = current_uptime;
+        Serial.printf("⚠️ Adjusting end time: requested timestamp in future (capped to current uptime: %llu)\n",
+                     (unsigned long long)current_uptime);
+    }
+    
+    return true;
+}
+
+size_t HistoricalDataStorage::lowerBoundUptime(uint64_t uptime) const {
+    // First logical index whose uptime is >= the given value
+    size_t low = 0;
+    size_t high = current_records;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (recordAt(mid).getUptime() < uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+size_t HistoricalDataStorage::upperBoundUptime(uint64_t uptime) const {
+    // First logical index whose uptime is > the given value
+    size_t low = 0;
+    size_t high = current_records;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (recordAt(mid).getUptime() <= uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
 }
 
-std::vector<SensorRecord> HistoricalDataStorage::sampleRecords(const std::vector<SensorRecord>& records, size_t max_points) const {
-    if (records.size() <= max_points) {
-        return records;
+RecordView HistoricalDataStorage::viewLogicalRange(size_t begin, size_t end) const {
+    RecordView view;
+    if (begin >= end) {
+        return view;
     }
     
-    std::vector<SensorRecord> sampled;
-    sampled.reserve(max_points);
+    // Split at the physical end of the buffer if the range wraps around
+    size_t physical_begin = (oldestIndex() + begin) % max_records;
+    size_t count = end - begin;
+    size_t first_count = min(count, max_records - physical_begin);
     
-    // Use simple uniform sampling
-    double step = static_cast<double>(records.size()) / max_points;
+    view.spans[0].data = &record_buffer[physical_begin];
+    view.spans[0].count = first_count;
+    if (first_count < count) {
+        view.spans[1].data = &record_buffer[0];
+        view.spans[1].count = count - first_count;
+    }
+    
+    return view;
+}
+
+uint32_t HistoricalDataStorage::getOldestSequence() const {
+    uint32_t memory_sequence = getMemorySequence();
+    if (sd_archive && !sd_archive->isEmpty() && sd_archive->getFirstSequence() < memory_sequence) {
+        return sd_archive->getFirstSequence();
+    }
+    return memory_sequence;
+}
+
+uint32_t HistoricalDataStorage::getMemorySequence() const {
+    uint32_t first_sequence = getFirstSequence();
+    if (archive.getRecordCount() > 0 && archive.getFirstSequence() < first_sequence) {
+        return archive.getFirstSequence();
+    }
+    return first_sequence;
+}
+
+bool HistoricalDataStorage::useSdArchive(uint64_t uptime) const {
+    if (!sd_archive || sd_archive->isEmpty() || sd_archive->getFirstSequence() >= getMemorySequence()) {
+        return false;
+    }
     
-    for (size_t i = 0; i < max_points; i++) {
-        size_t idx = static_cast<size_t>(i * step);
-        if (idx < records.size()) {
-            sampled.push_back(records[idx]);
+    // Only for uptimes older than anything still held in RAM
+    uint64_t memory_oldest;
+    if (archive.getRecordCount() > 0 && archive.getFirstSequence() < getFirstSequence() &&
+        archive.getOldestUptime(memory_oldest)) {
+        return uptime < memory_oldest;
+    }
+    return current_records == 0 || uptime < recordAt(0).getUptime();
+}
+
+uint32_t HistoricalDataStorage::lowerBoundSequence(uint64_t uptime) const {
+    if (useSdArchive(uptime)) {
+        uint32_t sequence = sd_archive->lowerBoundSequence(uptime);
+        if (sequence < getMemorySequence()) {
+            return sequence;
         }
     }
     
-    Serial.printf("📊 Sampled %zu records from %zu (max: %zu)\n", 
-                 sampled.size(), records.size(), max_points);
+    // Older than everything in the ring: resolve inside the archive
+    if (archive.getRecordCount() > 0 && archive.getFirstSequence() < getFirstSequence() &&
+        (current_records == 0 || uptime < recordAt(0).getUptime())) {
+        uint32_t sequence = archive.lowerBoundSequence(uptime);
+        if (sequence < getFirstSequence()) {
+            return sequence;
+        }
+    }
+    return getFirstSequence() + lowerBoundUptime(uptime);
+}
+
+uint32_t HistoricalDataStorage::upperBoundSequence(uint64_t uptime) const {
+    if (useSdArchive(uptime)) {
+        uint32_t sequence = sd_archive->upperBoundSequence(uptime);
+        if (sequence < getMemorySequence()) {
+            return sequence;
+        }
+    }
     
-    return sampled;
+    if (archive.getRecordCount() > 0 && archive.getFirstSequence() < getFirstSequence() &&
+        (current_records == 0 || uptime < recordAt(0).getUptime())) {
+        uint32_t sequence = archive.upperBoundSequence(uptime);
+        if (sequence < getFirstSequence()) {
+            return sequence;
+        }
+    }
+    return getFirstSequence() + upperBoundUptime(uptime);
+}
+
+String HistoricalDataStorage::getStorageKey(size_t index) const {
+    return "rec_" + String(index);
 }
 
 // ================================
 // STORAGE FACTORY
 // ================================
 
+// The raw ring stays in RAM either way; a card adds the archive (daily partitions)
+static bool attachSdCard(HistoricalDataStorage& storage) {
+    IFileSystem* fs = StorageFactory::getSDCardFileSystem();
+    return fs && storage.initialize() && storage.enableSdArchive(*fs);
+}
+
 std::unique_ptr<HistoricalDataStorage> StorageFactory::createStorage(StorageType type) {
+    std::unique_ptr<HistoricalDataStorage> storage(
+        new HistoricalDataStorage("flash", HistoricalDataStorage::MAX_RECORDS_FLASH));
+    
     switch (type) {
         case FLASH_STORAGE:
-            return std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("flash", 600));
+            return storage;
             
         case SD_CARD_STORAGE:
-            if (isSDCardAvailable()) {
-                return std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("sd_card", 500000)); // 500k records
-            } else {
+            if (!attachSdCard(*storage)) {
                 Serial.println("⚠️  SD card not available, falling back to flash");
-                return std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("flash", 600));
             }
+            return storage;
             
         case AUTO_DETECT:
         default:
-            if (isSDCardAvailable()) {
+            if (attachSdCard(*storage)) {
                 Serial.println("📱 Auto-detected SD card storage");
-                return std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("sd_card", 500000));
             } else {
                 Serial.println("💾 Using internal flash storage");
-                return std::unique_ptr<HistoricalDataStorage>(new HistoricalDataStorage("flash", 600));
             }
+            return storage;
     }
 }
 
 bool StorageFactory::isSDCardAvailable() {
-    // TODO: Implement SD card detection
-    return false; // For now, only use flash storage
+#if HISTORY_SD_ARCHIVE
+    // Mount once - the card shares the SPI bus with the BME688 and the display
+    static bool checked = false;
+    static bool available = false;
+    if (!checked) {
+        checked = true;
+        available = SD.begin(HISTORY_SD_CS_PIN) && SD.cardType() != CARD_NONE;
+        if (available) {
+            Serial.printf("💾 SD card detected on CS %d: %llu MB\n", HISTORY_SD_CS_PIN,
+                         (unsigned long long)(SD.cardSize() / (1024ULL * 1024ULL)));
+        } else {
+            Serial.printf("⚠️  No SD card on CS %d\n", HISTORY_SD_CS_PIN);
+        }
+    }
+    return available;
+#else
+    return false;   // SD archive not built in - the pin is never driven
+#endif
+}
+
+IFileSystem* StorageFactory::getSDCardFileSystem() {
+#if HISTORY_SD_ARCHIVE
+    static ArduinoFileSystem sd_filesystem(SD, "sd_card");
+    return isSDCardAvailable() ? &sd_filesystem : nullptr;
+#else
+    return nullptr;
+#endif
 }
 
 size_t StorageFactory::getAvailableFlashSpace() {
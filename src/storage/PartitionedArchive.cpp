@@ -0,0 +1,437 @@
+/*
+ * storage/PartitionedArchive.cpp
+ * Implementation of the time-partitioned compressed archive
+ */
+
+#include "storage/PartitionedArchive.h"
+#include "utils/Checksum.h"
+#include <algorithm>
+
+PartitionedArchive::PartitionedArchive(IFileSystem& filesystem, const String& dir,
+                                       uint32_t partition_length_s, size_t partition_limit)
+    : fs(filesystem)
+    , directory(dir)
+    , partition_seconds(max(partition_length_s, (uint32_t)60))
+    , max_partitions(max(partition_limit, (size_t)1))
+    , end_sequence(0)
+    , newest_uptime(0)
+    , open_partition(0) {
+}
+
+// ================================
+// SETUP
+// ================================
+
+bool PartitionedArchive::begin() {
+    if (!fs.makeDirectory(directory)) {
+        Serial.printf("❌ Archive: cannot create %s\n", directory.c_str());
+        return false;
+    }
+
+    std::vector<String> names;
+    if (!fs.listFiles(directory, names)) {
+        return false;
+    }
+
+    std::vector<uint32_t> ids;
+    for (const String& name : names) {
+        // p_00000003.idx
+        if (name.startsWith("p_") && name.endsWith(".idx")) {
+            ids.push_back(strtoul(name.substring(2, name.length() - 4).c_str(), nullptr, 10));
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    partitions.clear();
+    for (uint32_t id : ids) {
+        Partition partition;
+        partition.id = id;
+        partition.entries = fs.fileSize(indexPath(id)) / sizeof(ArchiveIndexEntry);
+
+        ArchiveIndexEntry first;
+        if (partition.entries == 0 ||
+            fs.read(indexPath(id), 0, reinterpret_cast<uint8_t*>(&first), sizeof(first)) != sizeof(first)) {
+            // Interrupted before the first index entry - nothing usable
+            fs.remove(dataPath(id));
+            fs.remove(indexPath(id));
+            continue;
+        }
+
+        // Indexes written before record times were stored natively hold milliseconds
+        if (partitionOf(SensorRecord::rawTimeToUptime(first.first_uptime)) != id &&
+            first.first_uptime / 1000 / partition_seconds == id) {
+            if (!migrateIndex(id, partition.entries)) {
+                continue;
+            }
+            first.first_uptime /= 1000;
+        }
+
+        partition.first_sequence = first.first_sequence;
+        partition.first_uptime = SensorRecord::rawTimeToUptime(first.first_uptime);
+        partitions.push_back(partition);
+    }
+
+    ArchiveIndexEntry last;
+    if (!partitions.empty() && readEntry(partitions.size() - 1, partitions.back().entries - 1, last)) {
+        end_sequence = last.first_sequence + last.record_count;
+        newest_uptime = SensorRecord::rawTimeToUptime(last.last_uptime);
+    }
+
+    open_block.reset(end_sequence);
+    writer.reset();
+
+    Serial.printf("💾 Archive: %zu partitions in %s on %s (next sequence %lu)\n",
+                 partitions.size(), directory.c_str(), fs.getName().c_str(), (unsigned long)end_sequence);
+    return true;
+}
+
+// ================================
+// WRITING
+// ================================
+
+void PartitionedArchive::append(const SensorRecord& record, uint32_t sequence) {
+    if (sequence < end_sequence) {
+        return;   // Already on the card
+    }
+
+    // Blocks hold consecutive sequences and never straddle a partition boundary
+    uint32_t partition = partitionOf(record.getUptime());
+    if (!open_block.isEmpty() &&
+        (open_block.getEndSequence() != sequence || partition != open_partition)) {
+        writeBlock();
+    }
+
+    if (open_block.isEmpty() || !open_block.append(record, writer)) {
+        writeBlock();
+        open_block.reset(sequence);
+        writer.reset();
+        open_partition = partition;
+        open_block.append(record, writer);
+    }
+}
+
+bool PartitionedArchive::flush() {
+    return writeBlock();
+}
+
+bool PartitionedArchive::writeBlock() {
+    if (open_block.isEmpty()) {
+        return true;
+    }
+
+    uint8_t buffer[CompressedBlock::MAX_STORED_BYTES + sizeof(uint16_t)];
+    size_t length = open_block.serialize(buffer);
+    uint16_t crc = crc16Ccitt(buffer, length);
+    memcpy(buffer + length, &crc, sizeof(crc));
+
+    // Partition numbers only grow - a clock that stepped back keeps writing the newest one
+    uint32_t id = open_partition;
+    if (!partitions.empty() && id < partitions.back().id) {
+        id = partitions.back().id;
+    }
+
+    ArchiveIndexEntry entry;
+    entry.first_sequence = open_block.getFirstSequence();
+    entry.first_uptime = open_block.getFirstRawTime();
+    entry.last_uptime = open_block.getLastRawTime();
+    entry.offset = fs.fileSize(dataPath(id));
+    entry.record_count = open_block.getRecordCount();
+    entry.length = length;
+
+    uint32_t block_end = open_block.getEndSequence();
+    open_block.reset(block_end);
+    writer.reset();
+
+    // Data before index: an index entry never points at a block that is not there
+    if (!fs.append(dataPath(id), buffer, length + sizeof(crc)) ||
+        !fs.append(indexPath(id), reinterpret_cast<const uint8_t*>(&entry), sizeof(entry))) {
+        Serial.printf("❌ Archive: write to partition %lu failed\n", (unsigned long)id);
+        return false;
+    }
+
+    if (partitions.empty() || partitions.back().id != id) {
+        Partition partition;
+        partition.id = id;
+        partition.first_sequence = entry.first_sequence;
+        partition.first_uptime = SensorRecord::rawTimeToUptime(entry.first_uptime);
+        partition.entries = 0;
+        partitions.push_back(partition);
+
+        while (partitions.size() > max_partitions) {
+            removePartition(0);
+        }
+    }
+    partitions.back().entries++;
+
+    end_sequence = block_end;
+    newest_uptime = SensorRecord::rawTimeToUptime(entry.last_uptime);
+    stats.blocks_written++;
+    stats.bytes_written += length + sizeof(crc) + sizeof(entry);
+    return true;
+}
+
+// ================================
+// MAINTENANCE
+// ================================
+
+bool PartitionedArchive::clear() {
+    bool success = true;
+    for (const Partition& partition : partitions) {
+        success &= fs.remove(dataPath(partition.id));
+        success &= fs.remove(indexPath(partition.id));
+    }
+
+    partitions.clear();
+    open_block.reset(end_sequence);
+    writer.reset();
+    return success;
+}
+
+void PartitionedArchive::dropBefore(uint64_t uptime) {
+    while (!partitions.empty() &&
+           (uint64_t)(partitions.front().id + 1) * partition_seconds * 1000 <= uptime) {
+        removePartition(0);
+    }
+}
+
+void PartitionedArchive::removePartition(size_t index) {
+    fs.remove(dataPath(partitions[index].id));
+    fs.remove(indexPath(partitions[index].id));
+    partitions.erase(partitions.begin() + index);
+    stats.partitions_dropped++;
+}
+
+// ================================
+// READING
+// ================================
+
+bool PartitionedArchive::read(uint32_t sequence, Reader& reader, SensorRecord& record) const {
+    reader.next_available = end_sequence;
+    if (partitions.empty() || sequence >= end_sequence) {
+        return false;
+    }
+
+    if (sequence < reader.block_first_sequence || sequence >= reader.block_end_sequence) {
+        ArchiveIndexEntry entry;
+        bool loaded = false;
+
+        // Sequential reads: the next block is the next index entry of the same partition
+        if (reader.partition < partitions.size() &&
+            partitions[reader.partition].id == reader.partition_id &&
+            sequence == reader.block_end_sequence &&
+            reader.entry + 1 < partitions[reader.partition].entries &&
+            readEntry(reader.partition, reader.entry + 1, entry) &&
+            entry.first_sequence == sequence) {
+            if (!loadBlock(reader.partition, reader.entry + 1, reader)) {
+                reader.next_available = entry.first_sequence + entry.record_count;
+                return false;
+            }
+            loaded = true;
+        }
+
+        if (!loaded) {
+            size_t p = findPartition(sequence);
+            if (p == SIZE_MAX) {
+                reader.next_available = partitions.front().first_sequence;
+                return false;
+            }
+
+            // Binary search the sparse index for the block holding the sequence
+            size_t low = 0;
+            size_t high = partitions[p].entries;
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (!readEntry(p, mid, entry)) {
+                    return false;
+                }
+                if (entry.first_sequence + entry.record_count <= sequence) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+
+            if (low == partitions[p].entries) {
+                reader.next_available = p + 1 < partitions.size() ? partitions[p + 1].first_sequence : end_sequence;
+                return false;
+            }
+            if (!readEntry(p, low, entry)) {
+                return false;
+            }
+            if (entry.first_sequence > sequence) {
+                reader.next_available = entry.first_sequence;
+                return false;
+            }
+            if (!loadBlock(p, low, reader)) {
+                reader.next_available = entry.first_sequence + entry.record_count;
+                return false;
+            }
+        }
+    }
+
+    // Restart decoding unless the reader is already positioned before the target
+    uint16_t target = sequence - reader.block_first_sequence;
+    if (reader.state.record_index > target) {
+        reader.state.reset();
+    }
+
+    while (reader.state.record_index <= target) {
+        if (!reader.block.decodeNext(reader.state, record)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t PartitionedArchive::lowerBoundSequence(uint64_t uptime) const {
+    return boundSequence(uptime, true);
+}
+
+uint32_t PartitionedArchive::upperBoundSequence(uint64_t uptime) const {
+    return boundSequence(uptime, false);
+}
+
+uint32_t PartitionedArchive::boundSequence(uint64_t uptime, bool inclusive) const {
+    // Jump straight to the partition holding the uptime (one earlier in case the clock stepped back)
+    uint32_t target = partitionOf(uptime);
+    size_t p = std::lower_bound(partitions.begin(), partitions.end(), target,
+                                [](const Partition& partition, uint32_t id) { return partition.id < id; })
+               - partitions.begin();
+    if (p > 0) {
+        p--;
+    }
+
+    for (; p < partitions.size(); p++) {
+        // First block whose last record passes the bound
+        ArchiveIndexEntry entry;
+        size_t low = 0;
+        size_t high = partitions[p].entries;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (!readEntry(p, mid, entry)) {
+                return end_sequence;
+            }
+            uint64_t last_uptime = SensorRecord::rawTimeToUptime(entry.last_uptime);
+            bool before = inclusive ? last_uptime < uptime : last_uptime <= uptime;
+            if (before) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (low == partitions[p].entries) {
+            continue;
+        }
+
+        // Decode within the block to find the exact record
+        Reader reader;
+        if (!loadBlock(p, low, reader)) {
+            return readEntry(p, low, entry) ? entry.first_sequence : end_sequence;
+        }
+
+        SensorRecord record;
+        uint32_t sequence = reader.block_first_sequence;
+        while (reader.block.decodeNext(reader.state, record)) {
+            uint64_t record_uptime = record.getUptime();
+            if (inclusive ? record_uptime >= uptime : record_uptime > uptime) {
+                return sequence;
+            }
+            sequence++;
+        }
+        return sequence;
+    }
+
+    return end_sequence;
+}
+
+bool PartitionedArchive::getOldestUptime(uint64_t& uptime) const {
+    if (partitions.empty()) {
+        return false;
+    }
+    uptime = partitions.front().first_uptime;
+    return true;
+}
+
+// ================================
+// HELPERS
+// ================================
+
+String PartitionedArchive::dataPath(uint32_t id) const {
+    char name[20];
+    snprintf(name, sizeof(name), "/p_%08lu.blk", (unsigned long)id);
+    return directory + name;
+}
+
+String PartitionedArchive::indexPath(uint32_t id) const {
+    char name[20];
+    snprintf(name, sizeof(name), "/p_%08lu.idx", (unsigned long)id);
+    return directory + name;
+}
+
+bool PartitionedArchive::readEntry(size_t partition, size_t entry, ArchiveIndexEntry& out) const {
+    return fs.read(indexPath(partitions[partition].id), entry * sizeof(ArchiveIndexEntry),
+                   reinterpret_cast<uint8_t*>(&out), sizeof(out)) == sizeof(out);
+}
+
+bool PartitionedArchive::migrateIndex(uint32_t id, size_t entries) {
+    std::vector<ArchiveIndexEntry> index(entries);
+    size_t bytes = entries * sizeof(ArchiveIndexEntry);
+    if (fs.read(indexPath(id), 0, reinterpret_cast<uint8_t*>(index.data()), bytes) != bytes) {
+        return false;
+    }
+
+    for (ArchiveIndexEntry& entry : index) {
+        entry.first_uptime /= 1000;
+        entry.last_uptime /= 1000;
+    }
+
+    // The blocks themselves already store native record times
+    if (!fs.remove(indexPath(id)) ||
+        !fs.append(indexPath(id), reinterpret_cast<const uint8_t*>(index.data()), bytes)) {
+        Serial.printf("❌ Archive: cannot migrate index of partition %lu\n", (unsigned long)id);
+        return false;
+    }
+
+    Serial.printf("💾 Archive: partition %lu index migrated to native record times\n", (unsigned long)id);
+    return true;
+}
+
+bool PartitionedArchive::loadBlock(size_t partition, size_t entry, Reader& reader) const {
+    ArchiveIndexEntry index;
+    if (!readEntry(partition, entry, index) || index.length > CompressedBlock::MAX_STORED_BYTES) {
+        return false;
+    }
+
+    uint8_t buffer[CompressedBlock::MAX_STORED_BYTES + sizeof(uint16_t)];
+    size_t length = index.length + sizeof(uint16_t);
+    if (fs.read(dataPath(partitions[partition].id), index.offset, buffer, length) != length) {
+        return false;
+    }
+
+    uint16_t stored_crc;
+    memcpy(&stored_crc, buffer + index.length, sizeof(stored_crc));
+    if (crc16Ccitt(buffer, index.length) != stored_crc || !reader.block.deserialize(buffer, index.length)) {
+        stats.crc_errors++;
+        reader.block_first_sequence = reader.block_end_sequence = 0;   // Block contents no longer valid
+        return false;
+    }
+
+    reader.partition = partition;
+    reader.partition_id = partitions[partition].id;
+    reader.entry = entry;
+    reader.block_first_sequence = index.first_sequence;
+    reader.block_end_sequence = index.first_sequence + index.record_count;
+    reader.state.reset();
+    stats.blocks_read++;
+    return true;
+}
+
+size_t PartitionedArchive::findPartition(uint32_t sequence) const {
+    // Last partition starting at or before the sequence
+    size_t p = std::upper_bound(partitions.begin(), partitions.end(), sequence,
+                                [](uint32_t value, const Partition& partition) { return value < partition.first_sequence; })
+               - partitions.begin();
+    return p == 0 ? SIZE_MAX : p - 1;
+}
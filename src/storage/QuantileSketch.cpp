@@ -0,0 +1,274 @@
+/*
+ * storage/QuantileSketch.cpp
+ * Implementation of the log-bucketed quantile sketches
+ */
+
+#include "storage/QuantileSketch.h"
+#include <math.h>
+
+const size_t QuantileStatistics::METRICS[QuantileStatistics::SKETCH_COUNT] = {
+    SensorRecord::METRIC_CO2, SensorRecord::METRIC_VOC
+};
+
+// CO2 in ppm, VOC in ppb - values outside the range land in the edge bins
+const SketchRange QuantileStatistics::RANGES[QuantileStatistics::SKETCH_COUNT] = {
+    { 250.0f, 10000.0f },
+    { 10.0f, 5000.0f }
+};
+
+// ================================
+// QUANTILE SKETCH
+// ================================
+
+void QuantileSketch::clear() {
+    memset(bins, 0, sizeof(bins));
+    shift = 0;
+    phase = 0x9E3779B9;
+    count = 0;
+    min_value = max_value = 0;
+}
+
+void QuantileSketch::add(float value, const SketchRange& range) {
+    count++;
+    if (count == 1) {
+        min_value = max_value = value;
+    } else {
+        min_value = min(min_value, value);
+        max_value = max(max_value, value);
+    }
+
+    // After a halving each bin count stands for 2^shift samples - keep one in 2^shift,
+    // picked by xorshift so periodic input cannot alias with the thinning
+    if (shift > 0) {
+        phase ^= phase << 13;
+        phase ^= phase >> 17;
+        phase ^= phase << 5;
+        if ((phase & ((1UL << shift) - 1)) != 0) {
+            return;
+        }
+    }
+
+    size_t bin = binOf(value, range);
+    if (bins[bin] == UINT16_MAX) {
+        compact();
+    }
+    bins[bin]++;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    // Bring both to the coarser scale, rounding to nearest
+    uint8_t target = max(shift, other.shift);
+    uint32_t merged[BIN_COUNT];
+    uint32_t peak = 0;
+    for (size_t i = 0; i < BIN_COUNT; i++) {
+        uint8_t own_drop = target - shift;
+        uint8_t other_drop = target - other.shift;
+        uint32_t own = own_drop == 0 ? bins[i] : (bins[i] + (1UL << (own_drop - 1))) >> own_drop;
+        uint32_t theirs = other_drop == 0 ? other.bins[i]
+                                          : (other.bins[i] + (1UL << (other_drop - 1))) >> other_drop;
+        merged[i] = own + theirs;
+        peak = max(peak, merged[i]);
+    }
+
+    while (peak > UINT16_MAX) {
+        for (size_t i = 0; i < BIN_COUNT; i++) {
+            merged[i] = (merged[i] + 1) >> 1;
+        }
+        peak = (peak + 1) >> 1;
+        target++;
+    }
+
+    for (size_t i = 0; i < BIN_COUNT; i++) {
+        bins[i] = merged[i];
+    }
+    shift = target;
+    count += other.count;
+    min_value = min(min_value, other.min_value);
+    max_value = max(max_value, other.max_value);
+}
+
+float QuantileSketch::quantile(float q, const SketchRange& range) const {
+    if (count == 0) {
+        return 0.0f;
+    }
+    if (q <= 0.0f) {
+        return min_value;
+    }
+    if (q >= 1.0f) {
+        return max_value;
+    }
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < BIN_COUNT; i++) {
+        total += bins[i];
+    }
+
+    // Nearest-rank: first bin whose cumulative count reaches q of the total
+    uint32_t rank = max((uint32_t)ceilf(q * total), (uint32_t)1);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < BIN_COUNT; i++) {
+        cumulative += bins[i];
+        if (cumulative >= rank) {
+            return constrain(binValue(i, range), min_value, max_value);
+        }
+    }
+    return max_value;
+}
+
+size_t QuantileSketch::binOf(float value, const SketchRange& range) {
+    if (value <= range.low) {
+        return 0;
+    }
+
+    float position = logf(value / range.low) / logf(range.high / range.low) * BIN_COUNT;
+    return position >= BIN_COUNT ? BIN_COUNT - 1 : (size_t)position;
+}
+
+float QuantileSketch::binValue(size_t bin, const SketchRange& range) {
+    // Geometric middle of the bin
+    return range.low * powf(range.high / range.low, (bin + 0.5f) / BIN_COUNT);
+}
+
+void QuantileSketch::compact() {
+    for (size_t i = 0; i < BIN_COUNT; i++) {
+        bins[i] = (bins[i] + 1) >> 1;
+    }
+    shift++;
+}
+
+// ================================
+// METRIC QUANTILES
+// ================================
+
+void MetricQuantiles::clear() {
+    slice_head = 0;
+    slices_used = 0;
+    day_head = 0;
+    days_used = 0;
+}
+
+void MetricQuantiles::add(uint32_t uptime_s, float value, const SketchRange& range) {
+    uint32_t start_s = uptime_s - uptime_s % SLICE_SECONDS;
+
+    // Uptime only moves forward; anything older than the open slice is folded into it
+    if (slices_used == 0 || start_s > slice_starts[slice_head]) {
+        if (slices_used > 0) {
+            closeSlice(slice_head);
+            slice_head = (slice_head + 1) % DAY_SLICES;
+        }
+        if (slices_used < DAY_SLICES) {
+            slices_used++;
+        }
+        slices[slice_head].clear();
+        slice_starts[slice_head] = start_s;
+    }
+
+    slices[slice_head].add(value, range);
+}
+
+void MetricQuantiles::closeSlice(size_t slot) {
+    uint32_t day_s = slice_starts[slot] - slice_starts[slot] % DAY_SECONDS;
+
+    if (days_used == 0 || day_s > day_starts[day_head]) {
+        if (days_used > 0) {
+            day_head = (day_head + 1) % WEEK_DAYS;
+        }
+        if (days_used < WEEK_DAYS) {
+            days_used++;
+        }
+        days[day_head].clear();
+        day_starts[day_head] = day_s;
+    }
+
+    days[day_head].merge(slices[slot]);
+}
+
+QuantileSketch MetricQuantiles::lastDay() const {
+    QuantileSketch result;
+    if (slices_used == 0) {
+        return result;
+    }
+
+    uint32_t newest_s = slice_starts[slice_head];
+    for (size_t i = 0; i < slices_used; i++) {
+        size_t slot = (slice_head + DAY_SLICES - i) % DAY_SLICES;
+        if (newest_s - slice_starts[slot] < DAY_SECONDS) {
+            result.merge(slices[slot]);
+        }
+    }
+    return result;
+}
+
+QuantileSketch MetricQuantiles::lastWeek() const {
+    QuantileSketch result;
+    if (slices_used == 0) {
+        return result;
+    }
+
+    // Closed slices live in the daily roll-ups, the open one is added on top
+    result = slices[slice_head];
+    uint32_t newest_day_s = slice_starts[slice_head] - slice_starts[slice_head] % DAY_SECONDS;
+    for (size_t i = 0; i < days_used; i++) {
+        size_t slot = (day_head + WEEK_DAYS - i) % WEEK_DAYS;
+        if (newest_day_s - day_starts[slot] < WEEK_DAYS * DAY_SECONDS) {
+            result.merge(days[slot]);
+        }
+    }
+    return result;
+}
+
+// ================================
+// QUANTILE STATISTICS
+// ================================
+
+bool QuantileStatistics::begin() {
+    clear();
+    enabled = true;
+    return true;
+}
+
+void QuantileStatistics::clear() {
+    for (size_t s = 0; s < SKETCH_COUNT; s++) {
+        sketches[s].clear();
+    }
+}
+
+void QuantileStatistics::add(const SensorRecord& record) {
+    if (!enabled) {
+        return;
+    }
+
+    uint32_t uptime_s = record.getUptime() / 1000UL;
+    for (size_t s = 0; s < SKETCH_COUNT; s++) {
+        float value = record.getValue(METRICS[s]);
+        if ((record.validity_flags & SensorRecord::metricFlag(METRICS[s])) && !isnan(value)) {
+            sketches[s].add(uptime_s, value, RANGES[s]);
+        }
+    }
+}
+
+size_t QuantileStatistics::sketchOf(size_t metric) {
+    for (size_t s = 0; s < SKETCH_COUNT; s++) {
+        if (METRICS[s] == metric) {
+            return s;
+        }
+    }
+    return SIZE_MAX;
+}
+
+QuantileSketch QuantileStatistics::get(Window window, size_t metric) const {
+    size_t sketch = sketchOf(metric);
+    if (sketch == SIZE_MAX) {
+        return QuantileSketch();
+    }
+
+    return window == LAST_DAY ? sketches[sketch].lastDay() : sketches[sketch].lastWeek();
+}
@@ -0,0 +1,80 @@
+/*
+ * storage/RecordColumns.cpp
+ * Implementation of the structure-of-arrays ring mirror
+ */
+
+#include "storage/RecordColumns.h"
+#include <float.h>
+
+bool RecordColumns::begin(size_t capacity) {
+    if (capacity == 0) {
+        return false;
+    }
+
+    // Sized once - like the ring itself, the columns never grow
+    uptime_column.assign(capacity, 0);
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        value_columns[i].assign(capacity, 0.0f);
+    }
+    flag_column.assign(capacity, 0);
+    return true;
+}
+
+void RecordColumns::release() {
+    uptime_column = std::vector<uint32_t>();
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        value_columns[i] = std::vector<float>();
+    }
+    flag_column = std::vector<uint8_t>();
+}
+
+void RecordColumns::set(size_t slot, const SensorRecord& record) {
+    if (slot >= uptime_column.size()) {
+        return;
+    }
+
+    uptime_column[slot] = record.getUptime();
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        value_columns[i][slot] = record.getValue(i);
+    }
+    flag_column[slot] = record.validity_flags;
+}
+
+size_t RecordColumns::getMemoryBytes() const {
+    return uptime_column.size() * (sizeof(uint32_t) + SensorRecord::METRIC_COUNT * sizeof(float) + sizeof(uint8_t));
+}
+
+void RecordColumns::accumulate(const float* values, const uint8_t* flags, size_t count,
+                               uint8_t valid_mask, Accumulator& accumulator) {
+    float low = accumulator.count > 0 ? accumulator.min : FLT_MAX;
+    float high = accumulator.count > 0 ? accumulator.max : -FLT_MAX;
+    float sum = accumulator.sum;
+    uint32_t valid_count = accumulator.count;
+
+    for (size_t i = 0; i < count; i++) {
+        bool valid = (flags[i] & valid_mask) != 0;
+        float value = values[i];
+        low = (valid && value < low) ? value : low;
+        high = (valid && value > high) ? value : high;
+        sum += valid ? value : 0.0f;
+        valid_count += valid;
+    }
+
+    accumulator.min = low;
+    accumulator.max = high;
+    accumulator.sum = sum;
+    accumulator.count = valid_count;
+}
+
+MetricSummary RecordColumns::Accumulator::result() const {
+    MetricSummary summary;
+    if (count == 0) {
+        return summary;
+    }
+
+    summary.count = count;
+    summary.min = min;
+    summary.max = max;
+    summary.mean = sum / count;
+    return summary;
+}
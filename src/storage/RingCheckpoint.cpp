@@ -0,0 +1,335 @@
+/*
+ * storage/RingCheckpoint.cpp
+ * Implementation of the incremental ring checkpoint
+ */
+
+#include "storage/RingCheckpoint.h"
+#include "utils/Checksum.h"
+
+RingCheckpoint::RingCheckpoint(IFileSystem& filesystem, const String& dir, size_t slot_count,
+                               size_t page_size, uint32_t interval)
+    : fs(filesystem)
+    , directory(dir)
+    , slots(max(slot_count, (size_t)1))
+    , page_records(max(page_size, (size_t)1))
+    , page_count((slots + page_records - 1) / page_records)
+    , interval_ms(interval)
+    , scan_page(0)
+    , round_active(false)
+    , meta_dirty(false)
+    , round_started(0)
+    , generation(0)
+    , written_floor(0) {
+
+    dirty.assign(page_count, 0);
+    newer_copy.assign(page_count, 1);   // First write of each page goes to copy A
+    scratch.resize(pageBytes());
+}
+
+// ================================
+// SETUP & RECOVERY
+// ================================
+
+bool RingCheckpoint::begin() {
+    if (!fs.makeDirectory(directory)) {
+        Serial.printf("❌ Checkpoint: cannot create %s\n", directory.c_str());
+        return false;
+    }
+
+    CheckpointMeta meta;
+    if (fs.fileSize(filePath()) == getFileBytes() && readMeta(meta)) {
+        generation = meta.generation;
+        written_floor = meta.floor_sequence;
+        Serial.printf("💾 Checkpoint: %s (%zu KB, generation %lu)\n", filePath().c_str(),
+                     getFileBytes() / 1024, (unsigned long)generation);
+        return true;
+    }
+
+    // Missing, other geometry or no valid metadata - start over
+    return createFile();
+}
+
+size_t RingCheckpoint::restore(const RestoreCallback& callback) {
+    CheckpointMeta meta;
+    if (!readMeta(meta)) {
+        return 0;
+    }
+
+    // Sequence each slot held according to the page it was written with
+    std::vector<uint32_t> slot_sequence(slots, 0);
+    std::vector<uint8_t> slot_valid(slots, 0);
+    bool found = false;
+    uint32_t newest_sequence = 0;
+    size_t newest_slot = 0;
+
+    for (size_t page = 0; page < page_count; page++) {
+        // Latest intact copy of the page
+        CheckpointPageHeader copies[2];
+        bool valid[2];
+        for (size_t copy = 0; copy < 2; copy++) {
+            valid[copy] = readPage(page, copy, copies[copy]);
+        }
+        if (!valid[0] && !valid[1]) {
+            continue;
+        }
+        size_t copy = !valid[0] || (valid[1] && copies[1].next_sequence > copies[0].next_sequence) ? 1 : 0;
+        newer_copy[page] = copy;
+        const CheckpointPageHeader& header = copies[copy];
+
+        size_t first_slot = page * page_records;
+        for (size_t i = 0; i < page_records && first_slot + i < slots; i++) {
+            size_t slot = first_slot + i;
+            // Slots before write_index hold the newest records, counting backwards
+            size_t distance = (header.write_index + slots - 1 - slot) % slots;
+            if (header.next_sequence < distance + 1) {
+                continue;
+            }
+            uint32_t sequence = header.next_sequence - 1 - distance;
+            if (sequence < header.first_sequence || sequence < meta.floor_sequence) {
+                continue;
+            }
+
+            slot_sequence[slot] = sequence;
+            slot_valid[slot] = 1;
+            if (!found || sequence > newest_sequence) {
+                found = true;
+                newest_sequence = sequence;
+                newest_slot = slot;
+            }
+        }
+    }
+
+    if (!found) {
+        return 0;
+    }
+
+    // Walk back from the newest record while the slots stay contiguous
+    size_t count = 1;
+    while (count < slots) {
+        size_t slot = (newest_slot + slots - count) % slots;
+        if (!slot_valid[slot] || slot_sequence[slot] != newest_sequence - count) {
+            break;
+        }
+        count++;
+    }
+
+    size_t first_slot = (newest_slot + slots + 1 - count) % slots;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = (first_slot + i) % slots;
+        size_t page = slot / page_records;
+        size_t offset = pageOffset(page, newer_copy[page]) + sizeof(CheckpointPageHeader) +
+                        (slot % page_records) * sizeof(SensorRecord);
+        SensorRecord record;
+        if (fs.read(filePath(), offset, reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) {
+            break;
+        }
+        callback(record, newest_sequence + 1 - count + i, slot);
+        stats.restored_records++;
+    }
+
+    Serial.printf("💾 Checkpoint restored %lu records (%lu bad page copies)\n",
+                 (unsigned long)stats.restored_records, (unsigned long)stats.crc_errors);
+    return stats.restored_records;
+}
+
+// ================================
+// WRITING
+// ================================
+
+size_t RingCheckpoint::step(const CheckpointRing& ring) {
+    uint32_t now = millis();
+    uint32_t started_us = micros();
+    if (!round_active) {
+        if (!meta_dirty && now - round_started < interval_ms) {
+            return 0;
+        }
+        round_active = true;
+        round_started = now;
+        stats.rounds++;
+
+        // Records that left the ring are excluded before their slots are rewritten
+        if (ring.first_sequence != written_floor) {
+            meta_dirty = true;
+        }
+    }
+
+    // One flash write per call: the metadata first, then the next dirty page
+    size_t written = 0;
+    if (meta_dirty) {
+        writeMeta(ring.first_sequence);
+    } else {
+        for (size_t scanned = 0; scanned < page_count; scanned++) {
+            size_t page = scan_page;
+            scan_page = (scan_page + 1) % page_count;
+            if (dirty[page]) {
+                writePage(page, ring);
+                written++;
+                break;
+            }
+        }
+    }
+
+    if (getDirtyPages() == 0) {
+        round_active = false;
+    }
+
+    stats.max_step_us = max(stats.max_step_us, (uint32_t)(micros() - started_us));
+    return written;
+}
+
+bool RingCheckpoint::checkpointAll(const CheckpointRing& ring) {
+    bool success = writeMeta(ring.first_sequence);
+    for (size_t page = 0; page < page_count; page++) {
+        if (dirty[page]) {
+            success &= writePage(page, ring);
+        }
+    }
+    round_active = false;
+    round_started = millis();
+    return success;
+}
+
+bool RingCheckpoint::clear(uint32_t floor_sequence) {
+    dirty.assign(page_count, 0);
+    round_active = false;
+    return writeMeta(floor_sequence);
+}
+
+bool RingCheckpoint::writePage(size_t page, const CheckpointRing& ring) {
+    dirty[page] = 0;
+
+    CheckpointPageHeader header;
+    header.magic = PAGE_MAGIC;
+    header.next_sequence = ring.next_sequence;
+    header.first_sequence = ring.first_sequence;
+    header.write_index = ring.write_index;
+    header.page = page;
+
+    size_t first_slot = page * page_records;
+    size_t count = min(page_records, slots - first_slot);
+    memset(scratch.data() + sizeof(header), 0, scratch.size() - sizeof(header));
+    memcpy(scratch.data() + sizeof(header), ring.slots + first_slot, count * sizeof(SensorRecord));
+
+    header.crc = crc16Ccitt(reinterpret_cast<const uint8_t*>(&header), offsetof(CheckpointPageHeader, crc));
+    header.crc = crc16Ccitt(scratch.data() + sizeof(header), scratch.size() - sizeof(header), header.crc);
+    memcpy(scratch.data(), &header, sizeof(header));
+
+    // The other copy keeps the previous write of this page until this one is complete
+    size_t copy = 1 - newer_copy[page];
+    if (!fs.writeAt(filePath(), pageOffset(page, copy), scratch.data(), scratch.size())) {
+        Serial.printf("❌ Checkpoint: page %zu write failed\n", page);
+        dirty[page] = 1;   // Retried next round
+        return false;
+    }
+    newer_copy[page] = copy;
+
+    stats.pages_written++;
+    stats.flash_bytes += scratch.size();
+    return true;
+}
+
+bool RingCheckpoint::writeMeta(uint32_t floor_sequence) {
+    CheckpointMeta meta;
+    meta.magic = META_MAGIC;
+    meta.generation = generation + 1;
+    meta.floor_sequence = floor_sequence;
+    meta.slot_count = slots;
+    meta.page_records = page_records;
+    meta.record_format = HISTORY_RECORD_FORMAT;
+    meta.record_size = sizeof(SensorRecord);
+    meta.crc = crc16Ccitt(reinterpret_cast<const uint8_t*>(&meta), offsetof(CheckpointMeta, crc));
+
+    // Alternate slots - the other one still holds the previous generation
+    size_t offset = (meta.generation % 2) * sizeof(CheckpointMeta);
+    if (!fs.writeAt(filePath(), offset, reinterpret_cast<const uint8_t*>(&meta), sizeof(meta))) {
+        Serial.println("❌ Checkpoint: metadata write failed");
+        return false;
+    }
+
+    generation = meta.generation;
+    written_floor = floor_sequence;
+    meta_dirty = false;
+    stats.meta_written++;
+    stats.flash_bytes += sizeof(meta);
+    return true;
+}
+
+bool RingCheckpoint::readMeta(CheckpointMeta& meta) {
+    bool found = false;
+    for (size_t i = 0; i < 2; i++) {
+        CheckpointMeta candidate;
+        if (fs.read(filePath(), i * sizeof(CheckpointMeta), reinterpret_cast<uint8_t*>(&candidate),
+                    sizeof(candidate)) != sizeof(candidate)) {
+            continue;
+        }
+
+        bool valid = candidate.magic == META_MAGIC &&
+                     candidate.crc == crc16Ccitt(reinterpret_cast<const uint8_t*>(&candidate),
+                                                 offsetof(CheckpointMeta, crc)) &&
+                     candidate.slot_count == slots &&
+                     candidate.page_records == page_records &&
+                     candidate.record_format == HISTORY_RECORD_FORMAT &&
+                     candidate.record_size == sizeof(SensorRecord);
+        if (valid && (!found || candidate.generation > meta.generation)) {
+            meta = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool RingCheckpoint::readPage(size_t page, size_t copy, CheckpointPageHeader& header) {
+    if (fs.read(filePath(), pageOffset(page, copy), scratch.data(), scratch.size()) != scratch.size()) {
+        return false;
+    }
+
+    memcpy(&header, scratch.data(), sizeof(header));
+    if (header.magic != PAGE_MAGIC) {
+        return false;   // Never written
+    }
+
+    uint16_t crc = crc16Ccitt(scratch.data(), offsetof(CheckpointPageHeader, crc));
+    crc = crc16Ccitt(scratch.data() + sizeof(header), scratch.size() - sizeof(header), crc);
+    if (header.page != page || header.crc != crc || header.write_index >= slots) {
+        stats.crc_errors++;
+        return false;
+    }
+    return true;
+}
+
+bool RingCheckpoint::createFile() {
+    fs.remove(filePath());
+
+    // Preallocate so later writes only overwrite (zeroed pages have no magic)
+    uint8_t zeros[256] = {};
+    size_t remaining = getFileBytes();
+    while (remaining > 0) {
+        size_t chunk = min(remaining, sizeof(zeros));
+        if (!fs.append(filePath(), zeros, chunk)) {
+            Serial.printf("❌ Checkpoint: cannot create %s\n", filePath().c_str());
+            return false;
+        }
+        remaining -= chunk;
+    }
+
+    generation = 0;
+    written_floor = 0;
+    if (!writeMeta(0)) {
+        return false;
+    }
+
+    Serial.printf("💾 Checkpoint: created %s (%zu KB)\n", filePath().c_str(), getFileBytes() / 1024);
+    return true;
+}
+
+// ================================
+// STATUS
+// ================================
+
+size_t RingCheckpoint::getDirtyPages() const {
+    size_t count = 0;
+    for (uint8_t flag : dirty) {
+        count += flag;
+    }
+    return count;
+}
@@ -0,0 +1,170 @@
+/*
+ * storage/RollupTiers.cpp
+ * Implementation of multi-resolution rollup tiers
+ */
+
+#include "storage/RollupTiers.h"
+
+const uint32_t RollupTiers::TIER_SECONDS[RollupTiers::TIER_COUNT] = { 60, 3600, 86400 };
+
+// ================================
+// ROLLUP BUCKET
+// ================================
+
+SensorRecord RollupBucket::toRecord() const {
+    SensorRecord record;
+    record.setUptime(getStartUptime());
+    record.setCo2(mean[SensorRecord::METRIC_CO2]);
+    record.setTemperature(mean[SensorRecord::METRIC_TEMPERATURE]);
+    record.setHumidity(mean[SensorRecord::METRIC_HUMIDITY]);
+    record.setPressure(mean[SensorRecord::METRIC_PRESSURE]);
+    record.setVoc(mean[SensorRecord::METRIC_VOC]);
+    record.validity_flags = validity_flags;
+    record.alert_level = alert_level;
+    return record;
+}
+
+// ================================
+// ROLLUP TIER
+// ================================
+
+bool RollupTier::begin(uint32_t bucket_length_s, size_t retention_buckets) {
+    if (bucket_length_s == 0 || retention_buckets < 2) {
+        return false;
+    }
+
+    bucket_seconds = bucket_length_s;
+    buckets.assign(retention_buckets, RollupBucket());
+    clear();
+    return true;
+}
+
+void RollupTier::clear() {
+    head = 0;
+    used = 0;
+    memset(open_counts, 0, sizeof(open_counts));
+}
+
+void RollupTier::add(const SensorRecord& record) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    uint32_t uptime_s = record.getUptime() / 1000UL;
+    uint32_t start_s = uptime_s - uptime_s % bucket_seconds;
+
+    // Uptime only moves forward; anything older than the open bucket is folded into it
+    if (used == 0 || start_s > openBucket().start_s) {
+        startBucket(start_s);
+    }
+
+    RollupBucket& bucket = openBucket();
+    bucket.count++;
+    bucket.validity_flags |= record.validity_flags & ~SensorRecord::FLAG_HELD;
+    bucket.alert_level = max(bucket.alert_level, record.alert_level);
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (!(record.validity_flags & SensorRecord::metricFlag(i))) {
+            continue;
+        }
+
+        float value = record.getValue(i);
+        uint32_t n = ++open_counts[i];
+        if (n == 1) {
+            bucket.min[i] = bucket.max[i] = bucket.mean[i] = value;
+        } else {
+            bucket.min[i] = min(bucket.min[i], value);
+            bucket.max[i] = max(bucket.max[i], value);
+            bucket.mean[i] += (value - bucket.mean[i]) / n;   // Running mean, no sum overflow
+        }
+    }
+}
+
+void RollupTier::startBucket(uint32_t start_s) {
+    if (used == buckets.size()) {
+        // Retention reached - drop the oldest bucket
+        head = (head + 1) % buckets.size();
+        used--;
+    }
+
+    used++;
+    RollupBucket& bucket = openBucket();
+    bucket = RollupBucket();
+    bucket.start_s = start_s;
+    memset(open_counts, 0, sizeof(open_counts));
+}
+
+void RollupTier::findRange(uint64_t start_uptime, uint64_t end_uptime,
+                           size_t& begin, size_t& end) const {
+    // First bucket that ends after start_uptime
+    size_t low = 0;
+    size_t high = used;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if ((uint64_t)(at(mid).start_s + bucket_seconds) * 1000 <= start_uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    begin = low;
+
+    // First bucket that starts after end_uptime
+    high = used;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (at(mid).getStartUptime() <= end_uptime) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    end = low;
+}
+
+bool RollupTier::getOldestUptime(uint64_t& uptime) const {
+    if (used == 0) {
+        return false;
+    }
+    uptime = at(0).getStartUptime();
+    return true;
+}
+
+// ================================
+// ROLLUP TIERS
+// ================================
+
+bool RollupTiers::begin(size_t minute_buckets, size_t hour_buckets, size_t day_buckets) {
+    const size_t retention[TIER_COUNT] = { minute_buckets, hour_buckets, day_buckets };
+
+    for (size_t i = 0; i < TIER_COUNT; i++) {
+        if (!tiers[i].begin(TIER_SECONDS[i], retention[i])) {
+            Serial.printf("❌ Rollup tier %lus needs at least 2 buckets\n", (unsigned long)TIER_SECONDS[i]);
+            return false;
+        }
+    }
+
+    Serial.printf("📈 Rollup tiers ready: %zu x 1min, %zu x 1h, %zu x 1d (%zu bytes)\n",
+                 minute_buckets, hour_buckets, day_buckets, getMemoryBytes());
+    return true;
+}
+
+void RollupTiers::clear() {
+    for (size_t i = 0; i < TIER_COUNT; i++) {
+        tiers[i].clear();
+    }
+}
+
+void RollupTiers::add(const SensorRecord& record) {
+    for (size_t i = 0; i < TIER_COUNT; i++) {
+        tiers[i].add(record);
+    }
+}
+
+size_t RollupTiers::getMemoryBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < TIER_COUNT; i++) {
+        bytes += tiers[i].getCapacity() * sizeof(RollupBucket);
+    }
+    return bytes;
+}
@@ -0,0 +1,253 @@
+/*
+ * storage/RunningStats.cpp
+ * Implementation of the rolling-window running statistics
+ */
+
+#include "storage/RunningStats.h"
+#include <math.h>
+
+// ================================
+// METRIC MOMENTS
+// ================================
+
+void MetricMoments::add(float value) {
+    count++;
+    if (count == 1) {
+        min = max = value;
+    } else {
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+
+    // Welford: numerically stable without keeping a sum of squares
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+}
+
+void MetricMoments::merge(const MetricMoments& other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    uint32_t total = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * ((double)count * other.count / total);
+    min = other.min < min ? other.min : min;
+    max = other.max > max ? other.max : max;
+    count = total;
+}
+
+void MetricMoments::subtract(const MetricMoments& part) {
+    if (part.count == 0) {
+        return;
+    }
+    if (part.count >= count) {
+        *this = MetricMoments();
+        return;
+    }
+
+    // Inverse of merge(): recover the moments of the remaining values
+    uint32_t remaining = count - part.count;
+    double remaining_mean = (mean * count - part.mean * part.count) / remaining;
+    double delta = part.mean - remaining_mean;
+    m2 -= part.m2 + delta * delta * ((double)remaining * part.count / count);
+    m2 = m2 > 0 ? m2 : 0;   // Rounding must not produce a negative variance
+    mean = remaining_mean;
+    count = remaining;
+}
+
+float MetricMoments::stddev() const {
+    return sqrtf(variance());
+}
+
+MetricSummary MetricMoments::summary() const {
+    MetricSummary result;
+    if (count == 0) {
+        return result;
+    }
+
+    result.count = count;
+    result.min = min;
+    result.max = max;
+    result.mean = mean;
+    result.stddev = stddev();
+    return result;
+}
+
+// ================================
+// STATS WINDOW
+// ================================
+
+bool StatsWindow::begin(uint32_t slice_length_s, size_t slice_count) {
+    if (slice_count > 0 && (slice_length_s == 0 || slice_count < 2)) {
+        return false;
+    }
+
+    slice_seconds = slice_length_s;
+    slices.assign(slice_count, Slice());
+    clear();
+    return true;
+}
+
+void StatsWindow::clear() {
+    head = 0;
+    used = 0;
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        totals[i] = MetricMoments();
+    }
+}
+
+void StatsWindow::add(uint32_t uptime_s, const float values[SensorRecord::METRIC_COUNT],
+                      uint8_t validity_flags) {
+    Slice* slice = nullptr;
+
+    if (!slices.empty()) {
+        uint32_t start_s = uptime_s - uptime_s % slice_seconds;
+
+        // Uptime only moves forward; anything older than the open slice is folded into it
+        if (used == 0 || start_s > at(used - 1).start_s) {
+            expireBefore(start_s);
+
+            used++;
+            slice = &slices[(head + used - 1) % slices.size()];
+            *slice = Slice();
+            slice->start_s = start_s;
+        } else {
+            slice = &slices[(head + used - 1) % slices.size()];
+        }
+    }
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        // A NaN would stay in the moments until its slice expires (forever since boot)
+        if (!(validity_flags & SensorRecord::metricFlag(i)) || isnan(values[i])) {
+            continue;
+        }
+
+        totals[i].add(values[i]);
+        if (slice) {
+            slice->metrics[i].add(values[i]);
+        }
+    }
+}
+
+void StatsWindow::expireBefore(uint32_t start_s) {
+    // The new slice and the ones before it must fit in the window span
+    uint32_t span = getSpanSeconds();
+    if (start_s < span) {
+        return;
+    }
+    uint32_t limit = start_s - span;
+
+    bool rescan[SensorRecord::METRIC_COUNT] = {};
+    while (used > 0 && at(0).start_s <= limit) {
+        const Slice& expired = at(0);
+        for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+            const MetricMoments& part = expired.metrics[i];
+            if (part.count == 0) {
+                continue;
+            }
+
+            // Only a slice that held the window extreme forces a rescan
+            rescan[i] |= part.min <= totals[i].min || part.max >= totals[i].max;
+            totals[i].subtract(part);
+        }
+
+        head = (head + 1) % slices.size();
+        used--;
+    }
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (rescan[i]) {
+            rescanExtremes(i);
+        }
+    }
+}
+
+void StatsWindow::rescanExtremes(size_t metric) {
+    bool found = false;
+    for (size_t s = 0; s < used; s++) {
+        const MetricMoments& part = at(s).metrics[metric];
+        if (part.count == 0) {
+            continue;
+        }
+
+        if (!found) {
+            totals[metric].min = part.min;
+            totals[metric].max = part.max;
+            found = true;
+        } else {
+            totals[metric].min = min(totals[metric].min, part.min);
+            totals[metric].max = max(totals[metric].max, part.max);
+        }
+    }
+
+    if (!found) {
+        totals[metric] = MetricMoments();
+    }
+}
+
+float StatsWindow::getTrend(size_t metric) const {
+    const Slice* oldest = nullptr;
+    const Slice* newest = nullptr;
+
+    for (size_t s = 0; s < used; s++) {
+        if (at(s).metrics[metric].count > 0) {
+            oldest = oldest ? oldest : &at(s);
+            newest = &at(s);
+        }
+    }
+
+    if (!oldest || oldest == newest) {
+        return 0.0f;
+    }
+
+    float hours = (newest->start_s - oldest->start_s) / 3600.0f;
+    return (newest->metrics[metric].mean - oldest->metrics[metric].mean) / hours;
+}
+
+// ================================
+// RUNNING STATISTICS
+// ================================
+
+bool RunningStatistics::begin() {
+    enabled = windows[LAST_HOUR].begin(HOUR_SLICE_SECONDS, 3600 / HOUR_SLICE_SECONDS) &&
+              windows[LAST_DAY].begin(DAY_SLICE_SECONDS, 86400 / DAY_SLICE_SECONDS) &&
+              windows[SINCE_BOOT].begin(0, 0);
+    return enabled;
+}
+
+void RunningStatistics::clear() {
+    for (size_t w = 0; w < WINDOW_COUNT; w++) {
+        windows[w].clear();
+    }
+}
+
+void RunningStatistics::add(const SensorRecord& record) {
+    if (!enabled) {
+        return;
+    }
+
+    float values[SensorRecord::METRIC_COUNT];
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        values[i] = record.getValue(i);
+    }
+
+    uint32_t uptime_s = record.getUptime() / 1000UL;
+    for (size_t w = 0; w < WINDOW_COUNT; w++) {
+        windows[w].add(uptime_s, values, record.validity_flags);
+    }
+}
+
+size_t RunningStatistics::getMemoryBytes() const {
+    size_t bytes = sizeof(*this);
+    for (size_t w = 0; w < WINDOW_COUNT; w++) {
+        bytes += windows[w].getMemoryBytes();
+    }
+    return bytes;
+}
@@ -0,0 +1,310 @@
+/*
+ * storage/SegmentLog.cpp
+ * Implementation of the append-only segment log
+ */
+
+#include "storage/SegmentLog.h"
+#include "utils/Checksum.h"
+#include <algorithm>
+
+SegmentLog::SegmentLog(IFileSystem& filesystem, const String& dir,
+                       size_t segment_size, size_t segment_limit, size_t batch_size)
+    : fs(filesystem)
+    , directory(dir)
+    , segment_bytes(max(segment_size, sizeof(SegmentHeader) + ENTRY_BYTES))
+    , max_segments(max(segment_limit, (size_t)2))
+    , batch_records(max(batch_size, (size_t)1))
+    , next_segment_id(1)
+    , open_writable(false)
+    , open_segment_bytes(0)
+    , open_end_sequence(0)
+    , pending_records(0)
+    , pending_first_sequence(0) {
+
+    pending.reserve(batch_records * ENTRY_BYTES);
+}
+
+// ================================
+// SETUP & RECOVERY
+// ================================
+
+bool SegmentLog::begin() {
+    if (!fs.makeDirectory(directory)) {
+        Serial.printf("❌ Segment log: cannot create %s\n", directory.c_str());
+        return false;
+    }
+
+    std::vector<String> names;
+    if (!fs.listFiles(directory, names)) {
+        return false;
+    }
+
+    segment_ids.clear();
+    for (const String& name : names) {
+        // seg_00000001.log
+        if (name.startsWith("seg_") && name.endsWith(".log")) {
+            uint32_t id = strtoul(name.substring(4, name.length() - 4).c_str(), nullptr, 10);
+            if (id > 0) {
+                segment_ids.push_back(id);
+            }
+        }
+    }
+    std::sort(segment_ids.begin(), segment_ids.end());
+
+    next_segment_id = segment_ids.empty() ? 1 : segment_ids.back() + 1;
+    open_writable = false;   // replay() decides whether the last segment can be continued
+
+    Serial.printf("💾 Segment log: %zu segments in %s on %s\n",
+                 segment_ids.size(), directory.c_str(), fs.getName().c_str());
+    return true;
+}
+
+size_t SegmentLog::replay(const ReplayCallback& callback) {
+    static const size_t READ_ENTRIES = 32;
+    uint8_t buffer[READ_ENTRIES * ENTRY_BYTES];
+    size_t replayed = 0;
+
+    for (size_t s = 0; s < segment_ids.size(); s++) {
+        uint32_t id = segment_ids[s];
+        bool last_segment = (s + 1 == segment_ids.size());
+
+        SegmentHeader header;
+        if (!readHeader(id, header)) {
+            Serial.printf("⚠️  Segment %lu has an invalid header - skipped\n", (unsigned long)id);
+            continue;
+        }
+
+        String path = segmentPath(id);
+        size_t file_size = fs.fileSize(path);
+        size_t offset = sizeof(SegmentHeader);
+        uint32_t sequence = header.first_sequence;
+        bool intact = true;
+
+        while (intact && offset + ENTRY_BYTES <= file_size) {
+            size_t bytes = fs.read(path, offset, buffer, min(sizeof(buffer), file_size - offset));
+            size_t entries = bytes / ENTRY_BYTES;
+            if (entries == 0) {
+                intact = false;
+                break;
+            }
+
+            for (size_t e = 0; e < entries; e++) {
+                const uint8_t* entry = buffer + e * ENTRY_BYTES;
+                uint16_t stored_crc;
+                memcpy(&stored_crc, entry + sizeof(SensorRecord), sizeof(stored_crc));
+                if (crc16Ccitt(entry, sizeof(SensorRecord)) != stored_crc) {
+                    // Torn or corrupted write - nothing after it in this segment is trusted
+                    stats.crc_errors++;
+                    intact = false;
+                    break;
+                }
+
+                SensorRecord record;
+                memcpy(&record, entry, sizeof(SensorRecord));
+                callback(record, sequence);
+                sequence++;
+                replayed++;
+                offset += ENTRY_BYTES;
+            }
+        }
+
+        if (last_segment) {
+            // Keep appending to the newest segment only if it ends on a clean entry boundary
+            open_writable = intact && offset == file_size && offset < segment_bytes;
+            open_segment_bytes = offset;
+            open_end_sequence = sequence;
+        }
+    }
+
+    Serial.printf("💾 Segment log replayed %zu records (%lu CRC errors)\n",
+                 replayed, (unsigned long)stats.crc_errors);
+    return replayed;
+}
+
+// ================================
+// WRITING
+// ================================
+
+bool SegmentLog::append(const SensorRecord& record, uint32_t sequence) {
+    // Batches hold consecutive sequences only
+    if (pending_records > 0 && sequence != pending_first_sequence + pending_records) {
+        if (!flush()) {
+            // A retried tail cannot be joined to the new run
+            stats.records_lost += pending_records;
+            pending.clear();
+            pending_records = 0;
+        }
+    }
+    if (pending_records == 0) {
+        pending_first_sequence = sequence;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+    uint16_t crc = crc16Ccitt(bytes, sizeof(SensorRecord));
+    pending.insert(pending.end(), bytes, bytes + sizeof(SensorRecord));
+    pending.insert(pending.end(), reinterpret_cast<const uint8_t*>(&crc),
+                   reinterpret_cast<const uint8_t*>(&crc) + sizeof(crc));
+    pending_records++;
+
+    // Flash has been failing for a while - keep the newest records only
+    size_t pending_limit = batch_records * MAX_PENDING_BATCHES;
+    if (pending_records > pending_limit) {
+        size_t dropped = pending_records - pending_limit;
+        pending.erase(pending.begin(), pending.begin() + dropped * ENTRY_BYTES);
+        pending_records -= dropped;
+        pending_first_sequence += dropped;
+        stats.records_lost += dropped;
+    }
+
+    stats.records_appended++;
+    stats.payload_bytes += sizeof(SensorRecord);
+
+    if (pending_records >= batch_records) {
+        return flush();
+    }
+    return true;
+}
+
+bool SegmentLog::flush() {
+    size_t written = 0;
+    bool success = true;
+
+    while (written < pending_records) {
+        uint32_t sequence = pending_first_sequence + written;
+
+        if (!open_writable || open_end_sequence != sequence ||
+            open_segment_bytes + ENTRY_BYTES > segment_bytes) {
+            if (!startSegment(sequence)) {
+                success = false;
+                break;
+            }
+        }
+
+        // As many entries as fit in the open segment, in one write
+        size_t room = (segment_bytes - open_segment_bytes) / ENTRY_BYTES;
+        size_t count = min(room, pending_records - written);
+        if (!fs.append(segmentPath(segment_ids.back()), pending.data() + written * ENTRY_BYTES,
+                       count * ENTRY_BYTES)) {
+            Serial.println("❌ Segment log: flash write failed");
+            open_writable = false;   // A torn entry may end this segment - retry in a new one
+            success = false;
+            break;
+        }
+
+        open_segment_bytes += count * ENTRY_BYTES;
+        open_end_sequence += count;
+        written += count;
+        stats.flash_bytes += count * ENTRY_BYTES;
+        stats.flushes++;
+    }
+
+    if (!success) {
+        stats.write_errors++;
+    }
+
+    // Written entries leave the queue; the rest are retried with the next flush
+    pending.erase(pending.begin(), pending.begin() + written * ENTRY_BYTES);
+    pending_records -= written;
+    pending_first_sequence += written;
+    return success;
+}
+
+bool SegmentLog::startSegment(uint32_t first_sequence) {
+    SegmentHeader header;
+    header.magic = SEGMENT_MAGIC;
+    header.version = SEGMENT_VERSION;
+    header.record_format = HISTORY_RECORD_FORMAT;
+    header.record_size = sizeof(SensorRecord);
+    header.first_sequence = first_sequence;
+    header.reserved = 0;
+
+    uint32_t id = next_segment_id++;
+    String path = segmentPath(id);
+    fs.remove(path);   // Leftover from an interrupted rotation
+    if (!fs.append(path, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) {
+        Serial.printf("❌ Segment log: cannot create %s\n", path.c_str());
+        fs.remove(path);   // Don't leave a headerless file behind
+        open_writable = false;
+        return false;
+    }
+
+    segment_ids.push_back(id);
+    open_writable = true;
+    open_segment_bytes = sizeof(header);
+    open_end_sequence = first_sequence;
+    stats.flash_bytes += sizeof(header);
+    stats.segments_created++;
+
+    // Rotate: the oldest segment goes once the budget is exceeded
+    while (segment_ids.size() > max_segments) {
+        fs.remove(segmentPath(segment_ids.front()));
+        segment_ids.erase(segment_ids.begin());
+        stats.segments_dropped++;
+    }
+
+    return true;
+}
+
+// ================================
+// MAINTENANCE
+// ================================
+
+bool SegmentLog::clear() {
+    bool success = true;
+    for (uint32_t id : segment_ids) {
+        success &= fs.remove(segmentPath(id));
+    }
+
+    segment_ids.clear();
+    open_writable = false;
+    open_segment_bytes = 0;
+    pending.clear();
+    pending_records = 0;
+    return success;
+}
+
+void SegmentLog::dropBefore(uint64_t uptime) {
+    // Closed segments only, oldest first - stop at the first one still needed
+    while (segment_ids.size() > 1) {
+        String path = segmentPath(segment_ids.front());
+        size_t file_size = fs.fileSize(path);
+        if (file_size < sizeof(SegmentHeader) + ENTRY_BYTES) {
+            fs.remove(path);
+            segment_ids.erase(segment_ids.begin());
+            continue;
+        }
+
+        // Newest record of the segment is its last entry
+        SensorRecord last;
+        size_t last_offset = sizeof(SegmentHeader) +
+                             ((file_size - sizeof(SegmentHeader)) / ENTRY_BYTES - 1) * ENTRY_BYTES;
+        if (fs.read(path, last_offset, reinterpret_cast<uint8_t*>(&last), sizeof(last)) != sizeof(last) ||
+            last.getUptime() >= uptime) {
+            break;
+        }
+
+        fs.remove(path);
+        segment_ids.erase(segment_ids.begin());
+        stats.segments_dropped++;
+    }
+}
+
+// ================================
+// HELPERS
+// ================================
+
+String SegmentLog::segmentPath(uint32_t id) const {
+    char name[20];
+    snprintf(name, sizeof(name), "/seg_%08lu.log", (unsigned long)id);
+    return directory + name;
+}
+
+bool SegmentLog::readHeader(uint32_t id, SegmentHeader& header) {
+    if (fs.read(segmentPath(id), 0, reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    return header.magic == SEGMENT_MAGIC &&
+           header.version == SEGMENT_VERSION &&
+           header.record_format == HISTORY_RECORD_FORMAT &&
+           header.record_size == sizeof(SensorRecord);
+}
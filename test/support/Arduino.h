@@ -0,0 +1,189 @@
+/*
+ * test/support/Arduino.h
+ * Minimal Arduino core for the native test environment
+ * Only what the storage and communication sources use: String, Print, Serial,
+ * a settable millis() clock and the ESP helpers they call.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+
+template <class T, class L, class H>
+inline T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+// ================================
+// CLOCK
+// ================================
+
+// Tests move time forward by assigning or adding to native_millis
+inline unsigned long native_millis = 0;
+
+inline unsigned long millis() { return native_millis; }
+inline unsigned long micros() { return native_millis * 1000UL; }
+inline void delay(unsigned long ms) { native_millis += ms; }
+inline void yield() {}
+inline uint32_t esp_random() { return ((uint32_t)rand() << 16) ^ (uint32_t)rand(); }
+
+// ================================
+// STRING
+// ================================
+
+class String {
+public:
+    String() {}
+    String(const char* text) { if (text) value = text; }
+    String(char c) : value(1, c) {}
+    explicit String(int number, unsigned char base = 10) { format(base == 16 ? "%x" : "%d", number); }
+    explicit String(unsigned int number, unsigned char base = 10) { format(base == 16 ? "%x" : "%u", number); }
+    explicit String(long number, unsigned char base = 10) { format(base == 16 ? "%lx" : "%ld", number); }
+    explicit String(unsigned long number, unsigned char base = 10) { format(base == 16 ? "%lx" : "%lu", number); }
+    explicit String(long long number) { format("%lld", number); }
+    explicit String(unsigned long long number) { format("%llu", number); }
+    explicit String(float number, unsigned int decimals = 2) { format("%.*f", decimals, (double)number); }
+    explicit String(double number, unsigned int decimals = 2) { format("%.*f", decimals, number); }
+
+    String& operator=(const char* text) { value = text ? text : ""; return *this; }
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.size(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+    bool concat(const char* text) { if (text) value += text; return text != nullptr; }
+    bool concat(const char* text, unsigned int length) { value.append(text, length); return true; }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    String& operator+=(const char* text) { concat(text); return *this; }
+    String& operator+=(char c) { value += c; return *this; }
+
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator==(const char* text) const { return value == (text ? text : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char* text) const { return !(*this == text); }
+    bool operator<(const String& other) const { return value < other.value; }
+
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+    void setCharAt(unsigned int index, char c) { if (index < value.size()) value[index] = c; }
+
+    String substring(unsigned int begin) const { return substring(begin, value.size()); }
+    String substring(unsigned int begin, unsigned int end) const {
+        if (begin >= value.size() || end <= begin) return String();
+        return String(value.substr(begin, end - begin).c_str());
+    }
+    int indexOf(char c) const { return position(value.find(c)); }
+    int indexOf(const char* text) const { return position(value.find(text)); }
+    int lastIndexOf(char c) const { return position(value.rfind(c)); }
+    bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+    bool endsWith(const String& suffix) const {
+        return value.size() >= suffix.value.size() &&
+               value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+    }
+    void remove(unsigned int index) { if (index < value.size()) value.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < value.size()) value.erase(index, count); }
+    void trim() {
+        size_t begin = value.find_first_not_of(" \t\r\n");
+        size_t end = value.find_last_not_of(" \t\r\n");
+        value = begin == std::string::npos ? "" : value.substr(begin, end - begin + 1);
+    }
+    long toInt() const { return atol(value.c_str()); }
+    float toFloat() const { return atof(value.c_str()); }
+
+private:
+    std::string value;
+
+    static int position(size_t index) { return index == std::string::npos ? -1 : (int)index; }
+
+    template <class... Args>
+    void format(const char* pattern, Args... args) {
+        char text[64];
+        snprintf(text, sizeof(text), pattern, args...);
+        value = text;
+    }
+};
+
+// Result type of String concatenation in the Arduino core (ArduinoJson checks for it)
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& text) : String(text) {}
+};
+
+inline StringSumHelper operator+(const String& left, const String& right) { String sum(left); sum += right; return sum; }
+inline StringSumHelper operator+(const String& left, const char* right) { String sum(left); sum += right; return sum; }
+inline StringSumHelper operator+(const char* left, const String& right) { String sum(left); sum += right; return sum; }
+
+// ================================
+// PRINT & SERIAL
+// ================================
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (size--) written += write(*buffer++);
+        return written;
+    }
+    size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+    size_t print(const String& text) { return write(text.c_str(), text.length()); }
+    size_t print(const char* text) { return write(text); }
+    size_t print(char c) { return write((uint8_t)c); }
+    template <class T> size_t print(T number) { return print(String(number)); }
+    size_t println() { return print("\r\n"); }
+    template <class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+
+    size_t printf(const char* pattern, ...) __attribute__((format(printf, 2, 3))) {
+        char text[512];
+        va_list args;
+        va_start(args, pattern);
+        int length = vsnprintf(text, sizeof(text), pattern, args);
+        va_end(args);
+        if (length < 0) return 0;
+        return write((const uint8_t*)text, min((size_t)length, sizeof(text) - 1));
+    }
+
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+// Log output is dropped unless a test sets Serial.echo
+class HardwareSerial : public Stream {
+public:
+    bool echo = false;
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { if (echo) putchar(c); return 1; }
+    using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+struct EspClass {
+    uint32_t getFreeHeap() { return 0; }
+    void restart() {}
+};
+
+inline EspClass ESP;
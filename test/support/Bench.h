@@ -0,0 +1,102 @@
+/*
+ * test/support/Bench.h
+ * Wall-clock timing and heap counters for the host benchmarks (pio test -e native_bench -v)
+ * The Arduino clock in this directory is a test clock, so timings use std::chrono.
+ */
+
+#pragma once
+#include <unity.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <chrono>
+
+// ================================
+// TIMING
+// ================================
+
+class BenchTimer {
+public:
+    BenchTimer() : start(std::chrono::steady_clock::now()) {}
+
+    double elapsedMicros() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// Average microseconds per call of body over iterations calls
+template <class Body>
+double benchMicros(size_t iterations, Body&& body) {
+    BenchTimer timer;
+    for (size_t i = 0; i < iterations; i++) {
+        body(i);
+    }
+    return timer.elapsedMicros() / iterations;
+}
+
+// Keeps a result alive so the optimizer cannot drop the work that produced it
+template <class T>
+inline void benchKeep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// One line of results in the test output
+inline void benchReport(const char* format, ...) __attribute__((format(printf, 1, 2)));
+inline void benchReport(const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    TEST_MESSAGE(line);
+}
+
+// ================================
+// HEAP COUNTERS
+// ================================
+
+// Define BENCH_COUNT_ALLOCATIONS before including this file (in one source file of the
+// suite) to count every operator new of the program
+#ifdef BENCH_COUNT_ALLOCATIONS
+#include <new>
+#include <stdlib.h>
+
+struct BenchHeap {
+    size_t allocations = 0;
+    size_t bytes = 0;
+};
+
+inline BenchHeap bench_heap;
+
+void* operator new(size_t size) {
+    bench_heap.allocations++;
+    bench_heap.bytes += size;
+    void* block = malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* block) noexcept { free(block); }
+void operator delete[](void* block) noexcept { free(block); }
+void operator delete(void* block, size_t) noexcept { free(block); }
+void operator delete[](void* block, size_t) noexcept { free(block); }
+
+// Heap activity between construction and heap()
+class BenchHeapScope {
+public:
+    BenchHeapScope() : start(bench_heap) {}
+
+    BenchHeap heap() const {
+        BenchHeap delta;
+        delta.allocations = bench_heap.allocations - start.allocations;
+        delta.bytes = bench_heap.bytes - start.bytes;
+        return delta;
+    }
+
+private:
+    BenchHeap start;
+};
+#endif
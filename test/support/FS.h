@@ -0,0 +1,39 @@
+/*
+ * test/support/FS.h
+ * Arduino fs::FS stand-in for the native test environment
+ * Nothing is mounted - native tests use PosixFileSystem on a temporary directory.
+ */
+
+#pragma once
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File {
+public:
+    explicit operator bool() const { return false; }
+    size_t size() const { return 0; }
+    size_t write(const uint8_t*, size_t) { return 0; }
+    size_t read(uint8_t*, size_t) { return 0; }
+    bool seek(size_t) { return false; }
+    void close() {}
+    bool isDirectory() const { return false; }
+    File openNextFile() { return File(); }
+    const char* name() const { return ""; }
+};
+
+class FS {
+public:
+    File open(const String&, const char* = FILE_READ) { return File(); }
+    bool exists(const String&) { return false; }
+    bool mkdir(const String&) { return false; }
+    bool remove(const String&) { return false; }
+};
+
+}  // namespace fs
+
+using fs::File;
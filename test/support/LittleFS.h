@@ -0,0 +1,14 @@
+/*
+ * test/support/LittleFS.h
+ * LittleFS stand-in for the native test environment (never mounts)
+ */
+
+#pragma once
+#include "FS.h"
+
+class LittleFSFS : public fs::FS {
+public:
+    bool begin(bool = false) { return false; }
+};
+
+inline LittleFSFS LittleFS;
@@ -0,0 +1,84 @@
+/*
+ * test/support/MemoryFileSystem.h
+ * IFileSystem kept in RAM for host tests: files can be corrupted or truncated directly,
+ * and reads are counted per file
+ */
+
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include "interfaces/IFileSystem.h"
+
+class MemoryFileSystem : public IFileSystem {
+public:
+    std::map<std::string, std::vector<uint8_t>> files;
+    std::map<std::string, size_t> reads;     // read() calls per path
+    size_t bytes_read = 0;
+
+    bool exists(const String& path) override {
+        return files.count(path.c_str()) > 0;
+    }
+
+    bool makeDirectory(const String& path) override {
+        return true;
+    }
+
+    bool remove(const String& path) override {
+        return files.erase(path.c_str()) > 0;
+    }
+
+    size_t fileSize(const String& path) override {
+        auto file = files.find(path.c_str());
+        return file == files.end() ? 0 : file->second.size();
+    }
+
+    bool append(const String& path, const uint8_t* data, size_t length) override {
+        std::vector<uint8_t>& file = files[path.c_str()];
+        file.insert(file.end(), data, data + length);
+        return true;
+    }
+
+    size_t read(const String& path, size_t offset, uint8_t* buffer, size_t length) override {
+        reads[path.c_str()]++;
+        auto file = files.find(path.c_str());
+        if (file == files.end() || offset >= file->second.size()) {
+            return 0;
+        }
+        size_t count = std::min(length, file->second.size() - offset);
+        memcpy(buffer, file->second.data() + offset, count);
+        bytes_read += count;
+        return count;
+    }
+
+    bool listFiles(const String& directory, std::vector<String>& names) override {
+        std::string prefix = std::string(directory.c_str()) + "/";
+        for (const auto& file : files) {
+            if (file.first.compare(0, prefix.size(), prefix) == 0 &&
+                file.first.find('/', prefix.size()) == std::string::npos) {
+                names.push_back(String(file.first.substr(prefix.size()).c_str()));
+            }
+        }
+        return true;
+    }
+
+    bool writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) override {
+        auto file = files.find(path.c_str());
+        if (file == files.end() || offset + length > file->second.size()) {
+            return false;
+        }
+        memcpy(file->second.data() + offset, data, length);
+        return true;
+    }
+
+    String getName() override { return "memory"; }
+
+    // Reads of files whose path contains part
+    size_t readsOf(const char* part) const {
+        size_t count = 0;
+        for (const auto& entry : reads) {
+            if (entry.first.find(part) != std::string::npos) count += entry.second;
+        }
+        return count;
+    }
+};
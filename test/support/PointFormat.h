@@ -0,0 +1,43 @@
+/*
+ * test/support/PointFormat.h
+ * Point-format history JSON as BluetoothComm::fillCompactPoint() writes it, without
+ * ArduinoJson: for comparing the delta-column encoding against it on the host
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "storage/SensorRecord.h"
+
+// Shortest text of a value rounded to two decimals, as ArduinoJson prints it
+inline void appendPointValue(String& text, double value) {
+    char number[24];
+    int length = snprintf(number, sizeof(number), "%.2f", round(value * 100) / 100.0);
+    while (length > 0 && number[length - 1] == '0') length--;
+    if (length > 0 && number[length - 1] == '.') length--;
+    if (length == 2 && number[0] == '-' && number[1] == '0') {
+        number[0] = '0';
+        length = 1;
+    }
+    number[length] = 0;
+    text += number;
+}
+
+// {"t":...,"c":...,"T":...,"h":...,"p":...,"v":...}, metrics without a valid reading left out
+inline void appendPoint(String& text, uint64_t timestamp, const SensorRecord& record) {
+    text += "{\"t\":";
+    text += String((unsigned long long)timestamp);
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        if (!(record.validity_flags & SensorRecord::metricFlag(i))) {
+            continue;
+        }
+        text += ",\"";
+        text += SensorRecord::metricKey(i);
+        text += "\":";
+        if (i == SensorRecord::METRIC_CO2) {
+            text += String((long)round(record.getCo2()));
+        } else {
+            appendPointValue(text, record.getValue(i));
+        }
+    }
+    text += '}';
+}
@@ -0,0 +1,40 @@
+/*
+ * test/support/ReadingSeries.h
+ * Numbered readings for the storage suites: reading k is taken at interval * (k + 1) and
+ * carries CO2 400 + k * co2_step, so a stored record names the reading it came from
+ */
+
+#pragma once
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+
+struct ReadingSeries {
+    uint64_t interval = 10000;   // ms between readings
+    uint32_t co2_step = 1;       // ppm between consecutive readings
+    uint32_t co2_period = 0;     // CO2 starts over every co2_period readings (0 = never)
+    float temperature = NAN;     // Same temperature in every reading (NaN = none)
+
+    uint64_t uptime(uint32_t index) const {
+        return interval * (index + 1);
+    }
+
+    // Reading number index of the series (CO2 valid, temperature valid if set)
+    SensorRecord at(uint32_t index) const {
+        SensorRecord record;
+        record.setUptime(uptime(index));
+        record.setCo2(400 + (co2_period ? index % co2_period : index) * co2_step);
+        record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_OVERALL_VALID;
+        if (!isnan(temperature)) {
+            record.setTemperature(temperature);
+            record.validity_flags |= SensorRecord::FLAG_TEMP_VALID;
+        }
+        return record;
+    }
+
+    // Stores readings first .. first + count - 1
+    void store(HistoricalDataStorage& storage, uint32_t first, uint32_t count) const {
+        for (uint32_t i = first; i < first + count; i++) {
+            TEST_ASSERT_TRUE(storage.storeReading(at(i)));
+        }
+    }
+};
@@ -0,0 +1,18 @@
+/*
+ * test/support/SD.h
+ * SD stand-in for the native test environment (no card)
+ */
+
+#pragma once
+#include "FS.h"
+
+#define CARD_NONE 0
+
+class SDFS : public fs::FS {
+public:
+    bool begin(int = 0) { return false; }
+    int cardType() { return CARD_NONE; }
+    uint64_t cardSize() { return 0; }
+};
+
+inline SDFS SD;
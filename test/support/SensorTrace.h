@@ -0,0 +1,68 @@
+/*
+ * test/support/SensorTrace.h
+ * Deterministic indoor air trace for storage tests and benchmarks
+ * CO2 rises while a room is occupied and drops when it is aired; temperature and
+ * humidity come from 16-bit SCD4x ticks, pressure and VOC at BME688 resolution.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "storage/SensorRecord.h"
+
+class SensorTrace {
+public:
+    SensorTrace(uint32_t seed = 1, uint64_t interval_ms = 10000, uint64_t first_uptime = 10000)
+        : state(seed ? seed : 1), interval(interval_ms), uptime(first_uptime),
+          co2(450), temperature_ticks(24500), humidity_ticks(29500), pressure_pa(101300), voc(120),
+          occupied(false), phase(0) {}
+
+    SensorRecord next() {
+        // Occupancy changes roughly every half hour of samples
+        if (++phase >= 180) {
+            phase = 0;
+            occupied = !occupied;
+        }
+
+        co2 = constrain(co2 + (occupied ? 3.0f : -2.5f) + noise(2.0f), 400.0f, 2500.0f);
+        temperature_ticks = constrain(temperature_ticks + (int32_t)noise(6.0f), 20000, 30000);
+        humidity_ticks = constrain(humidity_ticks + (int32_t)noise(10.0f), 15000, 45000);
+        pressure_pa = constrain(pressure_pa + (int32_t)noise(3.0f), 95000, 105000);
+        voc = constrain(voc + (occupied ? 0.4f : -0.3f) + noise(0.5f), 0.0f, 1000.0f);
+
+        SensorRecord record;
+        record.setUptime(uptime);
+        record.setCo2(roundf(co2));
+        record.setTemperature(-45.0f + 175.0f * temperature_ticks / 65535.0f);
+        record.setHumidity(100.0f * humidity_ticks / 65535.0f);
+        record.setPressure(pressure_pa / 100.0f);
+        record.setVoc(roundf(voc * 10.0f) / 10.0f);
+        record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_TEMP_VALID |
+                                SensorRecord::FLAG_HUMIDITY_VALID | SensorRecord::FLAG_PRESSURE_VALID |
+                                SensorRecord::FLAG_VOC_VALID | SensorRecord::FLAG_OVERALL_VALID;
+        record.alert_level = co2 >= 1500 ? 2 : (co2 >= 1000 ? 1 : 0);
+
+        uptime += interval;
+        return record;
+    }
+
+    uint64_t nextUptime() const { return uptime; }
+    void skip(int64_t milliseconds) { uptime += milliseconds; }   // Negative repeats an uptime
+
+private:
+    uint32_t state;
+    uint64_t interval;
+    uint64_t uptime;
+    float co2;
+    int32_t temperature_ticks;
+    int32_t humidity_ticks;
+    int32_t pressure_pa;
+    float voc;
+    bool occupied;
+    uint32_t phase;
+
+    // Uniform in [-amplitude, amplitude]
+    float noise(float amplitude) {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) / 8388608.0f - 1.0f) * amplitude;
+    }
+};
@@ -0,0 +1,31 @@
+/*
+ * test/support/TempDirectory.h
+ * Fresh host directory for each test of the suites that run on PosixFileSystem:
+ * create() from setUp(), remove() from tearDown()
+ */
+
+#pragma once
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <Arduino.h>
+
+class TempDirectory {
+public:
+    // Makes /tmp/<prefix>_XXXXXX
+    void create(const char* prefix) {
+        snprintf(directory, sizeof(directory), "/tmp/%s_XXXXXX", prefix);
+        TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    }
+
+    // Deletes it with everything the test wrote
+    void remove() {
+        String command = String("rm -rf ") + directory;
+        TEST_ASSERT_EQUAL_INT(0, system(command.c_str()));
+    }
+
+    const char* path() const { return directory; }
+
+private:
+    char directory[64] = "";
+};
@@ -0,0 +1,195 @@
+/*
+ * test/test_alert_episodes/test_main.cpp
+ * Alert episode index: runs opening and closing at the warning threshold, episodes
+ * that outlive the raw ring, and the episode ring dropping its oldest entries
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+#include "ReadingSeries.h"
+
+static const size_t CAPACITY = 16;
+static const uint64_t INTERVAL = 10000;   // 10 s between readings
+static const ReadingSeries series = { INTERVAL };
+
+static SensorRecord reading(uint32_t index, AlertLevel level, float co2 = 800) {
+    SensorRecord record = series.at(index);
+    record.setCo2(co2);
+    record.setVoc(100);
+    record.alert_level = (uint8_t)level;
+    record.validity_flags |= SensorRecord::FLAG_VOC_VALID;
+    return record;
+}
+
+// Readings first .. first + count - 1 at one level; returns the index after the last
+static uint32_t storeRun(HistoricalDataStorage& storage, uint32_t first, uint32_t count,
+                         AlertLevel level, float co2 = 800) {
+    for (uint32_t i = first; i < first + count; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(reading(i, level, co2)));
+    }
+    return first + count;
+}
+
+// Readings are stored without gaps in sequence numbers, so sequence = index unless given
+static void assertEpisode(const AlertEpisode& episode, uint32_t first, uint32_t count,
+                          uint32_t first_sequence = UINT32_MAX) {
+    TEST_ASSERT_EQUAL_UINT64(reading(first, AlertLevel::NONE).getUptime(), episode.start_uptime);
+    TEST_ASSERT_EQUAL_UINT64(reading(first + count - 1, AlertLevel::NONE).getUptime(), episode.end_uptime);
+    TEST_ASSERT_EQUAL_UINT32(first_sequence == UINT32_MAX ? first : first_sequence, episode.first_sequence);
+    TEST_ASSERT_EQUAL_UINT32(count, episode.record_count);
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_episodes_open_and_close_at_the_threshold(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableEpisodes());
+    const AlertEpisodeIndex& episodes = storage.getEpisodes();
+
+    // Info stays below the warning threshold
+    uint32_t next = storeRun(storage, 0, 3, AlertLevel::NONE);
+    next = storeRun(storage, next, 2, AlertLevel::INFO);
+    TEST_ASSERT_EQUAL_size_t(0, episodes.size());
+    TEST_ASSERT_FALSE(episodes.isOpen());
+
+    // Warning opens an episode, critical extends it and raises the peak
+    next = storeRun(storage, next, 2, AlertLevel::WARNING, 1100);
+    TEST_ASSERT_EQUAL_size_t(1, episodes.size());
+    TEST_ASSERT_TRUE(episodes.isOpen());
+    next = storeRun(storage, next, 3, AlertLevel::CRITICAL, 1600);
+    next = storeRun(storage, next, 1, AlertLevel::WARNING, 1200);
+    TEST_ASSERT_EQUAL_size_t(1, episodes.size());
+    assertEpisode(episodes.at(0), 5, 6);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)AlertLevel::CRITICAL, episodes.at(0).peak_level);
+    TEST_ASSERT_EQUAL_FLOAT(1600, episodes.at(0).peak_co2);
+
+    // Dropping to info closes it; the closed episode no longer grows
+    next = storeRun(storage, next, 1, AlertLevel::INFO);
+    TEST_ASSERT_FALSE(episodes.isOpen());
+    next = storeRun(storage, next, 2, AlertLevel::NONE);
+    assertEpisode(episodes.at(0), 5, 6);
+
+    // Crossing the threshold again starts a second episode
+    uint32_t second = next;
+    next = storeRun(storage, next, 2, AlertLevel::EMERGENCY, 2500);
+    TEST_ASSERT_EQUAL_size_t(2, episodes.size());
+    TEST_ASSERT_TRUE(episodes.isOpen());
+    assertEpisode(episodes.at(1), second, 2);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)AlertLevel::EMERGENCY, episodes.at(1).peak_level);
+
+    // A gap in the readings longer than max_gap closes it even at the same level
+    uint32_t after_gap = next + AlertEpisodeIndex::DEFAULT_MAX_GAP_MS / INTERVAL + 1;
+    storeRun(storage, after_gap, 1, AlertLevel::EMERGENCY);
+    TEST_ASSERT_EQUAL_size_t(3, episodes.size());
+    assertEpisode(episodes.at(1), second, 2);
+    assertEpisode(episodes.at(2), after_gap, 1, next);
+
+    // Time ranges find the overlapping episodes
+    size_t begin, end;
+    episodes.findRange(reading(9, AlertLevel::NONE).getUptime(), reading(second, AlertLevel::NONE).getUptime(),
+                       begin, end);
+    TEST_ASSERT_EQUAL_size_t(0, begin);
+    TEST_ASSERT_EQUAL_size_t(2, end);
+}
+
+void test_open_episode_outlives_the_raw_ring(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableEpisodes());
+    const AlertEpisodeIndex& episodes = storage.getEpisodes();
+
+    // An episode longer than the ring: its first records are overwritten while it is open
+    uint32_t next = storeRun(storage, 0, 4, AlertLevel::NONE);
+    next = storeRun(storage, next, CAPACITY * 3, AlertLevel::WARNING);
+    TEST_ASSERT_GREATER_THAN_UINT32(4, storage.getFirstSequence());
+    TEST_ASSERT_TRUE(episodes.isOpen());
+    assertEpisode(episodes.at(0), 4, CAPACITY * 3);
+
+    // It keeps growing and closes normally after the wrap
+    next = storeRun(storage, next, 5, AlertLevel::CRITICAL);
+    next = storeRun(storage, next, 1, AlertLevel::NONE);
+    TEST_ASSERT_FALSE(episodes.isOpen());
+    assertEpisode(episodes.at(0), 4, CAPACITY * 3 + 5);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)AlertLevel::CRITICAL, episodes.at(0).peak_level);
+
+    // Enabled over a ring that has already wrapped: only what the ring still holds,
+    // so the rebuilt episode starts at the oldest stored record
+    HistoricalDataStorage late("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(late.initialize());
+    storeRun(late, 0, CAPACITY * 2, AlertLevel::WARNING);
+    TEST_ASSERT_TRUE(late.enableEpisodes());
+    TEST_ASSERT_EQUAL_size_t(1, late.getEpisodes().size());
+    assertEpisode(late.getEpisodes().at(0), CAPACITY, CAPACITY);
+    TEST_ASSERT_TRUE(late.getEpisodes().isOpen());
+}
+
+void test_full_episode_ring_drops_the_oldest(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableEpisodes(AlertEpisodeIndex::DEFAULT_MIN_LEVEL, 4));
+    const AlertEpisodeIndex& episodes = storage.getEpisodes();
+
+    // Six episodes of i + 1 warning readings, one quiet reading after each
+    uint32_t starts[6];
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < 6; i++) {
+        starts[i] = next;
+        next = storeRun(storage, next, i + 1, AlertLevel::WARNING);
+        if (i < 5) {
+            next = storeRun(storage, next, 1, AlertLevel::NONE);
+        }
+    }
+
+    // The newest four are kept, oldest first, and the last one is still open
+    TEST_ASSERT_EQUAL_size_t(4, episodes.size());
+    TEST_ASSERT_TRUE(episodes.isOpen());
+    for (size_t i = 0; i < 4; i++) {
+        assertEpisode(episodes.at(i), starts[i + 2], i + 3);
+    }
+
+    // The open episode keeps growing in its slot after the ring wrapped
+    storeRun(storage, next, 2, AlertLevel::WARNING);
+    TEST_ASSERT_EQUAL_size_t(4, episodes.size());
+    assertEpisode(episodes.at(3), starts[5], 8);
+
+    size_t begin, end;
+    episodes.findRange(0, UINT64_MAX, begin, end);
+    TEST_ASSERT_EQUAL_size_t(0, begin);
+    TEST_ASSERT_EQUAL_size_t(4, end);
+}
+
+void test_retention_drops_episodes_that_ended(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableEpisodes());
+    const AlertEpisodeIndex& episodes = storage.getEpisodes();
+
+    uint32_t next = storeRun(storage, 0, 2, AlertLevel::WARNING);
+    next = storeRun(storage, next, 2, AlertLevel::NONE);
+    next = storeRun(storage, next, 3, AlertLevel::WARNING);
+    TEST_ASSERT_EQUAL_size_t(2, episodes.size());
+
+    // Cut inside the second episode: the first ended before it, the second is kept whole
+    TEST_ASSERT_TRUE(storage.clearOldData(reading(5, AlertLevel::NONE).getUptime()));
+    TEST_ASSERT_EQUAL_size_t(1, episodes.size());
+    assertEpisode(episodes.at(0), 4, 3);
+    TEST_ASSERT_TRUE(episodes.isOpen());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_episodes_open_and_close_at_the_threshold);
+    RUN_TEST(test_open_episode_outlives_the_raw_ring);
+    RUN_TEST(test_full_episode_ring_drops_the_oldest);
+    RUN_TEST(test_retention_drops_episodes_that_ended);
+    return UNITY_END();
+}
@@ -0,0 +1,183 @@
+/*
+ * test/test_bench_binary_frame/test_main.cpp
+ * Realtime sensor_data as binary frames (the fields BluetoothComm writes with binary
+ * framing): wire bytes and microseconds per frame, against the RealtimeWriter JSON line
+ * sent without it
+ */
+
+#define BENCH_COUNT_ALLOCATIONS
+#include <unity.h>
+#include "Bench.h"
+#include "communication/BinaryFrame.h"
+#include "communication/RealtimeWriter.h"
+
+static const size_t CYCLES = 200000;
+
+// Stands in for the Bluetooth link: counts what would be sent
+class NullLink : public Print {
+public:
+    size_t bytes = 0;
+
+    size_t write(uint8_t c) override {
+        benchKeep(c);
+        bytes++;
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+        benchKeep(buffer[size - 1]);
+        bytes += size;
+        return size;
+    }
+};
+
+static NullLink link;
+static FrameEncoder encoder(link);
+static RealtimeWriter writer;
+
+static uint32_t validBit(uint8_t field) {
+    return 1UL << (field - BinaryFrame::FIELD_CO2);
+}
+
+// Fields of BluetoothComm::sendSensorFrame()
+static size_t co2Frame(const CO2SensorData& co2, uint32_t timestamp) {
+    encoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    encoder.addUint(BinaryFrame::FIELD_TIMESTAMP, timestamp);
+    encoder.addUint(BinaryFrame::FIELD_SENSOR_TYPE, (uint8_t)co2.getType());
+    encoder.addFloat(BinaryFrame::FIELD_CO2, co2.co2);
+    encoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, co2.temperature);
+    encoder.addFloat(BinaryFrame::FIELD_HUMIDITY, co2.humidity);
+    encoder.addUint(BinaryFrame::FIELD_VALID, validBit(BinaryFrame::FIELD_CO2) |
+                    validBit(BinaryFrame::FIELD_TEMPERATURE) | validBit(BinaryFrame::FIELD_HUMIDITY));
+    return encoder.end();
+}
+
+static size_t vocFrame(const VOCSensorData& voc, uint32_t timestamp) {
+    encoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    encoder.addUint(BinaryFrame::FIELD_TIMESTAMP, timestamp);
+    encoder.addUint(BinaryFrame::FIELD_SENSOR_TYPE, (uint8_t)voc.getType());
+    encoder.addFloat(BinaryFrame::FIELD_VOC, voc.vocEstimate);
+    encoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, voc.temperature);
+    encoder.addFloat(BinaryFrame::FIELD_HUMIDITY, voc.humidity);
+    encoder.addFloat(BinaryFrame::FIELD_PRESSURE, voc.pressure / 100.0f);
+    encoder.addUint(BinaryFrame::FIELD_VALID, validBit(BinaryFrame::FIELD_VOC) |
+                    validBit(BinaryFrame::FIELD_TEMPERATURE) | validBit(BinaryFrame::FIELD_HUMIDITY) |
+                    validBit(BinaryFrame::FIELD_PRESSURE));
+    return encoder.end();
+}
+
+// Fields of BluetoothComm::sendSnapshotFrame() with both sensors valid
+static size_t snapshotFrame(const CO2SensorData& co2, const VOCSensorData& voc, uint32_t timestamp) {
+    encoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    encoder.addUint(BinaryFrame::FIELD_TIMESTAMP, timestamp);
+    encoder.addFloat(BinaryFrame::FIELD_CO2, co2.co2);
+    encoder.addFloat(BinaryFrame::FIELD_TEMPERATURE, co2.temperature);
+    encoder.addFloat(BinaryFrame::FIELD_HUMIDITY, co2.humidity);
+    encoder.addFloat(BinaryFrame::FIELD_VOC, voc.vocEstimate);
+    encoder.addFloat(BinaryFrame::FIELD_PRESSURE, voc.pressure / 100.0f);
+    encoder.addUint(BinaryFrame::FIELD_VALID, validBit(BinaryFrame::FIELD_CO2) |
+                    validBit(BinaryFrame::FIELD_TEMPERATURE) | validBit(BinaryFrame::FIELD_HUMIDITY) |
+                    validBit(BinaryFrame::FIELD_VOC) | validBit(BinaryFrame::FIELD_PRESSURE));
+    return encoder.end();
+}
+
+static CO2SensorData co2Reading() {
+    CO2SensorData data;
+    data.setValid(true);
+    data.co2 = 612.0f;
+    data.temperature = 22.37f;
+    data.humidity = 45.5f;
+    return data;
+}
+
+static VOCSensorData vocReading() {
+    VOCSensorData data;
+    data.setValid(true);
+    data.temperature = -3.2f;
+    data.humidity = 58.75f;
+    data.pressure = 101325.0f;
+    data.gasResistance = 50000.0f;
+    data.vocEstimate = 85.4f;
+    data.gasValid = true;
+    return data;
+}
+
+void setUp(void) {
+    writer.setDeviceId("AQM-0123456789AB");
+    link.bytes = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_sensor_frames_against_json(void) {
+    CO2SensorData co2 = co2Reading();
+    VOCSensorData voc = vocReading();
+    size_t json_bytes = 0;
+
+    double json_us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.co2 = 420.0f + cycle % 1500;
+        voc.vocEstimate = (cycle % 400) * 0.61f;
+        json_bytes += writer.format(co2, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+        json_bytes += writer.format(voc, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+    });
+
+    size_t frame_bytes = 0;
+    BenchHeapScope scope;
+    double frame_us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.co2 = 420.0f + cycle % 1500;
+        voc.vocEstimate = (cycle % 400) * 0.61f;
+        frame_bytes += co2Frame(co2, cycle);
+        frame_bytes += vocFrame(voc, cycle);
+    });
+    BenchHeap heap = scope.heap();
+
+    benchReport("sensor_data JSON:  %.3f us per message, %.1f bytes per message",
+                json_us / 2, (double)json_bytes / (2 * CYCLES));
+    benchReport("sensor_data frame: %.3f us per frame, %.1f bytes per frame, %zu allocations in %zu cycles",
+                frame_us / 2, (double)frame_bytes / (2 * CYCLES), heap.allocations, CYCLES);
+    TEST_ASSERT_EQUAL_size_t(frame_bytes, link.bytes);
+    TEST_ASSERT_LESS_THAN(json_bytes / 4, frame_bytes);
+    TEST_ASSERT_EQUAL_size_t(0, heap.allocations);
+}
+
+void bench_snapshot_frame_against_json(void) {
+    CO2SensorData co2 = co2Reading();
+    VOCSensorData voc = vocReading();
+    size_t json_bytes = 0;
+
+    double json_us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.temperature = 18.0f + (cycle % 700) * 0.013f;
+        voc.pressure = 98000.0f + (cycle % 5000) * 1.7f;
+        json_bytes += writer.formatSnapshot(&co2, &voc, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+    });
+
+    size_t frame_bytes = 0;
+    BenchHeapScope scope;
+    double frame_us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.temperature = 18.0f + (cycle % 700) * 0.013f;
+        voc.pressure = 98000.0f + (cycle % 5000) * 1.7f;
+        frame_bytes += snapshotFrame(co2, voc, cycle);
+    });
+    BenchHeap heap = scope.heap();
+
+    benchReport("snapshot JSON:     %.3f us per message, %.1f bytes per message",
+                json_us, (double)json_bytes / CYCLES);
+    benchReport("snapshot frame:    %.3f us per frame, %.1f bytes per frame, %zu allocations in %zu cycles",
+                frame_us, (double)frame_bytes / CYCLES, heap.allocations, CYCLES);
+    TEST_ASSERT_LESS_THAN(json_bytes / 4, frame_bytes);
+    TEST_ASSERT_EQUAL_size_t(0, heap.allocations);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_sensor_frames_against_json);
+    RUN_TEST(bench_snapshot_frame_against_json);
+    return UNITY_END();
+}
@@ -0,0 +1,81 @@
+/*
+ * test/test_bench_columns/test_main.cpp
+ * Single-metric summaries over a full ring: the record scan (AoS) against the column
+ * mirror from enableColumns() (SoA), in records per second
+ */
+
+#include <unity.h>
+#include <memory>
+#include "Bench.h"
+#include "SensorTrace.h"
+#include "storage/HistoricalDataStorage.h"
+
+static const size_t SCANS = 2000;
+
+// Whole ring, every metric in turn, so no single field stays hot in the cache
+static double recordsPerSecond(const HistoricalDataStorage& storage, MetricSummary* summaries) {
+    size_t records = storage.getRecordCount();
+    double us = benchMicros(SCANS, [&](size_t scan) {
+        size_t metric = scan % SensorRecord::METRIC_COUNT;
+        summaries[metric] = storage.summarizeMetric(metric, 0, UINT64_MAX);
+        benchKeep(summaries[metric]);
+    });
+    return records / us * 1e6;
+}
+
+template <size_t N>
+static void benchmarkRecords() {
+    std::unique_ptr<StaticHistoricalDataStorage<N>> ring(new StaticHistoricalDataStorage<N>("ram_only"));
+    HistoricalDataStorage& storage = *ring;
+    TEST_ASSERT_TRUE(storage.initialize());
+
+    // Wrapped, so every scan covers two spans
+    SensorTrace trace(10);
+    for (size_t i = 0; i < N + N / 3; i++) {
+        storage.storeReading(trace.next());
+    }
+
+    MetricSummary records[SensorRecord::METRIC_COUNT];
+    double aos = recordsPerSecond(storage, records);
+
+    TEST_ASSERT_TRUE(storage.enableColumns());
+    MetricSummary columns[SensorRecord::METRIC_COUNT];
+    double soa = recordsPerSecond(storage, columns);
+
+    // Same answers from both layouts
+    for (size_t metric = 0; metric < SensorRecord::METRIC_COUNT; metric++) {
+        TEST_ASSERT_EQUAL_UINT32(records[metric].count, columns[metric].count);
+        TEST_ASSERT_EQUAL_FLOAT(records[metric].min, columns[metric].min);
+        TEST_ASSERT_EQUAL_FLOAT(records[metric].max, columns[metric].max);
+        TEST_ASSERT_FLOAT_WITHIN(fabsf(records[metric].mean) * 1e-4f + 1e-4f, records[metric].mean,
+                                 columns[metric].mean);
+    }
+
+    benchReport("%6zu records (%zu-byte records): record scan %.0fM records/s, columns %.0fM records/s (%.1fx), "
+                "columns cost %zu KB",
+                N, sizeof(SensorRecord), aos / 1e6, soa / 1e6, soa / aos,
+                storage.getColumns().getMemoryBytes() / 1024);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_columns_flash_ring(void) {
+    benchmarkRecords<HistoricalDataStorage::MAX_RECORDS_FLASH>();
+}
+
+void bench_columns_10k(void) {
+    benchmarkRecords<10000>();
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_columns_flash_ring);
+    RUN_TEST(bench_columns_10k);
+    return UNITY_END();
+}
@@ -0,0 +1,91 @@
+/*
+ * test/test_bench_compressed_block/test_main.cpp
+ * Gorilla archive on a replayed day of 10 s readings: bytes per record, records per
+ * RAM budget, encode and decode time per record
+ * Build with -DHISTORY_RECORD_FORMAT=1 for the float layout
+ */
+
+#include <unity.h>
+#include <vector>
+#include "Bench.h"
+#include "SensorTrace.h"
+#include "storage/CompressedBlock.h"
+
+static const size_t DAY_RECORDS = 8640;
+static const size_t ROUNDS = 20;
+static const size_t ARCHIVE_BYTES = 32768;   // HistoricalDataStorage::DEFAULT_ARCHIVE_BYTES
+
+static std::vector<SensorRecord> replayDay(uint32_t seed) {
+    SensorTrace trace(seed);
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < DAY_RECORDS; i++) {
+        records.push_back(trace.next());
+    }
+    return records;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_archive_compression(void) {
+    std::vector<SensorRecord> records = replayDay(1);
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(DAY_RECORDS * sizeof(SensorRecord)));
+
+    double encode_us = benchMicros(ROUNDS, [&](size_t round) {
+        archive.clear();
+        for (size_t i = 0; i < records.size(); i++) {
+            archive.append(records[i], round * DAY_RECORDS + i);
+        }
+    }) / DAY_RECORDS;
+
+    uint32_t first = archive.getFirstSequence();
+    TEST_ASSERT_EQUAL_size_t(DAY_RECORDS, archive.getRecordCount());
+
+    double decode_us = benchMicros(ROUNDS, [&](size_t) {
+        CompressedArchive::Reader reader;
+        SensorRecord record;
+        for (uint32_t sequence = first; sequence < archive.getEndSequence(); sequence++) {
+            archive.read(sequence, reader, record);
+            benchKeep(record);
+        }
+    }) / DAY_RECORDS;
+
+    float bytes_per_record = (float)archive.getCompressedBytes() / archive.getRecordCount();
+    benchReport("format %d: %.2f bytes per %zu-byte record (ratio %.2f)", HISTORY_RECORD_FORMAT,
+                bytes_per_record, sizeof(SensorRecord), archive.getCompressionRatio());
+    // Whole blocks: the room left at the end of each sealed block counts too
+    float budget_records = (float)archive.getRecordCount() / archive.getBlockCount() *
+                           (ARCHIVE_BYTES / CompressedBlock::BLOCK_BYTES);
+    benchReport("default %zu KB budget: %.0f records (%.2f days at 10 s), same RAM as raw records: %zu",
+                ARCHIVE_BYTES / 1024, budget_records, budget_records / DAY_RECORDS,
+                ARCHIVE_BYTES / sizeof(SensorRecord));
+    benchReport("encode %.3f us/record (%.1fM records/s), decode %.3f us/record (%.1fM records/s)",
+                encode_us, 1 / encode_us, decode_us, 1 / decode_us);
+}
+
+void bench_constant_readings(void) {
+    // A quiet night: nothing changes between readings
+    SensorRecord record = SensorTrace(2).next();
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(64 * CompressedBlock::BLOCK_BYTES));
+    for (uint32_t sequence = 0; sequence < DAY_RECORDS; sequence++) {
+        record.setUptime(10000ULL * (sequence + 1));
+        archive.append(record, sequence);
+    }
+
+    benchReport("constant readings: %.2f bytes per record",
+                (float)archive.getCompressedBytes() / archive.getRecordCount());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_archive_compression);
+    RUN_TEST(bench_constant_readings);
+    return UNITY_END();
+}
@@ -0,0 +1,78 @@
+/*
+ * test/test_bench_delta_columns/test_main.cpp
+ * History payload for one 999-point response of 10 s readings: point format against
+ * delta columns, and the time to collect and write the columns
+ */
+
+#include <unity.h>
+#include <vector>
+#include "Bench.h"
+#include "PointFormat.h"
+#include "SensorTrace.h"
+#include "communication/DeltaColumnWriter.h"
+
+static const size_t POINTS = 999;
+static const size_t ROUNDS = 200;
+static const uint64_t BASE_TIMESTAMP = 1695120000000ULL;
+
+// Counts what would go out without keeping it
+class ByteCounter : public Print {
+public:
+    size_t bytes = 0;
+
+    size_t write(uint8_t) override {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t*, size_t size) override {
+        bytes += size;
+        return size;
+    }
+    using Print::write;
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_payload_size(void) {
+    SensorTrace trace(25);
+    std::vector<SensorRecord> records;
+    for (size_t k = 0; k < POINTS; k++) {
+        records.push_back(trace.next());
+        if (k % 97 == 5) trace.skip(1000);     // A late reading now and then
+    }
+
+    String points = "[";
+    for (const SensorRecord& record : records) {
+        if (points.length() > 1) points += ',';
+        appendPoint(points, BASE_TIMESTAMP + record.getUptime(), record);
+    }
+    points += ']';
+
+    size_t delta_bytes = 0;
+    double delta_us = benchMicros(ROUNDS, [&](size_t) {
+        DeltaColumnWriter writer;
+        for (const SensorRecord& record : records) {
+            writer.add(BASE_TIMESTAMP + record.getUptime(), record);
+        }
+        ByteCounter out;
+        delta_bytes = writer.write(out);
+        benchKeep(out.bytes);
+    });
+
+    benchReport("%zu points: %u bytes as points, %zu bytes as delta columns (%.1fx smaller)",
+                POINTS, points.length(), delta_bytes, (double)points.length() / delta_bytes);
+    benchReport("delta columns: %.1f us per response (%.3f us per point)", delta_us, delta_us / POINTS);
+    TEST_ASSERT_LESS_THAN(points.length() / 3, delta_bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_payload_size);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+/*
+ * test/test_bench_heap/test_main.cpp
+ * Heap used by the raw ring: growing vector (before the fixed ring), heap ring sized
+ * once, static ring; and what each optional index allocates when it is enabled
+ */
+
+#define BENCH_COUNT_ALLOCATIONS
+#include <unity.h>
+#include <vector>
+#include "Bench.h"
+#include "SensorTrace.h"
+#include "storage/HistoricalDataStorage.h"
+
+static const size_t CAPACITY = HistoricalDataStorage::MAX_RECORDS_FLASH;
+
+static StaticHistoricalDataStorage<CAPACITY> static_storage("ram_only");
+
+// Allocations while the ring fills twice over
+static BenchHeap fillTwice(HistoricalDataStorage& storage) {
+    SensorTrace trace(10);
+    BenchHeapScope scope;
+    for (size_t i = 0; i < 2 * CAPACITY; i++) {
+        storage.storeReading(trace.next());
+    }
+    return scope.heap();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_growing_vector(void) {
+    // The ring before it was sized up front: push_back until capacity
+    SensorTrace trace(10);
+    BenchHeapScope scope;
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < CAPACITY; i++) {
+        records.push_back(trace.next());
+    }
+    BenchHeap heap = scope.heap();
+    benchReport("growing vector: %zu allocations, %zu bytes allocated to hold %zu bytes of records",
+                heap.allocations, heap.bytes, CAPACITY * sizeof(SensorRecord));
+}
+
+void bench_heap_ring(void) {
+    BenchHeapScope scope;
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    BenchHeap setup = scope.heap();
+    BenchHeap fill = fillTwice(storage);
+
+    benchReport("heap ring: %zu allocations, %zu bytes at construction; %zu allocations filling it twice",
+                setup.allocations, setup.bytes, fill.allocations);
+    TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY * sizeof(SensorRecord), setup.bytes);
+    TEST_ASSERT_EQUAL_size_t(0, fill.allocations);
+}
+
+void bench_static_ring(void) {
+    BenchHeapScope scope;
+    TEST_ASSERT_TRUE(static_storage.initialize());
+    BenchHeap setup = scope.heap();
+    BenchHeap fill = fillTwice(static_storage);
+
+    benchReport("static ring: %zu bytes in .bss, %zu bytes of heap at initialize; %zu allocations filling it twice",
+                static_storage.RING_BYTES, setup.bytes, fill.allocations);
+    TEST_ASSERT_LESS_THAN(256, setup.bytes);
+    TEST_ASSERT_EQUAL_size_t(0, fill.allocations);
+}
+
+void bench_index_heap(void) {
+    // What enableHistoricalData() adds on top of the ring, index by index
+    HistoricalDataStorage& storage = static_storage;
+    struct {
+        const char* name;
+        bool (*enable)(HistoricalDataStorage&);
+    } indexes[] = {
+        { "compressed archive", [](HistoricalDataStorage& s) { return s.enableArchive(); } },
+        { "rollups", [](HistoricalDataStorage& s) { return s.enableRollups(); } },
+        { "statistics", [](HistoricalDataStorage& s) { return s.enableStatistics(); } },
+        { "quantiles", [](HistoricalDataStorage& s) { return s.enableQuantiles(); } },
+        { "episodes", [](HistoricalDataStorage& s) { return s.enableEpisodes(); } },
+        { "profile", [](HistoricalDataStorage& s) { return s.enableProfile(); } },
+    };
+
+    size_t total = 0;
+    for (const auto& index : indexes) {
+        BenchHeapScope scope;
+        TEST_ASSERT_TRUE(index.enable(storage));
+        BenchHeap heap = scope.heap();
+        benchReport("%-18s %6zu bytes in %zu allocations", index.name, heap.bytes, heap.allocations);
+        total += heap.bytes;
+    }
+    benchReport("all indexes: %.1f KB (quantile sketches are part of the storage object: %zu bytes)",
+                total / 1024.0, storage.getQuantiles().getMemoryBytes());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_growing_vector);
+    RUN_TEST(bench_heap_ring);
+    RUN_TEST(bench_static_ring);
+    RUN_TEST(bench_index_heap);
+    return UNITY_END();
+}
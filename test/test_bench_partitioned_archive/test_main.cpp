@@ -0,0 +1,90 @@
+/*
+ * test/test_bench_partitioned_archive/test_main.cpp
+ * SD card archive with a week of 10 s readings in daily partitions: bytes per record on
+ * the card, and what a one-hour query reads through the sparse index against a full scan
+ */
+
+#include <unity.h>
+#include <vector>
+#include "Bench.h"
+#include "MemoryFileSystem.h"
+#include "SensorTrace.h"
+#include "storage/PartitionedArchive.h"
+
+static const size_t DAY_RECORDS = 8640;
+static const size_t DAYS = 7;
+static const size_t HOUR_RECORDS = 360;
+static const size_t QUERIES = 100;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_week_on_card(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive");
+    TEST_ASSERT_TRUE(archive.begin());
+
+    SensorTrace trace(8);
+    std::vector<uint64_t> uptimes;
+    double write_us = benchMicros(DAYS * DAY_RECORDS, [&](size_t sequence) {
+        SensorRecord record = trace.next();
+        uptimes.push_back(record.getUptime());
+        archive.append(record, sequence);
+    });
+    TEST_ASSERT_TRUE(archive.flush());
+
+    size_t card_bytes = 0;
+    for (const auto& file : fs.files) {
+        card_bytes += file.second.size();
+    }
+    const PartitionedArchive::Stats& stats = archive.getStats();
+    benchReport("%zu records: %zu partitions, %lu blocks, %.2f bytes per record on the card "
+                "(%zu-byte records), %.3f us per append",
+                uptimes.size(), archive.getPartitionCount(), (unsigned long)stats.blocks_written,
+                (float)card_bytes / uptimes.size(), sizeof(SensorRecord), write_us);
+
+    // One-hour ranges spread over the week: index lookups, then only the blocks in range
+    uint32_t blocks_before = stats.blocks_read;
+    fs.bytes_read = 0;
+    size_t records_read = 0;
+    double query_us = benchMicros(QUERIES, [&](size_t query) {
+        size_t first = (query * 7919) % (uptimes.size() - HOUR_RECORDS);
+        uint32_t start = archive.lowerBoundSequence(uptimes[first]);
+        uint32_t end = archive.upperBoundSequence(uptimes[first + HOUR_RECORDS - 1]);
+        PartitionedArchive::Reader reader;
+        SensorRecord record;
+        for (uint32_t sequence = start; sequence < end; sequence++) {
+            records_read += archive.read(sequence, reader, record);
+            benchKeep(record);
+        }
+    });
+    TEST_ASSERT_EQUAL_size_t(QUERIES * HOUR_RECORDS, records_read);
+    float blocks_per_query = (float)(stats.blocks_read - blocks_before) / QUERIES;
+    size_t query_bytes = fs.bytes_read / QUERIES;
+    benchReport("1 h query: %.1f blocks and %zu bytes read, %.1f us", blocks_per_query, query_bytes, query_us);
+
+    // The same question answered by reading the whole week
+    fs.bytes_read = 0;
+    double scan_us = benchMicros(1, [&](size_t) {
+        PartitionedArchive::Reader reader;
+        SensorRecord record;
+        for (uint32_t sequence = archive.getFirstSequence(); sequence < archive.getEndSequence(); sequence++) {
+            archive.read(sequence, reader, record);
+            benchKeep(record);
+        }
+    });
+    benchReport("full scan: %zu bytes read, %.1f us (%.0fx the bytes of an indexed 1 h query)",
+                fs.bytes_read, scan_us, (double)fs.bytes_read / query_bytes);
+    TEST_ASSERT_LESS_THAN(fs.bytes_read / 50, query_bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_week_on_card);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+/*
+ * test/test_bench_range_query/test_main.cpp
+ * Uptime range lookups at 600, 10k and 500k records: binary-searched RecordView and
+ * queryByUptimeRange against the linear scan + std::sort they replaced
+ */
+
+#include <unity.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "Bench.h"
+#include "storage/HistoricalDataStorage.h"
+#include "ReadingSeries.h"
+
+static const uint64_t INTERVAL = 10000;          // 10 s between readings
+static const size_t RANGE_RECORDS = 360;         // One hour
+static const size_t QUERIES = 200;
+
+static const ReadingSeries series = { INTERVAL, 1, 600, 21.0f };
+
+// The query before binary search: every record visited, matches copied, then sorted
+static std::vector<SensorRecord> linearQuery(const RecordView& all, uint64_t start, uint64_t end) {
+    std::vector<SensorRecord> result;
+    for (size_t i = 0; i < all.size(); i++) {
+        uint64_t uptime = all[i].getUptime();
+        if (uptime >= start && uptime <= end) {
+            result.push_back(all[i]);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const SensorRecord& a, const SensorRecord& b) {
+        return a.getUptime() < b.getUptime();
+    });
+    return result;
+}
+
+// Rings past MAX_RECORDS_FLASH are static storages (SD-sized ring on a PSRAM build)
+template <size_t N>
+static void benchmarkRecords() {
+    std::unique_ptr<StaticHistoricalDataStorage<N>> ring(new StaticHistoricalDataStorage<N>("ram_only"));
+    HistoricalDataStorage& storage = *ring;
+    TEST_ASSERT_TRUE(storage.initialize());
+    const size_t capacity = N;
+
+    // Wrapped ring, so ranges cross the wrap point too
+    uint32_t stored = capacity + capacity / 3;
+    for (uint32_t i = 0; i < stored; i++) {
+        storage.storeReading(series.at(i));
+    }
+
+    RecordView all = storage.viewByUptimeRange(0, UINT64_MAX);
+    uint64_t first = all[0].getUptime();
+    size_t span = min(RANGE_RECORDS, capacity);
+
+    auto rangeStart = [&](size_t query) {
+        return first + (query * 7919 % (capacity - span + 1)) * INTERVAL;
+    };
+
+    size_t checked = 0;
+    double view_us = benchMicros(QUERIES, [&](size_t query) {
+        uint64_t start = rangeStart(query);
+        RecordView view = storage.viewByUptimeRange(start, start + (span - 1) * INTERVAL);
+        checked += view.size();
+        benchKeep(view);
+    });
+    TEST_ASSERT_EQUAL_size_t(QUERIES * span, checked);
+
+    double copy_us = benchMicros(QUERIES, [&](size_t query) {
+        uint64_t start = rangeStart(query);
+        std::vector<SensorRecord> records = storage.queryByUptimeRange(start, start + (span - 1) * INTERVAL);
+        benchKeep(records);
+    });
+
+    size_t linear_queries = capacity > 100000 ? QUERIES / 20 : QUERIES;
+    double linear_us = benchMicros(linear_queries, [&](size_t query) {
+        uint64_t start = rangeStart(query);
+        std::vector<SensorRecord> records = linearQuery(all, start, start + (span - 1) * INTERVAL);
+        TEST_ASSERT_EQUAL_size_t(span, records.size());
+        benchKeep(records);
+    });
+
+    benchReport("%7zu records, %zu-record range: view %.2f us, copy %.2f us, linear scan + sort %.1f us (%.0fx)",
+                capacity, span, view_us, copy_us, linear_us, linear_us / copy_us);
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_range_query_600(void) {
+    benchmarkRecords<600>();
+}
+
+void bench_range_query_10k(void) {
+    benchmarkRecords<10000>();
+}
+
+void bench_range_query_500k(void) {
+    benchmarkRecords<500000>();
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_range_query_600);
+    RUN_TEST(bench_range_query_10k);
+    RUN_TEST(bench_range_query_500k);
+    return UNITY_END();
+}
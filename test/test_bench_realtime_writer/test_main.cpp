@@ -0,0 +1,175 @@
+/*
+ * test/test_bench_realtime_writer/test_main.cpp
+ * Realtime sensor_data formatting per measurement cycle (one CO2 and one VOC message,
+ * and the snapshot of both): heap allocations and microseconds, against the JsonDocument
+ * messages RealtimeWriter replaced
+ */
+
+#define BENCH_COUNT_ALLOCATIONS
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "Bench.h"
+#include "communication/RealtimeWriter.h"
+
+static const size_t CYCLES = 200000;
+
+static RealtimeWriter writer;
+static String device_id("AQM-0123456789AB");
+
+// ArduinoJson takes its pool from malloc(), not operator new - count it here
+// (a pool that grows in place still counts as an allocation)
+class BenchJsonAllocator : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override {
+        bench_heap.allocations++;
+        bench_heap.bytes += size;
+        return malloc(size);
+    }
+
+    void deallocate(void* pointer) override {
+        free(pointer);
+    }
+
+    void* reallocate(void* pointer, size_t new_size) override {
+        bench_heap.allocations++;
+        bench_heap.bytes += new_size;
+        return realloc(pointer, new_size);
+    }
+};
+
+static BenchJsonAllocator json_allocator;
+
+static void addReading(JsonObject readings, const char* key, float value, const char* unit,
+                       double accuracy, const char* status) {
+    JsonObject reading = readings[key].to<JsonObject>();
+    reading["value"] = value;
+    reading["unit"] = unit;
+    reading["accuracy"] = accuracy;
+    reading["status"] = status;
+}
+
+// The sensor_data message as BluetoothComm built it before RealtimeWriter: a JsonDocument
+// per message, serialized into a new String
+static size_t formatWithJsonDocument(const SensorDataBase& data, uint32_t timestamp) {
+    JsonDocument doc(&json_allocator);
+    doc["type"] = "sensor_data";
+    doc["timestamp"] = timestamp;
+    doc["device_id"] = device_id;
+    JsonObject readings = doc["readings"].to<JsonObject>();
+
+    if (data.getType() == SensorType::CO2_TEMP_HUMIDITY) {
+        const CO2SensorData& co2 = static_cast<const CO2SensorData&>(data);
+        addReading(readings, "co2", co2.co2, "ppm", 0.95, co2.isDataValid() ? "valid" : "invalid");
+        addReading(readings, "temperature", co2.temperature, "celsius", 0.98, "valid");
+        addReading(readings, "humidity", co2.humidity, "percent", 0.92, "valid");
+    } else {
+        const VOCSensorData& voc = static_cast<const VOCSensorData&>(data);
+        addReading(readings, "voc", voc.vocEstimate, "ppb", 0.85, voc.gasValid ? "valid" : "invalid");
+        addReading(readings, "temperature", voc.temperature, "celsius", 0.98, "valid");
+        addReading(readings, "humidity", voc.humidity, "percent", 0.92, "valid");
+        addReading(readings, "pressure", voc.pressure / 100.0, "hPa", 0.99, "valid");
+    }
+
+    String message;
+    serializeJson(doc, message);
+    benchKeep(message.c_str()[message.length() - 1]);
+    return message.length() + 1;   // Sent with println()
+}
+
+static CO2SensorData co2Reading() {
+    CO2SensorData data;
+    data.setValid(true);
+    data.co2 = 612.0f;
+    data.temperature = 22.37f;
+    data.humidity = 45.5f;
+    return data;
+}
+
+static VOCSensorData vocReading() {
+    VOCSensorData data;
+    data.setValid(true);
+    data.temperature = -3.2f;
+    data.humidity = 58.75f;
+    data.pressure = 101325.0f;
+    data.gasResistance = 50000.0f;
+    data.vocEstimate = 85.4f;
+    data.gasValid = true;
+    return data;
+}
+
+void setUp(void) {
+    writer.setDeviceId(device_id);
+}
+
+void tearDown(void) {}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_json_document_messages_per_cycle(void) {
+    CO2SensorData co2 = co2Reading();
+    VOCSensorData voc = vocReading();
+    size_t bytes = 0;
+
+    BenchHeapScope scope;
+    double us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.co2 = 420.0f + cycle % 1500;
+        voc.vocEstimate = (cycle % 400) * 0.61f;
+        bytes += formatWithJsonDocument(co2, cycle);
+        bytes += formatWithJsonDocument(voc, cycle);
+    });
+    BenchHeap heap = scope.heap();
+
+    benchReport("JsonDocument (before): %.3f us per cycle, %.1f bytes per cycle, %zu allocations in %zu cycles",
+                us, (double)bytes / CYCLES, heap.allocations, CYCLES);
+    TEST_ASSERT_GREATER_THAN(0, heap.allocations);
+}
+
+void bench_messages_per_cycle(void) {
+    CO2SensorData co2 = co2Reading();
+    VOCSensorData voc = vocReading();
+    size_t bytes = 0;
+
+    BenchHeapScope scope;
+    double us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.co2 = 420.0f + cycle % 1500;
+        voc.vocEstimate = (cycle % 400) * 0.61f;
+        bytes += writer.format(co2, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+        bytes += writer.format(voc, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+    });
+    BenchHeap heap = scope.heap();
+
+    benchReport("CO2 + VOC messages: %.3f us per cycle, %.1f bytes per cycle, %zu allocations in %zu cycles",
+                us, (double)bytes / CYCLES, heap.allocations, CYCLES);
+    TEST_ASSERT_EQUAL_size_t(0, heap.allocations);
+}
+
+void bench_snapshot_per_cycle(void) {
+    CO2SensorData co2 = co2Reading();
+    VOCSensorData voc = vocReading();
+    size_t bytes = 0;
+
+    BenchHeapScope scope;
+    double us = benchMicros(CYCLES, [&](size_t cycle) {
+        co2.temperature = 18.0f + (cycle % 700) * 0.013f;
+        voc.pressure = 98000.0f + (cycle % 5000) * 1.7f;
+        bytes += writer.formatSnapshot(&co2, &voc, cycle);
+        benchKeep(writer.data()[writer.length() - 1]);
+    });
+    BenchHeap heap = scope.heap();
+
+    benchReport("snapshot message:   %.3f us per cycle, %.1f bytes per cycle, %zu allocations in %zu cycles",
+                us, (double)bytes / CYCLES, heap.allocations, CYCLES);
+    TEST_ASSERT_EQUAL_size_t(0, heap.allocations);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_json_document_messages_per_cycle);
+    RUN_TEST(bench_messages_per_cycle);
+    RUN_TEST(bench_snapshot_per_cycle);
+    return UNITY_END();
+}
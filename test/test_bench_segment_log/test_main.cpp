@@ -0,0 +1,93 @@
+/*
+ * test/test_bench_segment_log/test_main.cpp
+ * Segment log write amplification: bytes that reach the file system per payload byte
+ * and file writes per record, for a few batch sizes, with segment rotation
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include "Bench.h"
+#include "SensorTrace.h"
+#include "storage/SegmentLog.h"
+#include "storage/FileSystems.h"
+#include "TempDirectory.h"
+
+static const size_t RECORDS = 5000;
+static const size_t FLASH_BLOCK = 4096;          // LittleFS block on the ESP32 flash partition
+
+static TempDirectory directory;
+
+// Host directory that counts file writes and models their flash cost: LittleFS cannot
+// program a block it already closed, so each append copies the file's partial tail block
+class CountingFileSystem : public PosixFileSystem {
+public:
+    size_t writes = 0;
+    size_t modeled_flash_bytes = 0;
+
+    CountingFileSystem(const String& root_directory) : PosixFileSystem(root_directory) {}
+
+    bool append(const String& path, const uint8_t* data, size_t length) override {
+        writes++;
+        modeled_flash_bytes += fileSize(path) % FLASH_BLOCK + length;
+        return PosixFileSystem::append(path, data, length);
+    }
+    bool writeAt(const String& path, size_t offset, const uint8_t* data, size_t length) override {
+        writes++;
+        modeled_flash_bytes += length;
+        return PosixFileSystem::writeAt(path, offset, data, length);
+    }
+};
+
+void setUp(void) {
+    directory.create("seg");
+}
+
+void tearDown(void) {
+    directory.remove();
+}
+
+static void benchmarkBatch(size_t batch) {
+    CountingFileSystem fs(directory.path());
+    SegmentLog log(fs, "/history", SegmentLog::DEFAULT_SEGMENT_BYTES, SegmentLog::DEFAULT_MAX_SEGMENTS, batch);
+    TEST_ASSERT_TRUE(log.begin());
+
+    SensorTrace trace(7);
+    double append_us = benchMicros(RECORDS, [&](size_t sequence) {
+        log.append(trace.next(), sequence);
+    });
+    TEST_ASSERT_TRUE(log.flush());
+
+    const SegmentLog::Stats& stats = log.getStats();
+    TEST_ASSERT_EQUAL_UINT32(RECORDS, stats.records_appended);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.write_errors);
+    float amplification = (float)fs.getBytesAppended() / stats.payload_bytes;
+    benchReport("batch %2zu: %.3f file bytes per payload byte (log counts %.3f), %.3f writes per record, "
+                "%.1f modeled flash bytes per payload byte, %.2f us per append",
+                batch, amplification, stats.getWriteAmplification(), (float)fs.writes / RECORDS,
+                (float)fs.modeled_flash_bytes / stats.payload_bytes, append_us);
+    TEST_ASSERT_LESS_THAN(1.2f, amplification);
+}
+
+// ================================
+// BENCHMARKS
+// ================================
+
+void bench_unbatched(void) {
+    benchmarkBatch(1);
+}
+
+void bench_batch_10(void) {
+    benchmarkBatch(10);
+}
+
+void bench_default_batch(void) {
+    benchmarkBatch(SegmentLog::DEFAULT_BATCH_RECORDS);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_unbatched);
+    RUN_TEST(bench_batch_10);
+    RUN_TEST(bench_default_batch);
+    return UNITY_END();
+}
@@ -0,0 +1,219 @@
+/*
+ * test/test_binary_frame/test_main.cpp
+ * FrameEncoder/FrameDecoder round trips: COBS block boundaries, oversize frames, CRC errors
+ */
+
+#include <unity.h>
+#include <vector>
+#include "communication/BinaryFrame.h"
+#include "utils/Checksum.h"
+
+// Collects what the encoder sends to the link
+class WireBuffer : public Print {
+public:
+    std::vector<uint8_t> bytes;
+
+    size_t write(uint8_t c) override {
+        bytes.push_back(c);
+        return 1;
+    }
+    using Print::write;
+};
+
+static std::vector<uint8_t> encodeFrame(uint8_t type, const std::vector<uint8_t>& payload) {
+    WireBuffer wire;
+    FrameEncoder encoder(wire);
+    encoder.begin(type);
+    encoder.write(payload.data(), payload.size());
+    size_t wire_bytes = encoder.end();
+    TEST_ASSERT_EQUAL_size_t(wire.bytes.size(), wire_bytes);
+    return wire.bytes;
+}
+
+// Feeds a whole frame, true when its delimiter completed a valid frame
+static bool feedFrame(FrameDecoder& decoder, const std::vector<uint8_t>& wire) {
+    for (size_t i = 0; i + 1 < wire.size(); i++) {
+        TEST_ASSERT_FALSE(decoder.feed(wire[i]));
+    }
+    return decoder.feed(wire.back());
+}
+
+static void assertRoundTrip(uint8_t type, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> wire = encodeFrame(type, payload);
+
+    // Exactly one zero, at the end
+    for (size_t i = 0; i + 1 < wire.size(); i++) {
+        TEST_ASSERT_TRUE(wire[i] != 0);
+    }
+    TEST_ASSERT_EQUAL_UINT8(0, wire.back());
+
+    FrameDecoder decoder;
+    TEST_ASSERT_TRUE(feedFrame(decoder, wire));
+    TEST_ASSERT_EQUAL_UINT8(type, decoder.type());
+    TEST_ASSERT_EQUAL_size_t(payload.size(), decoder.payloadLength());
+    if (!payload.empty()) {
+        TEST_ASSERT_EQUAL_MEMORY(payload.data(), decoder.payload(), payload.size());
+    }
+}
+
+// Non-zero payload whose frame (type + payload + CRC) has no zero byte at all
+static std::vector<uint8_t> nonZeroFrame(uint8_t type, size_t length) {
+    std::vector<uint8_t> payload(length);
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = 1 + i % 255;
+    }
+    for (uint8_t last = 1; last != 0; last++) {
+        payload.back() = last;
+        uint16_t crc = crc16Ccitt(&type, 1);
+        crc = crc16Ccitt(payload.data(), payload.size(), crc);
+        if ((crc >> 8) != 0 && (crc & 0xFF) != 0) {
+            return payload;
+        }
+    }
+    TEST_FAIL_MESSAGE("No zero-free CRC found");
+    return payload;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_empty_and_short_payloads(void) {
+    assertRoundTrip(BinaryFrame::TYPE_JSON, {});
+    assertRoundTrip(BinaryFrame::TYPE_JSON, { 0x00 });
+    assertRoundTrip(BinaryFrame::TYPE_JSON, { 0x00, 0x00, 0x00 });
+    assertRoundTrip(BinaryFrame::TYPE_JSON, { '{', '}' });
+}
+
+void test_payload_ending_in_zero(void) {
+    assertRoundTrip(BinaryFrame::TYPE_SENSOR_DATA, { 0x21, 0x01, 0x7F, 0x00 });
+    assertRoundTrip(BinaryFrame::TYPE_SENSOR_DATA, { 0x11, 0x22, 0x00, 0x00 });
+}
+
+void test_full_block_followed_by_empty_block(void) {
+    // Type + 251 bytes + CRC = 254 non-zero bytes: one 0xFF block, then an empty 0x01 block
+    std::vector<uint8_t> payload = nonZeroFrame(BinaryFrame::TYPE_JSON, 251);
+    std::vector<uint8_t> wire = encodeFrame(BinaryFrame::TYPE_JSON, payload);
+
+    TEST_ASSERT_EQUAL_size_t(1 + 254 + 1 + 1, wire.size());
+    TEST_ASSERT_EQUAL_HEX8(0xFF, wire[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, wire[255]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, wire[256]);
+    assertRoundTrip(BinaryFrame::TYPE_JSON, payload);
+}
+
+void test_block_boundaries(void) {
+    // Zero-free runs either side of the 254-byte block limit, with and without a zero after them
+    for (size_t length = 250; length <= 512 - 8; length += 1) {
+        std::vector<uint8_t> payload(length);
+        for (size_t i = 0; i < length; i++) {
+            payload[i] = 1 + (i * 7) % 255;
+        }
+        assertRoundTrip(BinaryFrame::TYPE_JSON, payload);
+        payload.back() = 0;
+        assertRoundTrip(BinaryFrame::TYPE_JSON, payload);
+    }
+}
+
+void test_frame_over_max_is_dropped_and_decoder_resynchronizes(void) {
+    std::vector<uint8_t> large(FrameDecoder::MAX_FRAME, 'x');
+    std::vector<uint8_t> wire = encodeFrame(BinaryFrame::TYPE_JSON, large);
+    TEST_ASSERT_GREATER_THAN(FrameDecoder::MAX_FRAME + 1, wire.size());
+
+    FrameDecoder decoder;
+    TEST_ASSERT_FALSE(feedFrame(decoder, wire));
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getDropped());
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getCrcErrors());
+
+    // The next frame decodes normally
+    std::vector<uint8_t> small = { 'o', 'k' };
+    TEST_ASSERT_TRUE(feedFrame(decoder, encodeFrame(BinaryFrame::TYPE_JSON, small)));
+    TEST_ASSERT_EQUAL_size_t(2, decoder.payloadLength());
+    TEST_ASSERT_EQUAL_MEMORY(small.data(), decoder.payload(), small.size());
+}
+
+void test_crc_mismatch_is_counted(void) {
+    std::vector<uint8_t> payload = { 'h', 'e', 'l', 'l', 'o' };
+    std::vector<uint8_t> wire = encodeFrame(BinaryFrame::TYPE_JSON, payload);
+    wire[3] ^= 0x01;   // A data byte ('e' -> 'd'), still non-zero
+
+    FrameDecoder decoder;
+    TEST_ASSERT_FALSE(feedFrame(decoder, wire));
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getCrcErrors());
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getDropped());
+}
+
+void test_cobs_error_is_dropped(void) {
+    std::vector<uint8_t> wire = encodeFrame(BinaryFrame::TYPE_JSON, { 'a', 'b' });
+    wire[0] = 0x20;   // Code points past the end of the frame
+
+    FrameDecoder decoder;
+    TEST_ASSERT_FALSE(feedFrame(decoder, wire));
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getDropped());
+}
+
+void test_typed_fields_round_trip(void) {
+    WireBuffer wire;
+    FrameEncoder encoder(wire);
+    encoder.begin(BinaryFrame::TYPE_SENSOR_DATA);
+    encoder.addUint(BinaryFrame::FIELD_TIMESTAMP, 0x123456789ULL);
+    encoder.addUint(BinaryFrame::FIELD_SENSOR_TYPE, 0);
+    encoder.addInt(0x05, -2);
+    encoder.addInt(0x06, -40000);
+    encoder.addFloat(BinaryFrame::FIELD_CO2, 612.5f);
+    encoder.addBytes(0x07, (const uint8_t*)"id", 2);
+    encoder.end();
+
+    FrameDecoder decoder;
+    TEST_ASSERT_TRUE(feedFrame(decoder, wire.bytes));
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::TYPE_SENSOR_DATA, decoder.type());
+
+    size_t offset = 0;
+    FrameField field;
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::KIND_UINT, field.kind);
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::FIELD_TIMESTAMP, field.field);
+    TEST_ASSERT_EQUAL_UINT8(8, field.length);
+    TEST_ASSERT_EQUAL_UINT64(0x123456789ULL, field.asUint());
+
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(1, field.length);
+    TEST_ASSERT_EQUAL_UINT64(0, field.asUint());
+
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::KIND_INT, field.kind);
+    TEST_ASSERT_EQUAL_UINT8(1, field.length);
+    TEST_ASSERT_EQUAL_INT64(-2, field.asInt());
+
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(4, field.length);
+    TEST_ASSERT_EQUAL_INT64(-40000, field.asInt());
+
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::KIND_FLOAT, field.kind);
+    TEST_ASSERT_EQUAL_FLOAT(612.5f, field.asFloat());
+
+    TEST_ASSERT_TRUE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_UINT8(BinaryFrame::KIND_BYTES, field.kind);
+    TEST_ASSERT_EQUAL_UINT8(2, field.length);
+    TEST_ASSERT_EQUAL_MEMORY("id", field.value, 2);
+
+    TEST_ASSERT_FALSE(decoder.nextField(offset, field));
+    TEST_ASSERT_EQUAL_size_t(decoder.payloadLength(), offset);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_and_short_payloads);
+    RUN_TEST(test_payload_ending_in_zero);
+    RUN_TEST(test_full_block_followed_by_empty_block);
+    RUN_TEST(test_block_boundaries);
+    RUN_TEST(test_frame_over_max_is_dropped_and_decoder_resynchronizes);
+    RUN_TEST(test_crc_mismatch_is_counted);
+    RUN_TEST(test_cobs_error_is_dropped);
+    RUN_TEST(test_typed_fields_round_trip);
+    return UNITY_END();
+}
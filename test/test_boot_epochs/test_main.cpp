@@ -0,0 +1,225 @@
+/*
+ * test/test_boot_epochs/test_main.cpp
+ * Boot epochs and the storage clock: per-boot time offsets, boots that were never
+ * synchronized, timestamps in the downtime between boots, history restored over
+ * several reboots, and the 64-bit millis() across its 32-bit wrap
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+#include "MemoryFileSystem.h"
+#include "ReadingSeries.h"
+
+static const uint64_t INTERVAL = 10000;                    // 10 s between readings
+static const uint64_t OFFSET_A = 1695120000000ULL;         // Unix ms at uptime 0 of the first boot
+static const uint64_t OFFSET_C = OFFSET_A + 86400000ULL;   // Third boot, a day later
+
+// Reading number index of the whole test, taken at uptime of its own boot
+static SensorRecord reading(uint64_t uptime, uint32_t index) {
+    SensorRecord record = ReadingSeries().at(index);
+    record.setUptime(uptime);
+    return record;
+}
+
+static TimeSync syncedClock(uint64_t time_offset) {
+    TimeSync timeSync;
+    timeSync.has_time = true;
+    timeSync.time_offset = time_offset;
+    return timeSync;
+}
+
+// One boot on the shared file system: restore, store count readings at boot uptimes
+// INTERVAL, 2 * INTERVAL, ..., synchronize if time_offset is set, flush
+static uint64_t runBoot(MemoryFileSystem& fs, uint32_t first_index, uint32_t count, uint64_t time_offset) {
+    HistoricalDataStorage storage("flash", 200);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enablePersistence(fs, "/history"));
+    uint64_t clock_offset = storage.getClockOffset();
+
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * (i + 1), first_index + i)));
+    }
+    if (time_offset) {
+        storage.noteTimeSync(syncedClock(time_offset));
+    }
+    TEST_ASSERT_TRUE(storage.flush());
+    return clock_offset;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_each_epoch_keeps_its_offset(void) {
+    BootEpochTable table;
+    table.begin(0, 0, 11);
+    TEST_ASSERT_TRUE(table.setCurrentOffset(OFFSET_A));
+    table.begin(601000, 60, 22);                 // Never synchronized
+    table.begin(902000, 90, 33);
+
+    uint64_t current = OFFSET_C - 902000;       // Live offset of the current boot
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 5000, table.toTimestamp(5000, current));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 600000, table.toTimestamp(600000, current));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_C + 10000, table.toTimestamp(912000, current));
+
+    // The unsynced boot borrows the next synced one's offset, as if there had been no downtime
+    TEST_ASSERT_EQUAL_UINT64(current + 611000, table.toTimestamp(611000, current));
+    TEST_ASSERT_LESS_THAN(table.toTimestamp(902000, current), table.toTimestamp(901000, current));
+
+    // Back again
+    TEST_ASSERT_EQUAL_UINT64(5000, table.toUptime(OFFSET_A + 5000, current));
+    TEST_ASSERT_EQUAL_UINT64(611000, table.toUptime(current + 611000, current));
+    TEST_ASSERT_EQUAL_UINT64(912000, table.toUptime(OFFSET_C + 10000, current));
+
+    // Downtime after the first boot maps to its end; before all history there is nothing
+    TEST_ASSERT_EQUAL_UINT64(600999, table.toUptime(OFFSET_A + 4200000, current));
+    TEST_ASSERT_EQUAL_UINT64(0, table.toUptime(OFFSET_A - 1, current));
+
+    // Without the live offset the current boot has none of its own: the earlier synced one is used
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 912000, table.toTimestamp(912000, 0));
+}
+
+void test_unsynced_history_has_no_timestamps(void) {
+    BootEpochTable table;
+    TEST_ASSERT_EQUAL_UINT64(0, table.toTimestamp(5000, 0));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 5000, table.toTimestamp(5000, OFFSET_A));
+
+    table.begin(0, 0, 11);
+    table.begin(601000, 60, 22);
+    TEST_ASSERT_EQUAL_UINT64(0, table.toTimestamp(5000, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, table.toUptime(OFFSET_A, 0));
+
+    // A sync in the current boot dates the earlier boot too
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 5000, table.toTimestamp(5000, OFFSET_A));
+}
+
+void test_offset_changes_are_reported_past_a_second(void) {
+    BootEpochTable table;
+    TEST_ASSERT_FALSE(table.setCurrentOffset(OFFSET_A));   // No epoch yet
+    table.begin(0, 0, 11);
+    TEST_ASSERT_TRUE(table.setCurrentOffset(OFFSET_A));
+    TEST_ASSERT_FALSE(table.setCurrentOffset(OFFSET_A + 800));
+    TEST_ASSERT_FALSE(table.setCurrentOffset(OFFSET_A - 150));
+    TEST_ASSERT_TRUE(table.setCurrentOffset(OFFSET_A + 2000));
+    TEST_ASSERT_FALSE(table.setCurrentOffset(0));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 2000, table.current().time_offset);
+}
+
+void test_full_table_drops_oldest_epoch(void) {
+    BootEpochTable table;
+    for (uint32_t boot = 0; boot < BootEpochTable::MAX_EPOCHS + 3; boot++) {
+        table.begin(boot * 1000000ULL, boot * 10, boot + 1);
+        table.setCurrentOffset(OFFSET_A + boot * 86400000ULL);
+    }
+
+    TEST_ASSERT_EQUAL_UINT8(BootEpochTable::MAX_EPOCHS, table.count);
+    TEST_ASSERT_EQUAL_UINT32(4, table.epochs[0].boot_id);
+    TEST_ASSERT_EQUAL_size_t(table.count, table.findBoot(1));
+    TEST_ASSERT_EQUAL_size_t(0, table.findBoot(4));
+    TEST_ASSERT_EQUAL_size_t(table.count - 1, table.findBoot(BootEpochTable::MAX_EPOCHS + 3));
+
+    // Uptimes before the oldest remaining epoch use its offset
+    TEST_ASSERT_EQUAL_size_t(0, table.find(0));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 3 * 86400000ULL + 500, table.toTimestamp(500, 0));
+}
+
+void test_history_restored_over_reboots_keeps_timestamps(void) {
+    MemoryFileSystem fs;
+    uint64_t first = runBoot(fs, 0, 60, OFFSET_A);    // 10 min, synchronized
+    uint64_t second = runBoot(fs, 60, 30, 0);         // 5 min, never synchronized
+    uint64_t third = runBoot(fs, 90, 30, 0);
+    TEST_ASSERT_EQUAL_UINT64(0, first);
+    TEST_ASSERT_EQUAL_UINT64(60 * INTERVAL + 1000, second);
+    TEST_ASSERT_EQUAL_UINT64(second + 30 * INTERVAL + 1000, third);
+
+    // Fourth look at the same history, synchronized a day after the first boot
+    HistoricalDataStorage storage("flash", 200);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enablePersistence(fs, "/history"));
+    uint64_t fourth = storage.getClockOffset();
+    TimeSync timeSync = syncedClock(OFFSET_C);
+    storage.noteTimeSync(timeSync);
+
+    const BootEpochTable& epochs = storage.getEpochs();
+    TEST_ASSERT_EQUAL_UINT8(4, epochs.count);
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A, epochs.epochs[0].time_offset);
+    TEST_ASSERT_EQUAL_UINT64(0, epochs.epochs[1].time_offset);
+    TEST_ASSERT_EQUAL_UINT64(second, epochs.epochs[1].start_uptime);
+    TEST_ASSERT_EQUAL_UINT32(60, epochs.epochs[1].start_sequence);
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_C - fourth, epochs.current().time_offset);
+    for (size_t i = 1; i < epochs.count; i++) {
+        TEST_ASSERT_TRUE(epochs.epochs[i].boot_id != epochs.epochs[i - 1].boot_id);
+    }
+
+    // First boot: the wall clock it was synchronized with, both ways
+    HistoryCursor cursor = storage.openCursor(0, UINT64_MAX);
+    SensorRecord record;
+    uint64_t previous_timestamp = 0;
+    uint32_t index = 0;
+    while (cursor.next(record)) {
+        TEST_ASSERT_EQUAL_FLOAT(400 + index, record.getCo2());
+        uint64_t timestamp = storage.toTimestamp(timeSync, record.getUptime());
+        if (index < 60) {
+            TEST_ASSERT_EQUAL_UINT64(OFFSET_A + INTERVAL * (index + 1), timestamp);
+            TEST_ASSERT_EQUAL_UINT64(record.getUptime(), storage.toStorageUptime(timeSync, timestamp));
+        }
+        // Unsynced boots sit before the fourth boot's start, still in storage order
+        TEST_ASSERT_GREATER_THAN(previous_timestamp, timestamp);
+        TEST_ASSERT_LESS_THAN(OFFSET_C, timestamp);
+        previous_timestamp = timestamp;
+        index++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(120, index);
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_C - 1000, previous_timestamp);
+
+    // The current boot's readings go on at OFFSET_C + boot uptime
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL, 120)));
+    std::vector<SensorRecord> latest = storage.queryLatest(1);
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_C + INTERVAL, storage.toTimestamp(timeSync, latest[0].getUptime()));
+
+    // Time range query over the first boot's wall clock finds exactly its readings
+    native_millis = INTERVAL;
+    TimeRange range;
+    range.start_time = OFFSET_A + INTERVAL;
+    range.end_time = OFFSET_A + 60 * INTERVAL;
+    std::vector<SensorRecord> records = storage.queryByTimeRange(range, timeSync);
+    TEST_ASSERT_EQUAL_size_t(60, records.size());
+    TEST_ASSERT_EQUAL_FLOAT(400, records.front().getCo2());
+    TEST_ASSERT_EQUAL_FLOAT(459, records.back().getCo2());
+}
+
+// Runs last: millis64() keeps its wrap count for the rest of the process
+void test_millis64_counts_wraps(void) {
+    native_millis = 0xFFFFF000UL;
+    TEST_ASSERT_EQUAL_UINT64(0xFFFFF000ULL, millis64());
+
+    TimeSync timeSync;
+    TEST_ASSERT_TRUE(timeSync.synchronizeTime(OFFSET_A + 0xFFFFF000ULL));
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A, timeSync.time_offset);
+
+    // The 32-bit counter wraps; the 64-bit clock and the timestamps keep going
+    native_millis = 0x1000UL;
+    TEST_ASSERT_EQUAL_UINT64(0x100001000ULL, millis64());
+    TEST_ASSERT_EQUAL_UINT64(OFFSET_A + 0x100001000ULL, timeSync.getCurrentTimestamp());
+    TEST_ASSERT_EQUAL_UINT64(0x100001000ULL, timeSync.timestampToUptime(OFFSET_A + 0x100001000ULL));
+    TEST_ASSERT_EQUAL_UINT32(0x2000 / 60000, timeSync.getSyncAgeMinutes());
+
+    HistoricalDataStorage storage("ram_only", 10);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_EQUAL_UINT64(0x100001000ULL, storage.getCurrentUptime());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_each_epoch_keeps_its_offset);
+    RUN_TEST(test_unsynced_history_has_no_timestamps);
+    RUN_TEST(test_offset_changes_are_reported_past_a_second);
+    RUN_TEST(test_full_table_drops_oldest_epoch);
+    RUN_TEST(test_history_restored_over_reboots_keeps_timestamps);
+    RUN_TEST(test_millis64_counts_wraps);
+    return UNITY_END();
+}
@@ -0,0 +1,249 @@
+/*
+ * test/test_compressed_block/test_main.cpp
+ * Gorilla block codec and CompressedArchive: bit-exact round trips of realistic traces,
+ * NaN, constant runs and large timestamp gaps, block boundaries and uptime bounds
+ */
+
+#include <unity.h>
+#include <vector>
+#include "SensorTrace.h"
+#include "storage/CompressedBlock.h"
+
+static const size_t ARCHIVE_BYTES = 64 * CompressedBlock::BLOCK_BYTES;
+
+// Every record in sequence order, from sequence first on
+static void assertArchiveHolds(const CompressedArchive& archive, const std::vector<SensorRecord>& records,
+                               uint32_t first) {
+    CompressedArchive::Reader reader;
+    for (uint32_t sequence = archive.getFirstSequence(); sequence < archive.getEndSequence(); sequence++) {
+        SensorRecord record;
+        TEST_ASSERT_TRUE(archive.read(sequence, reader, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[sequence - first], &record, sizeof(SensorRecord));
+    }
+}
+
+// Encode into one block until it is full, then decode and compare
+static size_t assertBlockRoundTrip(const std::vector<SensorRecord>& records) {
+    CompressedBlock block;
+    block.reset(0);
+    GorillaState writer;
+    size_t appended = 0;
+    while (appended < records.size() && block.append(records[appended], writer)) {
+        appended++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, appended);
+
+    GorillaState reader;
+    SensorRecord record;
+    for (size_t i = 0; i < appended; i++) {
+        TEST_ASSERT_TRUE(block.decodeNext(reader, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[i], &record, sizeof(SensorRecord));
+    }
+    TEST_ASSERT_FALSE(block.decodeNext(reader, record));
+    return appended;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_realistic_trace_round_trip(void) {
+    SensorTrace trace(7);
+    std::vector<SensorRecord> records;
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(ARCHIVE_BYTES));
+
+    for (uint32_t sequence = 0; sequence < 3000; sequence++) {
+        records.push_back(trace.next());
+        archive.append(records.back(), sequence);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(3000, archive.getRecordCount());
+    assertArchiveHolds(archive, records, 0);
+
+    // Smaller than the raw records by a wide margin in either layout
+    float bytes_per_record = (float)archive.getCompressedBytes() / archive.getRecordCount();
+    char line[96];
+    snprintf(line, sizeof(line), "%.2f bytes per %zu-byte record (ratio %.2f)",
+             bytes_per_record, sizeof(SensorRecord), archive.getCompressionRatio());
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(sizeof(SensorRecord) / 2.0f, bytes_per_record);
+}
+
+void test_nan_values_round_trip(void) {
+    SensorTrace trace(3);
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < 200; i++) {
+        SensorRecord record = trace.next();
+        if (i % 7 == 3) record.setTemperature(NAN);
+        if (i % 11 == 5) record.setCo2(NAN);
+        if (i % 13 >= 6) record.setVoc(NAN);      // Runs of NaN, then back to values
+        if (i % 17 == 0) record.setPressure(-NAN);
+        records.push_back(record);
+    }
+
+    assertBlockRoundTrip(records);
+}
+
+void test_constant_runs_cost_a_few_bits(void) {
+    std::vector<SensorRecord> records;
+    SensorRecord record = SensorTrace(5).next();
+    for (size_t i = 0; i < 400; i++) {
+        record.setUptime(10000 + i * 10000ULL);
+        records.push_back(record);
+    }
+
+    CompressedBlock block;
+    block.reset(0);
+    GorillaState writer;
+    for (const SensorRecord& constant : records) {
+        TEST_ASSERT_TRUE(block.append(constant, writer));
+    }
+
+    // Verbatim first record, one interval (at most 36 bits), then 7 bits per record:
+    // time, flags and one per metric
+    size_t bits = GorillaState::METRIC_COUNT * 32 + 16 + 36 + (records.size() - 1) * 7;
+    TEST_ASSERT_LESS_OR_EQUAL((bits + 7) / 8, block.getUsedBytes());
+    assertBlockRoundTrip(records);
+}
+
+void test_large_timestamp_gaps(void) {
+    // Intervals in native time units (s or ms): delta-of-deltas on both edges of every
+    // prefix bucket (+-63/64, +-255/256, +-2047/2048), a 30-day gap and a repeated uptime
+    static const uint32_t INTERVALS[] = {
+        10, 10, 11, 10, 74, 139, 76, 12, 268, 525, 270, 14,
+        2062, 4111, 2064, 16, 2592000, 10, 0, 10
+    };
+
+    std::vector<SensorRecord> records;
+    SensorTrace trace(9);
+    uint32_t raw_time = 1000;
+    for (uint32_t interval : INTERVALS) {
+        raw_time += interval;
+        SensorRecord record = trace.next();
+        record.setRawTime(raw_time);
+        records.push_back(record);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(records.size(), assertBlockRoundTrip(records));
+}
+
+void test_block_boundary(void) {
+    SensorTrace trace(11);
+    std::vector<SensorRecord> records;
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(ARCHIVE_BYTES));
+
+    // Fill the first block exactly: the record it refuses starts the second one
+    CompressedBlock probe;
+    probe.reset(0);
+    GorillaState writer;
+    uint32_t sequence = 0;
+    while (true) {
+        SensorRecord record = trace.next();
+        records.push_back(record);
+        archive.append(record, sequence++);
+        if (!probe.append(record, writer)) break;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(CompressedBlock::BLOCK_BYTES, probe.getUsedBytes());
+    TEST_ASSERT_EQUAL_size_t(2, archive.getBlockCount());
+    TEST_ASSERT_EQUAL_size_t(records.size(), archive.getRecordCount());
+
+    // Readers continue across the seal and restart when asked to go backwards
+    assertArchiveHolds(archive, records, 0);
+    CompressedArchive::Reader reader;
+    SensorRecord record;
+    TEST_ASSERT_TRUE(archive.read(sequence - 1, reader, record));
+    TEST_ASSERT_TRUE(archive.read(probe.getRecordCount() - 1, reader, record));
+    TEST_ASSERT_EQUAL_MEMORY(&records[probe.getRecordCount() - 1], &record, sizeof(SensorRecord));
+    TEST_ASSERT_FALSE(archive.read(sequence, reader, record));
+
+    // Persisted blocks load back, truncated ones are refused
+    uint8_t stored[CompressedBlock::MAX_STORED_BYTES];
+    size_t length = probe.serialize(stored);
+    CompressedBlock loaded;
+    TEST_ASSERT_FALSE(loaded.deserialize(stored, length - 1));
+    TEST_ASSERT_TRUE(loaded.deserialize(stored, length));
+    TEST_ASSERT_TRUE(loaded.isSealed());
+    GorillaState state;
+    for (size_t i = 0; i < probe.getRecordCount(); i++) {
+        TEST_ASSERT_TRUE(loaded.decodeNext(state, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[i], &record, sizeof(SensorRecord));
+    }
+}
+
+void test_sequence_gap_and_eviction(void) {
+    SensorTrace trace(13);
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(4 * CompressedBlock::BLOCK_BYTES));
+
+    // A gap in sequences starts a new block even with room left
+    archive.append(trace.next(), 0);
+    archive.append(trace.next(), 1);
+    archive.append(trace.next(), 5);
+    TEST_ASSERT_EQUAL_size_t(2, archive.getBlockCount());
+    CompressedArchive::Reader reader;
+    SensorRecord record;
+    TEST_ASSERT_FALSE(archive.read(3, reader, record));
+    TEST_ASSERT_TRUE(archive.read(5, reader, record));
+
+    // Past the budget the oldest block goes, the rest stays readable
+    std::vector<SensorRecord> records(6);
+    for (uint32_t sequence = 6; archive.getBlockCount() < 4 || archive.getFirstSequence() == 0; sequence++) {
+        records.push_back(trace.next());
+        archive.append(records.back(), sequence);
+    }
+    TEST_ASSERT_EQUAL_size_t(4, archive.getBlockCount());
+    TEST_ASSERT_EQUAL_UINT32(5, archive.getFirstSequence());
+    for (uint32_t sequence = 6; sequence < archive.getEndSequence(); sequence++) {
+        TEST_ASSERT_TRUE(archive.read(sequence, reader, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[sequence], &record, sizeof(SensorRecord));
+    }
+}
+
+void test_uptime_bounds_match_linear_scan(void) {
+    SensorTrace trace(17);
+    std::vector<SensorRecord> records;
+    CompressedArchive archive;
+    TEST_ASSERT_TRUE(archive.begin(8 * CompressedBlock::BLOCK_BYTES));
+
+    // Irregular spacing, including equal uptimes, over several blocks and an eviction
+    for (uint32_t sequence = 0; sequence < 2500; sequence++) {
+        records.push_back(trace.next());
+        archive.append(records.back(), sequence);
+        trace.skip(sequence % 97 == 0 ? 600000 : (sequence % 5 == 0 ? -10000 : 0));
+    }
+
+    uint32_t first = archive.getFirstSequence();
+    uint32_t end = archive.getEndSequence();
+    TEST_ASSERT_GREATER_THAN(0, first);
+    uint64_t oldest = records[first].getUptime();
+    uint64_t newest = records[end - 1].getUptime();
+
+    for (uint64_t uptime = oldest - 20000; uptime <= newest + 20000; uptime += 3000) {
+        uint32_t lower = end;
+        uint32_t upper = end;
+        for (uint32_t sequence = end; sequence-- > first;) {
+            if (records[sequence].getUptime() >= uptime) lower = sequence;
+            if (records[sequence].getUptime() > uptime) upper = sequence;
+        }
+        TEST_ASSERT_EQUAL_UINT32(lower, archive.lowerBoundSequence(uptime));
+        TEST_ASSERT_EQUAL_UINT32(upper, archive.upperBoundSequence(uptime));
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_realistic_trace_round_trip);
+    RUN_TEST(test_nan_values_round_trip);
+    RUN_TEST(test_constant_runs_cost_a_few_bits);
+    RUN_TEST(test_large_timestamp_gaps);
+    RUN_TEST(test_block_boundary);
+    RUN_TEST(test_sequence_gap_and_eviction);
+    RUN_TEST(test_uptime_bounds_match_linear_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,126 @@
+/*
+ * test/test_deadband/test_main.cpp
+ * Deadband runs: the held record reaches the archive and the episode index exactly
+ * once, however the run ends
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+
+static const float TOLERANCES[SensorRecord::METRIC_COUNT] = { 10.0f, 0.1f, 0.5f, 0.5f, 1.0f };
+static const uint32_t INTERVAL = 10000;
+
+static SensorRecord reading(uint64_t uptime, float co2, AlertLevel level = AlertLevel::NONE) {
+    SensorRecord record;
+    record.setUptime(uptime);
+    record.setCo2(co2);
+    record.alert_level = (uint8_t)level;
+    record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_OVERALL_VALID;
+    return record;
+}
+
+// Run start at 10 s, then five readings within tolerance: sequence 1 is held until 60 s
+static void storeRun(HistoricalDataStorage& storage, AlertLevel level = AlertLevel::NONE) {
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL, 500, level)));
+    for (int i = 2; i <= 6; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * i, 502 + i % 2, level)));
+    }
+    TEST_ASSERT_EQUAL_size_t(2, storage.getRecordCount());
+    TEST_ASSERT_EQUAL_UINT32(4, storage.getFoldedReadings());
+}
+
+static void assertHeldArchived(const HistoricalDataStorage& storage) {
+    CompressedArchive::Reader reader;
+    SensorRecord held;
+    TEST_ASSERT_TRUE(storage.getArchive().read(1, reader, held));
+    TEST_ASSERT_EQUAL_UINT64(INTERVAL * 6, held.getUptime());
+    TEST_ASSERT_TRUE(held.validity_flags & SensorRecord::FLAG_HELD);
+}
+
+static void setUpStorage(HistoricalDataStorage& storage) {
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableArchive(4096));
+    TEST_ASSERT_TRUE(storage.enableDeadband(TOLERANCES, INTERVAL));
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_run_closed_by_a_change(void) {
+    HistoricalDataStorage storage("ram_only", 32);
+    setUpStorage(storage);
+    storeRun(storage);
+
+    CompressedArchive::Reader reader;
+    SensorRecord record;
+    TEST_ASSERT_FALSE(storage.getArchive().read(1, reader, record));   // Still changing
+
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * 7, 560)));
+    assertHeldArchived(storage);
+}
+
+void test_run_closed_by_reenabling_deadband(void) {
+    HistoricalDataStorage storage("ram_only", 32);
+    setUpStorage(storage);
+    storeRun(storage);
+
+    TEST_ASSERT_TRUE(storage.enableDeadband(TOLERANCES, INTERVAL));
+    assertHeldArchived(storage);
+
+    // The next reading starts a new run instead of folding into the old one
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * 7, 502)));
+    TEST_ASSERT_EQUAL_size_t(3, storage.getRecordCount());
+}
+
+void test_held_record_survives_emptied_ring(void) {
+    HistoricalDataStorage storage("ram_only", 32);
+    setUpStorage(storage);
+    storeRun(storage);
+
+    TEST_ASSERT_TRUE(storage.clearOldData(INTERVAL * 6 + 1));
+    TEST_ASSERT_EQUAL_size_t(0, storage.getRecordCount());
+    assertHeldArchived(storage);
+}
+
+void test_episode_counts_held_record_once(void) {
+    HistoricalDataStorage storage("ram_only", 32);
+    setUpStorage(storage);
+    TEST_ASSERT_TRUE(storage.enableEpisodes());
+    storeRun(storage, AlertLevel::WARNING);
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * 7, 560, AlertLevel::WARNING)));
+
+    const AlertEpisodeIndex& episodes = storage.getEpisodes();
+    TEST_ASSERT_EQUAL_size_t(1, episodes.size());
+    TEST_ASSERT_EQUAL_UINT32(3, episodes.at(0).record_count);   // Run start, held record, change
+    TEST_ASSERT_EQUAL_UINT64(INTERVAL, episodes.at(0).start_uptime);
+    TEST_ASSERT_EQUAL_UINT64(INTERVAL * 7, episodes.at(0).end_uptime);
+}
+
+void test_episodes_enabled_during_run(void) {
+    HistoricalDataStorage storage("ram_only", 32);
+    setUpStorage(storage);
+    storeRun(storage, AlertLevel::WARNING);
+
+    // The held record is indexed when the run ends, not when the index is built
+    TEST_ASSERT_TRUE(storage.enableEpisodes());
+    TEST_ASSERT_EQUAL_UINT32(1, storage.getEpisodes().at(0).record_count);
+    TEST_ASSERT_TRUE(storage.storeReading(reading(INTERVAL * 7, 560, AlertLevel::WARNING)));
+    TEST_ASSERT_EQUAL_UINT32(3, storage.getEpisodes().at(0).record_count);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_run_closed_by_a_change);
+    RUN_TEST(test_run_closed_by_reenabling_deadband);
+    RUN_TEST(test_held_record_survives_emptied_ring);
+    RUN_TEST(test_episode_counts_held_record_once);
+    RUN_TEST(test_episodes_enabled_during_run);
+    return UNITY_END();
+}
@@ -0,0 +1,357 @@
+/*
+ * test/test_delta_columns/test_main.cpp
+ * DeltaColumnWriter: decode back to the original records (gaps, missing values, "m"
+ * bitmaps) and size against the point format; DeltaColumnStream writes the same text
+ */
+
+#include <unity.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "PointFormat.h"
+#include "communication/DeltaColumnWriter.h"
+
+// Collects the written JSON
+class TextBuffer : public Print {
+public:
+    String text;
+
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    using Print::write;
+};
+
+struct Point {
+    uint64_t timestamp;
+    SensorRecord record;
+};
+
+struct DecodedPoint {
+    uint64_t timestamp = 0;
+    bool present[SensorRecord::METRIC_COUNT] = {};
+    int64_t value[SensorRecord::METRIC_COUNT] = {};   // Integer at the column's decimals
+};
+
+// Parsed JSON value; the writer only emits objects, integers, strings and integer arrays
+struct JsonValue {
+    bool present = false;
+    int64_t number = 0;
+    std::string text;
+    std::vector<int64_t> array;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue& operator[](const char* key) const {
+        static const JsonValue missing;
+        for (const auto& member : members) {
+            if (member.first == key) return member.second;
+        }
+        return missing;
+    }
+};
+
+// Strict reader for that subset: anything else fails the test
+class JsonReader {
+public:
+    explicit JsonReader(const String& json) : p(json.c_str()) {}
+
+    JsonValue parse() {
+        JsonValue result = value();
+        TEST_ASSERT_EQUAL_INT(0, *p);
+        return result;
+    }
+
+private:
+    const char* p;
+
+    void expect(char c) {
+        TEST_ASSERT_EQUAL_INT(c, *p);
+        p++;
+    }
+
+    int64_t integer() {
+        char* end;
+        long long number = strtoll(p, &end, 10);
+        TEST_ASSERT_TRUE(end > p);
+        p = end;
+        return number;
+    }
+
+    std::string string() {
+        expect('"');
+        const char* start = p;
+        while (*p && *p != '"') p++;
+        std::string text(start, p);
+        expect('"');
+        return text;
+    }
+
+    JsonValue value() {
+        JsonValue result;
+        result.present = true;
+        if (*p == '{') {
+            for (p++; *p != '}';) {
+                std::string key = string();
+                expect(':');
+                result.members.emplace_back(key, value());
+                if (*p != '}') expect(',');
+            }
+            p++;
+        } else if (*p == '[') {
+            for (p++; *p != ']';) {
+                result.array.push_back(integer());
+                if (*p != ']') expect(',');
+            }
+            p++;
+        } else if (*p == '"') {
+            result.text = string();
+        } else {
+            result.number = integer();
+        }
+        return result;
+    }
+};
+
+// Same steps as the reference decoder in ANDROID_API_SPECIFICATION.md
+static std::vector<DecodedPoint> decode(const String& json) {
+    JsonValue doc = JsonReader(json).parse();
+
+    const JsonValue& t = doc["t"];
+    const std::vector<int64_t>& gaps = t["d"].array;
+    TEST_ASSERT_TRUE(t["d"].present);
+    size_t count = t["n"].number;
+    std::vector<DecodedPoint> points(count);
+    TEST_ASSERT_EQUAL_size_t(count < 2 ? 0 : count - 2, gaps.size());
+
+    uint64_t timestamp = t["b"].number;
+    int64_t interval = t["i"].number;
+    for (size_t k = 0; k < count; k++) {
+        if (k == 1) timestamp += interval;
+        if (k >= 2) timestamp += interval + gaps[k - 2];
+        points[k].timestamp = timestamp;
+    }
+
+    for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+        const JsonValue& column = doc[SensorRecord::metricKey(i)];
+        if (!column.present) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT64(DeltaColumnWriter::DECIMALS[i], column["x"].number);
+        const std::vector<int64_t>& deltas = column["d"].array;
+        const JsonValue& bitmap = column["m"];
+        int64_t value = 0;
+        size_t j = 0;
+        for (size_t k = 0; k < count; k++) {
+            if (bitmap.present) {
+                TEST_ASSERT_LESS_THAN(bitmap.text.size(), k / 8 * 2 + 1);
+                char hex[3] = { bitmap.text[k / 8 * 2], bitmap.text[k / 8 * 2 + 1], 0 };
+                if (!((strtol(hex, nullptr, 16) >> (k % 8)) & 1)) {
+                    continue;
+                }
+            }
+            TEST_ASSERT_LESS_THAN(deltas.size(), j);
+            value += deltas[j++];
+            points[k].present[i] = true;
+            points[k].value[i] = value;
+        }
+        TEST_ASSERT_EQUAL_size_t(deltas.size(), j);
+    }
+    return points;
+}
+
+static String encode(const std::vector<Point>& points) {
+    DeltaColumnWriter writer;
+    for (const Point& point : points) {
+        writer.add(point.timestamp, point.record);
+    }
+    TEST_ASSERT_EQUAL_size_t(points.size(), writer.size());
+
+    TextBuffer out;
+    size_t bytes = writer.write(out);
+    TEST_ASSERT_EQUAL_size_t(out.text.length(), bytes);
+    return out.text;
+}
+
+static void assertRoundTrip(const std::vector<Point>& points) {
+    std::vector<DecodedPoint> decoded = decode(encode(points));
+    TEST_ASSERT_EQUAL_size_t(points.size(), decoded.size());
+
+    for (size_t k = 0; k < points.size(); k++) {
+        const SensorRecord& record = points[k].record;
+        TEST_ASSERT_EQUAL_UINT64(points[k].timestamp, decoded[k].timestamp);
+        for (size_t i = 0; i < SensorRecord::METRIC_COUNT; i++) {
+            bool valid = record.validity_flags & SensorRecord::metricFlag(i);
+            TEST_ASSERT_EQUAL_INT(valid, decoded[k].present[i]);
+            if (valid) {
+                double scale = pow(10.0, DeltaColumnWriter::DECIMALS[i]);
+                TEST_ASSERT_EQUAL_INT64(lround(record.getValue(i) * scale), decoded[k].value[i]);
+            }
+        }
+    }
+}
+
+// Day of 10 s readings: slow drift, a late reading now and then, VOC warming up and
+// dropping out, one CO2 sensor outage
+static std::vector<Point> makeSeries(size_t count) {
+    std::vector<Point> points(count);
+    uint64_t timestamp = 1695120000000ULL;
+    srand(25);
+    float co2 = 620, temperature = 22.4f, humidity = 41.0f, pressure = 1008.0f, voc = 60.0f;
+    for (size_t k = 0; k < count; k++) {
+        timestamp += (k % 97 == 5) ? 11000 : 10000;
+        co2 += (rand() % 7) - 3;
+        temperature += ((rand() % 5) - 2) * 0.01f;
+        humidity += ((rand() % 5) - 2) * 0.02f;
+        pressure += ((rand() % 3) - 1) * 0.01f;
+        voc += ((rand() % 9) - 4) * 0.1f;
+
+        SensorRecord& record = points[k].record;
+        record.setUptime(timestamp - 1695120000000ULL);
+        record.setCo2(co2);
+        record.setTemperature(temperature);
+        record.setHumidity(humidity);
+        record.setPressure(pressure);
+        record.setVoc(voc);
+        record.validity_flags = SensorRecord::FLAG_TEMP_VALID | SensorRecord::FLAG_HUMIDITY_VALID |
+                                SensorRecord::FLAG_PRESSURE_VALID | SensorRecord::FLAG_OVERALL_VALID;
+        if (k < 300 || k > 340) {
+            record.validity_flags |= SensorRecord::FLAG_CO2_VALID;
+        }
+        if (k >= 3 && k % 50 != 0) {
+            record.validity_flags |= SensorRecord::FLAG_VOC_VALID;
+        }
+        points[k].timestamp = timestamp;
+    }
+    return points;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_empty_writer(void) {
+    String json = encode({});
+    TEST_ASSERT_EQUAL_STRING("{\"t\":{\"n\":0,\"b\":0,\"i\":0,\"d\":[]}}", json.c_str());
+    TEST_ASSERT_EQUAL_size_t(0, decode(json).size());
+}
+
+void test_one_and_two_points(void) {
+    std::vector<Point> points = makeSeries(2);
+    assertRoundTrip({ points[0] });
+    assertRoundTrip(points);
+
+    // Two points: the gap is the interval, nothing left for "d"
+    TEST_ASSERT_TRUE(encode(points).indexOf("\"i\":10000,\"d\":[]") > 0);
+}
+
+void test_spec_example(void) {
+    // ANDROID_API_SPECIFICATION.md, "Delta-Encoded History"
+    std::vector<Point> points(4);
+    const uint64_t timestamps[] = { 1695120000000ULL, 1695120010000ULL, 1695120020000ULL, 1695120031000ULL };
+    const float co2[] = { 455, 458, 0, 456 };
+    const float temperature[] = { 22.85f, 22.86f, 22.86f, 22.83f };
+    for (size_t k = 0; k < 4; k++) {
+        points[k].timestamp = timestamps[k];
+        points[k].record.setCo2(co2[k]);
+        points[k].record.setTemperature(temperature[k]);
+        points[k].record.setVoc(k == 0 ? 28.5f : 28.8f);
+        points[k].record.validity_flags = SensorRecord::FLAG_TEMP_VALID;
+        if (k != 2) points[k].record.validity_flags |= SensorRecord::FLAG_CO2_VALID;
+        if (k == 0 || k == 3) points[k].record.validity_flags |= SensorRecord::FLAG_VOC_VALID;
+    }
+
+    String json = encode(points);
+    TEST_ASSERT_EQUAL_STRING("{\"t\":{\"n\":4,\"b\":1695120000000,\"i\":10000,\"d\":[0,1000]},"
+                             "\"c\":{\"x\":0,\"d\":[455,3,-2],\"m\":\"0b\"},"
+                             "\"T\":{\"x\":2,\"d\":[2285,1,0,-3]},"
+                             "\"v\":{\"x\":2,\"d\":[2850,30],\"m\":\"09\"}}",
+                             json.c_str());
+    assertRoundTrip(points);
+}
+
+void test_day_of_readings_round_trip(void) {
+    assertRoundTrip(makeSeries(1000));
+}
+
+void test_bitmap_spans_bytes(void) {
+    // Missing values at byte boundaries of "m" (points 7, 8, 15, 16) and a partial last byte
+    std::vector<Point> points = makeSeries(21);
+    const size_t missing[] = { 0, 7, 8, 15, 16, 20 };
+    for (size_t k : missing) {
+        points[k].record.validity_flags &= ~SensorRecord::FLAG_HUMIDITY_VALID;
+    }
+    String json = encode(points);
+    TEST_ASSERT_TRUE(json.indexOf("\"m\":\"7e7e0e\"") > 0);
+    assertRoundTrip(points);
+}
+
+// Replays the points once per pass, as the one-message history response does
+static String encodeStream(const std::vector<Point>& points) {
+    TextBuffer out;
+    DeltaColumnStream stream(out);
+    size_t passes = 0;
+    do {
+        for (const Point& point : points) {
+            stream.add(point.timestamp, point.record);
+        }
+        passes++;
+    } while (stream.nextPass());
+    TEST_ASSERT_EQUAL_size_t(points.size(), stream.size());
+    TEST_ASSERT_EQUAL_size_t(out.text.length(), stream.bytesWritten());
+    TEST_ASSERT_LESS_OR_EQUAL(2 + 2 * SensorRecord::METRIC_COUNT, passes);
+    return out.text;
+}
+
+void test_stream_matches_writer(void) {
+    std::vector<Point> day = makeSeries(1000);
+    TEST_ASSERT_EQUAL_STRING(encode(day).c_str(), encodeStream(day).c_str());
+
+    // Short ranges, partial bitmap bytes and a metric that is never valid
+    const size_t sizes[] = { 0, 1, 2, 3, 9, 21 };
+    for (size_t size : sizes) {
+        std::vector<Point> points = makeSeries(size);
+        for (size_t k = 0; k < size; k += 4) {
+            points[k].record.validity_flags &= ~SensorRecord::FLAG_HUMIDITY_VALID;
+        }
+        for (Point& point : points) {
+            point.record.validity_flags &= ~SensorRecord::FLAG_PRESSURE_VALID;
+        }
+        TEST_ASSERT_EQUAL_STRING(encode(points).c_str(), encodeStream(points).c_str());
+    }
+}
+
+void test_smaller_than_point_format(void) {
+    std::vector<Point> points = makeSeries(1000);
+    size_t delta_bytes = encode(points).length();
+
+    // The "d" array of the point format for the same records
+    String point_text = "[";
+    for (const Point& point : points) {
+        if (point_text.length() > 1) point_text += ',';
+        appendPoint(point_text, point.timestamp, point.record);
+    }
+    point_text += ']';
+    size_t point_bytes = point_text.length();
+
+    char message[96];
+    snprintf(message, sizeof(message), "1000 points: %zu bytes as points, %zu bytes as delta columns",
+             point_bytes, delta_bytes);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(point_bytes / 3, delta_bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_writer);
+    RUN_TEST(test_one_and_two_points);
+    RUN_TEST(test_spec_example);
+    RUN_TEST(test_day_of_readings_round_trip);
+    RUN_TEST(test_bitmap_spans_bytes);
+    RUN_TEST(test_stream_matches_writer);
+    RUN_TEST(test_smaller_than_point_format);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+/*
+ * test/test_diurnal_profile/test_main.cpp
+ * Hour-of-week profile fed through HistoricalDataStorage: cells follow the synced
+ * wall-clock hour and weekday in the synced timezone, unsynced readings are left out
+ */
+
+#include <unity.h>
+#include <time.h>
+#include "storage/HistoricalDataStorage.h"
+
+static const size_t CAPACITY = 64;
+static const uint64_t HOUR_MS = 3600000ULL;
+static const uint64_t SYNC_OFFSET = 1695081600000ULL;   // Unix ms at uptime 0: Tue 2023-09-19 00:00 UTC
+
+static SensorRecord reading(uint64_t uptime, float co2) {
+    SensorRecord record;
+    record.setUptime(uptime);
+    record.setCo2(co2);
+    record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_OVERALL_VALID;
+    return record;
+}
+
+static TimeSync syncedClock(uint64_t time_offset, const char* timezone) {
+    TimeSync timeSync;
+    timeSync.has_time = true;
+    timeSync.time_offset = time_offset;
+    timeSync.timezone_offset = timezone;
+    return timeSync;
+}
+
+// Cell from the C library's calendar, Monday 00:00 = cell 0
+static size_t calendarCell(uint64_t timestamp, int timezone_minutes) {
+    time_t local = (time_t)(timestamp / 1000) + timezone_minutes * 60;
+    struct tm parts;
+    gmtime_r(&local, &parts);
+    return ((parts.tm_wday + 6) % 7) * DiurnalProfile::HOURS + parts.tm_hour;
+}
+
+static void setUpStorage(HistoricalDataStorage& storage) {
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableProfile());
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_unsynced_readings_are_left_out(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    setUpStorage(storage);
+
+    // Stored, but without a wall clock there is no hour to put them in
+    TEST_ASSERT_TRUE(storage.storeReading(reading(HOUR_MS, 600)));
+    TEST_ASSERT_TRUE(storage.storeReading(reading(2 * HOUR_MS, 700)));
+    TEST_ASSERT_EQUAL_size_t(2, storage.getRecordCount());
+    TEST_ASSERT_EQUAL_UINT32(0, storage.getProfile().getReadings());
+
+    storage.noteTimeSync(syncedClock(SYNC_OFFSET, "+0000"));
+    TEST_ASSERT_TRUE(storage.storeReading(reading(3 * HOUR_MS, 800)));
+    TEST_ASSERT_EQUAL_UINT32(1, storage.getProfile().getReadings());
+
+    // Tuesday 03:00 UTC
+    size_t cell = DiurnalProfile::HOURS + 3;
+    TEST_ASSERT_EQUAL_UINT16(1, storage.getProfile().getCount(cell, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_EQUAL_FLOAT(800, storage.getProfile().getMean(cell, SensorRecord::METRIC_CO2));
+}
+
+void test_week_of_readings_lands_on_calendar_cells(void) {
+    // Every hour of a week and a half, at an offset that is not a whole hour
+    static const char* const TIMEZONES[] = { "+0000", "+0300", "-05:30", "+1245" };
+    static const int MINUTES[] = { 0, 180, -330, 765 };
+
+    for (size_t z = 0; z < 4; z++) {
+        HistoricalDataStorage storage("ram_only", CAPACITY);
+        setUpStorage(storage);
+        storage.noteTimeSync(syncedClock(SYNC_OFFSET, TIMEZONES[z]));
+        TEST_ASSERT_EQUAL_INT16(MINUTES[z], storage.getProfile().getTimezone());
+
+        for (uint64_t hour = 1; hour <= 10 * 24; hour++) {
+            uint64_t uptime = hour * HOUR_MS + 17 * 60000;
+            size_t expected = calendarCell(SYNC_OFFSET + uptime, MINUTES[z]);
+            TEST_ASSERT_TRUE(storage.storeReading(reading(uptime, 400 + expected)));
+        }
+
+        // Each cell saw only readings of its own hour of the week
+        const DiurnalProfile& profile = storage.getProfile();
+        for (size_t cell = 0; cell < DiurnalProfile::CELL_COUNT; cell++) {
+            TEST_ASSERT_GREATER_OR_EQUAL(1, profile.getCount(cell, SensorRecord::METRIC_CO2));
+            TEST_ASSERT_EQUAL_FLOAT(400 + cell, profile.getMean(cell, SensorRecord::METRIC_CO2));
+            TEST_ASSERT_EQUAL_FLOAT(400 + cell, profile.getMax(cell, SensorRecord::METRIC_CO2));
+        }
+    }
+}
+
+void test_resync_moves_readings_to_the_new_wall_clock(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    setUpStorage(storage);
+    storage.noteTimeSync(syncedClock(SYNC_OFFSET, "+0200"));
+
+    // Tuesday 10:00 UTC = 12:00 local
+    TEST_ASSERT_TRUE(storage.storeReading(reading(10 * HOUR_MS, 500)));
+    size_t noon = DiurnalProfile::HOURS + 12;
+    TEST_ASSERT_EQUAL_UINT16(1, storage.getProfile().getCount(noon, SensorRecord::METRIC_CO2));
+
+    // The clock was a day and an hour behind: the next reading is Wednesday 13:00 local
+    storage.noteTimeSync(syncedClock(SYNC_OFFSET + 25 * HOUR_MS, "+0200"));
+    TEST_ASSERT_TRUE(storage.storeReading(reading(10 * HOUR_MS + 60000, 900)));
+    size_t wednesday = 2 * DiurnalProfile::HOURS + 13;
+    TEST_ASSERT_EQUAL_UINT16(1, storage.getProfile().getCount(wednesday, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_EQUAL_FLOAT(900, storage.getProfile().getMean(wednesday, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_EQUAL_UINT16(1, storage.getProfile().getCount(noon, SensorRecord::METRIC_CO2));
+
+    // A new timezone applies to readings from then on
+    storage.noteTimeSync(syncedClock(SYNC_OFFSET + 25 * HOUR_MS, "-0100"));
+    TEST_ASSERT_TRUE(storage.storeReading(reading(10 * HOUR_MS + 120000, 700)));
+    size_t ten = 2 * DiurnalProfile::HOURS + 10;
+    TEST_ASSERT_EQUAL_UINT16(1, storage.getProfile().getCount(ten, SensorRecord::METRIC_CO2));
+}
+
+void test_cell_mean_follows_new_readings_after_max_weight(void) {
+    DiurnalProfile profile;
+    TEST_ASSERT_TRUE(profile.begin());
+    uint64_t monday = SYNC_OFFSET - 24 * HOUR_MS;
+    TEST_ASSERT_EQUAL_size_t(0, profile.cellOf(monday));
+
+    for (uint32_t i = 0; i < DiurnalProfile::MAX_WEIGHT; i++) {
+        profile.add(reading(0, 500), monday);
+    }
+    TEST_ASSERT_EQUAL_UINT16(DiurnalProfile::MAX_WEIGHT, profile.getCount(0, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_EQUAL_FLOAT(500, profile.getMean(0, SensorRecord::METRIC_CO2));
+
+    // Saturated: another MAX_WEIGHT readings of 1000 move the mean ~63% of the way
+    for (uint32_t i = 0; i < DiurnalProfile::MAX_WEIGHT; i++) {
+        profile.add(reading(0, 1000), monday);
+    }
+    TEST_ASSERT_EQUAL_UINT16(DiurnalProfile::MAX_WEIGHT, profile.getCount(0, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_FLOAT_WITHIN(2.0f, 500 + 500 * (1 - expf(-1)), profile.getMean(0, SensorRecord::METRIC_CO2));
+    TEST_ASSERT_EQUAL_FLOAT(1000, profile.getMax(0, SensorRecord::METRIC_CO2));
+}
+
+void test_parse_timezone(void) {
+    TEST_ASSERT_EQUAL_INT16(180, DiurnalProfile::parseTimezone("+0300"));
+    TEST_ASSERT_EQUAL_INT16(180, DiurnalProfile::parseTimezone("+03:00"));
+    TEST_ASSERT_EQUAL_INT16(-330, DiurnalProfile::parseTimezone("-0530"));
+    TEST_ASSERT_EQUAL_INT16(840, DiurnalProfile::parseTimezone("+1400"));
+    TEST_ASSERT_EQUAL_INT16(840, DiurnalProfile::parseTimezone("+2000"));   // Clamped
+    TEST_ASSERT_EQUAL_INT16(0, DiurnalProfile::parseTimezone("UTC"));
+    TEST_ASSERT_EQUAL_INT16(0, DiurnalProfile::parseTimezone("+3"));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unsynced_readings_are_left_out);
+    RUN_TEST(test_week_of_readings_lands_on_calendar_cells);
+    RUN_TEST(test_resync_moves_readings_to_the_new_wall_clock);
+    RUN_TEST(test_cell_mean_follows_new_readings_after_max_weight);
+    RUN_TEST(test_parse_timezone);
+    return UNITY_END();
+}
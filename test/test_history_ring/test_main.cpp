@@ -0,0 +1,306 @@
+/*
+ * test/test_history_ring/test_main.cpp
+ * HistoricalDataStorage ring buffer: wrap-around, binary-searched uptime ranges,
+ * zero-copy views, max_points on time-range queries and incremental age retention
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+#include "ReadingSeries.h"
+
+static const size_t CAPACITY = 64;
+static const uint64_t INTERVAL = 10000;              // 10 s between readings
+static const uint64_t SYNC_OFFSET = 1695120000000ULL; // Unix ms at uptime 0
+static const uint64_t SLOW_INTERVAL = 120000;        // 2 min between readings: the ring holds 128 min
+static const size_t RETAINED = 31;                   // Readings within one hour of the newest at that rate
+
+static const ReadingSeries series = { INTERVAL, 1, 0, 21.0f };
+static const ReadingSeries slow_series = { SLOW_INTERVAL, 1, 0, 21.0f };
+
+static TimeSync syncedClock() {
+    TimeSync timeSync;
+    timeSync.has_time = true;
+    timeSync.time_offset = SYNC_OFFSET;
+    return timeSync;
+}
+
+// Index of the reading stored at the view's position
+static uint32_t indexAt(const RecordView& view, size_t position) {
+    return (uint32_t)(view[position].getUptime() / INTERVAL - 1);
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_ring_keeps_newest_records_after_wrap(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, CAPACITY * 2 + 10);
+
+    TEST_ASSERT_TRUE(storage.isFull());
+    TEST_ASSERT_EQUAL_size_t(CAPACITY, storage.getRecordCount());
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY * 2 + 10, storage.getNextSequence());
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 10, storage.getFirstSequence());
+
+    uint64_t oldest, newest;
+    TEST_ASSERT_TRUE(storage.getDataTimeRange(oldest, newest));
+    TEST_ASSERT_EQUAL_UINT64(series.at(CAPACITY + 10).getUptime(), oldest);
+    TEST_ASSERT_EQUAL_UINT64(series.at(CAPACITY * 2 + 9).getUptime(), newest);
+
+    std::vector<SensorRecord> latest = storage.queryLatest(5);
+    TEST_ASSERT_EQUAL_size_t(5, latest.size());
+    for (size_t i = 0; i < latest.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT64(series.at(CAPACITY * 2 + 5 + i).getUptime(), latest[i].getUptime());
+    }
+}
+
+void test_view_spans_the_wrap_point(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, CAPACITY + 20);   // Oldest record in slot 20
+
+    RecordView all = storage.viewByUptimeRange(0, UINT64_MAX);
+    TEST_ASSERT_EQUAL_size_t(CAPACITY, all.size());
+    TEST_ASSERT_EQUAL_size_t(CAPACITY - 20, all.spans[0].count);
+    TEST_ASSERT_EQUAL_size_t(20, all.spans[1].count);
+    for (size_t i = 0; i < all.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(20 + i, indexAt(all, i));
+    }
+
+    // A range entirely after the wrap point is a single span
+    RecordView tail = storage.viewByUptimeRange(series.at(CAPACITY + 5).getUptime(),
+                                                series.at(CAPACITY + 9).getUptime());
+    TEST_ASSERT_EQUAL_size_t(5, tail.size());
+    TEST_ASSERT_EQUAL_size_t(0, tail.spans[1].count);
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 5, indexAt(tail, 0));
+}
+
+void test_range_bounds_are_inclusive_and_binary_searched(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, CAPACITY + 37);
+
+    // Every start/end pair over the stored uptimes, on and between record uptimes,
+    // against a linear scan of the ring
+    RecordView all = storage.viewByUptimeRange(0, UINT64_MAX);
+    uint64_t first = all[0].getUptime();
+    uint64_t last = all[all.size() - 1].getUptime();
+    for (uint64_t start = first - INTERVAL; start <= last + INTERVAL; start += INTERVAL / 2) {
+        for (uint64_t end = start; end <= last + INTERVAL; end += INTERVAL / 2) {
+            size_t expected = 0;
+            size_t expected_first = 0;
+            for (size_t i = 0; i < all.size(); i++) {
+                uint64_t uptime = all[i].getUptime();
+                if (uptime >= start && uptime <= end) {
+                    if (expected++ == 0) expected_first = i;
+                }
+            }
+
+            RecordView view = storage.viewByUptimeRange(start, end);
+            TEST_ASSERT_EQUAL_size_t(expected, view.size());
+            if (expected > 0) {
+                TEST_ASSERT_EQUAL_UINT64(all[expected_first].getUptime(), view[0].getUptime());
+            }
+        }
+    }
+}
+
+void test_range_query_past_32_bit_milliseconds(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+
+    // 49.7 days in: the storage clock crosses 2^32 ms after the seventh reading
+    const uint64_t base = 4294900000ULL;
+    for (uint32_t i = 0; i < 40; i++) {
+        SensorRecord record = series.at(i);
+        record.setUptime(base + INTERVAL * i);
+        TEST_ASSERT_TRUE(storage.storeReading(record));
+    }
+
+    RecordView later = storage.viewByUptimeRange(1ULL << 32, UINT64_MAX);
+    TEST_ASSERT_EQUAL_size_t(33, later.size());
+    TEST_ASSERT_EQUAL_UINT64(base + INTERVAL * 7, later[0].getUptime());
+
+    HistoryCursor cursor = storage.openCursor(0, UINT64_MAX);
+    SensorRecord record;
+    size_t count = 0;
+    while (cursor.next(record)) {
+        TEST_ASSERT_EQUAL_UINT64(base + INTERVAL * count, record.getUptime());
+        count++;
+    }
+    TEST_ASSERT_EQUAL_size_t(40, count);
+}
+
+void test_clear_old_data_advances_head(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, CAPACITY + 20);
+
+    // Slots 20-63 hold readings 20-63, slots 0-19 readings 64-83: drop up to 69
+    TEST_ASSERT_TRUE(storage.clearOldData(series.at(70).getUptime()));
+    TEST_ASSERT_EQUAL_size_t(CAPACITY + 20 - 70, storage.getRecordCount());
+    RecordView all = storage.viewByUptimeRange(0, UINT64_MAX);
+    TEST_ASSERT_EQUAL_UINT32(70, indexAt(all, 0));
+
+    // New readings continue into the freed slots
+    series.store(storage, CAPACITY + 20, 10);
+    all = storage.viewByUptimeRange(0, UINT64_MAX);
+    TEST_ASSERT_EQUAL_size_t(CAPACITY + 30 - 70, all.size());
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 29, indexAt(all, all.size() - 1));
+}
+
+void test_time_range_query_honours_max_points(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, CAPACITY + 20);
+    TimeSync timeSync = syncedClock();
+    native_millis = (unsigned long)series.at(CAPACITY + 30).getUptime();   // Range ends now
+
+    TimeRange range;
+    range.start_time = SYNC_OFFSET + 1;
+    range.end_time = SYNC_OFFSET + series.at(CAPACITY + 30).getUptime();
+
+    // Fits: every record, oldest first
+    range.max_points = 1000;
+    std::vector<SensorRecord> records = storage.queryByTimeRange(range, timeSync);
+    TEST_ASSERT_EQUAL_size_t(CAPACITY, records.size());
+
+    // Thinned: never more than max_points, time order kept, extremes kept
+    range.max_points = 10;
+    records = storage.queryByTimeRange(range, timeSync);
+    TEST_ASSERT_GREATER_THAN(0, records.size());
+    TEST_ASSERT_LESS_OR_EQUAL(10, records.size());
+    for (size_t i = 1; i < records.size(); i++) {
+        TEST_ASSERT_GREATER_THAN(records[i - 1].getUptime(), records[i].getUptime());
+    }
+    TEST_ASSERT_EQUAL_FLOAT(400 + 20, records.front().getCo2());
+    TEST_ASSERT_EQUAL_FLOAT(400 + CAPACITY + 19, records.back().getCo2());
+
+    // Odd budgets too
+    for (uint16_t max_points = 1; max_points <= CAPACITY + 1; max_points++) {
+        range.max_points = max_points;
+        TEST_ASSERT_LESS_OR_EQUAL(max_points, storage.queryByTimeRange(range, timeSync).size());
+    }
+}
+
+void test_retention_across_ring_wrap(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    storage.setRetention(1);
+    TEST_ASSERT_EQUAL_UINT32(1, storage.getRetention());
+
+    // Ends with the write position at slot 20, so the kept hour wraps the ring end
+    uint32_t stored = CAPACITY + 20;
+    for (uint32_t i = 0; i < stored; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(i)));
+        uint64_t cutoff = slow_series.at(i).getUptime() > 3600000 ? slow_series.at(i).getUptime() - 3600000 : 0;
+        uint64_t oldest, newest;
+        TEST_ASSERT_TRUE(storage.getDataTimeRange(oldest, newest));
+        TEST_ASSERT_GREATER_OR_EQUAL(cutoff, oldest);
+    }
+
+    TEST_ASSERT_FALSE(storage.isFull());
+    TEST_ASSERT_EQUAL_size_t(RETAINED, storage.getRecordCount());
+    TEST_ASSERT_EQUAL_UINT32(stored - RETAINED, storage.getFirstSequence());
+
+    RecordView all = storage.viewByUptimeRange(0, UINT64_MAX);
+    TEST_ASSERT_EQUAL_size_t(RETAINED, all.size());
+    TEST_ASSERT_EQUAL_size_t(20, all.spans[1].count);
+    for (size_t i = 0; i < all.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT64(slow_series.at(stored - RETAINED + i).getUptime(), all[i].getUptime());
+    }
+}
+
+void test_retention_trims_a_few_records_per_reading(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(i)));
+    }
+    TEST_ASSERT_TRUE(storage.isFull());
+
+    // Turning retention on leaves a 33 record backlog: each reading expires at most four
+    // records, so no reading pays for the whole backlog
+    storage.setRetention(1);
+    uint32_t next = CAPACITY;
+    TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(next++)));   // Overwrote the oldest slot
+    size_t expected = CAPACITY - 4;
+    TEST_ASSERT_EQUAL_size_t(expected, storage.getRecordCount());
+    while (expected > RETAINED) {
+        TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(next++)));
+        expected = max(RETAINED, expected + 1 - 4);
+        TEST_ASSERT_EQUAL_size_t(expected, storage.getRecordCount());
+    }
+    TEST_ASSERT_EQUAL_UINT32(next - RETAINED, storage.getFirstSequence());
+
+    // Steady state: one in, one out
+    for (uint32_t i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(next++)));
+        TEST_ASSERT_EQUAL_size_t(RETAINED, storage.getRecordCount());
+    }
+
+    // Off again: the ring grows back to capacity
+    storage.setRetention(0);
+    for (uint32_t i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(slow_series.at(next++)));
+    }
+    TEST_ASSERT_EQUAL_size_t(RETAINED + 10, storage.getRecordCount());
+}
+
+void test_retention_sweeps_archive_blocks(void) {
+    HistoricalDataStorage kept("ram_only", CAPACITY);
+    HistoricalDataStorage trimmed("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(kept.initialize());
+    TEST_ASSERT_TRUE(trimmed.initialize());
+    TEST_ASSERT_TRUE(kept.enableArchive(64 * CompressedBlock::BLOCK_BYTES));
+    TEST_ASSERT_TRUE(trimmed.enableArchive(64 * CompressedBlock::BLOCK_BYTES));
+    trimmed.setRetention(1);
+
+    uint32_t stored = 600;
+    for (uint32_t i = 0; i < stored; i++) {
+        TEST_ASSERT_TRUE(kept.storeReading(slow_series.at(i)));
+        TEST_ASSERT_TRUE(trimmed.storeReading(slow_series.at(i)));
+    }
+
+    // Whole blocks went in the sweeps; the archive still reaches the ring with no gap
+    uint64_t kept_oldest, trimmed_oldest;
+    TEST_ASSERT_TRUE(kept.getArchive().getOldestUptime(kept_oldest));
+    TEST_ASSERT_TRUE(trimmed.getArchive().getOldestUptime(trimmed_oldest));
+    TEST_ASSERT_EQUAL_UINT64(slow_series.at(0).getUptime(), kept_oldest);
+    TEST_ASSERT_GREATER_THAN(kept_oldest, trimmed_oldest);
+    TEST_ASSERT_LESS_THAN(kept.getArchive().getRecordCount(), trimmed.getArchive().getRecordCount());
+
+    HistoryCursor cursor = trimmed.openCursor(0, UINT64_MAX);
+    SensorRecord record;
+    uint64_t previous = 0;
+    size_t count = 0;
+    while (cursor.next(record)) {
+        if (count++ > 0) {
+            TEST_ASSERT_EQUAL_UINT64(previous + SLOW_INTERVAL, record.getUptime());
+        }
+        previous = record.getUptime();
+    }
+    TEST_ASSERT_EQUAL_UINT64(slow_series.at(stored - 1).getUptime(), previous);
+    TEST_ASSERT_GREATER_OR_EQUAL(RETAINED, count);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_keeps_newest_records_after_wrap);
+    RUN_TEST(test_view_spans_the_wrap_point);
+    RUN_TEST(test_range_bounds_are_inclusive_and_binary_searched);
+    RUN_TEST(test_range_query_past_32_bit_milliseconds);
+    RUN_TEST(test_clear_old_data_advances_head);
+    RUN_TEST(test_time_range_query_honours_max_points);
+    RUN_TEST(test_retention_across_ring_wrap);
+    RUN_TEST(test_retention_trims_a_few_records_per_reading);
+    RUN_TEST(test_retention_sweeps_archive_blocks);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+/*
+ * test/test_history_since/test_main.cpp
+ * Incremental sync (openSince): resuming by sequence number, unknown boot ids, positions
+ * ahead of the device, evicted sequences, and sequences reissued after a reboot that
+ * lost unsaved records
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+#include "MemoryFileSystem.h"
+#include "ReadingSeries.h"
+
+static const size_t CAPACITY = 64;
+static const ReadingSeries series;                  // 10 s apart, CO2 400 + index
+
+// Reads the cursor to the end, checking the readings come back in order from first
+static size_t expectReadings(HistoryCursor& cursor, uint32_t first) {
+    SensorRecord record;
+    size_t count = 0;
+    while (cursor.next(record)) {
+        TEST_ASSERT_EQUAL_FLOAT(400 + first + count, record.getCo2());
+        count++;
+    }
+    return count;
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_resume_from_last_position(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 40);
+    uint32_t boot_id = storage.getBootId();
+    TEST_ASSERT_TRUE(boot_id != 0);
+
+    // First transfer stops part way; its position is where the next one starts
+    bool reset = true;
+    HistoryCursor cursor = storage.openSince(0, boot_id, reset);
+    TEST_ASSERT_FALSE(reset);
+    SensorRecord record;
+    for (size_t i = 0; i < 25; i++) {
+        TEST_ASSERT_TRUE(cursor.next(record));
+    }
+    uint32_t position = cursor.position();
+    TEST_ASSERT_EQUAL_UINT32(25, position);
+
+    series.store(storage, 40, 10);
+    HistoryCursor since = storage.openSince(position, boot_id, reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(25, expectReadings(since, 25));
+    TEST_ASSERT_EQUAL_UINT32(50, since.position());
+
+    // Up to date: nothing to send
+    HistoryCursor none = storage.openSince(storage.getNextSequence(), boot_id, reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_FALSE(none.next(record));
+}
+
+void test_unknown_boot_id_returns_all_history(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 30);
+
+    // Another device's (or a lost table's) boot: its position means nothing here
+    bool reset = false;
+    HistoryCursor other = storage.openSince(20, storage.getBootId() ^ 0x5A5A5A5A, reset);
+    TEST_ASSERT_TRUE(reset);
+    TEST_ASSERT_EQUAL_size_t(30, expectReadings(other, 0));
+
+    // A client that never synced sends boot id 0: everything, but that is no reset
+    HistoryCursor fresh = storage.openSince(20, 0, reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(30, expectReadings(fresh, 0));
+}
+
+void test_position_ahead_of_device_starts_over(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 30);
+
+    bool reset = false;
+    HistoryCursor cursor = storage.openSince(31, storage.getBootId(), reset);
+    TEST_ASSERT_TRUE(reset);
+    TEST_ASSERT_EQUAL_size_t(30, expectReadings(cursor, 0));
+}
+
+void test_evicted_sequence_resumes_at_oldest_record(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 200);
+    uint32_t oldest = storage.getFirstSequence();
+    TEST_ASSERT_EQUAL_UINT32(200 - CAPACITY, oldest);
+
+    // The client's position went out of the ring: it gets what is left, not a reset
+    bool reset = true;
+    HistoryCursor cursor = storage.openSince(50, storage.getBootId(), reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(CAPACITY, expectReadings(cursor, oldest));
+}
+
+void test_evicted_sequence_is_read_from_archive(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableArchive(16 * CompressedBlock::BLOCK_BYTES));
+    series.store(storage, 0, 200);
+    TEST_ASSERT_GREATER_THAN(50, storage.getFirstSequence());
+    TEST_ASSERT_LESS_OR_EQUAL(50, storage.getArchive().getFirstSequence());
+
+    bool reset = true;
+    HistoryCursor cursor = storage.openSince(50, storage.getBootId(), reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(150, expectReadings(cursor, 50));
+}
+
+void test_sequences_reissued_after_reboot_are_read_again(void) {
+    MemoryFileSystem fs;
+    uint32_t first_boot;
+    {
+        HistoricalDataStorage storage("flash", CAPACITY);
+        TEST_ASSERT_TRUE(storage.initialize());
+        TEST_ASSERT_TRUE(storage.enablePersistence(fs, "/history", 8));
+        series.store(storage, 0, 20);   // Two batches on flash, four readings unsaved
+        first_boot = storage.getBootId();
+    }
+
+    // The client had all 20; the reboot kept 16 and numbers new readings from there
+    HistoricalDataStorage storage("flash", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enablePersistence(fs, "/history", 8));
+    TEST_ASSERT_EQUAL_UINT32(16, storage.getNextSequence());
+    TEST_ASSERT_TRUE(storage.getBootId() != first_boot);
+    series.store(storage, 100, 10);
+
+    // Sequences 16-19 now hold other readings: the client gets them from 16 on
+    bool reset = true;
+    HistoryCursor cursor = storage.openSince(20, first_boot, reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(10, expectReadings(cursor, 100));
+
+    // A client that synced in the current boot resumes normally
+    HistoryCursor current = storage.openSince(20, storage.getBootId(), reset);
+    TEST_ASSERT_FALSE(reset);
+    TEST_ASSERT_EQUAL_size_t(6, expectReadings(current, 104));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resume_from_last_position);
+    RUN_TEST(test_unknown_boot_id_returns_all_history);
+    RUN_TEST(test_position_ahead_of_device_starts_over);
+    RUN_TEST(test_evicted_sequence_resumes_at_oldest_record);
+    RUN_TEST(test_evicted_sequence_is_read_from_archive);
+    RUN_TEST(test_sequences_reissued_after_reboot_are_read_again);
+    return UNITY_END();
+}
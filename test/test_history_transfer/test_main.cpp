@@ -0,0 +1,361 @@
+/*
+ * test/test_history_transfer/test_main.cpp
+ * Chunked history transfer against a static storage: chunks add up to the single
+ * response, acks in any order, resume after a dropped link, expiry, and the ring
+ * wrapping while a transfer is open
+ */
+
+#include <unity.h>
+#include <vector>
+#include "SensorTrace.h"
+#include "communication/HistoryTransfer.h"
+
+static const size_t CAPACITY = 32;
+static const uint16_t PASS_THROUGH = 1000;
+
+typedef StaticHistoricalDataStorage<CAPACITY> Storage;
+
+struct Chunk {
+    uint16_t index = 0;
+    std::vector<SensorRecord> points;
+    bool last = false;
+};
+
+static uint64_t storeReadings(HistoricalDataStorage& storage, SensorTrace& trace, size_t count) {
+    uint64_t uptime = 0;
+    for (size_t i = 0; i < count; i++) {
+        SensorRecord record = trace.next();
+        TEST_ASSERT_TRUE(storage.storeReading(record));
+        uptime = record.getUptime();
+    }
+    return uptime;
+}
+
+// What sendHistoricalData() sends without chunk_size: the whole range through one downsampler
+static std::vector<SensorRecord> singleResponse(const HistoricalDataStorage& storage, uint64_t start,
+                                                uint64_t end, uint16_t max_points) {
+    std::vector<SensorRecord> points;
+    HistoryCursor cursor = storage.openCursor(start, end);
+    MinMaxDownsampler sampler(cursor.remaining(), max_points);
+    SensorRecord record;
+    SensorRecord out[MinMaxDownsampler::MAX_OUTPUT];
+    bool done = false;
+    while (!done) {
+        size_t ready;
+        if (cursor.next(record)) {
+            ready = sampler.add(record, out);
+        } else {
+            ready = sampler.finish(out);
+            done = true;
+        }
+        points.insert(points.end(), out, out + ready);
+    }
+    return points;
+}
+
+static void startRaw(HistoryTransfer& transfer, const HistoricalDataStorage& storage, uint64_t end,
+                     uint16_t chunk_points, uint8_t window, uint16_t max_points = PASS_THROUGH,
+                     uint32_t now = 0) {
+    transfer.start(storage, "h1", HistoricalDataStorage::RAW_RESOLUTION, 0, end, 0, max_points,
+                   SensorRecord::METRIC_CO2, chunk_points, window, false, now);
+    TEST_ASSERT_TRUE(transfer.isActive());
+}
+
+// One pass of BluetoothComm::sendHistoryChunk()
+static Chunk sendChunk(HistoryTransfer& transfer, uint32_t now = 0) {
+    Chunk chunk;
+    chunk.index = transfer.getNextChunk();
+    TEST_ASSERT_TRUE(transfer.canSend());
+    TEST_ASSERT_TRUE(transfer.beginChunk());
+    SensorRecord record;
+    while (transfer.nextRecord(record)) {
+        chunk.points.push_back(record);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(transfer.getChunkPoints(), chunk.points.size());
+    chunk.last = transfer.endChunk(now);
+    return chunk;
+}
+
+// Sends whatever the window allows and acks it in order until the transfer completes
+static void drain(HistoryTransfer& transfer, std::vector<SensorRecord>& received) {
+    for (size_t guard = 0; transfer.isActive() && guard < 1000; guard++) {
+        uint16_t newest = transfer.getNextChunk();
+        while (transfer.canSend()) {
+            Chunk chunk = sendChunk(transfer);
+            received.insert(received.end(), chunk.points.begin(), chunk.points.end());
+            newest = chunk.index;
+        }
+        transfer.acknowledge(newest, 0, 0);
+    }
+    TEST_ASSERT_FALSE(transfer.isActive());
+}
+
+static void assertSamePoints(const std::vector<SensorRecord>& expected, const std::vector<SensorRecord>& actual) {
+    TEST_ASSERT_EQUAL_size_t(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT64(expected[i].getUptime(), actual[i].getUptime());
+        TEST_ASSERT_EQUAL_FLOAT(expected[i].getCo2(), actual[i].getCo2());
+    }
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_chunks_add_up_to_the_single_response(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(1);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+
+    // Pass-through and thinned, chunk sizes that do and do not divide the range
+    const uint16_t budgets[] = { PASS_THROUGH, 10, 1 };
+    const uint16_t chunk_sizes[] = { 1, 5, 8, 40 };
+    for (uint16_t max_points : budgets) {
+        for (uint16_t chunk_points : chunk_sizes) {
+            HistoryTransfer transfer;
+            startRaw(transfer, storage, end, chunk_points, 3, max_points);
+            TEST_ASSERT_EQUAL_UINT32(CAPACITY, transfer.getTotal());
+
+            std::vector<SensorRecord> received;
+            drain(transfer, received);
+            assertSamePoints(singleResponse(storage, 0, end, max_points), received);
+        }
+    }
+}
+
+void test_rollup_chunks_cover_the_tier_range(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableRollups());
+    SensorTrace trace(2);
+    uint64_t end = storeReadings(storage, trace, 6 * 25);   // 25 minute buckets
+
+    const RollupTier& tier = storage.getRollups().tier(0);
+    size_t begin, end_index;
+    tier.findRange(0, end, begin, end_index);
+
+    HistoryTransfer transfer;
+    transfer.start(storage, "r1", 0, 0, end, 0, PASS_THROUGH, SensorRecord::METRIC_CO2, 4, 2, true, 0);
+    TEST_ASSERT_FALSE(transfer.isDeltaEncoded());   // Raw transfers only
+    TEST_ASSERT_EQUAL_UINT32(end_index - begin, transfer.getTotal());
+
+    size_t expected = begin;
+    while (transfer.isActive()) {
+        uint16_t chunk = transfer.getNextChunk();
+        TEST_ASSERT_TRUE(transfer.beginChunk());
+        size_t first, last;
+        transfer.bucketRange(first, last);
+        TEST_ASSERT_EQUAL_size_t(expected, first);
+        expected = last;
+        transfer.endChunk(0);
+        transfer.acknowledge(chunk, 0, 0);
+    }
+    TEST_ASSERT_EQUAL_size_t(end_index, expected);
+}
+
+void test_duplicate_and_out_of_order_acks(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(3);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 4, 2);   // 8 chunks, 2 in flight
+    sendChunk(transfer);
+    sendChunk(transfer);
+    TEST_ASSERT_FALSE(transfer.canSend());
+
+    // Duplicate acks count once
+    TEST_ASSERT_FALSE(transfer.acknowledge(0, 0, 0));
+    TEST_ASSERT_FALSE(transfer.acknowledge(0, 0, 0));
+    TEST_ASSERT_EQUAL_UINT16(1, transfer.getAcknowledged());
+    sendChunk(transfer);
+    TEST_ASSERT_FALSE(transfer.canSend());
+
+    // An ack for a chunk not sent yet is clamped to what was sent
+    transfer.acknowledge(6, 0, 0);
+    TEST_ASSERT_EQUAL_UINT16(3, transfer.getAcknowledged());
+    TEST_ASSERT_EQUAL_UINT16(3, transfer.getNextChunk());
+
+    // A late ack for an earlier chunk does not move the window back
+    transfer.acknowledge(0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT16(3, transfer.getAcknowledged());
+
+    // An ack that widens the window (capped at MAX_WINDOW) lets the rest go out at once
+    transfer.acknowledge(2, 20, 0);
+    size_t in_flight = 0;
+    while (transfer.canSend()) {
+        sendChunk(transfer);
+        in_flight++;
+    }
+    TEST_ASSERT_EQUAL_size_t(5, in_flight);   // Chunks 3-7, the last one
+
+    // Acks out of order complete the transfer exactly once
+    TEST_ASSERT_FALSE(transfer.acknowledge(5, 0, 0));
+    TEST_ASSERT_FALSE(transfer.acknowledge(4, 0, 0));
+    TEST_ASSERT_TRUE(transfer.acknowledge(7, 0, 0));
+    TEST_ASSERT_FALSE(transfer.isActive());
+    TEST_ASSERT_FALSE(transfer.acknowledge(7, 0, 0));
+}
+
+void test_resume_after_dropped_link(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(4);
+    uint64_t end = storeReadings(storage, trace, CAPACITY - 8);
+
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 3, 4, 12);
+    std::vector<Chunk> sent;
+    while (transfer.canSend()) {
+        sent.push_back(sendChunk(transfer));
+    }
+    TEST_ASSERT_EQUAL_size_t(4, sent.size());
+
+    // Chunks 2 and 3 were lost with the link; readings kept arriving meanwhile
+    storeReadings(storage, trace, 5);
+    TEST_ASSERT_FALSE(transfer.resume(5, 0));   // Never sent
+    TEST_ASSERT_TRUE(transfer.resume(2, 0));
+    TEST_ASSERT_EQUAL_UINT16(2, transfer.getNextChunk());
+    TEST_ASSERT_EQUAL_UINT16(2, transfer.getAcknowledged());
+
+    // The same chunks again, then the rest: together the single response of the range
+    Chunk again = sendChunk(transfer);
+    assertSamePoints(sent[2].points, again.points);
+    again = sendChunk(transfer);
+    assertSamePoints(sent[3].points, again.points);
+
+    std::vector<SensorRecord> received(sent[0].points);
+    received.insert(received.end(), sent[1].points.begin(), sent[1].points.end());
+    received.insert(received.end(), sent[2].points.begin(), sent[2].points.end());
+    received.insert(received.end(), sent[3].points.begin(), sent[3].points.end());
+    transfer.acknowledge(3, 0, 0);
+    drain(transfer, received);
+    assertSamePoints(singleResponse(storage, 0, end, 12), received);
+}
+
+void test_resume_beyond_the_checkpoints_expires(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(5);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+
+    // One point per chunk: only the last MAX_WINDOW + 1 chunks can be rebuilt
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 1, 1);
+    for (uint16_t chunk = 0; chunk < 12; chunk++) {
+        sendChunk(transfer);
+        transfer.acknowledge(chunk, 0, 0);
+    }
+    TEST_ASSERT_FALSE(transfer.resume(12 - HistoryTransfer::MAX_WINDOW - 2, 0));
+    TEST_ASSERT_TRUE(transfer.resume(12 - HistoryTransfer::MAX_WINDOW - 1, 0));
+}
+
+void test_idle_and_formatted_transfers_expire(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(6);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 4, 2, PASS_THROUGH, 1000);
+    sendChunk(transfer, 2000);
+
+    // Acks and resumes keep it alive; silence for IDLE_TIMEOUT_MS does not
+    uint32_t timeout = HistoryTransfer::IDLE_TIMEOUT_MS;
+    TEST_ASSERT_FALSE(transfer.isIdle(2000 + timeout - 1));
+    transfer.acknowledge(0, 0, 2000 + timeout - 1);
+    TEST_ASSERT_FALSE(transfer.isIdle(2000 + timeout));
+    TEST_ASSERT_TRUE(transfer.resume(1, 2000 + 2 * timeout - 2));
+    TEST_ASSERT_FALSE(transfer.isIdle(2000 + 3 * timeout - 3));
+    TEST_ASSERT_TRUE(transfer.isIdle(2000 + 3 * timeout - 2));
+
+    // The storage was formatted underneath: neither the next chunk nor a resume is sent
+    TEST_ASSERT_TRUE(storage.format());
+    TEST_ASSERT_FALSE(transfer.beginChunk());
+    TEST_ASSERT_FALSE(transfer.resume(1, 0));
+    transfer.cancel();
+    TEST_ASSERT_FALSE(transfer.isActive());
+    TEST_ASSERT_FALSE(transfer.canSend());
+}
+
+void test_ring_wrap_under_open_transfer(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    SensorTrace trace(7);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+    std::vector<SensorRecord> before = singleResponse(storage, 0, end, PASS_THROUGH);
+
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 4, 1);
+    Chunk first = sendChunk(transfer);
+    transfer.acknowledge(0, 0, 0);
+
+    // 20 new readings overwrite the oldest 20 records, 16 of them not sent yet
+    storeReadings(storage, trace, 20);
+    std::vector<SensorRecord> received(first.points);
+    drain(transfer, received);
+
+    // Overwritten records are skipped (one read ahead before the wrap may still be sent):
+    // points stay in order without repeats, and every record still stored is sent
+    size_t next = 0;
+    for (const SensorRecord& point : received) {
+        while (next < before.size() && before[next].getUptime() != point.getUptime()) {
+            next++;
+        }
+        TEST_ASSERT_LESS_THAN_size_t(before.size(), next);
+        TEST_ASSERT_EQUAL_FLOAT(before[next].getCo2(), point.getCo2());
+        next++;
+    }
+    std::vector<SensorRecord> stored(before.begin() + 20, before.end());
+    std::vector<SensorRecord> tail(received.end() - stored.size(), received.end());
+    assertSamePoints(stored, tail);
+    TEST_ASSERT_LESS_THAN_size_t(before.size(), received.size());
+}
+
+void test_ring_wrap_under_open_transfer_reads_the_archive(void) {
+    Storage storage("ram_only");
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableArchive(4096));
+    SensorTrace trace(8);
+    uint64_t end = storeReadings(storage, trace, CAPACITY);
+    std::vector<SensorRecord> before = singleResponse(storage, 0, end, PASS_THROUGH);
+
+    HistoryTransfer transfer;
+    startRaw(transfer, storage, end, 4, 2);
+    Chunk chunk0 = sendChunk(transfer);
+    Chunk chunk1 = sendChunk(transfer);
+
+    // Overwritten records come from the compressed archive: nothing is lost, and a chunk
+    // whose records left the ring is sent again the same
+    storeReadings(storage, trace, 20);
+    TEST_ASSERT_TRUE(transfer.resume(1, 0));
+    Chunk again = sendChunk(transfer);
+    assertSamePoints(chunk1.points, again.points);
+
+    std::vector<SensorRecord> received(chunk0.points);
+    received.insert(received.end(), again.points.begin(), again.points.end());
+    transfer.acknowledge(1, 0, 0);
+    drain(transfer, received);
+    assertSamePoints(before, received);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_chunks_add_up_to_the_single_response);
+    RUN_TEST(test_rollup_chunks_cover_the_tier_range);
+    RUN_TEST(test_duplicate_and_out_of_order_acks);
+    RUN_TEST(test_resume_after_dropped_link);
+    RUN_TEST(test_resume_beyond_the_checkpoints_expires);
+    RUN_TEST(test_idle_and_formatted_transfers_expire);
+    RUN_TEST(test_ring_wrap_under_open_transfer);
+    RUN_TEST(test_ring_wrap_under_open_transfer_reads_the_archive);
+    return UNITY_END();
+}
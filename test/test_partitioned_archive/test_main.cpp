@@ -0,0 +1,308 @@
+/*
+ * test/test_partitioned_archive/test_main.cpp
+ * SD card archive on an in-memory file system: partition rollover and reopening, the
+ * sparse index against a linear scan, cursors falling through RAM to the card, and
+ * corrupt or truncated partition files
+ */
+
+#include <unity.h>
+#include <vector>
+#include "MemoryFileSystem.h"
+#include "SensorTrace.h"
+#include "storage/HistoricalDataStorage.h"
+
+static const uint32_t PARTITION_SECONDS = 3600;     // Hourly partitions: 360 readings each
+static const size_t HOUR = 360;
+
+static uint32_t partitionOf(const SensorRecord& record) {
+    return record.getUptime() / 1000 / PARTITION_SECONDS;
+}
+
+static void appendRecords(PartitionedArchive& archive, SensorTrace& trace, std::vector<SensorRecord>& records,
+                          size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        records.push_back(trace.next());
+        archive.append(records.back(), records.size() - 1);
+    }
+}
+
+// Every record the archive holds, by sequence
+static void assertArchiveHolds(const PartitionedArchive& archive, const std::vector<SensorRecord>& records) {
+    PartitionedArchive::Reader reader;
+    for (uint32_t sequence = archive.getFirstSequence(); sequence < archive.getEndSequence(); sequence++) {
+        SensorRecord record;
+        TEST_ASSERT_TRUE(archive.read(sequence, reader, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[sequence], &record, sizeof(SensorRecord));
+    }
+}
+
+static std::vector<ArchiveIndexEntry> indexOf(MemoryFileSystem& fs, uint32_t partition) {
+    char path[32];
+    snprintf(path, sizeof(path), "/archive/p_%08lu.idx", (unsigned long)partition);
+    const std::vector<uint8_t>& file = fs.files[path];
+    std::vector<ArchiveIndexEntry> entries(file.size() / sizeof(ArchiveIndexEntry));
+    memcpy(entries.data(), file.data(), entries.size() * sizeof(ArchiveIndexEntry));
+    return entries;
+}
+
+static std::vector<uint8_t>& dataOf(MemoryFileSystem& fs, uint32_t partition) {
+    char path[32];
+    snprintf(path, sizeof(path), "/archive/p_%08lu.blk", (unsigned long)partition);
+    TEST_ASSERT_TRUE(fs.files.count(path));
+    return fs.files[path];
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_partition_rollover(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive", PARTITION_SECONDS, 3);
+    TEST_ASSERT_TRUE(archive.begin());
+
+    SensorTrace trace(3);
+    std::vector<SensorRecord> records;
+    appendRecords(archive, trace, records, 5 * HOUR - 1);
+    TEST_ASSERT_TRUE(archive.flush());
+
+    // Five hourly partitions written, the two oldest dropped for the limit of three
+    TEST_ASSERT_EQUAL_UINT32(4, partitionOf(records.back()));
+    TEST_ASSERT_EQUAL_size_t(3, archive.getPartitionCount());
+    TEST_ASSERT_EQUAL_UINT32(2, archive.getStats().partitions_dropped);
+    TEST_ASSERT_FALSE(fs.exists("/archive/p_00000001.blk"));
+    TEST_ASSERT_FALSE(fs.exists("/archive/p_00000001.idx"));
+    TEST_ASSERT_EQUAL_UINT32(2 * HOUR - 1, archive.getFirstSequence());
+    TEST_ASSERT_EQUAL_UINT32(records.size(), archive.getEndSequence());
+
+    // No block straddles a partition boundary
+    for (uint32_t partition = 2; partition <= 4; partition++) {
+        for (const ArchiveIndexEntry& entry : indexOf(fs, partition)) {
+            TEST_ASSERT_EQUAL_UINT32(partition, partitionOf(records[entry.first_sequence]));
+            TEST_ASSERT_EQUAL_UINT32(partition, partitionOf(records[entry.first_sequence + entry.record_count - 1]));
+        }
+    }
+    assertArchiveHolds(archive, records);
+
+    // Reopened from the card: same range, and appending continues after it
+    PartitionedArchive reopened(fs, "/archive", PARTITION_SECONDS, 3);
+    TEST_ASSERT_TRUE(reopened.begin());
+    TEST_ASSERT_EQUAL_size_t(3, reopened.getPartitionCount());
+    TEST_ASSERT_EQUAL_UINT32(archive.getFirstSequence(), reopened.getFirstSequence());
+    TEST_ASSERT_EQUAL_UINT32(records.size(), reopened.getEndSequence());
+    TEST_ASSERT_EQUAL_UINT64(records.back().getUptime(), reopened.getNewestUptime());
+
+    appendRecords(reopened, trace, records, HOUR);
+    TEST_ASSERT_TRUE(reopened.flush());
+    TEST_ASSERT_EQUAL_size_t(3, reopened.getPartitionCount());
+    assertArchiveHolds(reopened, records);
+}
+
+void test_sparse_index_matches_linear_scan(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive", PARTITION_SECONDS, 100);
+    TEST_ASSERT_TRUE(archive.begin());
+
+    // Hours without readings (empty partitions) and repeated uptimes
+    SensorTrace trace(5);
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < 2500; i++) {
+        records.push_back(trace.next());
+        archive.append(records.back(), i);
+        trace.skip(i % 700 == 699 ? 2 * 3600000 : (i % 9 == 0 ? -10000 : 0));
+    }
+    TEST_ASSERT_TRUE(archive.flush());
+
+    uint64_t oldest = records.front().getUptime();
+    uint64_t newest = records.back().getUptime();
+    for (uint64_t uptime = oldest - 20000; uptime <= newest + 20000; uptime += 7000) {
+        uint32_t lower = records.size();
+        uint32_t upper = records.size();
+        for (uint32_t sequence = records.size(); sequence-- > 0;) {
+            if (records[sequence].getUptime() >= uptime) lower = sequence;
+            if (records[sequence].getUptime() > uptime) upper = sequence;
+        }
+        TEST_ASSERT_EQUAL_UINT32(lower, archive.lowerBoundSequence(uptime));
+        TEST_ASSERT_EQUAL_UINT32(upper, archive.upperBoundSequence(uptime));
+    }
+}
+
+void test_range_reads_only_its_blocks(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive");   // Daily partitions
+    TEST_ASSERT_TRUE(archive.begin());
+
+    SensorTrace trace(7);
+    std::vector<SensorRecord> records;
+    appendRecords(archive, trace, records, 24 * HOUR);
+    TEST_ASSERT_TRUE(archive.flush());
+    std::vector<ArchiveIndexEntry> index = indexOf(fs, 0);
+    TEST_ASSERT_GREATER_THAN(8, index.size());
+
+    // One hour in the middle of the day
+    uint64_t start = records[12 * HOUR].getUptime();
+    uint64_t end = records[13 * HOUR - 1].getUptime();
+    fs.reads.clear();
+    uint32_t first = archive.lowerBoundSequence(start);
+    uint32_t last = archive.upperBoundSequence(end);
+    TEST_ASSERT_EQUAL_UINT32(12 * HOUR, first);
+    TEST_ASSERT_EQUAL_UINT32(13 * HOUR, last);
+
+    // Each bound: a binary search of the index and one block decoded
+    size_t search_reads = 0;
+    for (size_t entries = index.size(); entries > 0; entries /= 2) search_reads++;
+    TEST_ASSERT_LESS_OR_EQUAL(2 * (search_reads + 1), fs.readsOf(".idx"));
+    TEST_ASSERT_EQUAL_size_t(2, fs.readsOf(".blk"));
+
+    // Reading the range loads exactly the blocks that overlap it, each once
+    size_t overlapping = 0;
+    for (const ArchiveIndexEntry& entry : index) {
+        if (entry.first_sequence < last && entry.first_sequence + entry.record_count > first) overlapping++;
+    }
+    uint32_t blocks_before = archive.getStats().blocks_read;
+    fs.reads.clear();
+    PartitionedArchive::Reader reader;
+    SensorRecord record;
+    for (uint32_t sequence = first; sequence < last; sequence++) {
+        TEST_ASSERT_TRUE(archive.read(sequence, reader, record));
+        TEST_ASSERT_EQUAL_MEMORY(&records[sequence], &record, sizeof(SensorRecord));
+    }
+    TEST_ASSERT_EQUAL_UINT32(overlapping, archive.getStats().blocks_read - blocks_before);
+    TEST_ASSERT_EQUAL_size_t(overlapping, fs.readsOf(".blk"));
+}
+
+void test_cursor_falls_through_ram_to_card(void) {
+    MemoryFileSystem fs;
+    HistoricalDataStorage storage("ram_only", 100);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableArchive(8 * CompressedBlock::BLOCK_BYTES));
+    TEST_ASSERT_TRUE(storage.enableSdArchive(fs, "/archive", PARTITION_SECONDS));
+    TimeSync time_sync;
+    TEST_ASSERT_EQUAL_STRING("sd_card", storage.getStorageInfo(time_sync).storage_type.c_str());
+
+    SensorTrace trace(11);
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < 3000; i++) {
+        records.push_back(trace.next());
+        TEST_ASSERT_TRUE(storage.storeReading(records.back()));
+    }
+
+    // Ring, then RAM archive, then only the card for the oldest records
+    const PartitionedArchive* card = storage.getSdArchive();
+    TEST_ASSERT_EQUAL_UINT32(0, card->getFirstSequence());
+    TEST_ASSERT_GREATER_THAN(storage.getArchive().getFirstSequence(), storage.getFirstSequence());
+    uint32_t memory_sequence = storage.getArchive().getFirstSequence();
+    TEST_ASSERT_GREATER_THAN(card->getFirstSequence(), memory_sequence);
+    TEST_ASSERT_GREATER_OR_EQUAL(memory_sequence, card->getEndSequence());
+
+    // Whole history, oldest first, with no record lost or repeated at either hand-over
+    HistoryCursor cursor = storage.openCursor(0, UINT64_MAX);
+    SensorRecord record;
+    size_t count = 0;
+    while (cursor.next(record)) {
+        TEST_ASSERT_LESS_THAN(records.size(), count);
+        TEST_ASSERT_EQUAL_UINT64(records[count].getUptime(), record.getUptime());
+        TEST_ASSERT_EQUAL_FLOAT(records[count].getCo2(), record.getCo2());
+        TEST_ASSERT_EQUAL_FLOAT(records[count].getVoc(), record.getVoc());
+        count++;
+    }
+    TEST_ASSERT_EQUAL_size_t(records.size(), count);
+    TEST_ASSERT_GREATER_THAN(0, fs.readsOf(".blk"));
+
+    // A range starting on the card and ending in the ring
+    uint64_t start = records[500].getUptime();
+    uint64_t end = records[2950].getUptime();
+    cursor = storage.openCursor(start, end);
+    for (count = 500; cursor.next(record); count++) {
+        TEST_ASSERT_EQUAL_UINT64(records[count].getUptime(), record.getUptime());
+    }
+    TEST_ASSERT_EQUAL_size_t(2951, count);
+}
+
+void test_corrupt_block_is_skipped(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive", PARTITION_SECONDS, 10);
+    TEST_ASSERT_TRUE(archive.begin());
+    SensorTrace trace(13);
+    std::vector<SensorRecord> records;
+    appendRecords(archive, trace, records, 2 * HOUR);
+    TEST_ASSERT_TRUE(archive.flush());
+
+    // Flip a payload byte of the second block of the first partition
+    std::vector<ArchiveIndexEntry> index = indexOf(fs, 0);
+    TEST_ASSERT_GREATER_THAN(2, index.size());
+    dataOf(fs, 0)[index[1].offset + index[1].length / 2] ^= 0x10;
+
+    PartitionedArchive::Reader reader;
+    SensorRecord record;
+    TEST_ASSERT_TRUE(archive.read(index[0].first_sequence, reader, record));
+    TEST_ASSERT_FALSE(archive.read(index[1].first_sequence, reader, record));
+    TEST_ASSERT_EQUAL_UINT32(1, archive.getStats().crc_errors);
+    TEST_ASSERT_EQUAL_UINT32(index[2].first_sequence, reader.next_available);
+    TEST_ASSERT_TRUE(archive.read(reader.next_available, reader, record));
+    TEST_ASSERT_EQUAL_MEMORY(&records[index[2].first_sequence], &record, sizeof(SensorRecord));
+
+    // Everything outside the corrupt block still reads back
+    for (uint32_t sequence = 0; sequence < records.size(); sequence++) {
+        bool corrupt = sequence >= index[1].first_sequence &&
+                       sequence < index[1].first_sequence + index[1].record_count;
+        TEST_ASSERT_EQUAL(!corrupt, archive.read(sequence, reader, record));
+    }
+}
+
+void test_truncated_partition_files(void) {
+    MemoryFileSystem fs;
+    PartitionedArchive archive(fs, "/archive", PARTITION_SECONDS, 10);
+    TEST_ASSERT_TRUE(archive.begin());
+    SensorTrace trace(17);
+    std::vector<SensorRecord> records;
+    appendRecords(archive, trace, records, 3 * HOUR);
+    TEST_ASSERT_TRUE(archive.flush());
+
+    std::vector<ArchiveIndexEntry> last_index = indexOf(fs, 2);
+    TEST_ASSERT_GREATER_THAN(1, last_index.size());
+    const ArchiveIndexEntry& torn = last_index.back();
+
+    // Power lost while writing: the last block is cut short and its index entry half written
+    dataOf(fs, 2).resize(torn.offset + torn.length / 2);
+    fs.files["/archive/p_00000002.idx"].resize((last_index.size() - 1) * sizeof(ArchiveIndexEntry) + 7);
+    // ... and a partition interrupted before its first index entry
+    fs.files["/archive/p_00000003.blk"] = { 1, 2, 3 };
+    fs.files["/archive/p_00000003.idx"] = {};
+
+    // Reopening keeps every complete block and continues after the last one
+    PartitionedArchive reopened(fs, "/archive", PARTITION_SECONDS, 10);
+    TEST_ASSERT_TRUE(reopened.begin());
+    TEST_ASSERT_EQUAL_size_t(3, reopened.getPartitionCount());
+    TEST_ASSERT_FALSE(fs.exists("/archive/p_00000003.blk"));
+    TEST_ASSERT_FALSE(fs.exists("/archive/p_00000003.idx"));
+    TEST_ASSERT_EQUAL_UINT32(torn.first_sequence, reopened.getEndSequence());
+    records.resize(torn.first_sequence);
+    assertArchiveHolds(reopened, records);
+
+    // An index entry pointing past the end of the data file fails the read, nothing more
+    std::vector<ArchiveIndexEntry> first_index = indexOf(fs, 0);
+    dataOf(fs, 0).resize(first_index.back().offset + 3);
+    PartitionedArchive::Reader reader;
+    SensorRecord record;
+    TEST_ASSERT_FALSE(reopened.read(first_index.back().first_sequence, reader, record));
+    TEST_ASSERT_TRUE(reopened.read(first_index.back().first_sequence - 1, reader, record));
+    TEST_ASSERT_EQUAL_MEMORY(&records[first_index.back().first_sequence - 1], &record, sizeof(SensorRecord));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_partition_rollover);
+    RUN_TEST(test_sparse_index_matches_linear_scan);
+    RUN_TEST(test_range_reads_only_its_blocks);
+    RUN_TEST(test_cursor_falls_through_ram_to_card);
+    RUN_TEST(test_corrupt_block_is_skipped);
+    RUN_TEST(test_truncated_partition_files);
+    return UNITY_END();
+}
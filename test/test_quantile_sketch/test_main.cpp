@@ -0,0 +1,169 @@
+/*
+ * test/test_quantile_sketch/test_main.cpp
+ * Quantile sketches against exact nearest-rank quantiles: within the relative error of
+ * one geometric bin for single sketches and for the merged day and week windows
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "SensorTrace.h"
+#include "storage/QuantileSketch.h"
+
+static const float QUANTILES[] = { 0.01f, 0.1f, 0.25f, 0.5f, 0.75f, 0.9f, 0.95f, 0.99f };
+
+// Half a bin's width on the log scale: the furthest a value is from its bin's middle
+static float relativeError(const SketchRange& range) {
+    return powf(range.high / range.low, 0.5f / QuantileSketch::BIN_COUNT) - 1.0f;
+}
+
+// Nearest-rank quantile, the definition QuantileSketch::quantile() estimates
+static float exactQuantile(std::vector<float> values, float q) {
+    std::sort(values.begin(), values.end());
+    size_t rank = max((size_t)ceilf(q * values.size()), (size_t)1);
+    return values[rank - 1];
+}
+
+static void assertQuantiles(const QuantileSketch& sketch, const std::vector<float>& values,
+                            const SketchRange& range, float tolerance) {
+    TEST_ASSERT_EQUAL_UINT32(values.size(), sketch.getCount());
+    TEST_ASSERT_EQUAL_FLOAT(*std::min_element(values.begin(), values.end()), sketch.getMin());
+    TEST_ASSERT_EQUAL_FLOAT(*std::max_element(values.begin(), values.end()), sketch.getMax());
+    TEST_ASSERT_EQUAL_FLOAT(sketch.getMin(), sketch.quantile(0.0f, range));
+    TEST_ASSERT_EQUAL_FLOAT(sketch.getMax(), sketch.quantile(1.0f, range));
+
+    for (float q : QUANTILES) {
+        float exact = exactQuantile(values, q);
+        TEST_ASSERT_FLOAT_WITHIN(exact * tolerance, exact, sketch.quantile(q, range));
+    }
+}
+
+// Deterministic uniform values in [0, 1)
+static float uniform(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0f;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_single_sketch_within_relative_error(void) {
+    for (size_t s = 0; s < QuantileStatistics::SKETCH_COUNT; s++) {
+        const SketchRange& range = QuantileStatistics::RANGES[s];
+        float tolerance = relativeError(range) * 1.001f;
+        uint32_t state = 7 + s;
+
+        // Log-uniform over the whole range, a narrow cluster, and a skewed tail
+        std::vector<std::vector<float>> distributions(3);
+        for (size_t i = 0; i < 20000; i++) {
+            distributions[0].push_back(range.low * powf(range.high / range.low, uniform(state)));
+            distributions[1].push_back(range.low * 2.0f + uniform(state) * range.low * 0.2f);
+            distributions[2].push_back(range.low * (1.0f + 40.0f * powf(uniform(state), 4.0f)));
+        }
+
+        for (const std::vector<float>& values : distributions) {
+            QuantileSketch sketch;
+            for (float value : values) {
+                sketch.add(value, range);
+            }
+            assertQuantiles(sketch, values, range, tolerance);
+        }
+    }
+}
+
+void test_bin_overflow_keeps_quantiles_close(void) {
+    // A million readings within 400-600 ppm: the busiest bins pass UINT16_MAX several
+    // times over, so the sketch is halved and later adds are thinned
+    const SketchRange& range = QuantileStatistics::RANGES[0];
+    QuantileSketch sketch;
+    std::vector<float> values;
+    uint32_t state = 11;
+    for (size_t i = 0; i < 1000000; i++) {
+        float value = 400.0f + 200.0f * uniform(state) * uniform(state);
+        values.push_back(value);
+        sketch.add(value, range);
+    }
+    assertQuantiles(sketch, values, range, 1.001f * relativeError(range));
+}
+
+void test_day_and_week_windows(void) {
+    // Nine days of 10 s CO2 readings; the windows are merged from 4 h slices and daily
+    // roll-ups, and must match the exact quantiles of the readings they cover
+    QuantileStatistics statistics;
+    TEST_ASSERT_TRUE(statistics.begin());
+    const SketchRange& range = QuantileStatistics::RANGES[QuantileStatistics::sketchOf(SensorRecord::METRIC_CO2)];
+    float tolerance = relativeError(range) * 1.001f;
+
+    SensorTrace trace(4);
+    std::vector<SensorRecord> records;
+    for (size_t i = 0; i < 9 * 8640; i++) {
+        SensorRecord record = trace.next();
+        statistics.add(record);
+        records.push_back(record);
+
+        // Check at slice and day boundaries and a few points between
+        if (i % 1440 != 1439 && i % 3001 != 0) {
+            continue;
+        }
+
+        uint32_t newest_s = record.getUptime() / 1000;
+        uint32_t newest_slice = newest_s - newest_s % MetricQuantiles::SLICE_SECONDS;
+        uint32_t newest_day = newest_s - newest_s % MetricQuantiles::DAY_SECONDS;
+        std::vector<float> day, week;
+        for (const SensorRecord& stored : records) {
+            uint32_t uptime_s = stored.getUptime() / 1000;
+            uint32_t slice = uptime_s - uptime_s % MetricQuantiles::SLICE_SECONDS;
+            uint32_t day_start = uptime_s - uptime_s % MetricQuantiles::DAY_SECONDS;
+            if (newest_slice - slice < MetricQuantiles::DAY_SECONDS) {
+                day.push_back(stored.getCo2());
+            }
+            if (newest_day - day_start < MetricQuantiles::WEEK_DAYS * MetricQuantiles::DAY_SECONDS) {
+                week.push_back(stored.getCo2());
+            }
+        }
+
+        assertQuantiles(statistics.get(QuantileStatistics::LAST_DAY, SensorRecord::METRIC_CO2), day, range, tolerance);
+        assertQuantiles(statistics.get(QuantileStatistics::LAST_WEEK, SensorRecord::METRIC_CO2), week, range, tolerance);
+    }
+
+    // Metrics that are not sketched come back empty
+    TEST_ASSERT_TRUE(statistics.get(QuantileStatistics::LAST_DAY, SensorRecord::METRIC_TEMPERATURE).isEmpty());
+}
+
+void test_invalid_and_nan_readings_are_skipped(void) {
+    QuantileStatistics statistics;
+    TEST_ASSERT_TRUE(statistics.begin());
+
+    SensorTrace trace(6);
+    for (size_t i = 0; i < 100; i++) {
+        SensorRecord record = trace.next();
+        if (i % 4 == 0) record.validity_flags &= ~SensorRecord::FLAG_CO2_VALID;
+        if (i % 5 == 0) record.setVoc(NAN);
+        statistics.add(record);
+    }
+
+    QuantileSketch co2 = statistics.get(QuantileStatistics::LAST_DAY, SensorRecord::METRIC_CO2);
+    TEST_ASSERT_EQUAL_UINT32(75, co2.getCount());
+#if HISTORY_RECORD_FORMAT == 1
+    // The quantized layout stores NaN as 0; the float layout keeps it
+    QuantileSketch voc = statistics.get(QuantileStatistics::LAST_DAY, SensorRecord::METRIC_VOC);
+    TEST_ASSERT_EQUAL_UINT32(80, voc.getCount());
+    TEST_ASSERT_FALSE(isnan(voc.getMin()));
+    TEST_ASSERT_FALSE(isnan(voc.quantile(0.5f, QuantileStatistics::RANGES[1])));
+#endif
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_sketch_within_relative_error);
+    RUN_TEST(test_bin_overflow_keeps_quantiles_close);
+    RUN_TEST(test_day_and_week_windows);
+    RUN_TEST(test_invalid_and_nan_readings_are_skipped);
+    return UNITY_END();
+}
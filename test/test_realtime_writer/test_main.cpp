@@ -0,0 +1,207 @@
+/*
+ * test/test_realtime_writer/test_main.cpp
+ * Realtime sensor_data lines: fixed-point values (signs, rounding, null for NaN and out of
+ * range), status words, the device id limit, and the largest message against the buffer
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <string>
+#include "communication/RealtimeWriter.h"
+
+static std::string message(const RealtimeWriter& writer) {
+    return std::string((const char*)writer.data(), writer.length());
+}
+
+static VOCSensorData vocReading(float voc_estimate) {
+    VOCSensorData data;
+    data.setValid(true);
+    data.temperature = 21.5f;
+    data.humidity = 40.0f;
+    data.pressure = 101325.0f;
+    data.gasResistance = 50000.0f;
+    data.vocEstimate = voc_estimate;
+    data.gasValid = true;
+    return data;
+}
+
+// The text the writer prints for value: the VOC estimate is passed through as is
+static std::string formatted(float value) {
+    RealtimeWriter writer;
+    TEST_ASSERT_GREATER_THAN(0, writer.format(vocReading(value), 1000));
+    std::string text = message(writer);
+    static const std::string HEAD = "\"voc\":{\"value\":";
+    size_t begin = text.find(HEAD);
+    TEST_ASSERT_TRUE(begin != std::string::npos);
+    begin += HEAD.size();
+    return text.substr(begin, text.find(',', begin) - begin);
+}
+
+static void assertFormatted(const char* expected, float value) {
+    std::string text = formatted(value);
+    TEST_ASSERT_EQUAL_STRING(expected, text.c_str());
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_values_trim_trailing_zeros(void) {
+    assertFormatted("0", 0.0f);
+    assertFormatted("412", 412.0f);
+    assertFormatted("21.5", 21.5f);
+    assertFormatted("21.05", 21.05f);
+    assertFormatted("1013.25", 1013.25f);
+    assertFormatted("0.01", 0.01f);
+    assertFormatted("0.1", 0.1f);
+}
+
+void test_values_round_to_hundredths(void) {
+    assertFormatted("0.12", 0.123f);
+    assertFormatted("0.13", 0.126f);
+    assertFormatted("1", 0.996f);          // Carries into the whole part
+    assertFormatted("100", 99.999f);
+    assertFormatted("1.05", 1.05f);        // Stored as 1.04999995
+    assertFormatted("0", 0.004f);
+}
+
+void test_negative_values(void) {
+    assertFormatted("-0.3", -0.3f);
+    assertFormatted("-12.75", -12.75f);
+    assertFormatted("-40", -40.0f);
+    assertFormatted("-1", -0.999f);
+    assertFormatted("-0.01", -0.006f);
+
+    // Rounding to zero drops the sign
+    assertFormatted("0", -0.001f);
+    assertFormatted("0", -0.0049f);
+    assertFormatted("0", -0.0f);
+}
+
+void test_large_values_keep_their_hundredths(void) {
+    assertFormatted("123456.78", 123456.78f);      // Nearest float: 123456.78125
+    assertFormatted("8388607.5", 8388607.5f);
+    assertFormatted("-19999998", -19999998.0f);
+    assertFormatted("19999998", 19999998.0f);
+}
+
+void test_nan_infinity_and_out_of_range_are_null(void) {
+    assertFormatted("null", NAN);
+    assertFormatted("null", INFINITY);
+    assertFormatted("null", -INFINITY);
+    assertFormatted("null", 2.0e7f);
+    assertFormatted("null", -2.0e7f);
+    assertFormatted("null", 1.0e30f);
+}
+
+void test_co2_message(void) {
+    RealtimeWriter writer;
+    writer.setDeviceId(String("AQM-01"));
+    CO2SensorData data;
+    data.setValid(true);
+    data.co2 = 612.0f;
+    data.temperature = 22.37f;
+    data.humidity = 45.5f;
+
+    size_t length = writer.format(data, 1695120000);
+    std::string text = message(writer);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"type\":\"sensor_data\",\"timestamp\":1695120000,\"device_id\":\"AQM-01\",\"readings\":{"
+        "\"co2\":{\"value\":612,\"unit\":\"ppm\",\"accuracy\":0.95,\"status\":\"valid\"},"
+        "\"temperature\":{\"value\":22.37,\"unit\":\"celsius\",\"accuracy\":0.98,\"status\":\"valid\"},"
+        "\"humidity\":{\"value\":45.5,\"unit\":\"percent\",\"accuracy\":0.92,\"status\":\"valid\"}}}\n",
+        text.c_str());
+    TEST_ASSERT_EQUAL_size_t(writer.length(), length);
+
+    // Out of the sensor's range: CO2 is marked invalid, the message is still sent
+    data.co2 = 50.0f;
+    TEST_ASSERT_GREATER_THAN(0, writer.format(data, 1695120005));
+    TEST_ASSERT_TRUE(message(writer).find("\"value\":50,\"unit\":\"ppm\",\"accuracy\":0.95,\"status\":\"invalid\"}") !=
+                     std::string::npos);
+}
+
+void test_snapshot_leaves_out_missing_sensors(void) {
+    RealtimeWriter writer;
+    VOCSensorData voc = vocReading(85.0f);
+    voc.gasValid = false;
+
+    // Temperature and humidity come from the BME688 when the SCD41 has no reading
+    TEST_ASSERT_GREATER_THAN(0, writer.formatSnapshot(nullptr, &voc, 7));
+    std::string text = message(writer);
+    TEST_ASSERT_TRUE(text.find("\"temperature\":{\"value\":21.5,") != std::string::npos);
+    TEST_ASSERT_TRUE(text.find("\"voc\":{\"value\":85,\"unit\":\"ppb\",\"accuracy\":0.85,\"status\":\"invalid\"}") !=
+                     std::string::npos);
+    TEST_ASSERT_TRUE(text.find("\"pressure\":{\"value\":1013.25,") != std::string::npos);
+    TEST_ASSERT_TRUE(text.find("co2") == std::string::npos);
+
+    // No valid sensor: an empty readings object
+    TEST_ASSERT_GREATER_THAN(0, writer.formatSnapshot(nullptr, nullptr, 7));
+    text = message(writer);
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"sensor_data\",\"timestamp\":7,\"device_id\":\"\",\"readings\":{}}\n",
+                             text.c_str());
+}
+
+void test_device_id_is_truncated(void) {
+    RealtimeWriter writer;
+    std::string id(RealtimeWriter::MAX_DEVICE_ID + 10, 'x');
+    writer.setDeviceId(String(id.c_str()));
+    TEST_ASSERT_GREATER_THAN(0, writer.formatSnapshot(nullptr, nullptr, 0));
+
+    std::string expected = "\"device_id\":\"" + std::string(RealtimeWriter::MAX_DEVICE_ID, 'x') + "\",";
+    TEST_ASSERT_TRUE(message(writer).find(expected) != std::string::npos);
+}
+
+void test_largest_messages_fit_the_buffer(void) {
+    // Longest id, timestamp and values: every sensor range at its widest, and the VOC
+    // estimate (not range checked) at the longest value that is not null
+    RealtimeWriter writer;
+    writer.setDeviceId(String(std::string(RealtimeWriter::MAX_DEVICE_ID, 'x').c_str()));
+    const float LONGEST = -19999998.99f;
+
+    CO2SensorData co2;
+    co2.setValid(true);
+    co2.co2 = 4999.99f;
+    co2.temperature = -39.99f;
+    co2.humidity = 99.99f;
+    VOCSensorData voc = vocReading(LONGEST);
+    voc.pressure = 109999.0f;
+
+    size_t snapshot = writer.formatSnapshot(&co2, &voc, UINT32_MAX);
+    TEST_ASSERT_GREATER_THAN(0, snapshot);
+    TEST_ASSERT_LESS_OR_EQUAL(RealtimeWriter::CAPACITY, snapshot);
+    TEST_ASSERT_EQUAL_UINT8('\n', writer.data()[snapshot - 1]);
+
+    // format() takes the BME688 values without range checks: all four at the longest
+    voc.temperature = LONGEST;
+    voc.humidity = LONGEST;
+    voc.pressure = LONGEST * 100.0f;
+    size_t single = writer.format(voc, UINT32_MAX);
+    TEST_ASSERT_GREATER_THAN(0, single);
+    TEST_ASSERT_LESS_OR_EQUAL(RealtimeWriter::CAPACITY, single);
+
+    // A shorter message reusing the buffer reports its own length
+    size_t shorter = writer.formatSnapshot(nullptr, nullptr, 1);
+    TEST_ASSERT_LESS_THAN(single, shorter);
+    TEST_ASSERT_EQUAL_size_t(shorter, writer.length());
+    TEST_ASSERT_EQUAL_UINT8('\n', writer.data()[shorter - 1]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_values_trim_trailing_zeros);
+    RUN_TEST(test_values_round_to_hundredths);
+    RUN_TEST(test_negative_values);
+    RUN_TEST(test_large_values_keep_their_hundredths);
+    RUN_TEST(test_nan_infinity_and_out_of_range_are_null);
+    RUN_TEST(test_co2_message);
+    RUN_TEST(test_snapshot_leaves_out_missing_sensors);
+    RUN_TEST(test_device_id_is_truncated);
+    RUN_TEST(test_largest_messages_fit_the_buffer);
+    return UNITY_END();
+}
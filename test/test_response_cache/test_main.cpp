@@ -0,0 +1,195 @@
+/*
+ * test/test_response_cache/test_main.cpp
+ * History response cache: entries are dropped once a stored record, expiry, a fold or a
+ * resync would change the response, and kept when new records land after the range
+ */
+
+#include <unity.h>
+#include "communication/ResponseCache.h"
+#include "ReadingSeries.h"
+
+static const size_t CAPACITY = 64;
+static const uint64_t INTERVAL = 10000;   // 10 s between readings
+static const uint64_t OFFSET = 1695120000000ULL;
+static const ReadingSeries series = { INTERVAL, 20 };
+
+// Stamp of a raw history response, derived as sendHistoricalData() does
+static ResponseCache::Stamp rawStamp(const HistoricalDataStorage& storage, uint64_t start_uptime,
+                                     uint64_t end_uptime, uint64_t time_offset = OFFSET) {
+    ResponseCache::Stamp stamp = ResponseCache::Stamp::of(storage, time_offset);
+    HistoryCursor cursor = storage.openCursor(start_uptime, end_uptime);
+    stamp.setRaw(storage, cursor, true, end_uptime);
+    return stamp;
+}
+
+static ResponseCache::Stamp rollupStamp(const HistoricalDataStorage& storage, size_t tier_index,
+                                        uint64_t start_uptime, uint64_t end_uptime) {
+    ResponseCache::Stamp stamp = ResponseCache::Stamp::of(storage, OFFSET);
+    size_t begin, end;
+    storage.getRollups().tier(tier_index).findRange(start_uptime, end_uptime, begin, end);
+    stamp.setRollup(storage, tier_index, begin, end);
+    return stamp;
+}
+
+static ResponseCache::Key requestKey(uint64_t start_uptime, uint64_t end_uptime) {
+    ResponseCache::Key key;
+    key.start_time = OFFSET + start_uptime;
+    key.end_time = OFFSET + end_uptime;
+    key.max_points = 500;
+    return key;
+}
+
+static void storeBody(ResponseCache& cache, const ResponseCache::Key& key, const ResponseCache::Stamp& stamp,
+                      size_t bytes = 100) {
+    std::vector<uint8_t> body(bytes, 'x');
+    TEST_ASSERT_TRUE(cache.store(key, stamp, body));
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_new_record_invalidates_open_range(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 20);
+
+    // A range reaching the newest record (and past it, as "until now" requests do)
+    uint64_t start = series.at(5).getUptime();
+    uint64_t end = series.at(40).getUptime();
+    ResponseCache cache;
+    storeBody(cache, requestKey(start, end), rawStamp(storage, start, end));
+    TEST_ASSERT_NOT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getStats().hits);
+
+    // The next reading lands in it: the stale entry is dropped, not served
+    series.store(storage, 20, 1);
+    TEST_ASSERT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getStats().stale);
+    TEST_ASSERT_EQUAL_size_t(0, cache.size());
+    TEST_ASSERT_EQUAL_size_t(0, cache.getUsedBytes());
+}
+
+void test_new_record_keeps_closed_range(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 20);
+
+    // Ends before the newest record: later readings cannot change it
+    uint64_t start = series.at(2).getUptime();
+    uint64_t end = series.at(10).getUptime();
+    ResponseCache cache;
+    storeBody(cache, requestKey(start, end), rawStamp(storage, start, end));
+    series.store(storage, 20, 10);
+    TEST_ASSERT_NOT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+
+    // Until the ring wraps into it
+    series.store(storage, 30, CAPACITY - 30 + 3);
+    TEST_ASSERT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getStats().stale);
+}
+
+void test_expiry_and_resync_invalidate(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 20);
+
+    uint64_t start = series.at(0).getUptime();
+    uint64_t end = series.at(10).getUptime();
+    ResponseCache cache;
+    storeBody(cache, requestKey(start, end), rawStamp(storage, start, end));
+
+    // Same request after the clock was resynced: timestamps would differ
+    TEST_ASSERT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end, OFFSET + 5000)));
+
+    // Records at the start of the range expire
+    storeBody(cache, requestKey(start, end), rawStamp(storage, start, end));
+    TEST_ASSERT_TRUE(storage.clearOldData(series.at(3).getUptime()));
+    TEST_ASSERT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+    TEST_ASSERT_EQUAL_UINT32(2, cache.getStats().stale);
+}
+
+void test_folded_reading_invalidates(void) {
+    // A deadband run moves its held record forward in place: same count, new values
+    static const float TOLERANCES[SensorRecord::METRIC_COUNT] = { 10.0f, 0.1f, 0.5f, 0.5f, 1.0f };
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableDeadband(TOLERANCES, INTERVAL));
+
+    SensorRecord first = series.at(0);
+    SensorRecord held = series.at(1);
+    held.setCo2(first.getCo2());
+    TEST_ASSERT_TRUE(storage.storeReading(first));
+    TEST_ASSERT_TRUE(storage.storeReading(held));
+
+    uint64_t start = 0;
+    uint64_t end = series.at(100).getUptime();
+    ResponseCache cache;
+    storeBody(cache, requestKey(start, end), rawStamp(storage, start, end));
+
+    SensorRecord folded = series.at(2);
+    folded.setCo2(first.getCo2() + 2);
+    TEST_ASSERT_TRUE(storage.storeReading(folded));
+    TEST_ASSERT_NULL(cache.find(requestKey(start, end), rawStamp(storage, start, end)));
+}
+
+void test_new_record_invalidates_open_rollup_bucket(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableRollups());
+    series.store(storage, 0, 30);   // Five minutes: buckets 0-4 closed, 5 open
+
+    ResponseCache cache;
+    uint64_t closed_end = series.at(17).getUptime();
+    uint64_t open_end = series.at(200).getUptime();
+    ResponseCache::Key closed = requestKey(0, closed_end);
+    ResponseCache::Key open = requestKey(0, open_end);
+    storeBody(cache, closed, rollupStamp(storage, 0, 0, closed_end));
+    storeBody(cache, open, rollupStamp(storage, 0, 0, open_end));
+
+    // A reading in the open bucket changes only the response that includes it
+    series.store(storage, 30, 1);
+    TEST_ASSERT_NOT_NULL(cache.find(closed, rollupStamp(storage, 0, 0, closed_end)));
+    TEST_ASSERT_NULL(cache.find(open, rollupStamp(storage, 0, 0, open_end)));
+}
+
+void test_budget_and_lru_eviction(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    TEST_ASSERT_TRUE(storage.initialize());
+    series.store(storage, 0, 10);
+    ResponseCache::Stamp stamp = rawStamp(storage, 0, series.at(5).getUptime());
+
+    ResponseCache cache(3, 1000);
+    storeBody(cache, requestKey(0, 1), stamp, 400);
+    storeBody(cache, requestKey(0, 2), stamp, 400);
+    TEST_ASSERT_NOT_NULL(cache.find(requestKey(0, 1), stamp));   // 2 is now least recently used
+
+    // Over budget: the least recently used entry makes room
+    storeBody(cache, requestKey(0, 3), stamp, 400);
+    TEST_ASSERT_EQUAL_size_t(2, cache.size());
+    TEST_ASSERT_EQUAL_size_t(800, cache.getUsedBytes());
+    TEST_ASSERT_NULL(cache.find(requestKey(0, 2), stamp));
+    TEST_ASSERT_NOT_NULL(cache.find(requestKey(0, 1), stamp));
+
+    // A body larger than the whole budget is not cached
+    std::vector<uint8_t> large(1001, 'x');
+    TEST_ASSERT_FALSE(cache.store(requestKey(0, 4), stamp, large));
+    TEST_ASSERT_EQUAL_size_t(2, cache.size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_new_record_invalidates_open_range);
+    RUN_TEST(test_new_record_keeps_closed_range);
+    RUN_TEST(test_expiry_and_resync_invalidate);
+    RUN_TEST(test_folded_reading_invalidates);
+    RUN_TEST(test_new_record_invalidates_open_rollup_bucket);
+    RUN_TEST(test_budget_and_lru_eviction);
+    return UNITY_END();
+}
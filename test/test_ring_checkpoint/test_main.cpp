@@ -0,0 +1,306 @@
+/*
+ * test/test_ring_checkpoint/test_main.cpp
+ * RingCheckpoint: restore after a simulated reboot, torn page copies, corrupt metadata,
+ * one flash write per step()
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include "storage/RingCheckpoint.h"
+#include "storage/FileSystems.h"
+#include "TempDirectory.h"
+#include "storage/HistoricalDataStorage.h"
+
+static const size_t SLOTS = 20;
+static const size_t PAGE_RECORDS = 5;
+
+static TempDirectory directory;
+
+// Ring as HistoricalDataStorage keeps it: slot = sequence % SLOTS
+struct TestRing {
+    SensorRecord slots[SLOTS];
+    uint32_t next_sequence = 0;
+
+    static SensorRecord recordFor(uint32_t sequence) {
+        SensorRecord record;
+        record.setUptime(1000ULL * (sequence + 1));
+        record.setCo2(400 + sequence);
+        record.setTemperature(20.0f + sequence * 0.01f);
+        record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_TEMP_VALID |
+                                SensorRecord::FLAG_OVERALL_VALID;
+        return record;
+    }
+
+    void store(RingCheckpoint& checkpoint, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            size_t slot = next_sequence % SLOTS;
+            slots[slot] = recordFor(next_sequence++);
+            checkpoint.markDirty(slot);
+        }
+    }
+
+    CheckpointRing view() const {
+        CheckpointRing ring;
+        ring.slots = slots;
+        ring.next_sequence = next_sequence;
+        ring.first_sequence = next_sequence > SLOTS ? next_sequence - SLOTS : 0;
+        ring.write_index = next_sequence % SLOTS;
+        return ring;
+    }
+};
+
+struct Restored {
+    std::vector<SensorRecord> records;
+    std::vector<uint32_t> sequences;
+    std::vector<size_t> slots;
+};
+
+static Restored restoreFrom(IFileSystem& fs) {
+    RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+    TEST_ASSERT_TRUE(checkpoint.begin());
+
+    Restored restored;
+    checkpoint.restore([&restored](const SensorRecord& record, uint32_t sequence, size_t slot) {
+        restored.records.push_back(record);
+        restored.sequences.push_back(sequence);
+        restored.slots.push_back(slot);
+    });
+    return restored;
+}
+
+static void assertRun(const Restored& restored, uint32_t first, uint32_t count) {
+    TEST_ASSERT_EQUAL_size_t(count, restored.records.size());
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t sequence = first + i;
+        SensorRecord expected = TestRing::recordFor(sequence);
+        TEST_ASSERT_EQUAL_UINT32(sequence, restored.sequences[i]);
+        TEST_ASSERT_EQUAL_size_t(sequence % SLOTS, restored.slots[i]);
+        TEST_ASSERT_EQUAL_MEMORY(&expected, &restored.records[i], sizeof(SensorRecord));
+    }
+}
+
+// Byte offset of one copy of a page in ring.ckp (layout documented in RingCheckpoint.h)
+static size_t pageOffset(size_t page, size_t copy) {
+    size_t page_bytes = sizeof(CheckpointPageHeader) + PAGE_RECORDS * sizeof(SensorRecord);
+    return 2 * sizeof(CheckpointMeta) + (2 * page + copy) * page_bytes;
+}
+
+static void flipByte(IFileSystem& fs, size_t offset) {
+    uint8_t value;
+    TEST_ASSERT_EQUAL_size_t(1, fs.read("/ckp/ring.ckp", offset, &value, 1));
+    value ^= 0x5A;
+    TEST_ASSERT_TRUE(fs.writeAt("/ckp/ring.ckp", offset, &value, 1));
+}
+
+void setUp(void) {
+    directory.create("ckp");
+    native_millis = 0;
+}
+
+void tearDown(void) {
+    directory.remove();
+}
+
+// ================================
+// TESTS
+// ================================
+
+void test_restore_after_ring_wrap(void) {
+    PosixFileSystem fs(directory.path());
+    {
+        RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+        TEST_ASSERT_TRUE(checkpoint.begin());
+        TestRing ring;
+        ring.store(checkpoint, 47);   // Wrapped twice, newest record in slot 6
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));
+    }   // Reboot: nothing but the file survives
+
+    assertRun(restoreFrom(fs), 27, SLOTS);
+}
+
+void test_torn_page_falls_back_to_previous_copy(void) {
+    PosixFileSystem fs(directory.path());
+    {
+        RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+        TEST_ASSERT_TRUE(checkpoint.begin());
+        TestRing ring;
+        ring.store(checkpoint, 30);   // Slots 0-9 = 20-29, slots 10-19 = 10-19
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));
+        ring.store(checkpoint, 3);    // 30-32 into slots 10-12 (page 2)
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));
+    }
+
+    // Page 2 was written to copy A first, so the second write went to copy B - tear it
+    flipByte(fs, pageOffset(2, 1) + sizeof(CheckpointPageHeader) + 3);
+
+    RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+    TEST_ASSERT_TRUE(checkpoint.begin());
+    Restored restored;
+    checkpoint.restore([&restored](const SensorRecord& record, uint32_t sequence, size_t slot) {
+        restored.records.push_back(record);
+        restored.sequences.push_back(sequence);
+        restored.slots.push_back(slot);
+    });
+
+    // Copy A of page 2 still holds 10-14 from the first round. 30-32 are lost and 10-12 are
+    // below the floor the second round recorded, so the newest intact run is 13-29
+    assertRun(restored, 13, SLOTS - 3);
+    TEST_ASSERT_EQUAL_UINT32(1, checkpoint.getStats().crc_errors);
+}
+
+void test_both_page_copies_bad_keeps_newest_contiguous_run(void) {
+    PosixFileSystem fs(directory.path());
+    {
+        RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+        TEST_ASSERT_TRUE(checkpoint.begin());
+        TestRing ring;
+        ring.store(checkpoint, 47);
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));
+    }
+
+    // Page 0 (slots 0-4 = 40-44) corrupt: the run after it (45, 46) is all that is provably intact
+    flipByte(fs, pageOffset(0, 0) + 4);   // Header of the only copy ever written
+
+    assertRun(restoreFrom(fs), 45, 2);
+}
+
+void test_corrupt_metadata_uses_other_slot(void) {
+    PosixFileSystem fs(directory.path());
+    {
+        RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+        TEST_ASSERT_TRUE(checkpoint.begin());   // Metadata generation 1 (slot B)
+        TestRing ring;
+        ring.store(checkpoint, 12);
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));   // Generation 2 (slot A)
+    }
+
+    // Newest metadata fails its CRC - generation 1 describes the same geometry
+    flipByte(fs, offsetof(CheckpointMeta, floor_sequence));
+    assertRun(restoreFrom(fs), 0, 12);
+
+    // Both slots bad: no checkpoint, the file is recreated empty
+    flipByte(fs, sizeof(CheckpointMeta) + offsetof(CheckpointMeta, floor_sequence));
+    TEST_ASSERT_EQUAL_size_t(0, restoreFrom(fs).records.size());
+}
+
+void test_dropped_records_are_not_restored(void) {
+    PosixFileSystem fs(directory.path());
+    {
+        RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS);
+        TEST_ASSERT_TRUE(checkpoint.begin());
+        TestRing ring;
+        ring.store(checkpoint, 15);
+        TEST_ASSERT_TRUE(checkpoint.checkpointAll(ring.view()));
+        TEST_ASSERT_TRUE(checkpoint.clear(15));   // Storage formatted
+    }
+
+    TEST_ASSERT_EQUAL_size_t(0, restoreFrom(fs).records.size());
+}
+
+void test_step_makes_one_flash_write(void) {
+    PosixFileSystem fs(directory.path());
+    RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS, 1000);
+    TEST_ASSERT_TRUE(checkpoint.begin());
+    TestRing ring;
+    ring.store(checkpoint, SLOTS + 3);   // Every page dirty, first sequences dropped
+    native_millis += 1000;
+
+    // Metadata (new floor) first, then one page per call until the round is done
+    uint32_t writes = 0;
+    for (size_t i = 0; i < 10 && checkpoint.getDirtyPages() > 0; i++) {
+        const RingCheckpoint::Stats& stats = checkpoint.getStats();
+        uint32_t before = stats.meta_written + stats.pages_written;
+        size_t pages = checkpoint.step(ring.view());
+        TEST_ASSERT_EQUAL_UINT32(before + 1, stats.meta_written + stats.pages_written);
+        TEST_ASSERT_EQUAL_size_t(i == 0 ? 0 : 1, pages);
+        writes++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1 + SLOTS / PAGE_RECORDS, writes);
+
+    // Nothing dirty until the next interval
+    TEST_ASSERT_EQUAL_size_t(0, checkpoint.step(ring.view()));
+    assertRun(restoreFrom(fs), 3, SLOTS);
+}
+
+void test_crash_between_steps_restores_consistent_run(void) {
+    // Crash after a random number of readings and step() calls; whatever comes back
+    // must be a contiguous run of the records that were stored under those sequences
+    srand(16);
+    for (int round = 0; round < 25; round++) {
+        PosixFileSystem fs(directory.path());
+        fs.remove("/ckp/ring.ckp");
+        uint32_t stored = 0;
+        {
+            RingCheckpoint checkpoint(fs, "/ckp", SLOTS, PAGE_RECORDS, 1000);
+            TEST_ASSERT_TRUE(checkpoint.begin());
+            TestRing ring;
+            int steps = 5 + rand() % 40;
+            for (int i = 0; i < steps; i++) {
+                ring.store(checkpoint, 1 + rand() % 4);
+                native_millis += 400;
+                checkpoint.step(ring.view());   // One flash write per call
+            }
+            stored = ring.next_sequence;
+        }
+
+        Restored restored = restoreFrom(fs);
+        TEST_ASSERT_LESS_OR_EQUAL(SLOTS, restored.records.size());
+        for (size_t i = 0; i < restored.records.size(); i++) {
+            uint32_t sequence = restored.sequences[i];
+            SensorRecord expected = TestRing::recordFor(sequence);
+            TEST_ASSERT_LESS_THAN(stored, sequence);
+            TEST_ASSERT_EQUAL_UINT32(restored.sequences[0] + i, sequence);
+            TEST_ASSERT_EQUAL_MEMORY(&expected, &restored.records[i], sizeof(SensorRecord));
+        }
+    }
+}
+
+void test_storage_restores_ring_on_enable(void) {
+    PosixFileSystem fs(directory.path());
+    uint64_t newest_uptime = 0;
+    {
+        HistoricalDataStorage storage("ram_only", 40);
+        TEST_ASSERT_TRUE(storage.initialize());
+        TEST_ASSERT_TRUE(storage.enableCheckpoint(fs, "/ckp"));
+        for (uint32_t i = 0; i < 95; i++) {
+            native_millis += 10000;
+            TEST_ASSERT_TRUE(storage.storeReading(TestRing::recordFor(i)));
+        }
+        TEST_ASSERT_TRUE(storage.checkpointNow());
+        uint64_t oldest_uptime;
+        TEST_ASSERT_TRUE(storage.getDataTimeRange(oldest_uptime, newest_uptime));
+    }
+
+    native_millis = 5000;   // Rebooted
+    HistoricalDataStorage storage("ram_only", 40);
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableCheckpoint(fs, "/ckp"));
+
+    TEST_ASSERT_EQUAL_size_t(40, storage.getRecordCount());
+    TEST_ASSERT_EQUAL_UINT32(95, storage.getNextSequence());
+    HistoryCursor cursor = storage.openCursor(0, UINT64_MAX);
+    SensorRecord record;
+    size_t count = 0;
+    while (cursor.next(record)) {
+        TEST_ASSERT_EQUAL_FLOAT(400 + 55 + count, record.getCo2());
+        count++;
+    }
+    TEST_ASSERT_EQUAL_size_t(40, count);
+
+    // New readings continue after the restored ones
+    TEST_ASSERT_GREATER_THAN(newest_uptime, storage.getCurrentUptime());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_restore_after_ring_wrap);
+    RUN_TEST(test_torn_page_falls_back_to_previous_copy);
+    RUN_TEST(test_both_page_copies_bad_keeps_newest_contiguous_run);
+    RUN_TEST(test_corrupt_metadata_uses_other_slot);
+    RUN_TEST(test_dropped_records_are_not_restored);
+    RUN_TEST(test_step_makes_one_flash_write);
+    RUN_TEST(test_crash_between_steps_restores_consistent_run);
+    RUN_TEST(test_storage_restores_ring_on_enable);
+    return UNITY_END();
+}
@@ -0,0 +1,278 @@
+/*
+ * test/test_rollup_tiers/test_main.cpp
+ * Rollup tiers: bucket min/max/mean against the folded records, retention rollover,
+ * bucket range search, and which resolution a history range is answered from
+ */
+
+#include <unity.h>
+#include "storage/HistoricalDataStorage.h"
+#include "ReadingSeries.h"
+
+static const size_t CAPACITY = 32;                  // Raw ring: the last 32 minutes
+static const uint64_t INTERVAL = 60000;             // One reading per minute
+static const size_t MINUTE_BUCKETS = 120;           // 2 hours
+static const size_t HOUR_BUCKETS = 48;              // 2 days
+static const size_t DAY_BUCKETS = 10;
+
+static const ReadingSeries series = { INTERVAL, 10, 7, 20.0f };
+
+// Temperature and alert level cycle too, so buckets have distinct min/max/mean
+static SensorRecord reading(uint32_t index) {
+    SensorRecord record = series.at(index);
+    record.setTemperature(20.0f + (index % 4));
+    record.alert_level = index % 3;
+    return record;
+}
+
+static SensorRecord readingAt(uint64_t uptime, float co2) {
+    SensorRecord record = ReadingSeries().at(0);
+    record.setUptime(uptime);
+    record.setCo2(co2);
+    return record;
+}
+
+// One day of readings into a storage with rollups
+static void fillDay(HistoricalDataStorage& storage) {
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_TRUE(storage.enableRollups(MINUTE_BUCKETS, HOUR_BUCKETS, DAY_BUCKETS));
+    for (uint32_t i = 0; i < 24 * 60; i++) {
+        TEST_ASSERT_TRUE(storage.storeReading(reading(i)));
+    }
+}
+
+static uint64_t newestUptime() {
+    return reading(24 * 60 - 1).getUptime();
+}
+
+void setUp(void) {
+    native_millis = 0;
+}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_bucket_aggregates_match_records(void) {
+    RollupTier tier;
+    TEST_ASSERT_TRUE(tier.begin(3600, 4));
+
+    // Two hours of minute readings, every fifth one without a temperature
+    for (uint32_t i = 0; i < 120; i++) {
+        SensorRecord record = reading(i);
+        if (i % 5 == 0) {
+            record.validity_flags &= ~SensorRecord::FLAG_TEMP_VALID;
+            record.setTemperature(99.0f);
+        }
+        tier.add(record);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(3, tier.size());   // 0:01-0:59, 1:00-1:59, 2:00
+    for (size_t index = 0; index < tier.size(); index++) {
+        const RollupBucket& bucket = tier.at(index);
+        TEST_ASSERT_EQUAL_UINT32(index * 3600, bucket.start_s);
+
+        // Brute force over the readings that fall into the bucket
+        uint32_t count = 0, temp_count = 0;
+        float co2_min = 1e9f, co2_max = -1e9f, co2_sum = 0, temp_min = 1e9f, temp_sum = 0;
+        uint8_t alert = 0;
+        for (uint32_t i = 0; i < 120; i++) {
+            uint64_t uptime = reading(i).getUptime();
+            if (uptime / 3600000 != index) continue;
+            SensorRecord record = reading(i);
+            count++;
+            alert = max(alert, record.alert_level);
+            co2_min = min(co2_min, record.getCo2());
+            co2_max = max(co2_max, record.getCo2());
+            co2_sum += record.getCo2();
+            if (i % 5 != 0) {
+                temp_count++;
+                temp_min = min(temp_min, record.getTemperature());
+                temp_sum += record.getTemperature();
+            }
+        }
+        TEST_ASSERT_EQUAL_UINT32(count, bucket.count);
+        TEST_ASSERT_EQUAL_UINT8(alert, bucket.alert_level);
+        TEST_ASSERT_EQUAL_FLOAT(co2_min, bucket.min[SensorRecord::METRIC_CO2]);
+        TEST_ASSERT_EQUAL_FLOAT(co2_max, bucket.max[SensorRecord::METRIC_CO2]);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, co2_sum / count, bucket.mean[SensorRecord::METRIC_CO2]);
+        if (temp_count > 0) {
+            TEST_ASSERT_EQUAL_FLOAT(temp_min, bucket.min[SensorRecord::METRIC_TEMPERATURE]);
+            TEST_ASSERT_FLOAT_WITHIN(0.01f, temp_sum / temp_count, bucket.mean[SensorRecord::METRIC_TEMPERATURE]);
+            TEST_ASSERT_LESS_THAN(99.0f, bucket.max[SensorRecord::METRIC_TEMPERATURE]);
+        }
+    }
+
+    // Bucket means as a record stamped at the bucket start
+    SensorRecord mean = tier.at(1).toRecord();
+    TEST_ASSERT_EQUAL_UINT64(3600000, mean.getUptime());
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, tier.at(1).mean[SensorRecord::METRIC_CO2], mean.getCo2());
+}
+
+void test_held_flag_is_not_rolled_up(void) {
+    RollupTier tier;
+    TEST_ASSERT_TRUE(tier.begin(60, 4));
+    SensorRecord record = readingAt(1000, 500.0f);
+    record.validity_flags |= SensorRecord::FLAG_HELD;
+    tier.add(record);
+
+    TEST_ASSERT_FALSE(tier.at(0).validity_flags & SensorRecord::FLAG_HELD);
+    TEST_ASSERT_TRUE(tier.at(0).validity_flags & SensorRecord::FLAG_CO2_VALID);
+}
+
+void test_retention_drops_oldest_bucket(void) {
+    RollupTier tier;
+    TEST_ASSERT_TRUE(tier.begin(60, 5));
+    TEST_ASSERT_FALSE(tier.begin(60, 1));   // An open bucket and at least one closed one
+    TEST_ASSERT_TRUE(tier.begin(60, 5));
+
+    for (uint32_t minute = 0; minute < 12; minute++) {
+        tier.add(readingAt(minute * 60000ULL + 5000, 400.0f + minute));
+        tier.add(readingAt(minute * 60000ULL + 35000, 410.0f + minute));
+    }
+
+    // Only the newest five minutes are left, oldest first, each with both readings
+    TEST_ASSERT_EQUAL_size_t(5, tier.size());
+    uint64_t oldest;
+    TEST_ASSERT_TRUE(tier.getOldestUptime(oldest));
+    TEST_ASSERT_EQUAL_UINT64(7 * 60000ULL, oldest);
+    for (size_t index = 0; index < tier.size(); index++) {
+        TEST_ASSERT_EQUAL_UINT32((7 + index) * 60, tier.at(index).start_s);
+        TEST_ASSERT_EQUAL_UINT32(2, tier.at(index).count);
+        TEST_ASSERT_EQUAL_FLOAT(400.0f + 7 + index, tier.at(index).min[SensorRecord::METRIC_CO2]);
+    }
+
+    // A late record is folded into the open bucket rather than reopening an old one
+    tier.add(readingAt(8 * 60000ULL, 300.0f));
+    TEST_ASSERT_EQUAL_size_t(5, tier.size());
+    TEST_ASSERT_EQUAL_UINT32(3, tier.at(4).count);
+    TEST_ASSERT_EQUAL_FLOAT(300.0f, tier.at(4).min[SensorRecord::METRIC_CO2]);
+
+    tier.clear();
+    TEST_ASSERT_EQUAL_size_t(0, tier.size());
+    TEST_ASSERT_FALSE(tier.getOldestUptime(oldest));
+}
+
+void test_find_range_over_wrapped_ring(void) {
+    RollupTier tier;
+    TEST_ASSERT_TRUE(tier.begin(60, 8));
+    for (uint32_t minute = 0; minute < 21; minute++) {
+        tier.add(readingAt(minute * 60000ULL + 1000, 400.0f));
+    }
+    // Minutes 13-20 are left; slot order wrapped twice
+
+    // Every start/end pair against a linear scan of the buckets
+    for (uint64_t start = 10 * 60000ULL; start <= 22 * 60000ULL; start += 15000) {
+        for (uint64_t end = start; end <= 22 * 60000ULL; end += 15000) {
+            size_t expected_begin = tier.size(), expected_end = 0;
+            for (size_t index = 0; index < tier.size(); index++) {
+                uint64_t bucket_start = tier.at(index).getStartUptime();
+                if (bucket_start + 60000 > start && bucket_start <= end) {
+                    expected_begin = min(expected_begin, index);
+                    expected_end = index + 1;
+                }
+            }
+            size_t begin, end_index;
+            tier.findRange(start, end, begin, end_index);
+            TEST_ASSERT_EQUAL_size_t(expected_end > 0 ? expected_end - expected_begin : 0,
+                                     end_index - begin);
+            if (expected_end > 0) {
+                TEST_ASSERT_EQUAL_size_t(expected_begin, begin);
+            }
+        }
+    }
+}
+
+void test_tiers_fill_at_their_own_resolution(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    fillDay(storage);
+
+    const RollupTiers& rollups = storage.getRollups();
+    TEST_ASSERT_EQUAL_size_t(MINUTE_BUCKETS, rollups.tier(0).size());   // Rolled over
+    TEST_ASSERT_EQUAL_size_t(25, rollups.tier(1).size());               // 0:01 - 24:00
+    TEST_ASSERT_EQUAL_size_t(2, rollups.tier(2).size());
+    TEST_ASSERT_EQUAL_UINT32(59, rollups.tier(1).at(0).count);   // Readings start at minute 1
+    TEST_ASSERT_EQUAL_UINT32(60, rollups.tier(1).at(1).count);
+    TEST_ASSERT_EQUAL_UINT32(24 * 60 - 1, rollups.tier(2).at(0).count);
+    TEST_ASSERT_EQUAL_UINT32(1, rollups.tier(2).at(1).count);
+    for (size_t i = 0; i < rollups.tier(0).size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(1, rollups.tier(0).at(i).count);
+    }
+
+    // Clearing the storage clears every tier
+    TEST_ASSERT_TRUE(storage.clear());
+    for (size_t i = 0; i < RollupTiers::TIER_COUNT; i++) {
+        TEST_ASSERT_EQUAL_size_t(0, rollups.tier(i).size());
+    }
+}
+
+void test_resolution_follows_range_and_budget(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    uint64_t now = newestUptime();
+
+    // Without rollups everything is raw
+    TEST_ASSERT_TRUE(storage.initialize());
+    TEST_ASSERT_EQUAL_INT(HistoricalDataStorage::RAW_RESOLUTION, storage.selectResolution(0, now, 10));
+
+    fillDay(storage);
+
+    // Inside the raw ring and within budget
+    TEST_ASSERT_EQUAL_INT(HistoricalDataStorage::RAW_RESOLUTION,
+                          storage.selectResolution(now - 20 * INTERVAL, now, 1000));
+
+    // Inside the ring but over budget: minutes would be 21 points, hours fit
+    TEST_ASSERT_EQUAL_INT(1, storage.selectResolution(now - 20 * INTERVAL, now, 10));
+
+    // Older than the ring, within minute retention
+    TEST_ASSERT_EQUAL_INT(0, storage.selectResolution(now - 90 * INTERVAL, now, 1000));
+
+    // Beyond minute retention: hours
+    TEST_ASSERT_EQUAL_INT(1, storage.selectResolution(now - 12 * 60 * INTERVAL, now, 1000));
+
+    // The whole day in two points: days
+    TEST_ASSERT_EQUAL_INT(2, storage.selectResolution(0, now, 2));
+
+    // Nothing fits: the coarsest tier anyway
+    TEST_ASSERT_EQUAL_INT(2, storage.selectResolution(0, now, 1));
+
+    // Reversed range
+    TEST_ASSERT_EQUAL_INT(HistoricalDataStorage::RAW_RESOLUTION, storage.selectResolution(now, 0, 10));
+}
+
+void test_long_range_query_returns_bucket_means(void) {
+    HistoricalDataStorage storage("ram_only", CAPACITY);
+    fillDay(storage);
+    native_millis = (unsigned long)newestUptime();
+
+    TimeSync timeSync;
+    timeSync.has_time = true;
+    timeSync.time_offset = 1695120000000ULL;
+
+    TimeRange range;
+    range.start_time = timeSync.time_offset + newestUptime() - 12 * 60 * INTERVAL;
+    range.end_time = timeSync.time_offset + newestUptime();
+    range.max_points = 1000;
+
+    std::vector<SensorRecord> records = storage.queryByTimeRange(range, timeSync);
+    std::vector<RollupBucket> hours = storage.queryRollups(1, newestUptime() - 12 * 60 * INTERVAL,
+                                                           newestUptime());
+    TEST_ASSERT_EQUAL_size_t(13, hours.size());
+    TEST_ASSERT_EQUAL_size_t(hours.size(), records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT64(hours[i].getStartUptime(), records[i].getUptime());
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, hours[i].mean[SensorRecord::METRIC_CO2], records[i].getCo2());
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_aggregates_match_records);
+    RUN_TEST(test_held_flag_is_not_rolled_up);
+    RUN_TEST(test_retention_drops_oldest_bucket);
+    RUN_TEST(test_find_range_over_wrapped_ring);
+    RUN_TEST(test_tiers_fill_at_their_own_resolution);
+    RUN_TEST(test_resolution_follows_range_and_budget);
+    RUN_TEST(test_long_range_query_returns_bucket_means);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/*
+ * test/test_running_stats/test_main.cpp
+ * Rolling-window statistics against a brute-force recomputation of each window:
+ * count, mean, variance, min and max as slices expire
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include "SensorTrace.h"
+#include "storage/RunningStats.h"
+
+// Every reading kept, so a window can be recomputed from scratch
+struct Reading {
+    uint32_t uptime_s;
+    float values[SensorRecord::METRIC_COUNT];
+    uint8_t flags;
+};
+
+struct Expected {
+    uint32_t count = 0;
+    double mean = 0;
+    double variance = 0;
+    float min = 0;
+    float max = 0;
+};
+
+// Readings whose slice is one of the newest span / slice_s slices (span 0 = all of them)
+static Expected bruteForce(const std::vector<Reading>& readings, size_t metric,
+                           uint32_t slice_s, uint32_t span_s) {
+    Expected expected;
+    if (readings.empty()) {
+        return expected;
+    }
+
+    int64_t newest_slice = slice_s ? readings.back().uptime_s - readings.back().uptime_s % slice_s : 0;
+    std::vector<double> values;
+    for (const Reading& reading : readings) {
+        float value = reading.values[metric];
+        if (!(reading.flags & SensorRecord::metricFlag(metric)) || isnan(value)) {
+            continue;
+        }
+        if (span_s && (int64_t)(reading.uptime_s - reading.uptime_s % slice_s) <= newest_slice - span_s) {
+            continue;
+        }
+
+        expected.min = values.empty() ? value : min(expected.min, value);
+        expected.max = values.empty() ? value : max(expected.max, value);
+        values.push_back(value);
+    }
+
+    expected.count = values.size();
+    if (values.empty()) {
+        return expected;
+    }
+    for (double value : values) {
+        expected.mean += value;
+    }
+    expected.mean /= values.size();
+    if (values.size() > 1) {
+        for (double value : values) {
+            expected.variance += (value - expected.mean) * (value - expected.mean);
+        }
+        expected.variance /= values.size() - 1;
+    }
+    return expected;
+}
+
+static void assertMatches(const Expected& expected, const MetricMoments& actual) {
+    TEST_ASSERT_EQUAL_UINT32(expected.count, actual.count);
+    if (expected.count == 0) {
+        return;
+    }
+    TEST_ASSERT_EQUAL_FLOAT(expected.min, actual.min);
+    TEST_ASSERT_EQUAL_FLOAT(expected.max, actual.max);
+    TEST_ASSERT_FLOAT_WITHIN(fabs(expected.mean) * 1e-6 + 1e-6, expected.mean, actual.mean);
+    TEST_ASSERT_FLOAT_WITHIN(expected.variance * 1e-4 + 1e-4, expected.variance, actual.variance());
+}
+
+static void assertWindows(const RunningStatistics& stats, const std::vector<Reading>& readings) {
+    for (size_t metric = 0; metric < SensorRecord::METRIC_COUNT; metric++) {
+        assertMatches(bruteForce(readings, metric, RunningStatistics::HOUR_SLICE_SECONDS, 3600),
+                      stats.get(RunningStatistics::LAST_HOUR, metric));
+        assertMatches(bruteForce(readings, metric, RunningStatistics::DAY_SLICE_SECONDS, 86400),
+                      stats.get(RunningStatistics::LAST_DAY, metric));
+        assertMatches(bruteForce(readings, metric, 0, 0),
+                      stats.get(RunningStatistics::SINCE_BOOT, metric));
+    }
+}
+
+static Reading remember(const SensorRecord& record) {
+    Reading reading;
+    reading.uptime_s = record.getUptime() / 1000;
+    for (size_t metric = 0; metric < SensorRecord::METRIC_COUNT; metric++) {
+        reading.values[metric] = record.getValue(metric);
+    }
+    reading.flags = record.validity_flags;
+    return reading;
+}
+
+static SensorRecord co2Reading(uint32_t uptime_s, float co2) {
+    SensorRecord record;
+    record.setUptime(uptime_s * 1000ULL);
+    record.setCo2(co2);
+    record.validity_flags = SensorRecord::FLAG_CO2_VALID | SensorRecord::FLAG_OVERALL_VALID;
+    return record;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_windows_match_brute_force(void) {
+    RunningStatistics stats;
+    TEST_ASSERT_TRUE(stats.begin());
+
+    // 30 hours at one reading a minute, with gaps longer than a slice and metrics
+    // dropping out, so windows expire one slice, several slices or everything at once
+    SensorTrace trace(3, 60000);
+    std::vector<Reading> readings;
+    for (size_t i = 0; i < 1800; i++) {
+        if (i % 250 == 0) trace.skip(1000UL * (i % 500 ? 900 : 5400));
+        SensorRecord record = trace.next();
+        if (i % 7 == 0) record.validity_flags &= ~SensorRecord::FLAG_HUMIDITY_VALID;
+        if ((i / 100) % 5 == 4) record.validity_flags &= ~SensorRecord::FLAG_VOC_VALID;
+
+        stats.add(record);
+        readings.push_back(remember(record));
+        assertWindows(stats, readings);
+    }
+}
+
+void test_nan_values_are_skipped(void) {
+    RunningStatistics stats;
+    TEST_ASSERT_TRUE(stats.begin());
+
+    // A NaN flagged as valid must not poison the since-boot window, which never expires
+    SensorTrace trace(5);
+    std::vector<Reading> readings;
+    for (size_t i = 0; i < 200; i++) {
+        SensorRecord record = trace.next();
+        if (i % 3 == 0) record.setPressure(NAN);
+        if (i % 50 == 0) record.setCo2(NAN);
+        stats.add(record);
+        readings.push_back(remember(record));
+    }
+    assertWindows(stats, readings);
+
+    const MetricMoments& pressure = stats.get(RunningStatistics::SINCE_BOOT, SensorRecord::METRIC_PRESSURE);
+    TEST_ASSERT_EQUAL_UINT32(133, pressure.count);
+    TEST_ASSERT_FALSE(isnan(pressure.mean));
+    TEST_ASSERT_FALSE(isnan(pressure.variance()));
+
+    // Windowed moments stay finite through expiry as well
+    StatsWindow window;
+    TEST_ASSERT_TRUE(window.begin(60, 2));
+    float values[SensorRecord::METRIC_COUNT] = { NAN, 20.0f, NAN, 1000.0f, 1.0f };
+    window.add(0, values, 0xFF);
+    values[0] = 500.0f;
+    window.add(70, values, 0xFF);
+    window.add(130, values, 0xFF);
+    TEST_ASSERT_EQUAL_UINT32(2, window.metric(SensorRecord::METRIC_CO2).count);
+    TEST_ASSERT_EQUAL_FLOAT(500.0f, window.metric(SensorRecord::METRIC_CO2).mean);
+    TEST_ASSERT_EQUAL_UINT32(0, window.metric(SensorRecord::METRIC_HUMIDITY).count);
+}
+
+void test_evicting_the_minimum_and_maximum(void) {
+    RunningStatistics stats;
+    TEST_ASSERT_TRUE(stats.begin());
+    std::vector<Reading> readings;
+    auto add = [&](uint32_t uptime_s, float co2) {
+        SensorRecord record = co2Reading(uptime_s, co2);
+        stats.add(record);
+        readings.push_back(remember(record));
+    };
+
+    // First slice holds both extremes; a later slice ties the maximum
+    add(0, 400);
+    add(10, 2000);
+    add(600, 800);
+    add(1200, 2000);
+    add(1800, 900);
+    const MetricMoments& hour = stats.get(RunningStatistics::LAST_HOUR, SensorRecord::METRIC_CO2);
+    TEST_ASSERT_EQUAL_FLOAT(400, hour.min);
+    TEST_ASSERT_EQUAL_FLOAT(2000, hour.max);
+
+    // First slice expires: the minimum moves, the tied maximum stays
+    add(3600, 1000);
+    assertWindows(stats, readings);
+    TEST_ASSERT_EQUAL_FLOAT(800, hour.min);
+    TEST_ASSERT_EQUAL_FLOAT(2000, hour.max);
+
+    // Slice with the remaining maximum expires
+    add(4800, 1100);
+    assertWindows(stats, readings);
+    TEST_ASSERT_EQUAL_FLOAT(900, hour.min);
+    TEST_ASSERT_EQUAL_FLOAT(1100, hour.max);
+
+    // A gap longer than the window leaves only the new reading
+    add(9000, 600);
+    assertWindows(stats, readings);
+    TEST_ASSERT_EQUAL_UINT32(1, hour.count);
+    TEST_ASSERT_EQUAL_FLOAT(600, hour.min);
+    TEST_ASSERT_EQUAL_FLOAT(600, hour.max);
+    TEST_ASSERT_EQUAL_FLOAT(0, hour.variance());
+
+    // Since boot keeps the first extremes
+    const MetricMoments& boot = stats.get(RunningStatistics::SINCE_BOOT, SensorRecord::METRIC_CO2);
+    TEST_ASSERT_EQUAL_UINT32(8, boot.count);
+    TEST_ASSERT_EQUAL_FLOAT(400, boot.min);
+    TEST_ASSERT_EQUAL_FLOAT(2000, boot.max);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_windows_match_brute_force);
+    RUN_TEST(test_nan_values_are_skipped);
+    RUN_TEST(test_evicting_the_minimum_and_maximum);
+    return UNITY_END();
+}
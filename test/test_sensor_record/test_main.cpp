@@ -0,0 +1,150 @@
+/*
+ * test/test_sensor_record/test_main.cpp
+ * SensorRecord quantization: resolution of each metric, the stored pressure and VOC ranges
+ * and readings outside them, NaN inputs, storage clock values past 32-bit milliseconds
+ */
+
+#include <unity.h>
+#include "storage/SensorRecord.h"
+
+static VOCSensorData vocReading(float pressure_pa, float voc_estimate = 35.5f) {
+    VOCSensorData voc;
+    voc.temperature = 22.5f;
+    voc.humidity = 41.0f;
+    voc.pressure = pressure_pa;
+    voc.gasResistance = 50000.0f;
+    voc.vocEstimate = voc_estimate;
+    voc.gasValid = true;
+    voc.setValid(true);
+    return voc;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// ================================
+// TESTS
+// ================================
+
+void test_values_keep_their_resolution(void) {
+    SensorRecord record;
+    record.setCo2(1234.4f);
+    record.setTemperature(-12.344f);
+    record.setHumidity(55.554f);
+    record.setPressure(1008.37f);
+    record.setVoc(123.44f);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 1234.4f, record.getCo2());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, -12.344f, record.getTemperature());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 55.554f, record.getHumidity());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 1008.37f, record.getPressure());
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 123.44f, record.getVoc());
+}
+
+void test_sensor_pressure_is_flagged_valid(void) {
+    VOCSensorData voc = vocReading(90000.0f);   // ~1000 m altitude
+    SensorRecord record(10000, nullptr, &voc);
+
+    TEST_ASSERT_TRUE(record.validity_flags & SensorRecord::FLAG_PRESSURE_VALID);
+    TEST_ASSERT_TRUE(record.validity_flags & SensorRecord::FLAG_VOC_VALID);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 900.0f, record.getPressure());
+}
+
+void test_uptime_past_32_bit_milliseconds(void) {
+    const uint64_t uptime = 60ULL * 24 * 3600 * 1000 + 123000;   // 60 days, past 2^32 ms
+    TEST_ASSERT_GREATER_THAN_UINT64(UINT32_MAX, uptime);
+
+    SensorRecord record(uptime);
+    TEST_ASSERT_EQUAL_UINT64(uptime, record.getUptime());
+
+    // The block codec carries the native time and must come back to the same uptime
+    SensorRecord decoded;
+    decoded.setRawTime(record.getRawTime());
+    TEST_ASSERT_EQUAL_UINT64(uptime, decoded.getUptime());
+    TEST_ASSERT_EQUAL_UINT64(uptime, SensorRecord::rawTimeToUptime(record.getRawTime()));
+}
+
+#if HISTORY_RECORD_FORMAT == 2
+void test_pressure_range_edges(void) {
+    SensorRecord record;
+    record.setPressure(685.58f);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 685.58f, record.getPressure());
+    record.setPressure(1340.92f);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 1340.92f, record.getPressure());
+
+    // Outside the offset range: no value rather than a clamped one
+    static const float OUTSIDE[] = { 685.5f, 620.0f, 300.0f, 1341.0f, 2000.0f, NAN };
+    for (float pressure : OUTSIDE) {
+        record.setPressure(pressure);
+        TEST_ASSERT_EQUAL_INT16(SensorRecord::PRESSURE_NONE, record.pressure_offset_pa);
+        TEST_ASSERT_FLOAT_IS_NAN(record.getPressure());
+    }
+}
+
+void test_high_altitude_pressure_is_not_flagged(void) {
+    // 620 hPa (~4000 m) is a valid BME688 reading but cannot be stored
+    VOCSensorData voc = vocReading(62000.0f);
+    SensorRecord record(10000, nullptr, &voc);
+
+    TEST_ASSERT_FALSE(record.validity_flags & SensorRecord::FLAG_PRESSURE_VALID);
+    TEST_ASSERT_TRUE(record.validity_flags & SensorRecord::FLAG_VOC_VALID);
+    TEST_ASSERT_TRUE(record.isValid());
+    TEST_ASSERT_FLOAT_IS_NAN(record.getPressure());
+}
+
+void test_voc_range_edges(void) {
+    SensorRecord record;
+    record.setVoc(0.0f);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, record.getVoc());
+    record.setVoc(6553.4f);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 6553.4f, record.getVoc());
+
+    // Above the field range: no value rather than a clamped one
+    static const float OUTSIDE[] = { 6553.5f, 8300.0f, 1e9f, NAN };
+    for (float voc : OUTSIDE) {
+        record.setVoc(voc);
+        TEST_ASSERT_EQUAL_UINT16(SensorRecord::VOC_NONE, record.voc_deci);
+        TEST_ASSERT_FLOAT_IS_NAN(record.getVoc());
+    }
+}
+
+void test_high_voc_estimate_is_not_flagged(void) {
+    // ~8300 ppb is what the BME688 estimate gives at 300 Ohm gas resistance
+    VOCSensorData voc = vocReading(90000.0f, 8300.0f);
+    SensorRecord record(10000, nullptr, &voc);
+
+    TEST_ASSERT_FALSE(record.validity_flags & SensorRecord::FLAG_VOC_VALID);
+    TEST_ASSERT_TRUE(record.validity_flags & SensorRecord::FLAG_PRESSURE_VALID);
+    TEST_ASSERT_TRUE(record.isValid());
+    TEST_ASSERT_FLOAT_IS_NAN(record.getVoc());
+}
+
+void test_nan_and_out_of_range_inputs_clamp(void) {
+    SensorRecord record;
+    record.setCo2(NAN);
+    record.setTemperature(NAN);
+    record.setHumidity(-5.0f);
+    record.setVoc(-3.0f);
+
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, record.getCo2());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, record.getTemperature());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, record.getHumidity());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, record.getVoc());
+}
+#endif
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_values_keep_their_resolution);
+    RUN_TEST(test_sensor_pressure_is_flagged_valid);
+    RUN_TEST(test_uptime_past_32_bit_milliseconds);
+#if HISTORY_RECORD_FORMAT == 2
+    RUN_TEST(test_pressure_range_edges);
+    RUN_TEST(test_high_altitude_pressure_is_not_flagged);
+    RUN_TEST(test_voc_range_edges);
+    RUN_TEST(test_high_voc_estimate_is_not_flagged);
+    RUN_TEST(test_nan_and_out_of_range_inputs_clamp);
+#endif
+    return UNITY_END();
+}